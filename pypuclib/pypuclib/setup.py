@@ -12,7 +12,9 @@ ext_modules = [
     Pybind11Extension(
         "pypuclib",
         sorted(glob("src/*.cpp")),
-        define_macros = [('VERSION_INFO', __version__)],
+        define_macros = [('VERSION_INFO', __version__)] +
+            # counts native allocations for tests, not for release build
+            ([('PYPUCLIB_COUNT_ALLOCATIONS', None)] if os.environ.get("PYPUCLIB_COUNT_ALLOCATIONS") else []),
         ),
 ]
 
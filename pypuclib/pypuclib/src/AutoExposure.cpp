@@ -0,0 +1,399 @@
+#include "AutoExposure.h"
+#include <cmath>
+
+static constexpr int64_t DEFAULT_EXPOSURE = 1000000;      // 1 msec
+static constexpr int64_t DEFAULT_MIN_EXPOSURE = 1000;     // 1 usec
+static constexpr int64_t DEFAULT_MAX_EXPOSURE = 1000000000;
+
+AutoExposure::AutoExposure(double target, ExposureMode mode)
+	:
+	m_stop(false),
+	m_applying(false),
+	m_mode(mode),
+	m_target(0),
+	m_tolerance(0),
+	m_kp(0.2),
+	m_ki(0.5),
+	m_minExposure(DEFAULT_MIN_EXPOSURE),
+	m_maxExposure(DEFAULT_MAX_EXPOSURE),
+	m_deviceMin(0),
+	m_deviceMax(0),
+	m_interval(50),
+	m_settleFrames(2),
+	m_exposure(DEFAULT_EXPOSURE),
+	m_desired(DEFAULT_EXPOSURE),
+	m_pending(false),
+	m_skip(0),
+	m_hasPrev(false),
+	m_prevError(0),
+	m_measured(0),
+	m_error(0),
+	m_stable(0),
+	m_converged(false),
+	m_targetFrame(0),
+	m_settlingFrames(-1),
+	m_frameCount(0),
+	m_updateCount(0),
+	m_errorCount(0)
+{
+	setTarget(target);
+	m_thread = std::thread(&AutoExposure::work, this);
+}
+
+AutoExposure::~AutoExposure()
+{
+	close();
+}
+
+void AutoExposure::setTarget(double target, double tolerance)
+{
+	bool legal = m_mode == ExposureMode::MEAN ?
+		(target > 0 && target < 255) : (target > 0 && target < 1);
+	if (!legal) {
+		throw(WrapperException("target may be illegal."));
+	}
+	if (tolerance <= 0) {
+		throw(WrapperException("tolerance may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_target = target;
+	m_tolerance = tolerance;
+	m_stable = 0;
+	m_converged = false;
+	m_targetFrame = m_frameCount;
+	m_settlingFrames = -1;
+}
+
+void AutoExposure::setGain(double kp, double ki)
+{
+	if (kp < 0 || ki <= 0) {
+		throw(WrapperException("gain may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_kp = kp;
+	m_ki = ki;
+}
+
+void AutoExposure::setLimits(int64_t minExposure, int64_t maxExposure)
+{
+	if (minExposure <= 0 || maxExposure < minExposure) {
+		throw(WrapperException("exposure limit may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_minExposure = minExposure;
+	m_maxExposure = maxExposure;
+}
+
+void AutoExposure::setRate(int interval, int settleFrames)
+{
+	if (interval < 0 || settleFrames < 0) {
+		throw(WrapperException("update rate may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_interval = std::chrono::milliseconds(interval);
+	m_settleFrames = settleFrames;
+}
+
+void AutoExposure::setExposure(int64_t exposure)
+{
+	if (exposure <= 0) {
+		throw(WrapperException("exposure may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_exposure = exposure;
+	m_desired = exposure;
+	m_pending = false;
+	m_hasPrev = false;
+}
+
+void AutoExposure::setActuator(std::function<void(int64_t)> f)
+{
+	std::shared_ptr<Actuator> actuator;
+	if (f)
+	{
+		actuator = std::make_shared<Actuator>([f](int64_t& exposure)
+		{
+			py::gil_scoped_acquire acquire;
+			try
+			{
+				f(exposure);
+				return true;
+			}
+			catch (py::error_already_set&)
+			{
+				// counted in errorCount
+				return false;
+			}
+		});
+	}
+
+	// python actuator in progress needs the GIL to finish
+	OptionalGilRelease release;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	waitApplying(lock);
+	m_actuator.swap(actuator);
+	m_deviceMin = 0;
+	m_deviceMax = 0;
+}
+
+void AutoExposure::setDevice(Actuator f, int64_t minExposure, int64_t maxExposure, int64_t exposure)
+{
+	std::shared_ptr<Actuator> actuator;
+	if (f) {
+		actuator = std::make_shared<Actuator>(f);
+	}
+
+	OptionalGilRelease release;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	waitApplying(lock);
+	m_actuator.swap(actuator);
+	m_deviceMin = f ? minExposure : 0;
+	m_deviceMax = f ? maxExposure : 0;
+	if (f && exposure > 0)
+	{
+		m_exposure = exposure;
+		m_desired = exposure;
+		m_pending = false;
+		m_hasPrev = false;
+	}
+}
+
+double AutoExposure::feed(XferData* data)
+{
+	if (data == nullptr) {
+		throw(WrapperException("xferdata is not specified."));
+	}
+
+	double measured;
+	auto ret = measure(data->dataInfo()->pData, data->resolution(), measured);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_DecodeDCData", ret));
+	}
+	update(measured);
+	return measured;
+}
+
+double AutoExposure::feed(py::array_t<uint8_t>& array, const Resolution& res)
+{
+	double measured;
+	auto ret = measure(array.data(), res, measured);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_DecodeDCData", ret));
+	}
+	update(measured);
+	return measured;
+}
+
+bool AutoExposure::feed(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+{
+	double measured;
+	if (PUC_CHK_FAILED(measure(info->pData, res, measured))) {
+		return false;
+	}
+	update(measured);
+	return true;
+}
+
+PUCRESULT AutoExposure::measure(const uint8_t* src, const Resolution& res, double& measured)
+{
+	int countX = (ALIGN(res.width, 4) + 7) / 8;
+	int countY = (res.height + 7) / 8;
+	if (countX <= 0 || countY <= 0) {
+		return PUC_ERROR_ILLEGAL_RESOLUTION;
+	}
+
+	std::lock_guard<std::mutex> lock(m_dcMutex);
+	m_dc.resize((size_t)countX * countY);
+	auto ret = PUC_DecodeDCData(m_dc.data(), 0, 0, countX, countY, (uint8_t*)src);
+	if (PUC_CHK_FAILED(ret)) {
+		return ret;
+	}
+
+	int64_t count = 0;
+	if (m_mode == ExposureMode::MEAN)
+	{
+		for (auto v : m_dc) {
+			count += v;
+		}
+	}
+	else
+	{
+		for (auto v : m_dc) {
+			count += v >= SATURATION_LEVEL;
+		}
+	}
+	measured = (double)count / m_dc.size();
+	return PUC_SUCCEEDED;
+}
+
+void AutoExposure::update(double measured)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	++m_frameCount;
+	m_measured = measured;
+
+	// frames exposed before the latest update don't tell its effect
+	if (m_pending) {
+		return;
+	}
+	if (m_skip > 0)
+	{
+		--m_skip;
+		return;
+	}
+
+	double e = m_mode == ExposureMode::MEAN ?
+		std::log(m_target / std::max(measured, MIN_MEAN)) :
+		std::log((m_target + SATURATION_EPS) / (measured + SATURATION_EPS));
+	m_error = e;
+
+	if (std::abs(e) <= m_tolerance)
+	{
+		if (++m_stable >= STABLE_FRAMES && !m_converged)
+		{
+			m_converged = true;
+			if (m_settlingFrames < 0) {
+				m_settlingFrames = m_frameCount - m_targetFrame;
+			}
+		}
+	}
+	else
+	{
+		m_stable = 0;
+		m_converged = false;
+	}
+
+	// velocity form, so the integral never winds up at the limits
+	double step = m_ki * e + (m_hasPrev ? m_kp * (e - m_prevError) : 0.0);
+	step = std::max(-MAX_STEP, std::min(step, MAX_STEP));
+	m_prevError = e;
+	m_hasPrev = true;
+
+	int64_t desired = clampExposure((int64_t)std::llround(m_exposure * std::exp(step)));
+	if (desired != m_exposure)
+	{
+		m_desired = desired;
+		m_pending = true;
+		m_cond.notify_all();
+	}
+}
+
+AutoExposureState AutoExposure::state() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	AutoExposureState s;
+	s.mode = m_mode;
+	s.target = m_target;
+	s.measured = m_measured;
+	s.error = m_error;
+	s.exposure = m_exposure;
+	s.frameCount = m_frameCount;
+	s.updateCount = m_updateCount;
+	s.errorCount = m_errorCount;
+	s.pending = m_pending;
+	s.converged = m_converged;
+	s.settlingFrames = m_settlingFrames;
+	return s;
+}
+
+void AutoExposure::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pending = false;
+	m_desired = m_exposure;
+	m_skip = 0;
+	m_hasPrev = false;
+	m_measured = 0;
+	m_error = 0;
+	m_stable = 0;
+	m_converged = false;
+	m_frameCount = 0;
+	m_targetFrame = 0;
+	m_settlingFrames = -1;
+	m_updateCount = 0;
+	m_errorCount = 0;
+}
+
+void AutoExposure::close()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_all();
+
+	// python actuator of the side thread may be waiting for the GIL
+	OptionalGilRelease release;
+	m_thread.join();
+}
+
+void AutoExposure::work()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop)
+	{
+		if (!m_pending)
+		{
+			m_cond.wait(lock, [&] { return m_stop || m_pending; });
+			continue;
+		}
+
+		auto due = m_lastApply + m_interval;
+		if (std::chrono::steady_clock::now() < due)
+		{
+			m_cond.wait_until(lock, due, [&] { return m_stop; });
+			continue;
+		}
+
+		int64_t exposure = m_desired;
+		auto actuator = m_actuator;
+		m_applying = true;
+		lock.unlock();
+
+		bool ok = actuator ? (*actuator)(exposure) : true;
+
+		lock.lock();
+		m_applying = false;
+		m_lastApply = std::chrono::steady_clock::now();
+		m_cond.notify_all();
+
+		// setExposure() or reset() while applying overrides the result
+		if (!m_pending) {
+			continue;
+		}
+		if (ok)
+		{
+			m_exposure = exposure;
+			++m_updateCount;
+		}
+		else {
+			++m_errorCount;
+		}
+		m_pending = false;
+		m_skip = m_settleFrames;
+	}
+}
+
+void AutoExposure::waitApplying(std::unique_lock<std::mutex>& lock)
+{
+	m_cond.wait(lock, [&] { return !m_applying; });
+}
+
+int64_t AutoExposure::clampExposure(int64_t exposure) const
+{
+	int64_t lo = std::max(m_minExposure, m_deviceMin);
+	int64_t hi = m_deviceMax > 0 ? std::min(m_maxExposure, m_deviceMax) : m_maxExposure;
+	return std::max(lo, std::min(exposure, std::max(lo, hi)));
+}
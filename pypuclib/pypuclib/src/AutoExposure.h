@@ -0,0 +1,311 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+#include "XferData.h"
+
+namespace py = pybind11;
+
+enum class ExposureMode
+{
+	MEAN,
+	SATURATION,
+};
+
+class AutoExposureState
+{
+public:
+	PY_DOC(DOC_CLASS_AUTO_EXPOSURE_STATE,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"State of auto exposure controller.                \n"
+	"                                                  \n"
+	"Attributes                                        \n"
+	"----------                                        \n"
+	"mode : AE_MODE(enum)                              \n"
+	"    Quantity to control.                          \n"
+	"target : float                                    \n"
+	"    Target of the quantity.                       \n"
+	"measured : float                                  \n"
+	"    Quantity measured from the latest frame.      \n"
+	"error : float                                     \n"
+	"    log(target / measured) of the latest frame    \n"
+	"    used for control.                             \n"
+	"exposure : int                                    \n"
+	"    Exposure period applied last [nsec].          \n"
+	"frameCount : int                                  \n"
+	"    Number of frames measured.                    \n"
+	"updateCount : int                                 \n"
+	"    Number of exposure updates applied.           \n"
+	"errorCount : int                                  \n"
+	"    Number of exposure updates failed.            \n"
+	"pending : bool                                    \n"
+	"    True if an update waits for the side thread.  \n"
+	"converged : bool                                  \n"
+	"    True if error stays within tolerance.         \n"
+	"settlingFrames : int                              \n"
+	"    Frames from setTarget() to convergence. -1 if \n"
+	"    not converged yet.                            \n"
+	"\"\"                                              \n");
+public:
+	AutoExposureState()
+		: mode(ExposureMode::MEAN), target(0), measured(0), error(0), exposure(0),
+		frameCount(0), updateCount(0), errorCount(0), pending(false), converged(false),
+		settlingFrames(-1) {}
+	~AutoExposureState() {}
+
+	ExposureMode mode;
+	double target;
+	double measured;
+	double error;
+	int64_t exposure;
+	int64_t frameCount;
+	int64_t updateCount;
+	int64_t errorCount;
+	bool pending;
+	bool converged;
+	int64_t settlingFrames;
+};
+
+// PI controller of exposure driven by DC images. Control runs in log
+// domain, since brightness is proportional to exposure period. Frames are
+// measured on the caller thread (transfer thread of the SDK) and the
+// device is updated on a side thread at a bounded rate.
+class AutoExposure
+{
+public:
+	// Applies exposure period [nsec], returns false if failed. Exposure is
+	// lowered to the period applied when the device limits it.
+	using Actuator = std::function<bool(int64_t&)>;
+
+	AutoExposure(double target, ExposureMode mode = ExposureMode::MEAN);
+	~AutoExposure();
+	AutoExposure(const AutoExposure& obj) = delete;
+	AutoExposure& operator=(const AutoExposure& obj) = delete;
+
+	PY_DOC(DOC_AE_SET_TARGET,
+	"\"\"Set target of the controlled quantity.        \n"
+	"                                                  \n"
+	"Convergence is measured again from this call.     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"target : float                                    \n"
+	"    Mean DC value from 0 to 255 for MEAN, fraction\n"
+	"    of saturated DC pixels from 0 to 1 for        \n"
+	"    SATURATION.                                   \n"
+	"tolerance : float                                 \n"
+	"    Converged while |log(target / measured)| is   \n"
+	"    within this. (default=0.05)                   \n"
+	"\"\"                                              \n");
+	void setTarget(double target, double tolerance = 0.05);
+
+	PY_DOC(DOC_AE_SET_GAIN,
+	"\"\"Set gains of PI loop.                         \n"
+	"                                                  \n"
+	"Exposure is multiplied by                         \n"
+	"exp(kp * (e - previous e) + ki * e) on each frame \n"
+	"used for control, where e = log(target/measured). \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"kp : float                                        \n"
+	"    Proportional gain. (default=0.2)              \n"
+	"ki : float                                        \n"
+	"    Integral gain. (default=0.5)                  \n"
+	"\"\"                                              \n");
+	void setGain(double kp, double ki);
+
+	PY_DOC(DOC_AE_SET_LIMITS,
+	"\"\"Set range of exposure period.                 \n"
+	"                                                  \n"
+	"Range is narrowed further by the device limits    \n"
+	"when attached to Camera obj.                      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"minExposure : int                                 \n"
+	"    Minimum exposure period [nsec].               \n"
+	"maxExposure : int                                 \n"
+	"    Maximum exposure period [nsec].               \n"
+	"\"\"                                              \n");
+	void setLimits(int64_t minExposure, int64_t maxExposure);
+
+	PY_DOC(DOC_AE_SET_RATE,
+	"\"\"Set rate of exposure updates.                 \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"interval : int                                    \n"
+	"    Minimum interval of updates [msec].           \n"
+	"settleFrames : int                                \n"
+	"    Frames skipped after each update, which may be\n"
+	"    exposed before the update takes effect.       \n"
+	"\"\"                                              \n");
+	void setRate(int interval, int settleFrames);
+
+	PY_DOC(DOC_AE_SET_EXPOSURE,
+	"\"\"Set current exposure period.                  \n"
+	"                                                  \n"
+	"Starting point of the loop when the device is not \n"
+	"attached. This doesn't call the actuator.         \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"exposure : int                                    \n"
+	"    Exposure period [nsec].                       \n"
+	"\"\"                                              \n");
+	void setExposure(int64_t exposure);
+
+	PY_DOC(DOC_AE_SET_ACTUATOR,
+	"\"\"Set function to apply exposure period.        \n"
+	"                                                  \n"
+	"This is for a simulated device. Function is called\n"
+	"on the side thread as actuator(exposure [nsec]),  \n"
+	"and an exception counts as failed update.         \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"actuator : function(int)                          \n"
+	"    Actuator function. None to remove.            \n"
+	"\"\"                                              \n");
+	void setActuator(std::function<void(int64_t)> f);
+
+	// Camera obj attaches itself. nullptr detaches and waits for the update
+	// in progress.
+	void setDevice(Actuator f, int64_t minExposure, int64_t maxExposure, int64_t exposure);
+
+	PY_DOC(DOC_AE_FEED_A,
+	"\"\"Measure a frame and run the loop.             \n"
+	"                                                  \n"
+	"DC image of the frame is decoded to measure the   \n"
+	"quantity. Camera obj calls this on transfer thread\n"
+	"for each frame when attached.                     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to measure.                          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"float                                             \n"
+	"    Quantity measured.                            \n"
+	"\"\"                                              \n");
+	double feed(XferData* data);
+
+	PY_DOC(DOC_AE_FEED_B,
+	"\"\"Measure a frame and run the loop.             \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of original data resolution.       \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"float                                             \n"
+	"    Quantity measured.                            \n"
+	"\"\"                                              \n");
+	double feed(py::array_t<uint8_t>& array, const Resolution& res);
+
+	// Called on the transfer thread of the SDK, errors are not thrown.
+	bool feed(const PUC_XFER_DATA_INFO* info, const Resolution& res);
+
+	PY_DOC(DOC_AE_UPDATE,
+	"\"\"Run the loop with a measured quantity.        \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"measured : float                                  \n"
+	"    Quantity measured by the caller.              \n"
+	"\"\"                                              \n");
+	void update(double measured);
+
+	PY_DOC(DOC_AE_STATE,
+	"\"\"Get state of the controller.                  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"AutoExposureState obj                             \n"
+	"    State and convergence of the controller.      \n"
+	"\"\"                                              \n");
+	AutoExposureState state() const;
+
+	PY_DOC(DOC_AE_RESET,
+	"\"\"Reset the loop and statistics.                \n"
+	"\"\"                                              \n");
+	void reset();
+
+	PY_DOC(DOC_AE_CLOSE,
+	"\"\"Stop the side thread.                         \n"
+	"                                                  \n"
+	"Exposure is not updated after this.               \n"
+	"\"\"                                              \n");
+	void close();
+
+private:
+	void work();
+	PUCRESULT measure(const uint8_t* src, const Resolution& res, double& measured);
+	void waitApplying(std::unique_lock<std::mutex>& lock);
+	int64_t clampExposure(int64_t exposure) const;
+
+	static constexpr int STABLE_FRAMES = 3;
+	static constexpr int SATURATION_LEVEL = 250;
+	static constexpr double SATURATION_EPS = 1e-3;
+	static constexpr double MIN_MEAN = 0.5;
+	static constexpr double MAX_STEP = 0.6931471805599453;  // log(2)
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::thread m_thread;
+	bool m_stop;
+	bool m_applying;
+
+	ExposureMode m_mode;
+	double m_target;
+	double m_tolerance;
+	double m_kp;
+	double m_ki;
+	int64_t m_minExposure;
+	int64_t m_maxExposure;
+	int64_t m_deviceMin;
+	int64_t m_deviceMax;
+	std::chrono::milliseconds m_interval;
+	int m_settleFrames;
+	std::shared_ptr<Actuator> m_actuator;
+
+	// loop
+	int64_t m_exposure;
+	int64_t m_desired;
+	bool m_pending;
+	int m_skip;
+	bool m_hasPrev;
+	double m_prevError;
+	std::chrono::steady_clock::time_point m_lastApply;
+
+	// convergence and statistics
+	double m_measured;
+	double m_error;
+	int m_stable;
+	bool m_converged;
+	int64_t m_targetFrame;
+	int64_t m_settlingFrames;
+	int64_t m_frameCount;
+	int64_t m_updateCount;
+	int64_t m_errorCount;
+
+	std::mutex m_dcMutex;
+	std::vector<uint8_t> m_dc;
+};
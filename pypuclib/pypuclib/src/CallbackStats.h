@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include "Common.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+class CallbackStats
+{
+public:
+	PY_DOC(DOC_CLASS_CALLBACK_STATS,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Service time of continuous transfer callback and  \n"
+	"ring buffer settings recommended from it.         \n"
+	"                                                  \n"
+	"Attributes                                        \n"
+	"----------                                        \n"
+	"count : int                                       \n"
+	"    Number of callbacks measured.                 \n"
+	"mean : float                                      \n"
+	"    Mean service time [sec].                      \n"
+	"p50 : float                                       \n"
+	"    Median service time [sec].                    \n"
+	"p99 : float                                       \n"
+	"    99th percentile of service time [sec].        \n"
+	"p999 : float                                      \n"
+	"    99.9th percentile of service time [sec].      \n"
+	"max : float                                       \n"
+	"    Maximum service time [sec].                   \n"
+	"ringBufferCount : int                             \n"
+	"    Ring buffer count to absorb p999 pause.       \n"
+	"xferTimeout : int                                 \n"
+	"    Continuous transfer timeout [msec].           \n"
+	"budgetLimited : bool                              \n"
+	"    True if ring buffer count is limited by the   \n"
+	"    memory budget.                                \n"
+	"\"\"                                              \n");
+public:
+	CallbackStats()
+		: count(0), mean(0), p50(0), p99(0), p999(0), max(0),
+		ringBufferCount(0), xferTimeout(0), budgetLimited(false) {}
+	~CallbackStats() {}
+
+	int64_t count;
+	double mean;
+	double p50;
+	double p99;
+	double p999;
+	double max;
+	int ringBufferCount;
+	int xferTimeout;
+	bool budgetLimited;
+};
+
+// Log-linear histogram of durations in nsec, 16 buckets per power of two
+// (error < 1/16). Single writer, any number of readers.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram()
+	{
+		reset();
+	}
+
+	void record(uint64_t ns)
+	{
+		m_buckets[index(ns)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(ns, std::memory_order_relaxed);
+		if (ns > m_max.load(std::memory_order_relaxed)) {
+			m_max.store(ns, std::memory_order_relaxed);
+		}
+	}
+
+	void reset()
+	{
+		for (auto& b : m_buckets) {
+			b.store(0, std::memory_order_relaxed);
+		}
+		m_count.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+	uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+	// Upper bound of the bucket holding q-quantile, clamped to max.
+	uint64_t percentile(double q) const
+	{
+		uint64_t total = 0;
+		for (auto& b : m_buckets) {
+			total += b.load(std::memory_order_relaxed);
+		}
+		if (total == 0) {
+			return 0;
+		}
+
+		uint64_t target = (uint64_t)std::ceil(q * total);
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			seen += m_buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target && seen > 0) {
+				return std::min(upperBound(i), max());
+			}
+		}
+		return max();
+	}
+
+private:
+	static constexpr int SUB_BITS = 4;
+	static constexpr int SUB_COUNT = 1 << SUB_BITS;
+	static constexpr int BUCKET_COUNT = SUB_COUNT + (64 - SUB_BITS) * SUB_COUNT;
+
+	static int msb(uint64_t v)
+	{
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanReverse64(&i, v);
+		return (int)i;
+#else
+		return 63 - __builtin_clzll(v);
+#endif
+	}
+
+	static int index(uint64_t v)
+	{
+		if (v < SUB_COUNT) {
+			return (int)v;
+		}
+		int e = msb(v);
+		int sub = (int)(v >> (e - SUB_BITS)) - SUB_COUNT;
+		return SUB_COUNT + (e - SUB_BITS) * SUB_COUNT + sub;
+	}
+
+	static uint64_t upperBound(int i)
+	{
+		if (i < SUB_COUNT) {
+			return (uint64_t)i;
+		}
+		int e = (i - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+		uint64_t sub = (uint64_t)((i - SUB_COUNT) % SUB_COUNT) + SUB_COUNT;
+		return ((sub + 1) << (e - SUB_BITS)) - 1;
+	}
+
+	std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_max;
+};
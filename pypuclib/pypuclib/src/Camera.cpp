@@ -1,27 +1,47 @@
 #include "Camera.h"
 #include "Decoder.h"
+#include "FrameBus.h"
+#include "FrameStream.h"
+#include "FrameMailbox.h"
+#include "AutoExposure.h"
 #include "Exception.h"
 #include <pybind11/pybind11.h>
+#include <chrono>
+#include <thread>
 
 
 Camera::Camera(int deviceNo)
 	:
 	m_handle(nullptr),
 	m_deviceNo(deviceNo),
-	m_enableCallback(false)
+	m_enableCallback(false),
+	m_arenaCount(DEFAULT_ARENA_COUNT),
+	m_arenaLock(false),
+	m_minExposeOn(0),
+	m_minExposeOff(0),
+	m_serialNo(0),
+	m_configValid(false),
+	m_applyCommands(0),
+	m_adaptiveRing(false),
+	m_ringBudget(0)
 {
 	memset(m_quntize, 0, sizeof(m_quntize));
+	memset(&m_resoLimit, 0, sizeof(m_resoLimit));
+	memset(&m_framerateLimit, 0, sizeof(m_framerateLimit));
 }
 
 Camera::~Camera()
 {
-	if (m_handle) {
-		close();
-	}
+	close();
 }
 
 void Camera::open()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	if (m_handle != nullptr) {
+		return;
+	}
+
 	auto ret = PUC_OpenDevice(m_deviceNo, &m_handle);
 	if (PUC_CHK_FAILED(ret))
 	{
@@ -35,33 +55,52 @@ void Camera::open()
 			throw(PUCException("PUC_GetQuantization", ret));
 		}
 	}
+
+	loadLimits();
+	m_configValid = false;
+
+	prepareArena();
 }
 
 void Camera::close()
 {
+	// Threads stopped here may wait for the GIL or for m_configMutex, so
+	// they are stopped before the lock. Python threads hold the GIL while
+	// waiting for the lock.
+	m_telemetry.stop();
+	setAutoExposure(nullptr);
+
+	auto xferLock = lockXfer();
+	try
+	{
+		// closed handle throws, and there is nothing to end
+		if (isXferring()) {
+			endXferLocked();
+		}
+	}
+	catch (PUCException&)
+	{
+		// do nothing
+	}
+
+	// handle is closed and cleared under the lock, so users holding the
+	// lock never see it closed
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
 	if (m_handle != nullptr)
 	{
-		try
+		auto ret = PUC_CloseDevice(m_handle);
+		if (!PUC_CHK_FAILED(ret))
 		{
-			if (isXferring()) {
-				endXfer();
-			}
-
-			auto ret = PUC_CloseDevice(m_handle);
-			if (PUC_CHK_FAILED(ret)) {
-				throw(PUCException("PUC_CloseDevice", ret));
-			}
 			m_handle = nullptr;
-		}
-		catch (PUCException&)
-		{
-			// do nothing
+			std::atomic_store(&m_arena, std::shared_ptr<FrameArena>());
 		}
 	}
 }
 
 Resolution Camera::resolution() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int w, h;
 	auto ret = PUC_GetResolution(m_handle, &w, &h);
 	if (PUC_CHK_FAILED(ret)) {
@@ -72,6 +111,8 @@ Resolution Camera::resolution() const
 
 Resolution Camera::resolutionMax() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int w, h;
 	auto ret = PUC_GetMaxResolution(m_handle, &w, &h);
 	if (PUC_CHK_FAILED(ret)) {
@@ -83,6 +124,8 @@ Resolution Camera::resolutionMax() const
 
 ResolutionLimit Camera::resolutionLimit() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	PUC_RESO_LIMIT_INFO limit;
 	auto ret = PUC_GetResolutionLimit(m_handle, &limit);
 	if (PUC_CHK_FAILED(ret)) {
@@ -97,7 +140,8 @@ ResolutionLimit Camera::resolutionLimit() const
 
 FramerateLimit Camera::framerateLimit() const
 {
-	
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	PUC_FRAMERATE_LIMIT_INFO info;
 	auto ret = PUC_GetFramerateLimit(m_handle, &info);
 	if (PUC_CHK_FAILED(ret)) {
@@ -109,10 +153,18 @@ FramerateLimit Camera::framerateLimit() const
 
 void Camera::setResolution(const Resolution& res)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_SetResolution(m_handle, res.width, res.height);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_SetResolution", ret));
 	}
+	m_config.resolution = res;
+
+	auto arena = std::atomic_load(&m_arena);
+	if (arena && maxXferDataSize() > arena->slotSize()) {
+		prepareArena();
+	}
 }
 
 void Camera::setResolution(const int& w, const int& h)
@@ -127,6 +179,8 @@ int Camera::framerate() const
 
 int Camera::framerateMax() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int f;
 	auto ret = PUC_GetMaxFramerate(m_handle, &f);
 	if (PUC_CHK_FAILED(ret)) {
@@ -143,6 +197,8 @@ int Camera::shutter() const
 
 std::tuple<int, int> Camera::framerateShutter() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int f, s;
 	auto ret = PUC_GetFramerateShutter(m_handle, &f, &s);
 	if (PUC_CHK_FAILED(ret)) {
@@ -153,9 +209,8 @@ std::tuple<int, int> Camera::framerateShutter() const
 
 void Camera::setFramerate(const int& framerate)
 {
-	auto values = framerateShutter();
-
-	auto shutter = std::get<1>(values);
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	auto shutter = config().shutter;
 
 	if (framerate > shutter)
 		shutter = framerate;
@@ -165,21 +220,27 @@ void Camera::setFramerate(const int& framerate)
 
 void Camera::setShutter(const int& shutter)
 {
-	auto ret = framerateShutter();
-
-	setFramerateShutter(std::get<0>(ret), shutter);
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	setFramerateShutter(config().framerate, shutter);
 }
 
 void Camera::setFramerateShutter(const int& framerate, const int& shutter)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_SetFramerateShutter(m_handle, framerate, shutter);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_SetFramerateShutter", ret));
 	}
+	m_config.framerate = framerate;
+	m_config.shutter = shutter;
+	m_config.exposeTime = 0;
 }
 
 PUC_COLOR_TYPE Camera::colortype() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	PUC_COLOR_TYPE type;
 	auto ret = PUC_GetColorType(m_handle, &type);
 	if (PUC_CHK_FAILED(ret)) {
@@ -191,6 +252,8 @@ PUC_COLOR_TYPE Camera::colortype() const
 
 unsigned int Camera::xferDataSize() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int dataSize;
 
 	auto ret = PUC_GetXferDataSize(m_handle, &dataSize);
@@ -203,6 +266,8 @@ unsigned int Camera::xferDataSize() const
 
 unsigned int Camera::maxXferDataSize() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int dataSize;
 
 	auto ret = PUC_GetMaxXferDataSize(m_handle, &dataSize);
@@ -215,6 +280,8 @@ unsigned int Camera::maxXferDataSize() const
 
 int Camera::ringBufferCount() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int count;
 
 	auto ret = PUC_GetRingBufferCount(m_handle, &count);
@@ -227,6 +294,8 @@ int Camera::ringBufferCount() const
 
 void Camera::setRingBufferCount(const int &count)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_SetRingBufferCount(m_handle, count);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_SetRingBufferCount", ret));
@@ -235,6 +304,8 @@ void Camera::setRingBufferCount(const int &count)
 
 std::tuple<int, int> Camera::xferTimeout() const
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	unsigned int single, continuous;
 
 	auto ret = PUC_GetXferTimeOut(m_handle, &single, &continuous);
@@ -247,39 +318,88 @@ std::tuple<int, int> Camera::xferTimeout() const
 
 void Camera::setXferTimeout(const int& single, const int& continuos)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_SetXferTimeOut(m_handle, single, continuos);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_SetXferTimeOut", ret));
 	}
 }
 
-void Camera::beginXfer(std::function<void(XferData*)> f)
+void Camera::beginXfer(const py::object& f)
 {
-	auto ret = PUC_BeginXferData(m_handle, this->continuousCallback, (void*)this);
-	if (PUC_CHK_FAILED(ret)) {
-		throw(PUCException("PUC_BeginXferData", ret));
+	auto xferLock = lockXfer();
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
+		if (m_adaptiveRing) {
+			applyAdaptiveRingBuffer();
+		}
+		auto config = this->config();
+		m_xferResolution = config.resolution;
+		m_shedder.start(config.framerate);
+		m_shedder.resetStats();
+
+		m_latest.open();
+		auto ret = PUC_BeginXferData(m_handle, this->continuousCallback, (void*)this);
+		if (PUC_CHK_FAILED(ret)) {
+			throw(PUCException("PUC_BeginXferData", ret));
+		}
 	}
 
-	m_pythonCallback = f;
+	// dispatcher lock may wait for a callback, so not under m_configMutex
+	m_dispatcher.setCallback(f);
 	startCallback();
 }
 
 void Camera::endXfer()
+{
+	auto xferLock = lockXfer();
+	endXferLocked();
+}
+
+void Camera::endXferLocked()
 {
 	stopCallback();
+	m_latest.close();
 
-	py::gil_scoped_release release{};
+	// m_configMutex is not held while ending, since a callback in flight
+	// may call getters. Handle stays open while m_xferMutex is held.
+	void* handle;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+		handle = m_handle;
+	}
 
-	auto ret = PUC_EndXferData(m_handle);
-	if (PUC_CHK_FAILED(ret)) {
-		throw(PUCException("PUC_EndXferData", ret));
+	{
+		OptionalGilRelease release;
+
+		auto ret = PUC_EndXferData(handle);
+		if (PUC_CHK_FAILED(ret)) {
+			throw(PUCException("PUC_EndXferData", ret));
+		}
 	}
 
-	m_pythonCallback = nullptr;
+	m_dispatcher.setCallback(py::none());
+}
+
+std::unique_lock<std::mutex> Camera::lockXfer()
+{
+	// Same as the dispatcher, GIL is released only when the lock is busy,
+	// since the holder may need the GIL to end the transfer.
+	std::unique_lock<std::mutex> lock(m_xferMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		OptionalGilRelease release;
+		lock.lock();
+	}
+	return lock;
 }
 
 bool Camera::isXferring()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	BOOL xferring = FALSE;
 
 	auto ret = PUC_IsXferring(m_handle, &xferring);
@@ -290,6 +410,56 @@ bool Camera::isXferring()
 	return xferring == TRUE;
 }
 
+
+void Camera::simulateXfer(const py::object& f, py::array_t<uint8_t>& data, const Resolution& res, int count)
+{
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+		if (m_handle != nullptr) {
+			throw(WrapperException("camera of device can't simulate transfer."));
+		}
+	}
+	if (res.width <= 0 || res.height <= 0) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+	if (count < 0) {
+		throw(WrapperException("count may be illegal."));
+	}
+
+	PUC_XFER_DATA_INFO info;
+	memset(&info, 0, sizeof(PUC_XFER_DATA_INFO));
+	info.pData = (PUINT8)data.data();
+	info.nDataSize = (UINT32)data.size();
+
+	// framerate is unknown, so backlog is not estimated
+	m_xferResolution = res;
+	m_shedder.start(0);
+	m_shedder.resetStats();
+	m_latest.open();
+	m_dispatcher.setCallback(f);
+	startCallback();
+
+	{
+		// callback of the transfer thread needs the GIL
+		OptionalGilRelease release;
+
+		std::thread xfer([&]()
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				info.nSequenceNo = (unsigned short)i;
+				continuousCallback(&info, this);
+			}
+			m_dispatcher.releaseThreadState();
+		});
+		xfer.join();
+	}
+
+	stopCallback();
+	m_latest.close();
+	m_dispatcher.setCallback(py::none());
+}
+
 std::unique_ptr<Decoder> Camera::decoder()
 {
 	std::unique_ptr<Decoder> p =
@@ -304,8 +474,12 @@ std::unique_ptr<Decoder> Camera::decoder()
 
 std::unique_ptr<XferData> Camera::grab()
 {
+	// single transfer waits for the device, GIL is released before the lock
+	OptionalGilRelease release;
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	std::unique_ptr<XferData> p =
-		std::make_unique<XferData>(xferDataSize(), resolution());
+		std::make_unique<XferData>(std::atomic_load(&m_arena), xferDataSize(), resolution());
 	
 	if (!p) {
 		throw(WrapperException("bad memory allocation"));
@@ -319,6 +493,37 @@ std::unique_ptr<XferData> Camera::grab()
 	return p;
 }
 
+std::unique_ptr<XferData> Camera::grabNext(int timeout)
+{
+	return takeLatest(true, timeout);
+}
+
+std::unique_ptr<XferData> Camera::grabLatest()
+{
+	return takeLatest(false, 0);
+}
+
+std::unique_ptr<XferData> Camera::takeLatest(bool next, int timeout)
+{
+	// sized by the frame kept, the device is not queried
+	auto arena = std::atomic_load(&m_arena);
+	std::unique_ptr<XferData> p;
+	bool taken;
+	{
+		OptionalGilRelease release;
+		taken = m_latest.take(next, timeout, [&](size_t size, const Resolution& res)
+		{
+			p = std::make_unique<XferData>(arena, (int)size, res);
+			return p->dataInfo();
+		});
+	}
+
+	if (!taken) {
+		return nullptr;
+	}
+	return p;
+}
+
 void Camera::continuousCallback(PPUC_XFER_DATA_INFO pInfo, void* pArg)
 {
 	Camera* cam = (Camera*)pArg;
@@ -333,34 +538,182 @@ void Camera::callbackWork(PPUC_XFER_DATA_INFO pInfo)
 {
 	if (m_enableCallback)
 	{
-		std::unique_ptr<XferData> p =
-			std::make_unique<XferData>(pInfo, resolution());
+		const auto& res = m_xferResolution;
 
-		if (!p) {
-			throw(WrapperException("bad memory allocation"));
+		auto publisher = std::atomic_load(&m_publisher);
+		if (publisher) {
+			publisher->publish(pInfo, res);
+		}
+		auto server = std::atomic_load(&m_server);
+		if (server) {
+			server->send(pInfo, res);
+		}
+		auto controller = std::atomic_load(&m_autoExposure);
+		if (controller) {
+			controller->feed(pInfo, res);
+		}
+		m_latest.store(pInfo, res);
+		auto mailbox = std::atomic_load(&m_mailbox);
+		if (mailbox) {
+			mailbox->post(pInfo, res);
 		}
 
-		try
-		{
-			m_pythonCallback(p.get());
+		m_shedder.decide(pInfo, res, m_decision);
+		if (!m_decision.deliver) {
+			return;
 		}
-		catch (py::error_already_set& e)
+
+		// preview only frame carries no data for the consumer
+		PUC_XFER_DATA_INFO previewInfo;
+		if (!m_decision.payload)
 		{
-			printf(e.what());
+			previewInfo = *pInfo;
+			previewInfo.nDataSize = 0;
+			pInfo = &previewInfo;
 		}
+
+		auto begin = std::chrono::steady_clock::now();
+		m_dispatcher.dispatch(pInfo, res, m_decision);
+		m_serviceTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - begin).count());
+	}
+	else
+	{
+		// stopped by endXfer, which waits in PUC_EndXferData without GIL
+		m_dispatcher.releaseThreadState();
 	}
 }
 
+void Camera::setFramePublisher(std::shared_ptr<FramePublisher> publisher)
+{
+	std::atomic_store(&m_publisher, publisher);
+}
+
+std::shared_ptr<FramePublisher> Camera::framePublisher() const
+{
+	return std::atomic_load(&m_publisher);
+}
+
+void Camera::setFrameServer(std::shared_ptr<FrameServer> server)
+{
+	std::atomic_store(&m_server, server);
+}
+
+std::shared_ptr<FrameServer> Camera::frameServer() const
+{
+	return std::atomic_load(&m_server);
+}
+
+void Camera::setFrameMailbox(std::shared_ptr<FrameMailbox> mailbox)
+{
+	std::atomic_store(&m_mailbox, mailbox);
+}
+
+std::shared_ptr<FrameMailbox> Camera::frameMailbox() const
+{
+	return std::atomic_load(&m_mailbox);
+}
+
+// The actuator runs on the side thread of the controller and goes through
+// the setters under m_configMutex, so config() follows the controller.
+void Camera::setAutoExposure(std::shared_ptr<AutoExposure> controller, const std::string& actuator)
+{
+	if (actuator != "exposeTime" && actuator != "shutter") {
+		throw(WrapperException("actuator may be illegal."));
+	}
+
+	auto previous = std::atomic_exchange(&m_autoExposure, std::shared_ptr<AutoExposure>());
+	if (previous) {
+		previous->setDevice(nullptr, 0, 0, 0);
+	}
+	if (!controller) {
+		return;
+	}
+
+	auto config = this->config();
+	if (config.framerate <= 0) {
+		throw(WrapperException("framerate may be illegal."));
+	}
+	const int64_t frame = (int64_t)(NSEC_PER_SEC / config.framerate);
+
+	// Limits are taken at attach, but framerate may be changed while
+	// attached, so actuators read the current framerate on every update
+	// and clamp exposure to its frame.
+	AutoExposure::Actuator f;
+	int64_t minExposure;
+	int64_t maxExposure;
+	int64_t exposure;
+	if (actuator == "exposeTime")
+	{
+		minExposure = m_minExposeOn;
+		maxExposure = frame - m_minExposeOff;
+		exposure = config.exposeTime > 0 ? config.exposeTime : (int64_t)(NSEC_PER_SEC / config.shutter);
+		f = [this](int64_t& e)
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+			try
+			{
+				int64_t frame = (int64_t)(NSEC_PER_SEC / this->config().framerate);
+				e = std::min(e, frame - (int64_t)m_minExposeOff);
+				setExposeTime((int)e, (int)(frame - e));
+				return true;
+			}
+			catch (PUCException&)
+			{
+				return false;
+			}
+		};
+	}
+	else
+	{
+		// shutter speed 1/x[sec] is not slower than the framerate
+		minExposure = m_minExposeOn;
+		maxExposure = frame;
+		exposure = (int64_t)(NSEC_PER_SEC / config.shutter);
+		f = [this](int64_t& e)
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+			try
+			{
+				int framerate = this->config().framerate;
+				int shutter = std::max(framerate, (int)((NSEC_PER_SEC + e / 2) / e));
+				setFramerateShutter(framerate, shutter);
+				if (shutter == framerate) {
+					e = std::min(e, (int64_t)(NSEC_PER_SEC / framerate));
+				}
+				return true;
+			}
+			catch (PUCException&)
+			{
+				return false;
+			}
+		};
+	}
+
+	controller->setDevice(f, std::max<int64_t>(minExposure, 1), maxExposure, exposure);
+	std::atomic_store(&m_autoExposure, controller);
+}
+
+std::shared_ptr<AutoExposure> Camera::autoExposure() const
+{
+	return std::atomic_load(&m_autoExposure);
+}
+
 void Camera::resetDevice()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_ResetDevice(m_deviceNo);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_ResetDevice", ret));
 	}
+	m_configValid = false;
 }
 
 void Camera::resetSequenceNo()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_ResetSequenceNo(m_handle);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_ResetSequenceNo", ret));
@@ -369,6 +722,8 @@ void Camera::resetSequenceNo()
 
 bool Camera::fanState()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	PUC_MODE mode;
 	auto ret = PUC_GetFanState(m_handle, &mode);
 	if (PUC_CHK_FAILED(ret)) {
@@ -380,6 +735,8 @@ bool Camera::fanState()
 
 void Camera::setFanState(bool state)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	auto ret = PUC_SetFanState(m_handle, (PUC_MODE)state);
 	if (PUC_CHK_FAILED(ret)) {
 		throw(PUCException("PUC_SetFanState", ret));
@@ -388,6 +745,8 @@ void Camera::setFanState(bool state)
 
 int Camera::sensorTemperature()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
 	UINT32 temp;
 	auto ret = PUC_GetSensorTemperature(m_handle, &temp);
 	if (PUC_CHK_FAILED(ret)) {
@@ -395,4 +754,416 @@ int Camera::sensorTemperature()
 	}
 
 	return (int)temp;
+}
+
+int Camera::frameArenaCount() const
+{
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	return m_arenaCount;
+}
+
+void Camera::setFrameArenaCount(const int& count, bool lockMemory)
+{
+	if (count < 0) {
+		throw(WrapperException("frame arena count may be illegal."));
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	m_arenaCount = count;
+	m_arenaLock = lockMemory;
+
+	if (m_handle != nullptr) {
+		prepareArena();
+	}
+}
+
+bool Camera::isFrameArenaLargePage() const
+{
+	auto arena = std::atomic_load(&m_arena);
+	return arena && arena->isLargePage();
+}
+
+void Camera::prepareArena()
+{
+	// XferData still alive keeps the old arena until it is released.
+	std::atomic_store(&m_arena, std::shared_ptr<FrameArena>());
+
+	if (m_arenaCount > 0) {
+		std::atomic_store(&m_arena, std::make_shared<FrameArena>(maxXferDataSize(), m_arenaCount, m_arenaLock));
+	}
+}
+
+std::tuple<int, int> Camera::exposeTime() const
+{
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
+	UINT32 on, off;
+	auto ret = PUC_GetExposeTime(m_handle, &on, &off);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_GetExposeTime", ret));
+	}
+
+	return std::tuple<int, int>(on, off);
+}
+
+std::tuple<int, int> Camera::minExposeTime() const
+{
+	return std::tuple<int, int>(m_minExposeOn, m_minExposeOff);
+}
+
+void Camera::setExposeTime(const int& exposeOn, const int& exposeOff)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
+	auto ret = PUC_SetExposeTime(m_handle, exposeOn, exposeOff);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_SetExposeTime", ret));
+	}
+
+	if (exposeOn + exposeOff > 0) {
+		m_config.framerate = (int)(NSEC_PER_SEC / ((uint64_t)exposeOn + exposeOff));
+	}
+	m_config.exposeTime = exposeOn;
+}
+
+CameraConfig Camera::config()
+{
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	if (!m_configValid)
+	{
+		m_config.resolution = resolution();
+		auto fs = framerateShutter();
+		m_config.framerate = std::get<0>(fs);
+		m_config.shutter = std::get<1>(fs);
+		m_config.exposeTime = 0;
+		m_configValid = true;
+	}
+
+	return m_config;
+}
+
+void Camera::validate(const CameraConfig& config) const
+{
+	const auto& w = config.resolution.width;
+	const auto& h = config.resolution.height;
+	const auto& lim = m_resoLimit;
+	if (w < (int)lim.nMinWidth || w > (int)lim.nMaxWidth ||
+		h < (int)lim.nMinHeight || h > (int)lim.nMaxHeight ||
+		(lim.nUnitWidth > 0 && (w - (int)lim.nMinWidth) % (int)lim.nUnitWidth != 0) ||
+		(lim.nUnitHeight > 0 && (h - (int)lim.nMinHeight) % (int)lim.nUnitHeight != 0)) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+
+	if (config.framerate <= 0 ||
+		config.framerate < (int)m_framerateLimit.nMinFrameRate ||
+		config.framerate > (int)m_framerateLimit.nMaxFrameRate) {
+		throw(WrapperException("framerate may be illegal."));
+	}
+
+	if (config.exposeTime == 0)
+	{
+		if (config.shutter < config.framerate) {
+			throw(WrapperException("shutter may be illegal."));
+		}
+	}
+	else
+	{
+		int64_t off = (int64_t)(NSEC_PER_SEC / config.framerate) - config.exposeTime;
+		if (config.exposeTime < (int)m_minExposeOn || off < (int64_t)m_minExposeOff) {
+			throw(WrapperException("expose time may be illegal."));
+		}
+	}
+}
+
+double Camera::apply(const CameraConfig& config)
+{
+	validate(config);
+
+	auto begin = std::chrono::steady_clock::now();
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
+	CameraConfig prev = this->config();
+	m_applyCommands = 0;
+	try
+	{
+		applySteps(config);
+	}
+	catch (PUCException&)
+	{
+		// m_config holds the steps done so far, so only they are reverted.
+		try
+		{
+			applySteps(prev);
+		}
+		catch (PUCException&)
+		{
+			m_configValid = false;
+		}
+		throw;
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+	return elapsed.count();
+}
+
+int Camera::applyCommandCount() const
+{
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+	return m_applyCommands;
+}
+
+void Camera::applySteps(const CameraConfig& config)
+{
+	const auto& cur = m_config;
+
+	bool resolutionChanged =
+		cur.resolution.width != config.resolution.width ||
+		cur.resolution.height != config.resolution.height;
+
+	// PUC_SetFramerateShutter resets the exposure period.
+	bool framerateChanged = cur.framerate != config.framerate ||
+		(config.exposeTime == 0 && (cur.shutter != config.shutter || cur.exposeTime != 0));
+
+	bool exposeChanged = config.exposeTime != 0 &&
+		(framerateChanged || cur.exposeTime != config.exposeTime);
+
+	// Maximum framerate depends on resolution and vice versa. Lowering
+	// framerate first (or shrinking resolution first when framerate goes
+	// up) keeps every intermediate state valid.
+	bool resolutionFirst = config.framerate > cur.framerate;
+
+	if (resolutionChanged && resolutionFirst)
+	{
+		setResolution(config.resolution);
+		++m_applyCommands;
+	}
+
+	if (framerateChanged)
+	{
+		setFramerateShutter(config.framerate, std::max(config.shutter, config.framerate));
+		++m_applyCommands;
+	}
+
+	if (resolutionChanged && !resolutionFirst)
+	{
+		setResolution(config.resolution);
+		++m_applyCommands;
+	}
+
+	if (exposeChanged)
+	{
+		int off = (int)(NSEC_PER_SEC / config.framerate) - config.exposeTime;
+		setExposeTime(config.exposeTime, off);
+		m_config.framerate = config.framerate;
+		++m_applyCommands;
+	}
+
+	m_config.shutter = config.shutter;
+}
+
+void Camera::loadLimits()
+{
+	// called by open() under the lock
+	auto ret = PUC_GetResolutionLimit(m_handle, &m_resoLimit);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_GetResolutionLimit", ret));
+	}
+
+	ret = PUC_GetFramerateLimit(m_handle, &m_framerateLimit);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_GetFramerateLimit", ret));
+	}
+
+	ret = PUC_GetMinExposeTime(m_handle, &m_minExposeOn, &m_minExposeOff);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_GetMinExposeTime", ret));
+	}
+
+	ret = PUC_GetSerialNo(m_handle, &m_serialNo);
+	if (PUC_CHK_FAILED(ret)) {
+		throw(PUCException("PUC_GetSerialNo", ret));
+	}
+}
+
+uint64_t Camera::serialNo() const
+{
+	return m_serialNo;
+}
+
+std::shared_ptr<Capabilities> Camera::capabilities()
+{
+	// Shared by every Camera of the process. Table depends only on the device.
+	static std::map<uint64_t, std::shared_ptr<Capabilities>> cache;
+	static std::mutex cacheMutex;
+
+	// GIL is released before the locks, since building takes long and
+	// nothing in it needs python.
+	OptionalGilRelease release;
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	std::lock_guard<std::recursive_mutex> configLock(m_configMutex);
+
+	auto it = cache.find(m_serialNo);
+	if (it != cache.end()) {
+		return it->second;
+	}
+
+	auto caps = buildCapabilities();
+	cache[m_serialNo] = caps;
+	return caps;
+}
+
+std::shared_ptr<Capabilities> Camera::buildCapabilities()
+{
+	if (isXferring()) {
+		throw(WrapperException("capabilities can't be built while transferring."));
+	}
+
+	auto caps = std::make_shared<Capabilities>(m_serialNo, m_resoLimit);
+	CameraConfig prev = config();
+
+	try
+	{
+		// every resolution is legal at the minimum framerate
+		int f = m_framerateLimit.nMinFrameRate;
+		setFramerateShutter(f, f);
+
+		for (int h = 0; h < caps->heightCount(); ++h)
+		{
+			caps->buildRow(h, [&](int w) {
+				// PUC_SetResolution directly, frame arena is not needed here
+				auto ret = PUC_SetResolution(m_handle, caps->width(w), caps->height(h));
+				if (PUC_CHK_FAILED(ret)) {
+					throw(PUCException("PUC_SetResolution", ret));
+				}
+				m_config.resolution = Resolution(caps->width(w), caps->height(h));
+				return std::make_pair(framerateMax(), xferDataSize());
+			});
+		}
+
+		applySteps(prev);
+	}
+	catch (PUCException&)
+	{
+		try
+		{
+			applySteps(prev);
+		}
+		catch (PUCException&)
+		{
+			m_configValid = false;
+		}
+		throw;
+	}
+
+	return caps;
+}
+
+void Camera::startTelemetry(int interval)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_configMutex);
+
+	m_telemetry.start(m_handle, interval);
+}
+
+void Camera::stopTelemetry()
+{
+	m_telemetry.stop();
+}
+
+bool Camera::isTelemetryRunning() const
+{
+	return m_telemetry.isRunning();
+}
+
+Telemetry Camera::telemetry() const
+{
+	return m_telemetry.snapshot();
+}
+
+void Camera::setThermalCallback(int high, int low, std::function<void(const Telemetry&, bool)> f)
+{
+	m_telemetry.setThermalCallback(high, low, f);
+}
+
+void Camera::setAdaptiveRingBuffer(bool enable, int budget)
+{
+	if (budget <= 0) {
+		throw(WrapperException("ring buffer budget may be illegal."));
+	}
+
+	m_adaptiveRing = enable;
+	m_ringBudget = (uint64_t)budget * 1024 * 1024;
+}
+
+bool Camera::isAdaptiveRingBuffer() const
+{
+	return m_adaptiveRing;
+}
+
+CallbackStats Camera::callbackStats()
+{
+	CallbackStats stats;
+	stats.count = m_serviceTime.count();
+	if (stats.count > 0) {
+		stats.mean = (double)m_serviceTime.sum() / stats.count * 1e-9;
+	}
+	stats.p50 = m_serviceTime.percentile(0.5) * 1e-9;
+	stats.p99 = m_serviceTime.percentile(0.99) * 1e-9;
+	stats.p999 = m_serviceTime.percentile(0.999) * 1e-9;
+	stats.max = m_serviceTime.max() * 1e-9;
+
+	// frames arriving while the callback pauses for p99.9
+	int framerate = config().framerate;
+	uint64_t depth = (uint64_t)std::ceil(stats.p999 * framerate) * RING_SAFETY_FACTOR + MIN_RING_BUFFER_COUNT;
+	depth = std::min<uint64_t>(depth, MAX_RING_BUFFER_COUNT);
+
+	uint64_t slots = m_ringBudget / std::max(maxXferDataSize(), 1u);
+	stats.budgetLimited = m_ringBudget > 0 && depth > slots;
+	if (stats.budgetLimited) {
+		depth = std::max<uint64_t>(slots, MIN_RING_BUFFER_COUNT);
+	}
+	stats.ringBufferCount = (int)depth;
+
+	double timeout = stats.p999 * RING_SAFETY_FACTOR + (double)TIMEOUT_MARGIN_FRAMES / std::max(framerate, 1);
+	stats.xferTimeout = (int)std::ceil(timeout * 1000);
+
+	return stats;
+}
+
+void Camera::resetCallbackStats()
+{
+	m_serviceTime.reset();
+}
+
+void Camera::applyAdaptiveRingBuffer()
+{
+	// Both settings are rejected during transfer, so this runs in beginXfer.
+	auto stats = callbackStats();
+	if (stats.count < MIN_ADAPTIVE_SAMPLES)
+	{
+		// not enough samples for p99.9, only keep within the budget
+		int slots = (int)std::min<uint64_t>(m_ringBudget / std::max(maxXferDataSize(), 1u), MAX_RING_BUFFER_COUNT);
+		if (ringBufferCount() > slots) {
+			setRingBufferCount(std::max(slots, MIN_RING_BUFFER_COUNT));
+		}
+		return;
+	}
+
+	setRingBufferCount(stats.ringBufferCount);
+	setXferTimeout(std::get<0>(xferTimeout()), stats.xferTimeout);
+}
+
+void Camera::setLoadShedding(SheddingPolicy policy, int high, int low, int interval, double threshold)
+{
+	m_shedder.configure(policy, high, low, interval, threshold);
+}
+
+SheddingPolicy Camera::loadShedding() const
+{
+	return m_shedder.policy();
+}
+
+std::tuple<int64_t, int64_t, int64_t> Camera::loadSheddingStats() const
+{
+	return m_shedder.stats();
 }
\ No newline at end of file
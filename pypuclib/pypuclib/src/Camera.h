@@ -1,12 +1,24 @@
 #pragma once
 
+#include <mutex>
+#include <atomic>
 #include "Common.h"
 #include "Exception.h"
 #include "Utility.h"
 #include "XferData.h"
+#include "FrameArena.h"
+#include "Capabilities.h"
+#include "Telemetry.h"
+#include "CallbackStats.h"
+#include "XferDispatcher.h"
+#include "LatestFrame.h"
 
 
 class Decoder;
+class FramePublisher;
+class FrameServer;
+class AutoExposure;
+class FrameMailbox;
 class Camera
 {
 public:
@@ -17,6 +29,7 @@ public:
 	"\"\"This opens camera and initialization.         \n"
 	"                                                  \n"
 	"See CameraFactory to instance camera object.      \n"
+	"Camera already opened is kept as it is.           \n"
 	"                                                  \n"
 	"\"\"                                              \n");
 	void open();
@@ -255,13 +268,15 @@ public:
 	"                                                  \n"
 	"Begin continuous transfer on internal thread and  \n"
 	"callback starts immediately to argument function. \n"
+	"The same XferData obj is passed to every call     \n"
+	"unless the function keeps a reference to it.      \n"
 	"                                                  \n"
 	"Parameters                                        \n"
 	"----------                                        \n"
 	"function : function<void(XferData*)>              \n"
 	"    Callback function from C++ to Python.         \n"
 	"\"\"                                              \n");
-	void beginXfer(std::function<void(XferData*)> f);
+	void beginXfer(const py::object& f);
 
 	PY_DOC(DOC_END_XFER,
 	"\"\"Finish continuous transfer.                   \n"
@@ -282,6 +297,28 @@ public:
 	"\"\"                                              \n");
 	bool isXferring();
 
+	PY_DOC(DOC_SIMULATE_XFER,
+	"\"\"Run continuous transfer without device.       \n"
+	"                                                  \n"
+	"Frames of the same compressed data are passed     \n"
+	"through the callback path of beginXfer() on an    \n"
+	"internal thread, with sequence number from 0. This\n"
+	"returns after the last callback. Camera must be   \n"
+	"created by CameraFactory.createSimulated().       \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"function : function<void(XferData*)>              \n"
+	"    Callback function from C++ to Python.         \n"
+	"data : numpy array(uint8)                         \n"
+	"    Compressed data of a frame.                   \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of the frame.                      \n"
+	"count : int                                       \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	void simulateXfer(const py::object& f, py::array_t<uint8_t>& data, const Resolution& res, int count);
+
 	PY_DOC(DOC_DECODER,
 	"\"\"Get Decoder obj from the device.              \n"
 	"                                                  \n"
@@ -309,6 +346,45 @@ public:
 	"\"\"                                              \n");
 	std::unique_ptr<XferData> grab();
 
+	PY_DOC(DOC_GRAB_NEXT,
+	"\"\"Wait for a new frame of continuous transfer.  \n"
+	"                                                  \n"
+	"Returns the first frame newer than the one        \n"
+	"returned last by grabNext() or grabLatest(),      \n"
+	"without transfer from the device. Frames are kept \n"
+	"by transfer thread regardless of the callback and \n"
+	"load shedding, from the first call of grabNext()  \n"
+	"or grabLatest() in the transfer.                  \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"timeout : int                                     \n"
+	"    Timeout [msec]. Negative waits without limit. \n"
+	"    (default=1000)                                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"XferData obj                                      \n"
+	"    Frame received. None if timed out or transfer \n"
+	"    is not in progress.                           \n"
+	"\"\"                                              \n");
+	std::unique_ptr<XferData> grabNext(int timeout = 1000);
+
+	PY_DOC(DOC_GRAB_LATEST,
+	"\"\"Get the latest frame of continuous transfer.  \n"
+	"                                                  \n"
+	"Returns immediately the newest frame already      \n"
+	"received, even if it was returned before.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"XferData obj                                      \n"
+	"    Latest frame. None if no frame is kept yet.   \n"
+	"    The first call in the transfer starts keeping \n"
+	"    frames.                                       \n"
+	"\"\"                                              \n");
+	std::unique_ptr<XferData> grabLatest();
+
 
 	PY_DOC(DOC_RESETDEVICE,
 		"\"\"Reset the device.						   \n"
@@ -344,21 +420,522 @@ public:
 		"");
 	int sensorTemperature();
 
+	PY_DOC(DOC_FRAME_ARENA_COUNT,
+	"\"\"Get slot count of the frame arena.            \n"
+	"                                                  \n"
+	"Frame arena is a pre-faulted memory region that   \n"
+	"XferData of grab() is allocated from.             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Slot count of the frame arena.                \n"
+	"\"\"                                              \n");
+	int frameArenaCount() const;
+
+	PY_DOC(DOC_SET_FRAME_ARENA_COUNT,
+	"\"\"Set slot count of the frame arena.            \n"
+	"                                                  \n"
+	"Each slot has maximum transfer data size. 2MB     \n"
+	"large pages are used if the process has the lock  \n"
+	"memory privilege, otherwise regular pages. When   \n"
+	"all slots are in use, grab() falls back to heap.  \n"
+	"Default is 16.                                    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"count : int                                       \n"
+	"    Slot count to set. 0 disables the arena.      \n"
+	"lockMemory : bool                                 \n"
+	"    Lock the region in physical memory.           \n"
+	"    (default=false)                               \n"
+	"\"\"                                              \n");
+	void setFrameArenaCount(const int& count, bool lockMemory = false);
+
+	PY_DOC(DOC_IS_FRAME_ARENA_LARGE_PAGE,
+	"\"\"Check if the frame arena uses large pages.    \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if backed by large pages, false otherwise\n"
+	"\"\"                                              \n");
+	bool isFrameArenaLargePage() const;
+
+	PY_DOC(DOC_EXPOSE_TIME,
+	"\"\"Get exposure and non-exposure period.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int)                                        \n"
+	"    (exposure, non-exposure) period [nsec]        \n"
+	"\"\"                                              \n");
+	std::tuple<int, int> exposeTime() const;
+
+	PY_DOC(DOC_MIN_EXPOSE_TIME,
+	"\"\"Get minimum exposure and non-exposure period. \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int)                                        \n"
+	"    (exposure, non-exposure) period [nsec]        \n"
+	"\"\"                                              \n");
+	std::tuple<int, int> minExposeTime() const;
+
+	PY_DOC(DOC_SET_EXPOSE_TIME,
+	"\"\"Set exposure and non-exposure period.         \n"
+	"                                                  \n"
+	"Sum of the periods is one frame period. After     \n"
+	"this, framerateShutter() of the device is invalid.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"exposeOn : int                                    \n"
+	"    Exposure period [nsec].                       \n"
+	"exposeOff : int                                   \n"
+	"    Non-exposure period [nsec].                   \n"
+	"\"\"                                              \n");
+	void setExposeTime(const int& exposeOn, const int& exposeOff);
+
+	PY_DOC(DOC_CONFIG,
+	"\"\"Get current settings as CameraConfig obj.     \n"
+	"                                                  \n"
+	"Settings are read from the device only once after \n"
+	"open, then tracked by the setters of this class.  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"CameraConfig obj                                  \n"
+	"    Current settings.                             \n"
+	"\"\"                                              \n");
+	CameraConfig config();
+
+	PY_DOC(DOC_VALIDATE,
+	"\"\"Check settings without accessing the device.  \n"
+	"                                                  \n"
+	"Settings are checked against limits read on open. \n"
+	"Maximum framerate of each resolution is checked   \n"
+	"by the device on apply().                         \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"config : CameraConfig obj                         \n"
+	"    Settings to check.                            \n"
+	"\"\"                                              \n");
+	void validate(const CameraConfig& config) const;
+
+	PY_DOC(DOC_APPLY,
+	"\"\"Apply settings to the device at once.         \n"
+	"                                                  \n"
+	"Only changed settings are sent, in an order that  \n"
+	"keeps the device in a valid state: resolution     \n"
+	"first when framerate goes up, framerate first     \n"
+	"otherwise, exposure last. If the device rejects   \n"
+	"one of them, previous settings are restored and   \n"
+	"the exception is raised again.                    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"config : CameraConfig obj                         \n"
+	"    Settings to apply.                            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"float                                             \n"
+	"    Measured switch latency [sec].                \n"
+	"\"\"                                              \n");
+	double apply(const CameraConfig& config);
+
+	PY_DOC(DOC_APPLY_COMMAND_COUNT,
+	"\"\"Get number of commands sent by last apply().  \n"
+	"                                                  \n"
+	"Settings sent to restore previous ones after a    \n"
+	"rejection are counted too.                        \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of commands sent to the device.        \n"
+	"\"\"                                              \n");
+	int applyCommandCount() const;
+
+	PY_DOC(DOC_SERIAL_NO,
+	"\"\"Get serial number of the device.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Serial number.                                \n"
+	"\"\"                                              \n");
+	uint64_t serialNo() const;
+
+	PY_DOC(DOC_CAPABILITIES,
+	"\"\"Get capability table of the device.           \n"
+	"                                                  \n"
+	"On first call for a device, every legal resolution\n"
+	"is set to the device with minimum framerate to    \n"
+	"read its maximum framerate and transfer data size.\n"
+	"Settings are restored afterwards. The table is    \n"
+	"kept for the process, keyed on the serial number, \n"
+	"so later calls and other opens of the same device \n"
+	"return at once. Transfer must be stopped.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Capabilities obj                                  \n"
+	"    Capability table of the device.               \n"
+	"\"\"                                              \n");
+	std::shared_ptr<Capabilities> capabilities();
+
+	PY_DOC(DOC_START_TELEMETRY,
+	"\"\"Start sampling device values on native thread.\n"
+	"                                                  \n"
+	"Temperature, fan state, transfer state and        \n"
+	"framerate/shutter are read at the interval. Get   \n"
+	"the latest values by telemetry() without device   \n"
+	"access.                                           \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"interval : int                                    \n"
+	"    Sampling interval [msec]. (default=1000)      \n"
+	"\"\"                                              \n");
+	void startTelemetry(int interval = 1000);
+
+	PY_DOC(DOC_STOP_TELEMETRY,
+	"\"\"Stop sampling device values.                  \n"
+	"\"\"                                              \n");
+	void stopTelemetry();
+
+	PY_DOC(DOC_IS_TELEMETRY_RUNNING,
+	"\"\"Check if telemetry thread is running.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if running, false otherwise.             \n"
+	"\"\"                                              \n");
+	bool isTelemetryRunning() const;
+
+	PY_DOC(DOC_TELEMETRY,
+	"\"\"Get the latest values sampled.                \n"
+	"                                                  \n"
+	"This never accesses the device.                   \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Telemetry obj                                     \n"
+	"    Latest values.                                \n"
+	"\"\"                                              \n");
+	Telemetry telemetry() const;
+
+	PY_DOC(DOC_SET_THERMAL_CALLBACK,
+	"\"\"Set callback for thermal events.              \n"
+	"                                                  \n"
+	"Callback is called on telemetry thread as         \n"
+	"callback(telemetry, True) when temperature reaches\n"
+	"high, and callback(telemetry, False) when it goes \n"
+	"down to low again.                                \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"high : int                                        \n"
+	"    Temperature to raise the event.               \n"
+	"low : int                                         \n"
+	"    Temperature to clear the event.               \n"
+	"callback : function(Telemetry obj, bool)          \n"
+	"    Callback function. None to remove.            \n"
+	"\"\"                                              \n");
+	void setThermalCallback(int high, int low, std::function<void(const Telemetry&, bool)> f);
+
+	PY_DOC(DOC_SET_ADAPTIVE_RING_BUFFER,
+	"\"\"Tune ring buffer from callback service time.  \n"
+	"                                                  \n"
+	"Service time of the callback is measured during   \n"
+	"continuous transfer. On each beginXfer, ring      \n"
+	"buffer count is set to absorb p99.9 pause of the  \n"
+	"callback at current framerate, and continuous     \n"
+	"transfer timeout to outlast it. Ring buffer count \n"
+	"never exceeds the memory budget.                  \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"enable : bool                                     \n"
+	"    Enable adaptive ring buffer.                  \n"
+	"budget : int                                      \n"
+	"    Memory budget of ring buffer [MB].            \n"
+	"    (default=256)                                 \n"
+	"\"\"                                              \n");
+	void setAdaptiveRingBuffer(bool enable, int budget = 256);
+
+	PY_DOC(DOC_IS_ADAPTIVE_RING_BUFFER,
+	"\"\"Check if adaptive ring buffer is enabled.     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if enabled, false otherwise.             \n"
+	"\"\"                                              \n");
+	bool isAdaptiveRingBuffer() const;
+
+	PY_DOC(DOC_CALLBACK_STATS,
+	"\"\"Get service time statistics of the callback.  \n"
+	"                                                  \n"
+	"Statistics accumulate over transfers until        \n"
+	"resetCallbackStats() is called.                   \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"CallbackStats obj                                 \n"
+	"    Statistics and recommended ring buffer.       \n"
+	"\"\"                                              \n");
+	CallbackStats callbackStats();
+
+	PY_DOC(DOC_RESET_CALLBACK_STATS,
+	"\"\"Reset service time statistics of the callback.\n"
+	"\"\"                                              \n");
+	void resetCallbackStats();
+
+	PY_DOC(DOC_SET_LOAD_SHEDDING,
+	"\"\"Set load shedding of continuous transfer.     \n"
+	"                                                  \n"
+	"Backlog of the callback is estimated from sequence\n"
+	"number and framerate. When it reaches high, the   \n"
+	"policy becomes active until it goes down to low.  \n"
+	"While active, frames are delivered as below.      \n"
+	"  NONE       : all frames.                        \n"
+	"  DECIMATE   : every interval-th frame.           \n"
+	"  DC_PREVIEW : every interval-th frame (0=never), \n"
+	"               and others as DC preview only,     \n"
+	"               dataSize() of them is 0.           \n"
+	"  DC_CHANGE  : frames whose mean absolute DC      \n"
+	"               difference from last delivered one \n"
+	"               is threshold or more, and at least \n"
+	"               every interval-th frame (0=never). \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"policy : SHEDDING_POLICY(enum)                    \n"
+	"    Policy to use under backlog.                  \n"
+	"high : int                                        \n"
+	"    Backlog [frames] to activate. (default=64)    \n"
+	"low : int                                         \n"
+	"    Backlog [frames] to deactivate. (default=16)  \n"
+	"interval : int                                    \n"
+	"    Frame interval. (default=4)                   \n"
+	"threshold : float                                 \n"
+	"    DC change threshold. (default=2.0)            \n"
+	"\"\"                                              \n");
+	void setLoadShedding(SheddingPolicy policy, int high = 64, int low = 16, int interval = 4, double threshold = 2.0);
+
+	PY_DOC(DOC_LOAD_SHEDDING,
+	"\"\"Get load shedding policy.                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"SHEDDING_POLICY(enum)                             \n"
+	"    Policy set by setLoadShedding().              \n"
+	"\"\"                                              \n");
+	SheddingPolicy loadShedding() const;
+
+	PY_DOC(DOC_LOAD_SHEDDING_STATS,
+	"\"\"Get load shedding statistics.                 \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int, int)                                   \n"
+	"    (delivered, shed, activations) frame counts   \n"
+	"    since the last beginXfer. Frames delivered as \n"
+	"    preview only are counted as shed.             \n"
+	"\"\"                                              \n");
+	std::tuple<int64_t, int64_t, int64_t> loadSheddingStats() const;
+
+	PY_DOC(DOC_SET_FRAME_PUBLISHER,
+	"\"\"Publish every transferred frame to frame bus. \n"
+	"                                                  \n"
+	"Frames are written to shared memory on transfer   \n"
+	"thread of continuous transfer before the callback \n"
+	"and load shedding, so subscriber processes receive\n"
+	"them without python.                              \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"publisher : FramePublisher obj                    \n"
+	"    Publisher to write frames. None to stop.      \n"
+	"\"\"                                              \n");
+	void setFramePublisher(std::shared_ptr<FramePublisher> publisher);
+
+	PY_DOC(DOC_FRAME_PUBLISHER,
+	"\"\"Get frame publisher.                          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"FramePublisher obj                                \n"
+	"    Publisher set by setFramePublisher(). None if \n"
+	"    not set.                                      \n"
+	"\"\"                                              \n");
+	std::shared_ptr<FramePublisher> framePublisher() const;
+
+	PY_DOC(DOC_SET_FRAME_SERVER,
+	"\"\"Stream every transferred frame to clients.    \n"
+	"                                                  \n"
+	"Compressed data is sent on transfer thread of     \n"
+	"continuous transfer before the callback and load  \n"
+	"shedding.                                         \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"server : FrameServer obj                          \n"
+	"    Server to send frames. None to stop.          \n"
+	"\"\"                                              \n");
+	void setFrameServer(std::shared_ptr<FrameServer> server);
+
+	PY_DOC(DOC_FRAME_SERVER,
+	"\"\"Get frame server.                             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"FrameServer obj                                   \n"
+	"    Server set by setFrameServer(). None if not   \n"
+	"    set.                                          \n"
+	"\"\"                                              \n");
+	std::shared_ptr<FrameServer> frameServer() const;
+
+	PY_DOC(DOC_SET_FRAME_MAILBOX,
+	"\"\"Post every transferred frame to the mailbox.  \n"
+	"                                                  \n"
+	"Frames are posted on transfer thread of continuous\n"
+	"transfer before the callback and load shedding,   \n"
+	"and the mailbox keeps only the latest frame.      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"mailbox : FrameMailbox obj                        \n"
+	"    Mailbox to post frames. None to stop.         \n"
+	"\"\"                                              \n");
+	void setFrameMailbox(std::shared_ptr<FrameMailbox> mailbox);
+
+	PY_DOC(DOC_FRAME_MAILBOX,
+	"\"\"Get frame mailbox.                            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"FrameMailbox obj                                  \n"
+	"    Mailbox set by setFrameMailbox(). None if not \n"
+	"    set.                                          \n"
+	"\"\"                                              \n");
+	std::shared_ptr<FrameMailbox> frameMailbox() const;
+
+	PY_DOC(DOC_SET_AUTO_EXPOSURE,
+	"\"\"Control exposure by AutoExposure obj.         \n"
+	"                                                  \n"
+	"Each frame of continuous transfer is measured on  \n"
+	"transfer thread, and exposure is updated on side  \n"
+	"thread of the controller. Exposure is clamped to  \n"
+	"the frame of the framerate current at each update,\n"
+	"and config() follows exposure set by the          \n"
+	"controller.                                       \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"controller : AutoExposure obj                     \n"
+	"    Controller to attach. None to detach.         \n"
+	"actuator : str                                    \n"
+	"    'exposeTime' updates exposure period by       \n"
+	"    setExposeTime(). 'shutter' updates shutter    \n"
+	"    speed by setFramerateShutter().               \n"
+	"    (default='exposeTime')                        \n"
+	"\"\"                                              \n");
+	void setAutoExposure(std::shared_ptr<AutoExposure> controller, const std::string& actuator = "exposeTime");
+
+	PY_DOC(DOC_AUTO_EXPOSURE,
+	"\"\"Get auto exposure controller.                 \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"AutoExposure obj                                  \n"
+	"    Controller set by setAutoExposure(). None if  \n"
+	"    not set.                                      \n"
+	"\"\"                                              \n");
+	std::shared_ptr<AutoExposure> autoExposure() const;
+
 private:
+	friend class FramePublisher;
+	friend class FrameMailbox;
 	int deviceNo() const { return m_deviceNo; }
 	unsigned int xferDataSize() const;
 	unsigned int maxXferDataSize() const;
+	std::unique_ptr<XferData> takeLatest(bool next, int timeout);
+	void prepareArena();
+	void loadLimits();
+	void applySteps(const CameraConfig& config);
+	std::shared_ptr<Capabilities> buildCapabilities();
+	void applyAdaptiveRingBuffer();
 
 private: // for continuous callback
 	static void continuousCallback(PPUC_XFER_DATA_INFO pInfo, void* pArg);
 	void callbackWork(PPUC_XFER_DATA_INFO pInfo);
 	void startCallback() { m_enableCallback = true; }
 	void stopCallback() { m_enableCallback = false; }
-	std::function<void(XferData*)> m_pythonCallback;
-	bool m_enableCallback;
+	void endXferLocked();
+	std::unique_lock<std::mutex> lockXfer();
+	XferDispatcher m_dispatcher;
+	LoadShedder::Decision m_decision;
+	std::atomic<bool> m_enableCallback;
+	LatestFrame m_latest;
+	Resolution m_xferResolution;  // taken at beginXfer, not queried per frame
 
 private:
 	void* m_handle;
 	int m_deviceNo;
 	unsigned short m_quntize[PUC_Q_COUNT];
+
+private: // for camera config and frame arena
+	// Recursive since setters are combined into apply(). GIL is never
+	// acquired while this is locked.
+	mutable std::recursive_mutex m_configMutex;
+	// Taken before m_configMutex by beginXfer, endXfer and close, so the
+	// transfer is not ended twice and the handle is not closed meanwhile.
+	std::mutex m_xferMutex;
+
+private: // for frame arena
+	static constexpr int DEFAULT_ARENA_COUNT = 16;
+	std::shared_ptr<FrameArena> m_arena;
+	int m_arenaCount;
+	bool m_arenaLock;
+
+private: // for camera config
+	static constexpr uint64_t NSEC_PER_SEC = 1000000000;
+	PUC_RESO_LIMIT_INFO m_resoLimit;
+	PUC_FRAMERATE_LIMIT_INFO m_framerateLimit;
+	UINT32 m_minExposeOn;
+	UINT32 m_minExposeOff;
+	UINT64 m_serialNo;
+	CameraConfig m_config;
+	bool m_configValid;
+	int m_applyCommands;
+
+private: // for telemetry
+	TelemetrySampler m_telemetry;
+
+private: // for adaptive ring buffer
+	static constexpr int MIN_RING_BUFFER_COUNT = 4;
+	static constexpr int MAX_RING_BUFFER_COUNT = 65535;
+	static constexpr int RING_SAFETY_FACTOR = 2;
+	static constexpr int TIMEOUT_MARGIN_FRAMES = 16;
+	static constexpr int MIN_ADAPTIVE_SAMPLES = 1000;
+	LatencyHistogram m_serviceTime;
+	std::atomic<bool> m_adaptiveRing;
+	std::atomic<uint64_t> m_ringBudget;
+
+private: // for load shedding
+	LoadShedder m_shedder;
+
+private: // for auto exposure
+	std::shared_ptr<AutoExposure> m_autoExposure;
+
+private: // for frame bus, stream and mailbox
+	std::shared_ptr<FramePublisher> m_publisher;
+	std::shared_ptr<FrameServer> m_server;
+	std::shared_ptr<FrameMailbox> m_mailbox;
 };
\ No newline at end of file
@@ -8,10 +8,17 @@ CameraFactory& CameraFactory::instance()
 	return factory;
 }
 
-bool CameraFactory::isInit = false;
+std::atomic<bool> CameraFactory::isInit(false);
+std::mutex CameraFactory::initMutex;
 
+// Decoder obj of any thread calls this, PUC_Initialize runs only once.
 bool CameraFactory::initialize()
 {
+	if (CameraFactory::isInit) {
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(initMutex);
 	if (!CameraFactory::isInit)
 	{
 		auto ret = PUC_Initialize();
@@ -32,6 +39,7 @@ CameraFactory::CameraFactory()
 
 CameraFactory::~CameraFactory()
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
 	for (int i = 0; i < m_instancedCamera.size(); ++i)
 	{
 		m_instancedCamera[i]->close();
@@ -68,10 +76,24 @@ Camera* CameraFactory::create(int deviceNo, bool openAuto)
 	}
 
 	Camera* cam = new Camera(deviceNo);
-	m_instancedCamera.push_back(cam);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_instancedCamera.push_back(cam);
+	}
 
 	if(openAuto)
 		cam->open();
 
 	return cam;
-}
\ No newline at end of file
+}
+
+Camera* CameraFactory::createSimulated()
+{
+	Camera* cam = new Camera(SIMULATED_DEVICE_NO);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_instancedCamera.push_back(cam);
+	}
+
+	return cam;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mutex>
+#include <atomic>
 #include "Common.h"
 
 class Camera;
@@ -43,12 +45,31 @@ public:
     "\"\"                                              \n");
 	Camera* create(int deviceNo = 0, bool openAuto = true);
 
+    PY_DOC(DOC_CREATE_SIMULATED,
+    "\"\"Create the camera without device.             \n"
+    "                                                  \n"
+    "Frames are given by Camera.simulateXfer() to test \n"
+    "the callback path without a camera connected.     \n"
+    "Functions to control the device are not available.\n"
+    "                                                  \n"
+    "Returns                                           \n"
+    "-------                                           \n"
+    "Camera obj                                        \n"
+    "    Camera object without device.                 \n"
+    "\"\"                                              \n");
+	Camera* createSimulated();
+
 private:
 	CameraFactory();
 	CameraFactory(const CameraFactory& obj) = delete;
 	CameraFactory& operator=(const CameraFactory& obj) = delete;
 	~CameraFactory();
 
-	static bool isInit;
+	static constexpr int SIMULATED_DEVICE_NO = -1;
+
+	static std::atomic<bool> isInit;
+	static std::mutex initMutex;
+
+	std::mutex m_mutex;
 	std::vector<Camera*> m_instancedCamera;
 };
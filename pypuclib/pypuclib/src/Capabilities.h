@@ -0,0 +1,336 @@
+#pragma once
+
+#include <functional>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+
+// Maximum framerate and transfer data size of every legal resolution.
+// Rows are heights. Each row keeps only the widths where maximum framerate
+// changes.
+class Capabilities
+{
+public:
+	PY_DOC(DOC_CLASS_CAPABILITIES,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Table of maximum framerate and transfer data size \n"
+	"for each legal resolution of the device.          \n"
+	"                                                  \n"
+	"All queries are answered in memory.               \n"
+	"\"\"                                              \n");
+
+	struct Run
+	{
+		int first;      // first width index of the run
+		int framerate;
+	};
+
+	// Returns (max framerate, xfer data size) of width index in the row.
+	using Query = std::function<std::pair<int, unsigned int>(int)>;
+
+	Capabilities(uint64_t serialNo, const PUC_RESO_LIMIT_INFO& limit)
+		:
+		m_serialNo(serialNo),
+		m_limit(limit)
+	{
+		m_rows.resize(heightCount());
+	}
+
+	int widthCount() const { return stepCount(m_limit.nMinWidth, m_limit.nMaxWidth, m_limit.nUnitWidth); }
+	int heightCount() const { return stepCount(m_limit.nMinHeight, m_limit.nMaxHeight, m_limit.nUnitHeight); }
+	int width(int index) const { return m_limit.nMinWidth + index * unitWidth(); }
+	int height(int index) const { return m_limit.nMinHeight + index * unitHeight(); }
+
+	// Fill one row. Framerate runs are found by bisection, so a row with
+	// k distinct framerates costs O(k log n) queries. Transfer data size
+	// is interpolated when it is linear in width. Both assumptions are
+	// checked at every width queried, including probes at each eighth of
+	// the row, and the row falls back to querying every width if either
+	// fails.
+	void buildRow(int row, const Query& query)
+	{
+		std::map<int, std::pair<int, unsigned int>> done;
+		auto get = [&](int i) -> const std::pair<int, unsigned int>& {
+			auto it = done.find(i);
+			if (it == done.end()) {
+				it = done.emplace(i, query(i)).first;
+			}
+			return it->second;
+		};
+
+		Row& r = m_rows[row];
+		r.runs.clear();
+		r.sizes.clear();
+
+		int last = widthCount() - 1;
+		r.runs.push_back(Run{ 0, get(0).first });
+		bisect(0, last, get, r.runs);
+
+		r.sizeFirst = get(0).second;
+		r.sizeLast = get(last).second;
+		for (int k = 1; k < VERIFY_PROBES; ++k) {
+			get(last * k / VERIFY_PROBES);
+		}
+
+		bool monotone = true;
+		bool linear = true;
+		for (auto& d : done)
+		{
+			monotone = monotone && (runFramerate(r, d.first) == d.second.first);
+			linear = linear && (interpolate(r, d.first) == d.second.second);
+		}
+		if (!monotone)
+		{
+			r.runs.clear();
+			for (int i = 0; i <= last; ++i)
+			{
+				int f = get(i).first;
+				if (r.runs.empty() || r.runs.back().framerate != f) {
+					r.runs.push_back(Run{ i, f });
+				}
+			}
+		}
+		if (!linear)
+		{
+			r.sizes.resize(widthCount());
+			for (int i = 0; i <= last; ++i) {
+				r.sizes[i] = get(i).second;
+			}
+		}
+	}
+
+	PY_DOC(DOC_SERIAL_NO,
+	"\"\"Get serial number of the device.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Serial number.                                \n"
+	"\"\"                                              \n");
+	uint64_t serialNo() const { return m_serialNo; }
+
+	PY_DOC(DOC_IS_LEGAL,
+	"\"\"Check if resolution is legal for the device.  \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"width : int                                       \n"
+	"    Width of resolution.                          \n"
+	"height : int                                      \n"
+	"    Height of resolution.                         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if legal, false otherwise.               \n"
+	"\"\"                                              \n");
+	bool isLegal(int width, int height) const
+	{
+		return index(width, m_limit.nMinWidth, m_limit.nMaxWidth, unitWidth()) >= 0 &&
+			index(height, m_limit.nMinHeight, m_limit.nMaxHeight, unitHeight()) >= 0;
+	}
+
+	PY_DOC(DOC_CAPS_FRAMERATE_MAX,
+	"\"\"Get maximum framerate of the resolution.      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"width : int                                       \n"
+	"    Width of resolution.                          \n"
+	"height : int                                      \n"
+	"    Height of resolution.                         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Maximum framerate.                            \n"
+	"\"\"                                              \n");
+	int framerateMax(int width, int height) const
+	{
+		return runFramerate(row(height), widthIndex(width));
+	}
+
+	PY_DOC(DOC_CAPS_XFER_DATA_SIZE,
+	"\"\"Get transfer data size of the resolution.     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"width : int                                       \n"
+	"    Width of resolution.                          \n"
+	"height : int                                      \n"
+	"    Height of resolution.                         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Transfer data size [byte].                    \n"
+	"\"\"                                              \n");
+	unsigned int xferDataSize(int width, int height) const
+	{
+		const Row& r = row(height);
+		int i = widthIndex(width);
+		return r.sizes.empty() ? interpolate(r, i) : r.sizes[i];
+	}
+
+	PY_DOC(DOC_IS_FEASIBLE,
+	"\"\"Check if resolution can run at the framerate. \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"width : int                                       \n"
+	"    Width of resolution.                          \n"
+	"height : int                                      \n"
+	"    Height of resolution.                         \n"
+	"framerate : int                                   \n"
+	"    Framerate to check.                           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if feasible, false otherwise.            \n"
+	"\"\"                                              \n");
+	bool isFeasible(int width, int height, int framerate) const
+	{
+		return isLegal(width, height) && framerate <= framerateMax(width, height);
+	}
+
+	PY_DOC(DOC_THROUGHPUT,
+	"\"\"Get transfer throughput of the setting.       \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"width : int                                       \n"
+	"    Width of resolution.                          \n"
+	"height : int                                      \n"
+	"    Height of resolution.                         \n"
+	"framerate : int                                   \n"
+	"    Framerate.                                    \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Transfer throughput [byte/sec].               \n"
+	"\"\"                                              \n");
+	uint64_t throughput(int width, int height, int framerate) const
+	{
+		return (uint64_t)xferDataSize(width, height) * framerate;
+	}
+
+	PY_DOC(DOC_RESOLUTIONS,
+	"\"\"Get legal resolutions feasible at framerate.  \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"framerate : int                                   \n"
+	"    Framerate. 0 returns all legal resolutions.   \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"list(Resolution obj)                              \n"
+	"    Resolutions ordered by height, then width.    \n"
+	"\"\"                                              \n");
+	std::vector<Resolution> resolutions(int framerate = 0) const
+	{
+		std::vector<Resolution> list;
+		for (int h = 0; h < (int)m_rows.size(); ++h)
+		{
+			const auto& runs = m_rows[h].runs;
+			for (size_t k = 0; k < runs.size(); ++k)
+			{
+				if (runs[k].framerate < framerate) {
+					continue;
+				}
+				int end = k + 1 < runs.size() ? runs[k + 1].first : widthCount();
+				for (int w = runs[k].first; w < end; ++w) {
+					list.emplace_back(width(w), height(h));
+				}
+			}
+		}
+		return list;
+	}
+
+private:
+	static constexpr int VERIFY_PROBES = 8;
+
+	struct Row
+	{
+		std::vector<Run> runs;
+		unsigned int sizeFirst = 0;
+		unsigned int sizeLast = 0;
+		std::vector<unsigned int> sizes;  // empty if linear in width
+	};
+
+	template<class Get>
+	static void bisect(int lo, int hi, Get& get, std::vector<Run>& runs)
+	{
+		int fl = get(lo).first;
+		int fh = get(hi).first;
+		if (fl == fh) {
+			return;
+		}
+		if (hi - lo == 1)
+		{
+			runs.push_back(Run{ hi, fh });
+			return;
+		}
+		int mid = lo + (hi - lo) / 2;
+		bisect(lo, mid, get, runs);
+		bisect(mid, hi, get, runs);
+	}
+
+	static int runFramerate(const Row& r, int i)
+	{
+		auto it = std::upper_bound(r.runs.begin(), r.runs.end(), i,
+			[](int v, const Run& run) { return v < run.first; });
+		return std::prev(it)->framerate;
+	}
+
+	unsigned int interpolate(const Row& r, int i) const
+	{
+		int last = widthCount() - 1;
+		if (last == 0) {
+			return r.sizeFirst;
+		}
+		int64_t d = (int64_t)r.sizeLast - r.sizeFirst;
+		return (unsigned int)(r.sizeFirst + d * i / last);
+	}
+
+	const Row& row(int height) const
+	{
+		int i = index(height, m_limit.nMinHeight, m_limit.nMaxHeight, unitHeight());
+		if (i < 0) {
+			throw(WrapperException("resolution may be illegal."));
+		}
+		return m_rows[i];
+	}
+
+	int widthIndex(int width) const
+	{
+		int i = index(width, m_limit.nMinWidth, m_limit.nMaxWidth, unitWidth());
+		if (i < 0) {
+			throw(WrapperException("resolution may be illegal."));
+		}
+		return i;
+	}
+
+	int unitWidth() const { return m_limit.nUnitWidth > 0 ? m_limit.nUnitWidth : 1; }
+	int unitHeight() const { return m_limit.nUnitHeight > 0 ? m_limit.nUnitHeight : 1; }
+
+	static int stepCount(int minimum, int maximum, int unit)
+	{
+		return (maximum - minimum) / (unit > 0 ? unit : 1) + 1;
+	}
+
+	static int index(int value, int minimum, int maximum, int unit)
+	{
+		if (value < minimum || value > maximum || (value - minimum) % unit != 0) {
+			return -1;
+		}
+		return (value - minimum) / unit;
+	}
+
+	uint64_t m_serialNo;
+	PUC_RESO_LIMIT_INFO m_limit;
+	std::vector<Row> m_rows;
+};
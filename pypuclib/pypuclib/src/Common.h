@@ -1,6 +1,7 @@
 #pragma once
 
 #define NOMINMAX
+#include <winsock2.h>  // must precede windows.h, which pulls in old winsock.h
 #include "windows.h"
 
 #include "../include/PUCLIB.h"
@@ -8,6 +9,7 @@
 #pragma comment(lib, "lib/PUCLIB.lib")
 #pragma comment(lib, "lib/PUCUTIL.lib")
 
+#include <malloc.h>
 #include <iostream>
 #include <vector>
 #include <utility>
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <vector>
+#include "Common.h"
+
+namespace py = pybind11;
+
+// Subset of DLPack ABI (dlpack.h v0.8) to export host memory. Layout must
+// match dlpack.h exactly, consumers cast the capsule pointer to their own
+// definition.
+namespace dlpack
+{
+	enum DeviceType : int32_t
+	{
+		kDLCPU = 1,
+	};
+
+	enum DataTypeCode : uint8_t
+	{
+		kDLInt = 0,
+		kDLUInt = 1,
+		kDLFloat = 2,
+	};
+
+	struct DLDevice
+	{
+		int32_t device_type;
+		int32_t device_id;
+	};
+
+	struct DLDataType
+	{
+		uint8_t code;
+		uint8_t bits;
+		uint16_t lanes;
+	};
+
+	struct DLTensor
+	{
+		void* data;
+		DLDevice device;
+		int32_t ndim;
+		DLDataType dtype;
+		int64_t* shape;
+		int64_t* strides;
+		uint64_t byte_offset;
+	};
+
+	struct DLManagedTensor
+	{
+		DLTensor dl_tensor;
+		void* manager_ctx;
+		void (*deleter)(DLManagedTensor* self);
+	};
+
+	// Keeps owner alive until the consumer calls deleter, which may happen
+	// on any thread with or without GIL.
+	struct ManagerContext
+	{
+		DLManagedTensor tensor;
+		std::vector<int64_t> shape;
+		std::vector<int64_t> strides;
+		PyObject* owner;
+	};
+
+	inline void deleteManagedTensor(DLManagedTensor* self)
+	{
+		auto ctx = (ManagerContext*)self->manager_ctx;
+		{
+			py::gil_scoped_acquire acquire;
+			Py_XDECREF(ctx->owner);
+		}
+		delete ctx;
+	}
+
+	// Capsule not consumed is still named "dltensor", so release it here.
+	// Consumer renames it to "used_dltensor" and owns the tensor.
+	inline void deleteCapsule(PyObject* capsule)
+	{
+		if (PyCapsule_IsValid(capsule, "dltensor"))
+		{
+			auto p = (DLManagedTensor*)PyCapsule_GetPointer(capsule, "dltensor");
+			if (p) {
+				p->deleter(p);
+			}
+		}
+	}
+
+	// Strides are in elements, not bytes.
+	inline py::capsule toCapsule(void* data, DLDataType dtype,
+		const std::vector<int64_t>& shape, const std::vector<int64_t>& strides, const py::object& owner)
+	{
+		auto ctx = new ManagerContext();
+		ctx->shape = shape;
+		ctx->strides = strides;
+		ctx->owner = owner.ptr();
+		Py_XINCREF(ctx->owner);
+
+		DLTensor& t = ctx->tensor.dl_tensor;
+		t.data = data;
+		t.device.device_type = kDLCPU;
+		t.device.device_id = 0;
+		t.ndim = (int32_t)ctx->shape.size();
+		t.dtype = dtype;
+		t.shape = ctx->shape.data();
+		t.strides = ctx->strides.data();
+		t.byte_offset = 0;
+		ctx->tensor.manager_ctx = ctx;
+		ctx->tensor.deleter = deleteManagedTensor;
+
+		return py::capsule(&ctx->tensor, "dltensor", deleteCapsule);
+	}
+}
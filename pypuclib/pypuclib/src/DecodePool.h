@@ -0,0 +1,176 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include "Common.h"
+
+// Work-stealing thread pool shared by all decoders in the process.
+// Tasks of one run() are spread over every worker queue, and idle workers
+// steal from the others, so tiles of several frames decoded at the same
+// time keep all cores busy.
+class DecodePool
+{
+public:
+	static DecodePool& instance()
+	{
+		// Never deleted. Joining threads while the module is unloaded at
+		// process exit can deadlock on Windows loader lock.
+		static DecodePool* pool = new DecodePool(std::thread::hardware_concurrency());
+		return *pool;
+	}
+
+	int numThread() const { return (int)m_threads.size(); }
+
+	// Run tasks on the pool and wait for all of them.
+	// Calling thread also executes tasks while it is waiting.
+	void run(std::vector<std::function<void()>>& tasks)
+	{
+		if (tasks.empty()) {
+			return;
+		}
+
+		Group group;
+		group.remaining = (int)tasks.size();
+
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_pending += (int)tasks.size();
+		}
+		size_t start = m_next.fetch_add(1);
+		for (size_t i = 0; i < tasks.size(); ++i)
+		{
+			auto& q = *m_queues[(start + i) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			q.tasks.push_back(Task{ std::move(tasks[i]), &group });
+		}
+		m_sleepCond.notify_all();
+
+		Task task;
+		while (group.remaining.load() > 0)
+		{
+			if (steal(start % m_queues.size(), task)) {
+				execute(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(group.mutex);
+			group.cond.wait(lock, [&] { return group.remaining.load() == 0; });
+		}
+
+		// last executor may still hold the mutex of group on this stack
+		std::lock_guard<std::mutex> lock(group.mutex);
+	}
+
+private:
+	struct Group
+	{
+		std::atomic<int> remaining;
+		std::mutex mutex;
+		std::condition_variable cond;
+	};
+
+	struct Task
+	{
+		std::function<void()> func;
+		Group* group;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	DecodePool(unsigned int count)
+		:
+		m_next(0),
+		m_pending(0)
+	{
+		if (count == 0) {
+			count = 1;
+		}
+		for (unsigned int i = 0; i < count; ++i) {
+			m_queues.push_back(std::make_unique<Queue>());
+		}
+		for (unsigned int i = 0; i < count; ++i) {
+			m_threads.emplace_back(&DecodePool::work, this, i);
+		}
+	}
+	DecodePool(const DecodePool& obj) = delete;
+	DecodePool& operator=(const DecodePool& obj) = delete;
+
+	void work(size_t index)
+	{
+		Task task;
+		while (true)
+		{
+			if (popLocal(index, task) || steal(index + 1, task)) {
+				execute(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_sleepCond.wait(lock, [&] { return m_pending > 0; });
+		}
+	}
+
+	// Owner takes newest task from back, thieves take oldest from front.
+	bool popLocal(size_t index, Task& task)
+	{
+		auto& q = *m_queues[index];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.tasks.empty()) {
+			return false;
+		}
+		task = std::move(q.tasks.back());
+		q.tasks.pop_back();
+		taken();
+		return true;
+	}
+
+	bool steal(size_t first, Task& task)
+	{
+		for (size_t i = 0; i < m_queues.size(); ++i)
+		{
+			auto& q = *m_queues[(first + i) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (q.tasks.empty()) {
+				continue;
+			}
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			taken();
+			return true;
+		}
+		return false;
+	}
+
+	void taken()
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		--m_pending;
+	}
+
+	static void execute(Task& task)
+	{
+		task.func();
+
+		Group* group = task.group;
+		task.func = nullptr;
+		std::lock_guard<std::mutex> lock(group->mutex);
+		if (--group->remaining == 0) {
+			group->cond.notify_all();
+		}
+	}
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<size_t> m_next;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_sleepCond;
+	int m_pending;
+};
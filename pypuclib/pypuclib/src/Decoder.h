@@ -1,8 +1,18 @@
 #pragma once
 
 #include <pybind11/numpy.h>
+#include <thread>
+#include <array>
+#include <atomic>
+#include <mutex>
 #include "Common.h"
 #include "Exception.h"
+#include "Kernel.h"
+#include "DecodePool.h"
+#include "FrameStats.h"
+#include "ImagePool.h"
+#include "Demosaic.h"
+#include "TemporalProcessor.h"
 #include "XferData.h"
 #include "CameraFactory.h"
 
@@ -13,10 +23,16 @@ class Decoder
 public:
 	Decoder()
 		:
-		m_numThread(1)
+		m_numThread(1),
+		m_lineAlign(DEFAULT_LINE_ALIGN),
+		m_tileDecode(false),
+		m_tileWidth(DEFAULT_TILE_WIDTH),
+		m_tileHeight(DEFAULT_TILE_HEIGHT),
+		m_quantize(std::make_shared<Quantization>()),
+		m_pool(std::make_shared<ImagePool>())
 	{
 		CameraFactory::initialize();
-		memset(m_quantize, 0, sizeof(unsigned short) * PUC_Q_COUNT);
+		memset(&m_param, 0, sizeof(m_param));
 	}
 	Decoder(const std::vector<int>& q)
 		:Decoder()
@@ -29,7 +45,9 @@ public:
 		if (q == nullptr || qsize != PUC_Q_COUNT) {
 			throw(WrapperException("quantization may be illegal size or not defined."));
 		}
-		memcpy(m_quantize, q, sizeof(unsigned short) * qsize);
+		auto table = std::make_shared<Quantization>();
+		std::copy(q, q + qsize, table->begin());
+		m_quantize = table;
 	}
 	~Decoder() 
 	{
@@ -46,7 +64,8 @@ public:
 	"\"\"                                              \n");
 	std::vector<int> quantization() 
 	{
-		return std::vector<int>(std::begin(m_quantize), std::end(m_quantize));
+		auto table = quantize();
+		return std::vector<int>(table->begin(), table->end());
 	}
 	
 	PY_DOC(DOC_SET_QUANTIZATION,
@@ -65,15 +84,17 @@ public:
 		if (q.size() != PUC_Q_COUNT) {
 			throw(WrapperException("quantization may be illegal size."));
 		}
+		auto table = std::make_shared<Quantization>();
 		for (unsigned int i = 0; i < q.size(); ++i)
 		{
 			if (q[i] < 0)
-				m_quantize[i] = 0;
+				(*table)[i] = 0;
 			else if (q[i] > USHRT_MAX)
-				m_quantize[i] = USHRT_MAX;
+				(*table)[i] = USHRT_MAX;
 			else
-				m_quantize[i] = (unsigned short)q[i];
+				(*table)[i] = (unsigned short)q[i];
 		}
+		std::atomic_store(&m_quantize, std::shared_ptr<const Quantization>(table));
 	}
 
 	PY_DOC(DOC_DECODE_A,
@@ -86,22 +107,40 @@ public:
 	"----------                                        \n"
 	"data : XferData obj                               \n"
 	"    XferData to decode.                           \n"
+	"stats : bool                                      \n"
+	"    True to return statistics of the image too.   \n"
+	"    (default=False)                               \n"
 	"                                                  \n"
 	"Returns                                           \n"
 	"-------                                           \n"
 	"numpy array(uint8)                                \n"
 	"    Numpy array of the decompressed image.        \n"
+	"FrameStats obj                                    \n"
+	"    Statistics counted from each stripe while it  \n"
+	"    is on cache. Returned as (image, stats) tuple \n"
+	"    if stats is True.                             \n"
 	"\"\"                                              \n");
 	py::array_t<uint8_t> decode(XferData* data)
 	{
 		auto res = data->resolution();
 
-		py::array_t<uint8_t> buf({ res.height, res.width });
-		decode(data->dataInfo()->pData, buf.mutable_data(), 0, 0, res.width, res.height, res.width);
+		int lineBytes;
+		py::array_t<uint8_t> buf = allocateImage(res.width, res.height, lineBytes);
+		decode(data->dataInfo()->pData, buf.mutable_data(), 0, 0, res.width, res.height, lineBytes);
+		packImage(buf, lineBytes);
 
 		return buf;
 	}
 
+	py::object decode(XferData* data, bool stats)
+	{
+		if (!stats) {
+			return decode(data);
+		}
+		auto res = data->resolution();
+		return decodeWithStats(data->dataInfo()->pData, 0, 0, res.width, res.height);
+	}
+
 	PY_DOC(DOC_DECODE_B,
 	"\"\"Decode compressed data.                       \n"
 	"                                                  \n"
@@ -121,20 +160,37 @@ public:
 	"    Decode width start from x.                    \n"
 	"h : int                                           \n"
 	"    Decode height start form y.                   \n"
+	"stats : bool                                      \n"
+	"    True to return statistics of the image too.   \n"
+	"    (default=False)                               \n"
 	"                                                  \n"
 	"Returns                                           \n"
 	"-------                                           \n"
 	"numpy array(uint8)                                \n"
 	"    Numpy array of the decompressed image.        \n"
 	"    Array size is (h, w).                         \n"
+	"FrameStats obj                                    \n"
+	"    Statistics counted from each stripe while it  \n"
+	"    is on cache. Returned as (image, stats) tuple \n"
+	"    if stats is True.                             \n"
 	"\"\"                                              \n");
 	py::array_t<uint8_t> decode(XferData* data, int x, int y, int w, int h)
 	{
-		py::array_t<uint8_t> buf({ h, w });
-		decode(data->dataInfo()->pData, buf.mutable_data(), x, y, w, h, w);
+		int lineBytes;
+		py::array_t<uint8_t> buf = allocateImage(w, h, lineBytes);
+		decode(data->dataInfo()->pData, buf.mutable_data(), x, y, w, h, lineBytes);
+		packImage(buf, lineBytes);
 		return buf;
 	}
 
+	py::object decode(XferData* data, int x, int y, int w, int h, bool stats)
+	{
+		if (!stats) {
+			return decode(data, x, y, w, h);
+		}
+		return decodeWithStats(data->dataInfo()->pData, x, y, w, h);
+	}
+
 	PY_DOC(DOC_DECODE_C,
 	"\"\"Decode compressed data.                       \n"
 	"                                                  \n"
@@ -147,19 +203,36 @@ public:
 	"    Numpy array of 1d compressed data.            \n"
 	"resolution : Resolution obj                       \n"
 	"    Resolution of original data resolution.       \n"
+	"stats : bool                                      \n"
+	"    True to return statistics of the image too.   \n"
+	"    (default=False)                               \n"
 	"                                                  \n"
 	"Returns                                           \n"
 	"-------                                           \n"
 	"numpy array(uint8)                                \n"
 	"    Numpy array of the decompressed image.        \n"
+	"FrameStats obj                                    \n"
+	"    Statistics counted from each stripe while it  \n"
+	"    is on cache. Returned as (image, stats) tuple \n"
+	"    if stats is True.                             \n"
 	"\"\"                                              \n");
 	py::array_t<uint8_t> decode(py::array_t<uint8_t>& array, const Resolution& res)
 	{
-		py::array_t<uint8_t> buf({ res.height, res.width });
-		decode(array.mutable_data(), buf.mutable_data(), 0, 0, res.width, res.height, res.width);
+		int lineBytes;
+		py::array_t<uint8_t> buf = allocateImage(res.width, res.height, lineBytes);
+		decode(array.mutable_data(), buf.mutable_data(), 0, 0, res.width, res.height, lineBytes);
+		packImage(buf, lineBytes);
 		return buf;
 	}
 
+	py::object decode(py::array_t<uint8_t>& array, const Resolution& res, bool stats)
+	{
+		if (!stats) {
+			return decode(array, res);
+		}
+		return decodeWithStats(array.mutable_data(), 0, 0, res.width, res.height);
+	}
+
 	PY_DOC(DOC_DECODE_D,
 	"\"\"Decode compressed data.                       \n"
 	"                                                  \n"
@@ -179,20 +252,344 @@ public:
 	"    Decode width start from x.                    \n"
 	"h : int                                           \n"
 	"    Decode height start form y.                   \n"
+	"stats : bool                                      \n"
+	"    True to return statistics of the image too.   \n"
+	"    (default=False)                               \n"
 	"                                                  \n"
 	"Returns                                           \n"
 	"-------                                           \n"
 	"numpy array(uint8)                                \n" 
 	"    Numpy array of the decompressed image.        \n"
 	"    Array size is (h, w).                         \n"
+	"FrameStats obj                                    \n"
+	"    Statistics counted from each stripe while it  \n"
+	"    is on cache. Returned as (image, stats) tuple \n"
+	"    if stats is True.                             \n"
 	"\"\"                                              \n");
 	py::array_t<uint8_t> decode(py::array_t<uint8_t>& array, int x, int y, int w, int h)
 	{
-		py::array_t<uint8_t> buf({ h, w });
-		decode(array.mutable_data(), buf.mutable_data(), x, y, w, h, w);
+		int lineBytes;
+		py::array_t<uint8_t> buf = allocateImage(w, h, lineBytes);
+		decode(array.mutable_data(), buf.mutable_data(), x, y, w, h, lineBytes);
+		packImage(buf, lineBytes);
 		return buf;
 	}
 
+	py::object decode(py::array_t<uint8_t>& array, int x, int y, int w, int h, bool stats)
+	{
+		if (!stats) {
+			return decode(array, x, y, w, h);
+		}
+		return decodeWithStats(array.mutable_data(), x, y, w, h);
+	}
+
+	PY_DOC(DOC_DECODE_SCALE_A,
+	"\"\"Decode compressed data with downscaling.       \n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This decode data in XferData by 8 lines stripe and\n"
+	"reduce each stripe while it is on cache, so full  \n"
+	"resolution image is never created.                \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to decode.                           \n"
+	"scale : int                                       \n"
+	"    Reduction ratio. 2, 4 or 8.                   \n"
+	"mode : str                                        \n"
+	"    'box' averages scale x scale pixels.          \n"
+	"    'subsample' picks top left pixel of them.     \n"
+	"    (default='box')                               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of the decompressed image.        \n"
+	"    Array size is (h / scale, w / scale).         \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> decode(XferData* data, int scale, const std::string& mode)
+	{
+		auto res = data->resolution();
+		return decodeScaled(data->dataInfo()->pData, res.width, res.height, scale, mode);
+	}
+
+	PY_DOC(DOC_DECODE_SCALE_B,
+	"\"\"Decode compressed data with downscaling.       \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"This decode numpy array source by 8 lines stripe  \n"
+	"and reduce each stripe while it is on cache.      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of original data resolution.       \n"
+	"scale : int                                       \n"
+	"    Reduction ratio. 2, 4 or 8.                   \n"
+	"mode : str                                        \n"
+	"    'box' or 'subsample'. (default='box')         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of the decompressed image.        \n"
+	"    Array size is (h / scale, w / scale).         \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> decode(py::array_t<uint8_t>& array, const Resolution& res, int scale, const std::string& mode)
+	{
+		return decodeScaled(array.mutable_data(), res.width, res.height, scale, mode);
+	}
+
+	PY_DOC(DOC_DECODE_STATS_A,
+	"\"\"Get statistics of image without decoding it.   \n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This decode data in XferData by 8 lines stripe and\n"
+	"count each stripe while it is on cache. Image is  \n"
+	"never written out.                                \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to decode.                           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"FrameStats obj                                    \n"
+	"    Statistics of the image.                      \n"
+	"\"\"                                              \n");
+	FrameStats decodeStats(XferData* data)
+	{
+		auto res = data->resolution();
+		return decodeStats(data->dataInfo()->pData, 0, 0, res.width, res.height, nullptr, 0);
+	}
+
+	PY_DOC(DOC_DECODE_STATS_B,
+	"\"\"Get statistics of image without decoding it.   \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of original data resolution.       \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"FrameStats obj                                    \n"
+	"    Statistics of the image.                      \n"
+	"\"\"                                              \n");
+	FrameStats decodeStats(py::array_t<uint8_t>& array, const Resolution& res)
+	{
+		return decodeStats(array.mutable_data(), 0, 0, res.width, res.height, nullptr, 0);
+	}
+
+	PY_DOC(DOC_DECODE_COLOR_A,
+	"\"\"Decode compressed data of color device.       \n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This decode data in XferData by 8 lines stripe and\n"
+	"demosaic each stripe while it is on cache. Bayer  \n"
+	"image is never written out.                       \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to decode.                           \n"
+	"pattern : str                                     \n"
+	"    CFA pattern of top left 2x2 pixels, 'RGGB',   \n"
+	"    'BGGR', 'GRBG' or 'GBRG'. (default='RGGB')    \n"
+	"method : str                                      \n"
+	"    'bilinear' or 'edge'. 'edge' interpolates     \n"
+	"    green along edges and corrects other colors by\n"
+	"    gradient. (default='bilinear')                \n"
+	"output : str                                      \n"
+	"    'RGB', 'BGR' or 'YUV'. (default='RGB')        \n"
+	"wb : list(float)                                  \n"
+	"    White balance gains of R, G and B.            \n"
+	"    (default=[1.0, 1.0, 1.0])                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of color image. Array size is     \n"
+	"    (h, w, 3) for 'RGB' and 'BGR', or (3, h, w) of\n"
+	"    planar YUV 4:4:4 (BT.601 full range) for 'YUV'\n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> decodeColor(XferData* data, const std::string& pattern, const std::string& method,
+		const std::string& output, const std::vector<float>& wb)
+	{
+		auto res = data->resolution();
+		return decodeColor(data->dataInfo()->pData, res.width, res.height, Demosaic(pattern, method, output, wb));
+	}
+
+	PY_DOC(DOC_DECODE_COLOR_B,
+	"\"\"Decode compressed data of color device.       \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of original data resolution.       \n"
+	"pattern : str                                     \n"
+	"    CFA pattern of top left 2x2 pixels, 'RGGB',   \n"
+	"    'BGGR', 'GRBG' or 'GBRG'. (default='RGGB')    \n"
+	"method : str                                      \n"
+	"    'bilinear' or 'edge'. 'edge' interpolates     \n"
+	"    green along edges and corrects other colors by\n"
+	"    gradient. (default='bilinear')                \n"
+	"output : str                                      \n"
+	"    'RGB', 'BGR' or 'YUV'. (default='RGB')        \n"
+	"wb : list(float)                                  \n"
+	"    White balance gains of R, G and B.            \n"
+	"    (default=[1.0, 1.0, 1.0])                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of color image. Array size is     \n"
+	"    (h, w, 3) for 'RGB' and 'BGR', or (3, h, w) of\n"
+	"    planar YUV 4:4:4 (BT.601 full range) for 'YUV'\n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> decodeColor(py::array_t<uint8_t>& array, const Resolution& res, const std::string& pattern,
+		const std::string& method, const std::string& output, const std::vector<float>& wb)
+	{
+		return decodeColor(array.mutable_data(), res.width, res.height, Demosaic(pattern, method, output, wb));
+	}
+
+	PY_DOC(DOC_DECODE_TEMPORAL_A,
+	"\"\"Decode compressed data into TemporalProcessor.\n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This decode data in XferData by 8 lines stripe and\n"
+	"process each stripe while it is on cache. Image is\n"
+	"never written out.                                \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to decode.                           \n"
+	"processor : TemporalProcessor obj                 \n"
+	"    Processor of the same resolution.             \n"
+	"op : str                                          \n"
+	"    'background', 'difference' or 'accumulate'.   \n"
+	"threshold : int                                   \n"
+	"    Threshold of 'difference'. (default=-1)       \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Same as result of the op of TemporalProcessor.\n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> decodeTemporal(XferData* data, TemporalProcessor& processor, const std::string& op, int threshold)
+	{
+		auto res = data->resolution();
+		return decodeTemporal(data->dataInfo()->pData, res.width, res.height, processor, op, threshold);
+	}
+
+	PY_DOC(DOC_DECODE_TEMPORAL_B,
+	"\"\"Decode compressed data into TemporalProcessor.\n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of original data resolution.       \n"
+	"processor : TemporalProcessor obj                 \n"
+	"    Processor of the same resolution.             \n"
+	"op : str                                          \n"
+	"    'background', 'difference' or 'accumulate'.   \n"
+	"threshold : int                                   \n"
+	"    Threshold of 'difference'. (default=-1)       \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Same as result of the op of TemporalProcessor.\n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> decodeTemporal(py::array_t<uint8_t>& array, const Resolution& res, TemporalProcessor& processor, const std::string& op, int threshold)
+	{
+		return decodeTemporal(array.mutable_data(), res.width, res.height, processor, op, threshold);
+	}
+
+	PY_DOC(DOC_DECODE_TENSOR_A,
+	"\"\"Decode compressed data to input of neural net.\n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This decode data in XferData by 8 lines stripe and\n"
+	"write each stripe to the layout in one pass.      \n"
+	"Gray pixel is replicated to all channels. Result  \n"
+	"is numpy array, which exports __dlpack__.         \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to decode.                           \n"
+	"layout : str                                      \n"
+	"    'HWC' writes uint8 array of (h, w, channels). \n"
+	"    'NCHW' writes float32 array of                \n"
+	"    (1, channels, h, w) normalized as             \n"
+	"    (pixel / 255 - mean) / std.                   \n"
+	"    (default='HWC')                               \n"
+	"channels : int                                    \n"
+	"    Number of channels. 1 or 3. (default=3)       \n"
+	"mean : float                                      \n"
+	"    Mean of NCHW normalization. (default=0.0)     \n"
+	"std : float                                       \n"
+	"    Std of NCHW normalization. (default=1.0)      \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8 or float32)                     \n"
+	"    C contiguous array of the layout.             \n"
+	"\"\"                                              \n");
+	py::array decodeTensor(XferData* data, const std::string& layout, int channels, float mean, float stddev)
+	{
+		auto res = data->resolution();
+		return decodeTensor(data->dataInfo()->pData, res.width, res.height, layout, channels, mean, stddev);
+	}
+
+	PY_DOC(DOC_DECODE_TENSOR_B,
+	"\"\"Decode compressed data to input of neural net.\n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of original data resolution.       \n"
+	"layout : str                                      \n"
+	"    'HWC' or 'NCHW'. (default='HWC')              \n"
+	"channels : int                                    \n"
+	"    Number of channels. 1 or 3. (default=3)       \n"
+	"mean : float                                      \n"
+	"    Mean of NCHW normalization. (default=0.0)     \n"
+	"std : float                                       \n"
+	"    Std of NCHW normalization. (default=1.0)      \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8 or float32)                     \n"
+	"    C contiguous array of the layout.             \n"
+	"\"\"                                              \n");
+	py::array decodeTensor(py::array_t<uint8_t>& array, const Resolution& res, const std::string& layout, int channels, float mean, float stddev)
+	{
+		return decodeTensor(array.mutable_data(), res.width, res.height, layout, channels, mean, stddev);
+	}
+
 	PY_DOC(DOC_DECODE_DC_A,
 		"\"\"Decode compressed DC data.                    \n"
 		"                                                  \n"
@@ -284,8 +681,9 @@ public:
 		"\"\"																			\n");
 	py::array_t<uint8_t> decodeGPU(py::array_t<uint8_t>& array, bool download, int lineBytes)
 	{
-		UINT32 width = m_param.width;
-		UINT32 height = m_param.height;
+		auto param = gpuParam();
+		UINT32 width = param.width;
+		UINT32 height = param.height;
 		py::array_t<uint8_t> buf({ height, width });
 		auto dst = buf.mutable_data();
 
@@ -318,8 +716,9 @@ public:
 	"\"\"																			\n");
 	py::array_t<uint8_t> decodeGPU(XferData* data, bool download, int lineBytes)
 	{
-		UINT32 width = m_param.width;
-		UINT32 height = m_param.height;
+		auto param = gpuParam();
+		UINT32 width = param.width;
+		UINT32 height = param.height;
 		py::array_t<uint8_t> buf({ height, width });
 		auto dst = buf.mutable_data();
 
@@ -383,6 +782,92 @@ public:
 	"\"\"                                              \n");
 	void setNumDecodeThread(int num) { m_numThread = num; }
 
+	PY_DOC(DOC_IS_TILE_DECODE,
+	"\"\"Check if tile decode is enabled.               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if tile decode is enabled.               \n"
+	"\"\"                                              \n");
+	bool isTileDecode() { return m_tileDecode; }
+
+	PY_DOC(DOC_SET_TILE_DECODE,
+	"\"\"Enable tile decode on shared thread pool.      \n"
+	"                                                  \n"
+	"Image is split into tiles and decoded on a thread \n"
+	"pool shared by all decoders, sized to all cores.  \n"
+	"Tiles of frames decoded by several python threads \n"
+	"at the same time are spread over the pool, so it  \n"
+	"is not limited by numDecodeThread(max 32).        \n"
+	"GIL is released while decoding.                   \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"enable : bool                                     \n"
+	"    True to enable tile decode.                   \n"
+	"tileWidth : int                                   \n"
+	"    Tile width, multiple of 8. (default=256)      \n"
+	"tileHeight : int                                  \n"
+	"    Tile height, multiple of 8. (default=64)      \n"
+	"\"\"                                              \n");
+	void setTileDecode(bool enable, int tileWidth, int tileHeight)
+	{
+		if (tileWidth <= 0 || tileHeight <= 0 || tileWidth % 8 != 0 || tileHeight % 8 != 0) {
+			throw(WrapperException("tile size must be multiple of 8."));
+		}
+		// size is set before the flag, so tile decode never starts with the
+		// old size
+		m_tileWidth = tileWidth;
+		m_tileHeight = tileHeight;
+		m_tileDecode = enable;
+	}
+
+	PY_DOC(DOC_TILE_DECODE_THREAD,
+	"\"\"Get number of thread of tile decode pool.      \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of thread, same as logical cores.      \n"
+	"\"\"                                              \n");
+	int tileDecodeThread() { return DecodePool::instance().numThread(); }
+
+	PY_DOC(DOC_LINE_ALIGNMENT,
+	"\"\"Get line alignment of decoded image.           \n"
+	"                                                  \n"
+	"Each line of decoded array starts at address of   \n"
+	"multiple of this value. Array shape is (h, w) and \n"
+	"strides[0] is padded line bytes. 1 means packed   \n"
+	"C contiguous array, strides[0] is w.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Line alignment in bytes.                      \n"
+	"\"\"                                              \n");
+	int lineAlignment() { return m_lineAlign; }
+
+	PY_DOC(DOC_SET_LINE_ALIGNMENT,
+	"\"\"Set line alignment of decoded image.           \n"
+	"                                                  \n"
+	"Set 1, or power of 2 from 4 to 4096. Default is 1,\n"
+	"and decoded array is C contiguous. Other values   \n"
+	"pad each line, the array is not C contiguous then.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"align : int                                       \n"
+	"    Line alignment in bytes.                      \n"
+	"\"\"                                              \n");
+	void setLineAlignment(int align)
+	{
+		if (align != PACKED_LINE_ALIGN && (align < 4 || align > 4096 || (align & (align - 1)) != 0)) {
+			throw(WrapperException("line alignment must be 1 or power of 2 from 4 to 4096."));
+		}
+		m_lineAlign = align;
+	}
+
 	PY_DOC(DOC_GET_AVAILABLE_GPU_PROCESS,
 	"\"\"This retrieves whether the PC is capable of GPU processing. \n"
 	"																 \n"
@@ -411,6 +896,7 @@ public:
 	"\"\"                                              \n");
 	void setupGPUDecode(GPUSetup param)
 	{
+		std::lock_guard<std::mutex> lock(m_gpuMutex);
 		m_param.width = param.width;
 		m_param.height = param.height;
 		auto ret = PUC_SetupGPUDecode(m_param);
@@ -459,15 +945,405 @@ public:
 		PUC_GetGPULastError(errorCode);
 	}
 
+	// Memoized images of XferData are decoded into buffers recycled by the
+	// pool of this decoder.
+	std::shared_ptr<uint8_t> decodePooled(XferData* data, int x, int y, int w, int h, int& lineBytes)
+	{
+		const int lineAlign = m_lineAlign;
+		lineBytes = decodePitch(w, lineAlign);
+		auto buf = m_pool->acquire((size_t)lineBytes * std::max(h, 1), std::max(lineAlign, 16));
+		decode(data->dataInfo()->pData, buf.get(), x, y, w, h, lineBytes);
+
+		int stride = lineAlign == PACKED_LINE_ALIGN ? w : lineBytes;
+		packLines(buf.get(), w, h, lineBytes, stride);
+		lineBytes = stride;
+		return buf;
+	}
+
+	std::shared_ptr<uint8_t> decodeDCPooled(XferData* data, int countX, int countY)
+	{
+		auto buf = m_pool->acquire((size_t)countX * countY, 16);
+		decodeDC(data->dataInfo()->pData, buf.get(), 0, 0, countX, countY);
+		return buf;
+	}
+
 private:
 	void decode(uint8_t* src, uint8_t* dst, int x, int y, int w, int h, int lb)
 	{
-		auto ret = PUC_DecodeDataMultiThread(dst, x, y, w, h, lb, src, m_quantize, m_numThread);
+		if (m_tileDecode) {
+			decodeTiles(src, dst, x, y, w, h, lb);
+			return;
+		}
+
+		auto table = quantize();
+		auto ret = PUC_DecodeDataMultiThread(dst, x, y, w, h, lb, src, (PUSHORT)table->data(), m_numThread);
 		if (PUC_CHK_FAILED(ret)) {
 			throw(PUCException("PUC_DecodeDataMultiThread", ret));
 		}
 	}
 
+	// Decode destination must have line bytes of multiple of 4.
+	// Lines are padded to m_lineAlign and exposed as strided (h, w) array.
+	// Packed array is decoded with the smallest legal line bytes, and
+	// packImage() moves lines to its strides after decode.
+	py::array_t<uint8_t> allocateImage(int w, int h, int& lineBytes)
+	{
+		const int lineAlign = m_lineAlign;
+		lineBytes = decodePitch(w, lineAlign);
+		int stride = lineAlign == PACKED_LINE_ALIGN ? w : lineBytes;
+		size_t align = std::max(lineAlign, 16);
+		void* p = _aligned_malloc((size_t)lineBytes * std::max(h, 1), align);
+		if (!p) {
+			throw(WrapperException("bad memory allocation"));
+		}
+
+		py::capsule owner(p, [](void* f) { _aligned_free(f); });
+		return py::array_t<uint8_t>({ h, w }, { stride, 1 }, (uint8_t*)p, owner);
+	}
+
+	static int decodePitch(int w, int lineAlign)
+	{
+		return ALIGN(std::max(w, 1), std::max(lineAlign, 4));
+	}
+
+	static void packImage(py::array_t<uint8_t>& buf, int lineBytes)
+	{
+		packLines(buf.mutable_data(), (int)buf.shape(1), (int)buf.shape(0), lineBytes, (int)buf.strides(0));
+	}
+
+	// Lines only move up, so they are packed in place from the top.
+	static void packLines(uint8_t* p, int w, int h, int lineBytes, int stride)
+	{
+		if (stride == lineBytes) {
+			return;
+		}
+		for (int y = 1; y < h; ++y) {
+			memmove(p + (size_t)stride * y, p + (size_t)lineBytes * y, w);
+		}
+	}
+
+	// Tile origin is multiple of 8 from (x, y), so SDK validates each tile
+	// same as whole roi.
+	void decodeTiles(uint8_t* src, uint8_t* dst, int x, int y, int w, int h, int lb)
+	{
+		const int tileWidth = m_tileWidth;
+		const int tileHeight = m_tileHeight;
+		auto table = quantize();
+		PUSHORT q = (PUSHORT)table->data();
+
+		std::atomic<int> error(PUC_SUCCEEDED);
+		std::vector<std::function<void()>> tasks;
+		tasks.reserve(((w + tileWidth - 1) / tileWidth) * ((h + tileHeight - 1) / tileHeight));
+
+		for (int ty = 0; ty < h; ty += tileHeight)
+		{
+			for (int tx = 0; tx < w; tx += tileWidth)
+			{
+				int tw = std::min(tileWidth, w - tx);
+				int th = std::min(tileHeight, h - ty);
+				tasks.emplace_back([=, &error]()
+				{
+					auto ret = PUC_DecodeData(dst + (size_t)lb * ty + tx, x + tx, y + ty, tw, th, lb, src, q);
+					if (PUC_CHK_FAILED(ret)) {
+						int expected = PUC_SUCCEEDED;
+						error.compare_exchange_strong(expected, ret);
+					}
+				});
+			}
+		}
+
+		{
+			OptionalGilRelease release;
+			DecodePool::instance().run(tasks);
+		}
+
+		if (error != PUC_SUCCEEDED) {
+			throw(PUCException("PUC_DecodeData", (PUCRESULT)error.load()));
+		}
+	}
+
+	// Decode roi by 8 lines stripe on m_numThread threads.
+	// work(oy, rows, stripe, lineBytes) consumes each stripe of line oy from
+	// the top of roi while it is on cache. Stripes are decoded into dst if
+	// specified, otherwise into a buffer of each thread.
+	template<class F>
+	void decodeStripes(uint8_t* src, int x, int y, int w, int h, uint8_t* dst, int pitch, F&& work)
+	{
+		const int lineBytes = dst ? pitch : ALIGN(w, 4);
+		const int stripeCount = (h + STRIPE_HEIGHT - 1) / STRIPE_HEIGHT;
+		const int numThread = std::max(1, std::min<int>(m_numThread, stripeCount));
+		std::vector<PUCRESULT> results(numThread, PUC_SUCCEEDED);
+		auto table = quantize();
+		PUSHORT q = (PUSHORT)table->data();
+
+		auto loop = [&](int t)
+		{
+			std::vector<uint8_t> buffer(dst ? 0 : lineBytes * STRIPE_HEIGHT);
+
+			for (int s = t; s < stripeCount; s += numThread)
+			{
+				int oy = s * STRIPE_HEIGHT;
+				int rows = std::min(STRIPE_HEIGHT, h - oy);
+				uint8_t* stripe = dst ? dst + (size_t)pitch * oy : buffer.data();
+				auto ret = PUC_DecodeData(stripe, x, y + oy, w, rows, lineBytes, src, q);
+				if (PUC_CHK_FAILED(ret)) {
+					results[t] = ret;
+					return;
+				}
+				work(oy, rows, (const uint8_t*)stripe, lineBytes);
+			}
+		};
+
+		if (numThread == 1) {
+			loop(0);
+		}
+		else
+		{
+			std::vector<std::thread> threads;
+			for (int t = 0; t < numThread; ++t) {
+				threads.emplace_back(loop, t);
+			}
+			for (auto& th : threads) {
+				th.join();
+			}
+		}
+
+		for (auto ret : results) {
+			if (PUC_CHK_FAILED(ret)) {
+				throw(PUCException("PUC_DecodeData", ret));
+			}
+		}
+	}
+
+	py::array_t<uint8_t> decodeScaled(uint8_t* src, int w, int h, int scale, const std::string& mode)
+	{
+		if (scale != 2 && scale != 4 && scale != 8) {
+			throw(WrapperException("scale must be 2, 4 or 8."));
+		}
+		if (mode != "box" && mode != "subsample") {
+			throw(WrapperException("mode must be 'box' or 'subsample'."));
+		}
+
+		int ow = w / scale;
+		int oh = h / scale;
+		int pitch;
+		py::array_t<uint8_t> buf = allocateImage(ow, oh, pitch);
+		uint8_t* dst = buf.mutable_data();
+		if (ow <= 0 || oh <= 0) {
+			return buf;
+		}
+
+		const bool box = (mode == "box");
+		decodeStripes(src, 0, 0, w, oh * scale, nullptr, 0, [&](int y, int rows, const uint8_t* stripe, int lineBytes)
+		{
+			std::vector<uint16_t> colsum(lineBytes);
+			for (int r = 0; r + scale <= rows && (y + r) / scale < oh; r += scale)
+			{
+				uint8_t* line = dst + (size_t)pitch * ((y + r) / scale);
+				if (box)
+					boxReduceLine(stripe + lineBytes * r, lineBytes, scale, colsum.data(), line, ow);
+				else
+					subsampleLine(stripe + lineBytes * r, scale, line, ow);
+			}
+		});
+		packImage(buf, pitch);
+		return buf;
+	}
+
+	// Stripes are written to the output layout directly, so neither gray
+	// image nor per channel copy is created.
+	py::array decodeTensor(uint8_t* src, int w, int h, const std::string& layout, int channels, float mean, float stddev)
+	{
+		if (layout != "HWC" && layout != "NCHW") {
+			throw(WrapperException("layout must be 'HWC' or 'NCHW'."));
+		}
+		if (channels != 1 && channels != 3) {
+			throw(WrapperException("channels must be 1 or 3."));
+		}
+		if (stddev == 0.0f) {
+			throw(WrapperException("std may be illegal."));
+		}
+
+		if (layout == "HWC")
+		{
+			py::array_t<uint8_t> buf({ h, w, channels });
+			uint8_t* dst = buf.mutable_data();
+			decodeStripes(src, 0, 0, w, h, nullptr, 0, [&](int y, int rows, const uint8_t* stripe, int lineBytes)
+			{
+				for (int r = 0; r < rows; ++r) {
+					replicateLine(stripe + lineBytes * r, dst + (size_t)w * channels * (y + r), w, channels);
+				}
+			});
+			return std::move(buf);
+		}
+
+		float lut[256];
+		for (int i = 0; i < 256; ++i) {
+			lut[i] = (i / 255.0f - mean) / stddev;
+		}
+
+		py::array_t<float> buf({ 1, channels, h, w });
+		float* dst = buf.mutable_data();
+		const size_t plane = (size_t)w * h;
+		decodeStripes(src, 0, 0, w, h, nullptr, 0, [&](int y, int rows, const uint8_t* stripe, int lineBytes)
+		{
+			for (int r = 0; r < rows; ++r)
+			{
+				float* line = dst + (size_t)w * (y + r);
+				lookupLine(stripe + lineBytes * r, lut, line, w);
+				for (int c = 1; c < channels; ++c) {
+					memcpy(line + plane * c, line, sizeof(float) * w);
+				}
+			}
+		});
+		return std::move(buf);
+	}
+
+	// Histogram is counted from each stripe while it is on cache. Image is
+	// written out only if dst is specified.
+	FrameStats decodeStats(uint8_t* src, int x, int y, int w, int h, uint8_t* dst, int pitch)
+	{
+		HistogramAccumulator hist;
+		decodeStripes(src, x, y, w, h, dst, pitch, [&](int oy, int rows, const uint8_t* stripe, int lineBytes)
+		{
+			HistogramAccumulator::Bins bins;
+			for (int r = 0; r < rows; ++r) {
+				bins.addLine(stripe + lineBytes * r, w);
+			}
+			hist.merge(bins);
+		});
+		return hist.stats();
+	}
+
+	// Each thread decodes a contiguous run of stripes into a ring of 3
+	// stripes, and demosaics stripe s once stripe s + 1 is decoded. Only
+	// the stripes next to each run are decoded twice.
+	py::array_t<uint8_t> decodeColor(uint8_t* src, int w, int h, const Demosaic& demosaic)
+	{
+		if (w < 4 || h < 4) {
+			throw(WrapperException("resolution may be illegal."));
+		}
+
+		py::array_t<uint8_t> buf = demosaic.planar() ?
+			py::array_t<uint8_t>({ 3, h, w }) : py::array_t<uint8_t>({ h, w, 3 });
+		uint8_t* dst = buf.mutable_data();
+		const size_t plane = (size_t)w * h;
+		const size_t dstLine = demosaic.planar() ? (size_t)w : (size_t)w * 3;
+
+		// origin of each line is 4 bytes aligned after left padding
+		const int origin = ALIGN(Demosaic::PAD, 4);
+		const int lineBytes = ALIGN(origin + w + Demosaic::PAD, 4);
+		const size_t slotBytes = (size_t)lineBytes * STRIPE_HEIGHT;
+		const int stripeCount = (h + STRIPE_HEIGHT - 1) / STRIPE_HEIGHT;
+		const int numThread = std::max(1, std::min<int>(m_numThread, stripeCount));
+		std::vector<PUCRESULT> results(numThread, PUC_SUCCEEDED);
+		auto table = quantize();
+		PUSHORT q = (PUSHORT)table->data();
+
+		auto loop = [&](int t)
+		{
+			std::vector<uint8_t> ring(slotBytes * 3);
+			Demosaic::Lines lines(w);
+
+			auto decodeStripe = [&](int s)
+			{
+				if (s < 0 || s >= stripeCount) {
+					return (PUCRESULT)PUC_SUCCEEDED;
+				}
+				int oy = s * STRIPE_HEIGHT;
+				int rows = std::min(STRIPE_HEIGHT, h - oy);
+				uint8_t* slot = ring.data() + slotBytes * (s % 3) + origin;
+				auto ret = PUC_DecodeData(slot, 0, oy, w, rows, lineBytes, src, q);
+				if (!PUC_CHK_FAILED(ret))
+				{
+					for (int r = 0; r < rows; ++r) {
+						Demosaic::padLine(slot + (size_t)lineBytes * r, w);
+					}
+				}
+				return ret;
+			};
+			auto line = [&](int y)
+			{
+				y = y < 0 ? -y : (y >= h ? 2 * h - 2 - y : y);
+				return (const uint8_t*)ring.data() + slotBytes * ((y / STRIPE_HEIGHT) % 3) + (size_t)lineBytes * (y % STRIPE_HEIGHT) + origin;
+			};
+
+			const int first = stripeCount * t / numThread;
+			const int last = stripeCount * (t + 1) / numThread;
+			PUCRESULT ret = decodeStripe(first - 1);
+			if (!PUC_CHK_FAILED(ret)) {
+				ret = decodeStripe(first);
+			}
+			for (int s = first; s < last && !PUC_CHK_FAILED(ret); ++s)
+			{
+				ret = decodeStripe(s + 1);
+				if (PUC_CHK_FAILED(ret)) {
+					break;
+				}
+				int oy = s * STRIPE_HEIGHT;
+				int end = std::min(oy + STRIPE_HEIGHT, h);
+				for (int y = oy; y < end; ++y)
+				{
+					const uint8_t* rows[5] = { line(y - 2), line(y - 1), line(y), line(y + 1), line(y + 2) };
+					demosaic.line(rows, y, w, lines, dst + dstLine * y, plane);
+				}
+			}
+			results[t] = ret;
+		};
+
+		if (numThread == 1) {
+			loop(0);
+		}
+		else
+		{
+			std::vector<std::thread> threads;
+			for (int t = 0; t < numThread; ++t) {
+				threads.emplace_back(loop, t);
+			}
+			for (auto& th : threads) {
+				th.join();
+			}
+		}
+
+		for (auto ret : results) {
+			if (PUC_CHK_FAILED(ret)) {
+				throw(PUCException("PUC_DecodeData", ret));
+			}
+		}
+		return buf;
+	}
+
+	py::array_t<uint8_t> decodeTemporal(uint8_t* src, int w, int h, TemporalProcessor& processor, const std::string& op, int threshold)
+	{
+		TemporalProcessor::Op type;
+		if (op == "background")
+			type = TemporalProcessor::Op::BACKGROUND;
+		else if (op == "difference")
+			type = TemporalProcessor::Op::DIFFERENCE;
+		else if (op == "accumulate")
+			type = TemporalProcessor::Op::ACCUMULATE;
+		else
+			throw(WrapperException("op must be 'background', 'difference' or 'accumulate'."));
+
+		if (w != processor.width() || h != processor.height()) {
+			throw(WrapperException("resolution may be illegal."));
+		}
+
+		return processor.apply(type, [&](const TemporalProcessor::LineFn& line)
+		{
+			decodeStripes(src, 0, 0, w, h, nullptr, 0, line);
+		}, threshold);
+	}
+
+	py::tuple decodeWithStats(uint8_t* src, int x, int y, int w, int h)
+	{
+		int pitch;
+		py::array_t<uint8_t> buf = allocateImage(w, h, pitch);
+		FrameStats stats = decodeStats(src, x, y, w, h, buf.mutable_data(), pitch);
+		packImage(buf, pitch);
+		return py::make_tuple(buf, stats);
+	}
+
 	void decodeDC(uint8_t* src, uint8_t* dst, int bx, int by, int countX, int countY)
 	{
 		auto ret = PUC_DecodeDCData(dst, bx, by, countX, countY, src);
@@ -489,7 +1365,34 @@ private:
 		}
 	}
 
-	unsigned short m_quantize[PUC_Q_COUNT];
-	int m_numThread;
+	static constexpr int STRIPE_HEIGHT = 8;
+	static constexpr int PACKED_LINE_ALIGN = 1;
+	static constexpr int DEFAULT_LINE_ALIGN = PACKED_LINE_ALIGN;
+	static constexpr int DEFAULT_TILE_WIDTH = 256;
+	static constexpr int DEFAULT_TILE_HEIGHT = 64;
+
+	using Quantization = std::array<unsigned short, PUC_Q_COUNT>;
+
+	// Each decode reads settings once and keeps the quantization table it
+	// started with, so settings can be changed while other threads decode.
+	std::shared_ptr<const Quantization> quantize() const
+	{
+		return std::atomic_load(&m_quantize);
+	}
+
+	PUC_GPU_SETUP_PARAM gpuParam()
+	{
+		std::lock_guard<std::mutex> lock(m_gpuMutex);
+		return m_param;
+	}
+
+	std::atomic<int> m_numThread;
+	std::atomic<int> m_lineAlign;
+	std::atomic<bool> m_tileDecode;
+	std::atomic<int> m_tileWidth;
+	std::atomic<int> m_tileHeight;
+	std::shared_ptr<const Quantization> m_quantize;
+	std::mutex m_gpuMutex;
 	PUC_GPU_SETUP_PARAM m_param;
+	std::shared_ptr<ImagePool> m_pool;
 };
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include "Common.h"
+#include "Exception.h"
+#include "Kernel.h"
+
+// Bayer demosaic of one line at a time from 5 lines around it, so Decoder
+// can demosaic each stripe right after it is decoded. Each method computes
+// candidates of the whole line, which are picked by CFA phase of x:
+//
+//   h : color at G site from left and right
+//   v : color at G site from above and below
+//   x : G at R or B site
+//   d : B at R site or R at B site
+class Demosaic
+{
+public:
+	enum class Method
+	{
+		BILINEAR,
+		EDGE,
+	};
+
+	enum class Output
+	{
+		RGB,
+		BGR,
+		YUV,
+	};
+
+	// Lines are read from x - PAD to x + w - 1 + PAD.
+	static constexpr int PAD = 2;
+
+	// Work lines of one thread
+	struct Lines
+	{
+		Lines(int w)
+			: h(w), v(w), x(w), d(w), r(w), g(w), b(w) {}
+
+		std::vector<uint8_t> h, v, x, d;
+		std::vector<uint8_t> r, g, b;
+	};
+
+	Demosaic(const std::string& pattern, const std::string& method, const std::string& output, const std::vector<float>& wb)
+	{
+		if (pattern != "RGGB" && pattern != "BGGR" && pattern != "GRBG" && pattern != "GBRG") {
+			throw(WrapperException("pattern must be 'RGGB', 'BGGR', 'GRBG' or 'GBRG'."));
+		}
+		for (int i = 0; i < 4; ++i) {
+			m_color[i / 2][i % 2] = pattern[i];
+		}
+
+		if (method == "bilinear")
+			m_method = Method::BILINEAR;
+		else if (method == "edge")
+			m_method = Method::EDGE;
+		else
+			throw(WrapperException("method must be 'bilinear' or 'edge'."));
+
+		if (output == "RGB")
+			m_output = Output::RGB;
+		else if (output == "BGR")
+			m_output = Output::BGR;
+		else if (output == "YUV")
+			m_output = Output::YUV;
+		else
+			throw(WrapperException("output must be 'RGB', 'BGR' or 'YUV'."));
+
+		if (wb.size() != 3 || wb[0] < 0 || wb[1] < 0 || wb[2] < 0) {
+			throw(WrapperException("white balance may be illegal."));
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int i = 0; i < 256; ++i) {
+				m_lut[c][i] = (uint8_t)std::min(255.0f, std::floor(i * wb[c] + 0.5f));
+			}
+		}
+	}
+
+	bool planar() const { return m_output == Output::YUV; }
+
+	// Reflect line without repeating the edge pixel, which keeps CFA phase.
+	static void padLine(uint8_t* line, int w)
+	{
+		for (int i = 1; i <= PAD; ++i)
+		{
+			line[-i] = line[i];
+			line[w - 1 + i] = line[w - 1 - i];
+		}
+	}
+
+	// rows are lines y - 2 to y + 2. dst is interleaved line of RGB or BGR,
+	// or Y line of YUV planes separated by plane bytes.
+	void line(const uint8_t* const rows[5], int y, int w, Lines& t, uint8_t* dst, size_t plane) const
+	{
+		if (m_method == Method::BILINEAR)
+			bilinear(rows, w, t);
+		else
+			edge(rows, w, t);
+
+		// phase of R or B site in this line
+		const char* color = m_color[y & 1];
+		const int phase = color[0] == 'G' ? 1 : 0;
+		const char site = color[phase];
+
+		uint8_t* own = site == 'R' ? t.r.data() : t.b.data();
+		uint8_t* other = site == 'R' ? t.b.data() : t.r.data();
+		blendParityLine(rows[2], t.h.data(), phase, own, w);
+		blendParityLine(t.x.data(), rows[2], phase, t.g.data(), w);
+		blendParityLine(t.d.data(), t.v.data(), phase, other, w);
+
+		write(t, w, dst, plane);
+	}
+
+private:
+	static void bilinear(const uint8_t* const rows[5], int w, Lines& t)
+	{
+		const uint8_t* m1 = rows[1];
+		const uint8_t* c0 = rows[2];
+		const uint8_t* p1 = rows[3];
+		avg2Line(c0 - 1, c0 + 1, t.h.data(), w);
+		avg2Line(m1, p1, t.v.data(), w);
+		avg4Line(c0 - 1, c0 + 1, m1, p1, t.x.data(), w);
+		avg4Line(m1 - 1, m1 + 1, p1 - 1, p1 + 1, t.d.data(), w);
+	}
+
+	// Green is interpolated along the direction of smaller gradient
+	// (Hamilton-Adams), other colors by gradient corrected kernels of
+	// Malvar-He-Cutler.
+	static void edge(const uint8_t* const rows[5], int w, Lines& t)
+	{
+		const uint8_t* m2 = rows[0];
+		const uint8_t* m1 = rows[1];
+		const uint8_t* c0 = rows[2];
+		const uint8_t* p1 = rows[3];
+		const uint8_t* p2 = rows[4];
+
+		for (int x = 0; x < w; ++x)
+		{
+			const int c = c0[x];
+			const int l = c0[x - 1], r = c0[x + 1], ll = c0[x - 2], rr = c0[x + 2];
+			const int u = m1[x], d = p1[x], uu = m2[x], dd = p2[x];
+			const int diag = m1[x - 1] + m1[x + 1] + p1[x - 1] + p1[x + 1];
+
+			t.h[x] = clip((10 * c + 8 * (l + r) - 2 * (ll + rr) - 2 * diag + uu + dd + 8) >> 4);
+			t.v[x] = clip((10 * c + 8 * (u + d) - 2 * (uu + dd) - 2 * diag + ll + rr + 8) >> 4);
+			t.d[x] = clip((12 * c + 4 * diag - 3 * (ll + rr + uu + dd) + 8) >> 4);
+
+			const int lh = 2 * c - ll - rr;
+			const int lv = 2 * c - uu - dd;
+			const int dh = std::abs(l - r) + std::abs(lh);
+			const int dv = std::abs(u - d) + std::abs(lv);
+			const int gh = 2 * (l + r) + lh;
+			const int gv = 2 * (u + d) + lv;
+			const int g = dh < dv ? gh : (dv < dh ? gv : (gh + gv) >> 1);
+			t.x[x] = clip((g + 2) >> 2);
+		}
+	}
+
+	// White balance and output. YUV is BT.601 full range (JFIF).
+	void write(const Lines& t, int w, uint8_t* dst, size_t plane) const
+	{
+		const uint8_t* lr = m_lut[0];
+		const uint8_t* lg = m_lut[1];
+		const uint8_t* lb = m_lut[2];
+
+		switch (m_output)
+		{
+		case Output::RGB:
+			for (int x = 0; x < w; ++x)
+			{
+				dst[x * 3 + 0] = lr[t.r[x]];
+				dst[x * 3 + 1] = lg[t.g[x]];
+				dst[x * 3 + 2] = lb[t.b[x]];
+			}
+			break;
+		case Output::BGR:
+			for (int x = 0; x < w; ++x)
+			{
+				dst[x * 3 + 0] = lb[t.b[x]];
+				dst[x * 3 + 1] = lg[t.g[x]];
+				dst[x * 3 + 2] = lr[t.r[x]];
+			}
+			break;
+		case Output::YUV:
+			for (int x = 0; x < w; ++x)
+			{
+				const int r = lr[t.r[x]], g = lg[t.g[x]], b = lb[t.b[x]];
+				dst[x] = (uint8_t)((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+				dst[plane + x] = clip(((-11059 * r - 21709 * g + 32768 * b + 32768) >> 16) + 128);
+				dst[plane * 2 + x] = clip(((32768 * r - 27439 * g - 5329 * b + 32768) >> 16) + 128);
+			}
+			break;
+		}
+	}
+
+	static uint8_t clip(int v)
+	{
+		return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+	}
+
+	char m_color[2][2];
+	Method m_method;
+	Output m_output;
+	uint8_t m_lut[3][256];
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include "Common.h"
+#include "Exception.h"
+
+class FrameArena
+{
+public:
+	FrameArena(size_t slotSize, size_t slotCount, bool lock = false)
+		:
+		m_base(nullptr),
+		m_regionSize(0),
+		m_slotSize(0),
+		m_slotCount(slotCount),
+		m_largePage(false),
+		m_locked(false)
+	{
+		if (slotSize == 0 || slotCount == 0) {
+			throw(WrapperException("frame arena size may be illegal."));
+		}
+
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		m_slotSize = alignSize(slotSize, info.dwPageSize);
+
+		// 2MB pages need SeLockMemoryPrivilege. They are always resident,
+		// so there is nothing to pre-fault or lock afterwards.
+		size_t largePageSize = GetLargePageMinimum();
+		if (largePageSize > 0 && enableLockMemoryPrivilege())
+		{
+			m_regionSize = alignSize(m_slotSize * m_slotCount, largePageSize);
+			m_base = (uint8_t*)VirtualAlloc(nullptr, m_regionSize,
+				MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			m_largePage = (m_base != nullptr);
+		}
+
+		if (!m_base)
+		{
+			m_regionSize = m_slotSize * m_slotCount;
+			m_base = (uint8_t*)VirtualAlloc(nullptr, m_regionSize,
+				MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (!m_base) {
+				throw(WrapperException("bad memory allocation"));
+			}
+			prefault(info.dwPageSize);
+
+			if (lock) {
+				m_locked = lockRegion();
+			}
+		}
+
+		m_freeSlots.reserve(m_slotCount);
+		for (size_t i = m_slotCount; i > 0; --i) {
+			m_freeSlots.push_back(m_base + m_slotSize * (i - 1));
+		}
+	}
+	~FrameArena()
+	{
+		if (m_base != nullptr)
+		{
+			if (m_locked) {
+				VirtualUnlock(m_base, m_regionSize);
+			}
+			VirtualFree(m_base, 0, MEM_RELEASE);
+			m_base = nullptr;
+		}
+	}
+	FrameArena(const FrameArena& obj) = delete;
+	FrameArena& operator=(const FrameArena& obj) = delete;
+
+	// Returns nullptr when every slot is in use. Caller falls back to heap.
+	uint8_t* acquire()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_freeSlots.empty()) {
+			return nullptr;
+		}
+		uint8_t* p = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		return p;
+	}
+
+	void recycle(uint8_t* p)
+	{
+		if (!contains(p)) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freeSlots.push_back(p);
+	}
+
+	bool contains(const uint8_t* p) const
+	{
+		return p >= m_base && p < m_base + m_slotSize * m_slotCount;
+	}
+
+	size_t slotSize() const { return m_slotSize; }
+	size_t slotCount() const { return m_slotCount; }
+	bool isLargePage() const { return m_largePage; }
+	bool isLocked() const { return m_largePage || m_locked; }
+
+private:
+	static size_t alignSize(size_t x, size_t align)
+	{
+		return ((x + align - 1) / align) * align;
+	}
+
+	void prefault(size_t pageSize)
+	{
+		volatile uint8_t* p = m_base;
+		for (size_t offset = 0; offset < m_regionSize; offset += pageSize) {
+			p[offset] = 0;
+		}
+	}
+
+	bool lockRegion()
+	{
+		// VirtualLock is limited by the minimum working set size.
+		SIZE_T minSize, maxSize;
+		HANDLE process = GetCurrentProcess();
+		if (GetProcessWorkingSetSize(process, &minSize, &maxSize)) {
+			SetProcessWorkingSetSize(process, minSize + m_regionSize, maxSize + m_regionSize);
+		}
+		return VirtualLock(m_base, m_regionSize) != FALSE;
+	}
+
+	static bool enableLockMemoryPrivilege()
+	{
+		HANDLE token;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+			return false;
+		}
+
+		TOKEN_PRIVILEGES tp;
+		tp.PrivilegeCount = 1;
+		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		bool ret = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) &&
+			GetLastError() == ERROR_SUCCESS;
+
+		CloseHandle(token);
+		return ret;
+	}
+
+	uint8_t* m_base;
+	size_t m_regionSize;
+	size_t m_slotSize;
+	size_t m_slotCount;
+	bool m_largePage;
+	bool m_locked;
+	std::mutex m_mutex;
+	std::vector<uint8_t*> m_freeSlots;
+};
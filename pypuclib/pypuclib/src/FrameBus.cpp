@@ -0,0 +1,665 @@
+#include "FrameBus.h"
+#include "Camera.h"
+#include "Decoder.h"
+
+static constexpr int FRAME_BUS_ALIGN = 64;
+
+static bool isProcessAlive(uint32_t pid)
+{
+	HANDLE p = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	if (!p) {
+		return false;
+	}
+	bool alive = WaitForSingleObject(p, 0) == WAIT_TIMEOUT;
+	CloseHandle(p);
+	return alive;
+}
+
+static void closeEvent(HANDLE& h)
+{
+	if (h) {
+		CloseHandle(h);
+		h = nullptr;
+	}
+}
+
+
+std::wstring FrameBusMapping::objectName(const std::string& name, const std::string& suffix)
+{
+	std::string full = "Local\\pypuclib." + name + suffix;
+	int len = MultiByteToWideChar(CP_UTF8, 0, full.c_str(), -1, nullptr, 0);
+	std::vector<wchar_t> wname(len > 0 ? len : 1, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, full.c_str(), -1, wname.data(), len);
+	return std::wstring(wname.data());
+}
+
+FrameBusMapping::FrameBusMapping(const std::string& name, size_t size, bool create)
+	:
+	m_mapping(nullptr),
+	m_view(nullptr)
+{
+	auto wname = objectName(name, "");
+	if (create)
+	{
+		m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			(DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF), wname.c_str());
+		if (m_mapping && GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			CloseHandle(m_mapping);
+			throw(WrapperException("frame bus is already published: " + name));
+		}
+	}
+	else {
+		m_mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, wname.c_str());
+	}
+
+	if (!m_mapping) {
+		throw(WrapperException("couldn't open frame bus: " + name));
+	}
+
+	// size 0 maps whole of the existing mapping
+	m_view = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!m_view)
+	{
+		CloseHandle(m_mapping);
+		throw(WrapperException("couldn't map frame bus: " + name));
+	}
+}
+
+FrameBusMapping::~FrameBusMapping()
+{
+	UnmapViewOfFile(m_view);
+	CloseHandle(m_mapping);
+}
+
+
+FramePublisher::FramePublisher(const std::string& name, Camera* cam, int slotCount, bool decoded)
+	:
+	m_spaceEvent(nullptr),
+	m_numThread(std::max(1, (int)std::thread::hardware_concurrency())),
+	m_timeout(DEFAULT_LOSSLESS_TIMEOUT),
+	m_stalls(0)
+{
+	if (!cam) {
+		throw(WrapperException("camera is not specified."));
+	}
+
+	auto q = cam->decoder()->quantization();
+	unsigned short quantize[PUC_Q_COUNT];
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		quantize[i] = (unsigned short)q[i];
+	}
+
+	create(name, cam->resolution(), quantize, slotCount, decoded, cam->maxXferDataSize());
+}
+
+FramePublisher::FramePublisher(const std::string& name, const Resolution& res, const std::vector<int>& q,
+	int slotCount, bool decoded, int dataCapacity)
+	:
+	m_spaceEvent(nullptr),
+	m_numThread(std::max(1, (int)std::thread::hardware_concurrency())),
+	m_timeout(DEFAULT_LOSSLESS_TIMEOUT),
+	m_stalls(0)
+{
+	if (q.size() != PUC_Q_COUNT) {
+		throw(WrapperException("quantization may be illegal size."));
+	}
+
+	unsigned short quantize[PUC_Q_COUNT];
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		quantize[i] = (unsigned short)std::min(std::max(q[i], 0), (int)USHRT_MAX);
+	}
+
+	// compressed data doesn't exceed 8bit raw image
+	if (dataCapacity == 0) {
+		dataCapacity = res.width * res.height;
+	}
+	if (dataCapacity < 0) {
+		throw(WrapperException("data capacity may be illegal."));
+	}
+
+	create(name, res, quantize, slotCount, decoded, (uint32_t)dataCapacity);
+}
+
+FramePublisher::~FramePublisher()
+{
+	try
+	{
+		close();
+	}
+	catch (WrapperException&)
+	{
+		// do nothing
+	}
+}
+
+void FramePublisher::create(const std::string& name, const Resolution& res, const unsigned short* q,
+	int slotCount, bool decoded, uint32_t dataCapacity)
+{
+	for (auto& e : m_events) {
+		e = nullptr;
+	}
+
+	if (name.empty()) {
+		throw(WrapperException("frame bus name may be illegal."));
+	}
+	if (slotCount < 2 || slotCount > MAX_SLOT_COUNT) {
+		throw(WrapperException("slot count may be illegal."));
+	}
+	if (res.width <= 0 || res.height <= 0) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+
+	uint32_t lineBytes = ALIGN(res.width, 4);
+	uint64_t dataBytes = ALIGN(dataCapacity, FRAME_BUS_ALIGN);
+	uint64_t imageBytes = decoded ? ALIGN(lineBytes * res.height, FRAME_BUS_ALIGN) : 0;
+	uint64_t stride = sizeof(FrameBusSlot) + dataBytes + imageBytes;
+	if (stride > UINT_MAX) {
+		throw(WrapperException("data capacity may be illegal."));
+	}
+
+	m_name = name;
+	m_map = std::make_shared<FrameBusMapping>(name,
+		sizeof(FrameBusHeader) + (size_t)stride * slotCount, true);
+
+	// new mapping is zero filled, so every reader entry is free
+	auto h = m_map->header();
+	h->version = FRAME_BUS_VERSION;
+	h->headerSize = sizeof(FrameBusHeader);
+	h->slotCount = slotCount;
+	h->slotStride = (uint32_t)stride;
+	h->dataCapacity = dataCapacity;
+	h->imageOffset = decoded ? (uint32_t)(sizeof(FrameBusSlot) + dataBytes) : 0;
+	h->imageLineBytes = decoded ? lineBytes : 0;
+	h->width = res.width;
+	h->height = res.height;
+	h->publisherPid = GetCurrentProcessId();
+	memcpy(h->quantization, q, sizeof(h->quantization));
+
+	for (int i = 0; i < FRAME_BUS_MAX_READERS; ++i)
+	{
+		m_events[i] = CreateEventW(nullptr, FALSE, FALSE,
+			FrameBusMapping::objectName(name, "." + std::to_string(i)).c_str());
+	}
+	m_spaceEvent = CreateEventW(nullptr, FALSE, FALSE,
+		FrameBusMapping::objectName(name, ".space").c_str());
+
+	for (auto& e : m_events)
+	{
+		if (!e || !m_spaceEvent)
+		{
+			close();
+			throw(WrapperException("couldn't create event of frame bus: " + name));
+		}
+	}
+
+	// subscribers accept the mapping after magic is written
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(h->magic, FRAME_BUS_MAGIC, sizeof(h->magic));
+}
+
+void FramePublisher::publish(XferData* data)
+{
+	if (!data) {
+		throw(WrapperException("xferdata is not specified."));
+	}
+
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	checkOpen();
+
+	auto res = data->resolution();
+	auto h = m_map->header();
+	if (res.width != (int)h->width || res.height != (int)h->height) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+	if (data->dataSize() > h->dataCapacity) {
+		throw(WrapperException("data size may be illegal."));
+	}
+	write(data->dataInfo()->pData, data->dataSize(), data->sequenceNo());
+}
+
+void FramePublisher::publish(py::array_t<uint8_t>& array, int sequenceNo)
+{
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	checkOpen();
+
+	if ((uint64_t)array.size() > m_map->header()->dataCapacity) {
+		throw(WrapperException("data size may be illegal."));
+	}
+	write(array.data(), (uint32_t)array.size(), (uint16_t)sequenceNo);
+}
+
+bool FramePublisher::publish(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_map) {
+		return false;
+	}
+
+	auto h = m_map->header();
+	if (res.width != (int)h->width || res.height != (int)h->height || info->nDataSize > h->dataCapacity) {
+		return false;
+	}
+	write(info->pData, info->nDataSize, info->nSequenceNo);
+	return true;
+}
+
+void FramePublisher::setLosslessTimeout(int timeout)
+{
+	if (timeout < 0) {
+		throw(WrapperException("timeout may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_timeout = timeout;
+}
+
+void FramePublisher::close()
+{
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_map)
+	{
+		m_map->header()->closed.store(1, std::memory_order_release);
+		for (auto& e : m_events)
+		{
+			if (e) {
+				SetEvent(e);
+			}
+		}
+	}
+
+	for (auto& e : m_events) {
+		closeEvent(e);
+	}
+	closeEvent(m_spaceEvent);
+
+	// subscribers keep the mapping alive until they close
+	m_map.reset();
+}
+
+uint64_t FramePublisher::frameCount() const
+{
+	checkOpen();
+	return m_map->header()->writeSeq.load(std::memory_order_acquire);
+}
+
+std::vector<std::tuple<uint32_t, bool, uint64_t, uint64_t>> FramePublisher::readers() const
+{
+	checkOpen();
+
+	std::vector<std::tuple<uint32_t, bool, uint64_t, uint64_t>> list;
+	auto h = m_map->header();
+	uint64_t w = h->writeSeq.load(std::memory_order_acquire);
+	for (auto& r : h->readers)
+	{
+		auto state = r.state.load(std::memory_order_acquire);
+		if (state != FRAME_BUS_LOSSY && state != FRAME_BUS_LOSSLESS) {
+			continue;
+		}
+		uint64_t next = r.next.load(std::memory_order_relaxed);
+		list.emplace_back(r.pid, state == FRAME_BUS_LOSSLESS, w > next ? w - next : 0,
+			r.dropped.load(std::memory_order_relaxed));
+	}
+	return list;
+}
+
+// Caller holds m_mutex, so frames are written by one thread at a time.
+void FramePublisher::write(const uint8_t* src, uint32_t size, uint16_t seqNo)
+{
+	auto h = m_map->header();
+	uint64_t n = h->writeSeq.load(std::memory_order_relaxed);
+	if (!waitLossless(n)) {
+		m_stalls.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	auto s = m_map->slot(n);
+	s->seq.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	memcpy(m_map->data(s), src, size);
+	s->dataSize = size;
+	s->sequenceNo = seqNo;
+	if (h->imageOffset != 0)
+	{
+		auto ret = PUC_DecodeDataMultiThread(m_map->image(s), 0, 0, h->width, h->height,
+			h->imageLineBytes, (uint8_t*)src, h->quantization, m_numThread);
+		s->imageValid = PUC_CHK_FAILED(ret) ? 0 : 1;
+	}
+
+	s->seq.store(2 * n + 2, std::memory_order_release);
+	h->writeSeq.store(n + 1, std::memory_order_release);
+
+	for (int i = 0; i < FRAME_BUS_MAX_READERS; ++i)
+	{
+		if (h->readers[i].state.load(std::memory_order_relaxed) != FRAME_BUS_FREE) {
+			SetEvent(m_events[i]);
+		}
+	}
+}
+
+// Slot of frame n still holds frame n - slotCount. Wait until every lossless
+// reader has moved past it, up to the timeout. Readers signal the space event
+// while the waiting flag is set, and short waits cover a signal missed
+// between the check and the wait.
+bool FramePublisher::waitLossless(uint64_t n)
+{
+	auto h = m_map->header();
+	if (n < h->slotCount) {
+		return true;
+	}
+	uint64_t overwritten = n - h->slotCount;
+
+	auto blocking = [&]() {
+		for (int i = 0; i < FRAME_BUS_MAX_READERS; ++i)
+		{
+			auto& r = h->readers[i];
+			if (r.state.load(std::memory_order_acquire) == FRAME_BUS_LOSSLESS &&
+				r.held.load(std::memory_order_acquire) <= overwritten) {
+				return i;
+			}
+		}
+		return -1;
+	};
+
+	if (blocking() < 0) {
+		return true;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeout);
+	h->waiting.store(1, std::memory_order_seq_cst);
+	bool ok = true;
+	int i;
+	while ((i = blocking()) >= 0)
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			// reader process may have exited without detaching
+			auto& r = h->readers[i];
+			if (!isProcessAlive(r.pid)) {
+				r.state.store(FRAME_BUS_FREE, std::memory_order_release);
+				continue;
+			}
+			ok = false;
+			break;
+		}
+		WaitForSingleObject(m_spaceEvent, 1);
+	}
+	h->waiting.store(0, std::memory_order_relaxed);
+	return ok;
+}
+
+void FramePublisher::checkOpen() const
+{
+	if (!m_map) {
+		throw(WrapperException("frame bus is closed."));
+	}
+}
+
+
+FrameSubscriber::FrameSubscriber(const std::string& name, bool lossless, bool decoded)
+	:
+	m_entry(nullptr),
+	m_event(nullptr),
+	m_spaceEvent(nullptr),
+	m_lossless(lossless),
+	m_decoded(decoded),
+	m_next(0),
+	m_last(nullptr),
+	m_imageValid(false)
+{
+	m_map = std::make_shared<FrameBusMapping>(name, 0, false);
+
+	auto h = m_map->header();
+	if (memcmp(h->magic, FRAME_BUS_MAGIC, sizeof(h->magic)) != 0 || h->version != FRAME_BUS_VERSION) {
+		throw(WrapperException("not a frame bus: " + name));
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (decoded && h->imageOffset == 0) {
+		throw(WrapperException("decoded frame is not published."));
+	}
+	m_resolution = Resolution(h->width, h->height);
+	m_quantization.assign(std::begin(h->quantization), std::end(h->quantization));
+
+	int index = -1;
+	for (int i = 0; i < FRAME_BUS_MAX_READERS && index < 0; ++i)
+	{
+		uint32_t expected = FRAME_BUS_FREE;
+		if (h->readers[i].state.compare_exchange_strong(expected, FRAME_BUS_CLAIMING)) {
+			index = i;
+		}
+	}
+	if (index < 0) {
+		throw(WrapperException("too many subscribers of frame bus: " + name));
+	}
+
+	// entry is invisible to the publisher until the state is set
+	m_entry = &h->readers[index];
+	m_next = h->writeSeq.load(std::memory_order_acquire);
+	m_entry->pid = GetCurrentProcessId();
+	m_entry->next.store(m_next, std::memory_order_relaxed);
+	m_entry->held.store(m_next, std::memory_order_relaxed);
+	m_entry->dropped.store(0, std::memory_order_relaxed);
+
+	m_event = OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE,
+		FrameBusMapping::objectName(name, "." + std::to_string(index)).c_str());
+	m_spaceEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE,
+		FrameBusMapping::objectName(name, ".space").c_str());
+	if (!m_event || !m_spaceEvent)
+	{
+		close();
+		throw(WrapperException("couldn't open event of frame bus: " + name));
+	}
+
+	m_entry->state.store(lossless ? FRAME_BUS_LOSSLESS : FRAME_BUS_LOSSY, std::memory_order_release);
+}
+
+FrameSubscriber::~FrameSubscriber()
+{
+	close();
+}
+
+std::unique_ptr<XferData> FrameSubscriber::read(int timeout)
+{
+	checkOpen();
+
+	OptionalGilRelease release;
+
+	// frame returned last is given back to the publisher here
+	m_last = nullptr;
+	releaseHeld();
+
+	auto h = m_map->header();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout, 0));
+	while (true)
+	{
+		uint64_t w = h->writeSeq.load(std::memory_order_acquire);
+		if (m_next >= w)
+		{
+			if (h->closed.load(std::memory_order_acquire)) {
+				return nullptr;
+			}
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0) {
+				return nullptr;
+			}
+			WaitForSingleObject(m_event, (DWORD)remaining);
+			continue;
+		}
+
+		// lossless reader continues from the oldest frame still in the ring,
+		// lossy reader jumps to the latest one
+		uint64_t oldest = w > h->slotCount ? w - h->slotCount : 0;
+		uint64_t frame = m_lossless ? std::max(m_next, oldest) : w - 1;
+		m_entry->dropped.fetch_add(frame - m_next, std::memory_order_relaxed);
+
+		auto p = m_lossless ? referFrame(frame) : copyFrame(frame);
+		m_next = frame + 1;
+		m_entry->next.store(m_next, std::memory_order_relaxed);
+		if (p) {
+			return p;
+		}
+		m_entry->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Held frame is not overwritten while the publisher waits for this reader,
+// so returned data refers the slot directly. It keeps the mapping alive, so
+// the data read after close is stale but mapped.
+std::unique_ptr<XferData> FrameSubscriber::referFrame(uint64_t frame)
+{
+	m_entry->held.store(frame, std::memory_order_seq_cst);
+
+	auto s = m_map->slot(frame);
+	if (s->seq.load(std::memory_order_acquire) != 2 * frame + 2) {
+		return nullptr;
+	}
+
+	PUC_XFER_DATA_INFO info;
+	memset(&info, 0, sizeof(PUC_XFER_DATA_INFO));
+	info.pData = m_map->data(s);
+	info.nDataSize = s->dataSize;
+	info.nSequenceNo = s->sequenceNo;
+
+	m_last = s;
+	m_imageValid = m_decoded && s->imageValid;
+	return std::make_unique<XferData>(&info, m_resolution, m_map);
+}
+
+// Slot may be overwritten while it is copied. Copy is valid only if the
+// slot sequence is unchanged after the copy.
+std::unique_ptr<XferData> FrameSubscriber::copyFrame(uint64_t frame)
+{
+	auto h = m_map->header();
+	auto s = m_map->slot(frame);
+	uint64_t seq = s->seq.load(std::memory_order_acquire);
+	if (seq != 2 * frame + 2) {
+		return nullptr;
+	}
+
+	uint32_t size = std::min(s->dataSize, h->dataCapacity);
+	std::unique_ptr<XferData> p = std::make_unique<XferData>((int)size, m_resolution);
+	if (!p) {
+		throw(WrapperException("bad memory allocation"));
+	}
+
+	auto info = p->dataInfo();
+	memcpy(info->pData, m_map->data(s), size);
+	info->nDataSize = size;
+	info->nSequenceNo = s->sequenceNo;
+
+	bool imageValid = m_decoded && s->imageValid;
+	if (imageValid)
+	{
+		m_imageCopy.resize((size_t)h->imageLineBytes * h->height);
+		memcpy(m_imageCopy.data(), m_map->image(s), m_imageCopy.size());
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (s->seq.load(std::memory_order_relaxed) != seq) {
+		return nullptr;
+	}
+
+	m_last = s;
+	m_imageValid = imageValid;
+	return p;
+}
+
+void FrameSubscriber::releaseHeld()
+{
+	if (!m_lossless || !m_entry) {
+		return;
+	}
+
+	m_entry->held.store(m_next, std::memory_order_seq_cst);
+	if (m_map->header()->waiting.load(std::memory_order_seq_cst)) {
+		SetEvent(m_spaceEvent);
+	}
+}
+
+py::array_t<uint8_t> FrameSubscriber::image()
+{
+	checkOpen();
+	if (!m_decoded) {
+		throw(WrapperException("decoded frame is not subscribed."));
+	}
+	if (!m_last) {
+		throw(WrapperException("no frame is read."));
+	}
+	if (!m_imageValid) {
+		throw(WrapperException("decoded frame is broken."));
+	}
+
+	auto h = m_map->header();
+	int lineBytes = (int)h->imageLineBytes;
+	if (m_lossless)
+	{
+		// view keeps the mapping alive after close
+		auto keep = new std::shared_ptr<FrameBusMapping>(m_map);
+		py::capsule owner(keep, [](void* p) { delete (std::shared_ptr<FrameBusMapping>*)p; });
+		return py::array_t<uint8_t>({ m_resolution.height, m_resolution.width }, { lineBytes, 1 },
+			m_map->image(m_last), owner);
+	}
+
+	py::array_t<uint8_t> buf({ m_resolution.height, m_resolution.width });
+	for (int y = 0; y < m_resolution.height; ++y) {
+		memcpy(buf.mutable_data(y, 0), m_imageCopy.data() + (size_t)y * lineBytes, m_resolution.width);
+	}
+	return buf;
+}
+
+void FrameSubscriber::close()
+{
+	if (m_entry)
+	{
+		m_entry->state.store(FRAME_BUS_FREE, std::memory_order_release);
+		m_entry = nullptr;
+		if (m_spaceEvent) {
+			SetEvent(m_spaceEvent);
+		}
+	}
+	closeEvent(m_event);
+	closeEvent(m_spaceEvent);
+
+	m_last = nullptr;
+	m_map.reset();
+}
+
+uint64_t FrameSubscriber::lag() const
+{
+	checkOpen();
+	uint64_t w = m_map->header()->writeSeq.load(std::memory_order_acquire);
+	return w > m_next ? w - m_next : 0;
+}
+
+uint64_t FrameSubscriber::dropped() const
+{
+	checkOpen();
+	return m_entry->dropped.load(std::memory_order_relaxed);
+}
+
+std::unique_ptr<Decoder> FrameSubscriber::decoder()
+{
+	std::unique_ptr<Decoder> p =
+		std::make_unique<Decoder>(m_quantization);
+
+	if (!p) {
+		throw(WrapperException("bad memory allocation"));
+	}
+
+	return p;
+}
+
+void FrameSubscriber::checkOpen() const
+{
+	if (!m_map) {
+		throw(WrapperException("frame bus is closed."));
+	}
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+#include "XferData.h"
+
+namespace py = pybind11;
+
+class Camera;
+class Decoder;
+
+static constexpr char FRAME_BUS_MAGIC[8] = { 'P', 'U', 'C', 'B', 'U', 'S', '\0', '\0' };
+static constexpr uint32_t FRAME_BUS_VERSION = 1;
+static constexpr int FRAME_BUS_MAX_READERS = 16;
+static constexpr uint32_t FRAME_BUS_FREE = 0;
+static constexpr uint32_t FRAME_BUS_LOSSY = 1;
+static constexpr uint32_t FRAME_BUS_LOSSLESS = 2;
+static constexpr uint32_t FRAME_BUS_CLAIMING = 3;
+
+// Shared memory layout
+//   FrameBusHeader
+//   FrameBusSlot + compressed data + decoded image  (slotCount times)
+//
+// Frame n is written to slot n % slotCount. Slot sequence is 2n+1 while
+// frame n is written and 2n+2 when it is complete, so readers detect torn
+// or overwritten frames without a lock. Atomics in the mapping are lock
+// free and address free, so they work across processes.
+struct FrameBusReaderEntry
+{
+	std::atomic<uint32_t> state;    // FREE, LOSSY or LOSSLESS
+	uint32_t pid;
+	std::atomic<uint64_t> next;     // next frame to read
+	std::atomic<uint64_t> held;     // oldest frame still referred (lossless)
+	std::atomic<uint64_t> dropped;
+	uint8_t reserved[32];
+};
+static_assert(sizeof(FrameBusReaderEntry) == 64, "FrameBusReaderEntry must be 64 bytes");
+
+struct FrameBusHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t slotCount;
+	uint32_t slotStride;
+	uint32_t dataCapacity;
+	uint32_t imageOffset;           // 0 if decoded image is not published
+	uint32_t imageLineBytes;
+	uint32_t width;
+	uint32_t height;
+	uint32_t publisherPid;
+	uint16_t quantization[PUC_Q_COUNT];
+	uint8_t reserved0[64];
+	std::atomic<uint64_t> writeSeq; // number of frames published
+	std::atomic<uint32_t> closed;
+	std::atomic<uint32_t> waiting;  // publisher waits for lossless readers
+	uint8_t reserved1[64];
+	FrameBusReaderEntry readers[FRAME_BUS_MAX_READERS];
+};
+static_assert(sizeof(FrameBusHeader) == 1344, "FrameBusHeader must be 1344 bytes");
+
+struct FrameBusSlot
+{
+	std::atomic<uint64_t> seq;
+	uint32_t dataSize;
+	uint16_t sequenceNo;
+	uint8_t imageValid;
+	uint8_t reserved0;
+	uint8_t reserved1[48];
+};
+static_assert(sizeof(FrameBusSlot) == 64, "FrameBusSlot must be 64 bytes");
+
+// Named file mapping shared by publisher, subscribers and numpy views.
+class FrameBusMapping
+{
+public:
+	FrameBusMapping(const std::string& name, size_t size, bool create);
+	~FrameBusMapping();
+	FrameBusMapping(const FrameBusMapping& obj) = delete;
+	FrameBusMapping& operator=(const FrameBusMapping& obj) = delete;
+
+	FrameBusHeader* header() const { return (FrameBusHeader*)m_view; }
+	FrameBusSlot* slot(uint64_t frame) const
+	{
+		auto h = header();
+		return (FrameBusSlot*)(m_view + h->headerSize + (size_t)(frame % h->slotCount) * h->slotStride);
+	}
+	uint8_t* data(FrameBusSlot* s) const { return (uint8_t*)s + sizeof(FrameBusSlot); }
+	uint8_t* image(FrameBusSlot* s) const { return (uint8_t*)s + header()->imageOffset; }
+
+	static std::wstring objectName(const std::string& name, const std::string& suffix);
+
+private:
+	HANDLE m_mapping;
+	uint8_t* m_view;
+};
+
+class FramePublisher
+{
+public:
+	FramePublisher(const std::string& name, Camera* cam, int slotCount = 16, bool decoded = false);
+	FramePublisher(const std::string& name, const Resolution& res, const std::vector<int>& q,
+		int slotCount = 16, bool decoded = false, int dataCapacity = 0);
+	~FramePublisher();
+
+	PY_DOC(DOC_PUBLISH_A,
+	"\"\"Publish compressed data to the frame bus.     \n"
+	"                                                  \n"
+	"Data is copied to the next slot of shared memory  \n"
+	"ring. If the publisher was created with decoded,  \n"
+	"decoded image is also written to the slot.        \n"
+	"Publishing waits for lossless readers up to the   \n"
+	"timeout while the ring is full.                   \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to publish.                          \n"
+	"\"\"                                              \n");
+	void publish(XferData* data);
+
+	PY_DOC(DOC_PUBLISH_B,
+	"\"\"Publish compressed data to the frame bus.     \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"sequenceNo : int                                  \n"
+	"    Sequence number of the data.                  \n"
+	"\"\"                                              \n");
+	void publish(py::array_t<uint8_t>& array, int sequenceNo);
+
+	// Called on the transfer thread of the SDK, errors are not thrown.
+	bool publish(const PUC_XFER_DATA_INFO* info, const Resolution& res);
+
+	PY_DOC(DOC_SET_LOSSLESS_TIMEOUT,
+	"\"\"Set timeout of publish for lossless readers.  \n"
+	"                                                  \n"
+	"When a lossless reader doesn't release a slot in  \n"
+	"time, the frame is overwritten and counted as     \n"
+	"dropped for the reader.                           \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"timeout : int                                     \n"
+	"    Timeout [msec]. (default=100)                 \n"
+	"\"\"                                              \n");
+	void setLosslessTimeout(int timeout);
+
+	PY_DOC(DOC_PUBLISHER_CLOSE,
+	"\"\"Close the frame bus.                          \n"
+	"                                                  \n"
+	"Waiting subscribers are woken up and read None.   \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_PUBLISHER_NAME,
+	"\"\"Get name of the frame bus.                    \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"str                                               \n"
+	"    Name to attach subscribers.                   \n"
+	"\"\"                                              \n");
+	std::string name() const { return m_name; }
+
+	PY_DOC(DOC_PUBLISHER_FRAME_COUNT,
+	"\"\"Get number of frames published.               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	uint64_t frameCount() const;
+
+	PY_DOC(DOC_PUBLISHER_STALLS,
+	"\"\"Get number of publish timed out.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames published over lossless      \n"
+	"    readers after the timeout.                    \n"
+	"\"\"                                              \n");
+	uint64_t stalls() const { return m_stalls.load(std::memory_order_relaxed); }
+
+	PY_DOC(DOC_PUBLISHER_READERS,
+	"\"\"Get state of attached readers.                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"list((int, bool, int, int))                       \n"
+	"    (pid, lossless, lag, dropped) of each reader. \n"
+	"    lag is number of frames not read yet.         \n"
+	"\"\"                                              \n");
+	std::vector<std::tuple<uint32_t, bool, uint64_t, uint64_t>> readers() const;
+
+private:
+	void create(const std::string& name, const Resolution& res, const unsigned short* q,
+		int slotCount, bool decoded, uint32_t dataCapacity);
+	void write(const uint8_t* src, uint32_t size, uint16_t seq);
+	bool waitLossless(uint64_t frame);
+	void checkOpen() const;
+
+	static constexpr int MAX_SLOT_COUNT = 4096;
+	static constexpr int DEFAULT_LOSSLESS_TIMEOUT = 100;
+
+	std::string m_name;
+	std::shared_ptr<FrameBusMapping> m_map;
+	HANDLE m_events[FRAME_BUS_MAX_READERS];
+	HANDLE m_spaceEvent;
+	int m_numThread;
+	int m_timeout;
+	std::atomic<uint64_t> m_stalls;
+	std::mutex m_mutex;
+};
+
+class FrameSubscriber
+{
+public:
+	FrameSubscriber(const std::string& name, bool lossless = false, bool decoded = false);
+	~FrameSubscriber();
+
+	PY_DOC(DOC_SUBSCRIBER_READ,
+	"\"\"Read next frame from the frame bus.           \n"
+	"                                                  \n"
+	"Lossless reader reads every frame in order, and   \n"
+	"returned XferData refers shared memory without    \n"
+	"copy. It is valid until next read or close.       \n"
+	"Lossy reader skips to the latest frame when it    \n"
+	"falls behind, and returned XferData is a copy.    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"timeout : int                                     \n"
+	"    Timeout [msec]. (default=1000)                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"XferData obj                                      \n"
+	"    Frame read. None if timed out or closed.      \n"
+	"\"\"                                              \n");
+	std::unique_ptr<XferData> read(int timeout = 1000);
+
+	PY_DOC(DOC_SUBSCRIBER_IMAGE,
+	"\"\"Get decoded image of the frame read last.     \n"
+	"                                                  \n"
+	"Subscriber must be created with decoded. Lossless \n"
+	"reader gets a view of shared memory valid until   \n"
+	"next read, lossy reader gets a copy.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of the decompressed image.        \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> image();
+
+	PY_DOC(DOC_SUBSCRIBER_CLOSE,
+	"\"\"Detach from the frame bus.                    \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_SUBSCRIBER_LAG,
+	"\"\"Get number of frames published but not read.  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Lag [frames].                                 \n"
+	"\"\"                                              \n");
+	uint64_t lag() const;
+
+	PY_DOC(DOC_SUBSCRIBER_DROPPED,
+	"\"\"Get number of frames this reader missed.      \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames dropped.                     \n"
+	"\"\"                                              \n");
+	uint64_t dropped() const;
+
+	PY_DOC(DOC_SUBSCRIBER_RESOLUTION,
+	"\"\"Get resolution of published frames.           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Resolution obj                                    \n"
+	"    Resolution of published frames.               \n"
+	"\"\"                                              \n");
+	Resolution resolution() const { return m_resolution; }
+
+	PY_DOC(DOC_SUBSCRIBER_QUANTIZATION,
+	"\"\"Get quantization of published frames.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"list(int)                                         \n"
+	"    Quantization value list.                      \n"
+	"\"\"                                              \n");
+	std::vector<int> quantization() const { return m_quantization; }
+
+	PY_DOC(DOC_SUBSCRIBER_DECODER,
+	"\"\"Get Decoder obj for published frames.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Decoder obj                                       \n"
+	"    Decoder obj based on published quantization.  \n"
+	"\"\"                                              \n");
+	std::unique_ptr<Decoder> decoder();
+
+private:
+	std::unique_ptr<XferData> referFrame(uint64_t frame);
+	std::unique_ptr<XferData> copyFrame(uint64_t frame);
+	void releaseHeld();
+	void checkOpen() const;
+
+	std::shared_ptr<FrameBusMapping> m_map;
+	FrameBusReaderEntry* m_entry;
+	HANDLE m_event;
+	HANDLE m_spaceEvent;
+	bool m_lossless;
+	bool m_decoded;
+	Resolution m_resolution;
+	std::vector<int> m_quantization;
+
+	uint64_t m_next;
+	FrameBusSlot* m_last;
+	std::vector<uint8_t> m_imageCopy;
+	bool m_imageValid;
+};
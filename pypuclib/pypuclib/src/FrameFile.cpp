@@ -0,0 +1,495 @@
+#include "FrameFile.h"
+#include "Camera.h"
+#include "Decoder.h"
+
+static HANDLE openFile(const std::string& path, bool write)
+{
+	int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::vector<wchar_t> wpath(len > 0 ? len : 1, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath.data(), len);
+
+	HANDLE h;
+	if (write) {
+		h = CreateFileW(wpath.data(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	}
+	else {
+		h = CreateFileW(wpath.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+
+	if (h == INVALID_HANDLE_VALUE) {
+		throw(WrapperException("couldn't open file: " + path));
+	}
+	return h;
+}
+
+static bool writeAt(HANDLE h, uint64_t offset, const void* src, size_t size)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)offset;
+	if (!SetFilePointerEx(h, pos, nullptr, FILE_BEGIN)) {
+		return false;
+	}
+
+	const uint8_t* p = (const uint8_t*)src;
+	while (size > 0)
+	{
+		DWORD chunk = (DWORD)std::min<size_t>(size, 0x40000000);
+		DWORD written = 0;
+		if (!WriteFile(h, p, chunk, &written, nullptr) || written != chunk) {
+			return false;
+		}
+		p += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+
+FrameWriter::FrameWriter(const std::string& path, Camera* cam)
+	:
+	m_file(INVALID_HANDLE_VALUE),
+	m_fileOffset(0),
+	m_written(0),
+	m_busy(false),
+	m_flushRequested(false),
+	m_stop(false),
+	m_error(false)
+{
+	if (!cam) {
+		throw(WrapperException("camera is not specified."));
+	}
+
+	memset(&m_header, 0, sizeof(m_header));
+	auto res = cam->resolution();
+	auto fs = cam->framerateShutter();
+	auto q = cam->decoder()->quantization();
+
+	m_header.width = res.width;
+	m_header.height = res.height;
+	m_header.framerate = std::get<0>(fs);
+	m_header.shutter = std::get<1>(fs);
+	m_header.colortype = cam->colortype();
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		m_header.quantization[i] = (uint16_t)q[i];
+	}
+
+	open(path);
+}
+
+FrameWriter::FrameWriter(const std::string& path, const Resolution& res, const std::vector<int>& q,
+	int framerate, int shutter)
+	:
+	m_file(INVALID_HANDLE_VALUE),
+	m_fileOffset(0),
+	m_written(0),
+	m_busy(false),
+	m_flushRequested(false),
+	m_stop(false),
+	m_error(false)
+{
+	if (q.size() != PUC_Q_COUNT) {
+		throw(WrapperException("quantization may be illegal size."));
+	}
+
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.width = res.width;
+	m_header.height = res.height;
+	m_header.framerate = framerate;
+	m_header.shutter = shutter;
+	m_header.colortype = PUC_COLOR_MONO;
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		m_header.quantization[i] = (uint16_t)std::min(std::max(q[i], 0), (int)USHRT_MAX);
+	}
+
+	open(path);
+}
+
+FrameWriter::~FrameWriter()
+{
+	try
+	{
+		close();
+	}
+	catch (WrapperException&)
+	{
+		// do nothing
+	}
+}
+
+void FrameWriter::open(const std::string& path)
+{
+	memcpy(m_header.magic, FRAME_FILE_MAGIC, sizeof(m_header.magic));
+	m_header.version = FRAME_FILE_VERSION;
+	m_header.headerSize = sizeof(FrameFileHeader);
+
+	m_file = openFile(path, true);
+
+	// header is completed on close, frameCount = 0 means not closed
+	if (!writeAt(m_file, 0, &m_header, sizeof(m_header))) {
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+		throw(WrapperException("couldn't write file header: " + path));
+	}
+	m_fileOffset = sizeof(m_header);
+	m_written = sizeof(m_header);
+
+	m_pending.reserve(BATCH_BYTES * 2);
+	m_thread = std::thread(&FrameWriter::writeWork, this);
+}
+
+void FrameWriter::write(XferData* data)
+{
+	auto info = data->dataInfo();
+	append(info->pData, info->nDataSize, info->nSequenceNo);
+}
+
+void FrameWriter::write(py::array_t<uint8_t>& array, int sequenceNo)
+{
+	append(array.data(), (uint32_t)array.size(), (uint16_t)sequenceNo);
+}
+
+// The GIL is released before the lock, since frameCount() and close()
+// take the lock with the GIL while append may wait for the writer thread.
+void FrameWriter::append(const uint8_t* data, uint32_t size, uint16_t seq)
+{
+	OptionalGilRelease release;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_file == INVALID_HANDLE_VALUE || m_stop) {
+		throw(WrapperException("file is already closed."));
+	}
+
+	// writer is behind
+	m_cond.wait(lock, [&] { return m_pending.size() < MAX_PENDING_BYTES || m_error || m_stop; });
+	if (m_stop) {
+		throw(WrapperException("file is already closed."));
+	}
+	if (m_error) {
+		throw(WrapperException("failed to write file."));
+	}
+
+	FrameRecord record = { size, seq, 0 };
+	auto p = (const uint8_t*)&record;
+	m_pending.insert(m_pending.end(), p, p + sizeof(record));
+	m_pending.insert(m_pending.end(), data, data + size);
+
+	m_index.push_back(m_fileOffset);
+	m_fileOffset += sizeof(record) + size;
+
+	if (m_pending.size() >= BATCH_BYTES && !m_busy) {
+		m_cond.notify_all();
+	}
+}
+
+void FrameWriter::writeWork()
+{
+	std::vector<uint8_t> batch;
+	batch.reserve(BATCH_BYTES * 2);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cond.wait(lock, [&] {
+			return m_stop || (!m_pending.empty() && (m_pending.size() >= BATCH_BYTES || m_flushRequested));
+		});
+
+		if (m_pending.empty())
+		{
+			m_flushRequested = false;
+			m_cond.notify_all();
+			if (m_stop) {
+				break;
+			}
+			continue;
+		}
+
+		batch.swap(m_pending);
+		m_busy = true;
+		uint64_t offset = m_written;
+		lock.unlock();
+
+		bool ok = writeAt(m_file, offset, batch.data(), batch.size());
+
+		lock.lock();
+		m_busy = false;
+		if (ok) {
+			m_written += batch.size();
+		}
+		else {
+			m_error = true;
+		}
+		batch.clear();
+		if (m_pending.empty()) {
+			m_flushRequested = false;
+		}
+		m_cond.notify_all();
+	}
+}
+
+void FrameWriter::flush()
+{
+	OptionalGilRelease release;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_file == INVALID_HANDLE_VALUE || m_stop) {
+		return;
+	}
+
+	m_flushRequested = true;
+	m_cond.notify_all();
+	m_cond.wait(lock, [&] { return (m_pending.empty() && !m_busy) || m_error; });
+	m_flushRequested = false;
+	checkError();
+}
+
+// Appends are rejected once m_stop is set, so the index is complete when
+// the writer thread has drained the pending frames.
+void FrameWriter::close()
+{
+	OptionalGilRelease release;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_file == INVALID_HANDLE_VALUE || m_stop) {
+			return;
+		}
+		m_stop = true;
+		m_flushRequested = true;
+	}
+	m_cond.notify_all();
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+
+	bool ok = !m_error;
+	if (ok)
+	{
+		m_header.frameCount = m_index.size();
+		m_header.indexOffset = m_written;
+		ok = writeAt(m_file, m_written, m_index.data(), m_index.size() * sizeof(uint64_t)) &&
+			writeAt(m_file, 0, &m_header, sizeof(m_header));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+
+	if (!ok) {
+		throw(WrapperException("failed to write file."));
+	}
+}
+
+uint64_t FrameWriter::frameCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_index.size();
+}
+
+uint64_t FrameWriter::bytesWritten() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_written;
+}
+
+void FrameWriter::checkError()
+{
+	if (m_error) {
+		throw(WrapperException("failed to write file."));
+	}
+}
+
+
+FrameReader::FrameReader(const std::string& path)
+	:
+	m_file(INVALID_HANDLE_VALUE),
+	m_fileSize(0)
+{
+	m_file = openFile(path, false);
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) {
+		close();
+		throw(WrapperException("couldn't get file size: " + path));
+	}
+	m_fileSize = (uint64_t)size.QuadPart;
+
+	try
+	{
+		if (m_fileSize < sizeof(m_header)) {
+			throw(WrapperException("illegal file format: " + path));
+		}
+		readAt(0, &m_header, sizeof(m_header));
+		if (memcmp(m_header.magic, FRAME_FILE_MAGIC, sizeof(m_header.magic)) != 0 ||
+			m_header.version != FRAME_FILE_VERSION) {
+			throw(WrapperException("illegal file format: " + path));
+		}
+		buildIndex();
+	}
+	catch (WrapperException&)
+	{
+		close();
+		throw;
+	}
+}
+
+FrameReader::~FrameReader()
+{
+	close();
+}
+
+void FrameReader::close()
+{
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+}
+
+void FrameReader::buildIndex()
+{
+	if (m_header.frameCount > 0 &&
+		m_header.indexOffset + m_header.frameCount * sizeof(uint64_t) <= m_fileSize)
+	{
+		m_index.resize(m_header.frameCount);
+		readAt(m_header.indexOffset, m_index.data(), m_index.size() * sizeof(uint64_t));
+		return;
+	}
+
+	// writer was not closed, scan records as far as complete
+	uint64_t offset = m_header.headerSize;
+	while (offset + sizeof(FrameRecord) <= m_fileSize)
+	{
+		FrameRecord record;
+		readAt(offset, &record, sizeof(record));
+		if (offset + sizeof(record) + record.dataSize > m_fileSize) {
+			break;
+		}
+		m_index.push_back(offset);
+		offset += sizeof(record) + record.dataSize;
+	}
+}
+
+std::unique_ptr<Decoder> FrameReader::decoder()
+{
+	std::unique_ptr<Decoder> p =
+		std::make_unique<Decoder>(m_header.quantization, PUC_Q_COUNT);
+
+	if (!p) {
+		throw(WrapperException("bad memory allocation"));
+	}
+
+	return p;
+}
+
+int FrameReader::sequenceNo(int frameNo)
+{
+	return readRecord(frameNo).sequenceNo;
+}
+
+py::array_t<uint8_t> FrameReader::read(int frameNo)
+{
+	auto record = readRecord(frameNo);
+	py::array_t<uint8_t> buf(record.dataSize);
+	readAt(m_index[frameNo] + sizeof(record), buf.mutable_data(), record.dataSize);
+	return buf;
+}
+
+std::tuple<py::array_t<uint8_t>, py::array_t<int64_t>, py::array_t<uint16_t>>
+FrameReader::readRange(int start, int count)
+{
+	if (count <= 0 || start < 0 || (uint64_t)start + count > m_index.size()) {
+		throw(WrapperException("frame range is out of file."));
+	}
+
+	uint64_t begin = m_index[start];
+	uint64_t end = (uint64_t)start + count < m_index.size() ? m_index[start + count] : 0;
+	if (end == 0)
+	{
+		auto last = readRecord(start + count - 1);
+		end = m_index[start + count - 1] + sizeof(FrameRecord) + last.dataSize;
+	}
+
+	std::vector<uint8_t> raw(end - begin);
+	readAt(begin, raw.data(), raw.size());
+
+	// strip record headers so that frames are packed back to back
+	py::array_t<uint8_t> data((ssize_t)(raw.size() - sizeof(FrameRecord) * count));
+	py::array_t<int64_t> offsets(count + 1);
+	py::array_t<uint16_t> seqs(count);
+	uint8_t* dst = data.mutable_data();
+	int64_t* off = offsets.mutable_data();
+	uint16_t* seq = seqs.mutable_data();
+
+	int64_t pos = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		FrameRecord record;
+		size_t at = (size_t)(m_index[start + i] - begin);
+		memcpy(&record, raw.data() + at, sizeof(record));
+		if (at + sizeof(record) + record.dataSize > raw.size()) {
+			throw(WrapperException("illegal file format."));
+		}
+
+		memcpy(dst + pos, raw.data() + at + sizeof(record), record.dataSize);
+		off[i] = pos;
+		seq[i] = record.sequenceNo;
+		pos += record.dataSize;
+	}
+	off[count] = pos;
+
+	return std::make_tuple(data, offsets, seqs);
+}
+
+uint16_t FrameReader::readInto(int frameNo, std::vector<uint8_t>& dst)
+{
+	auto record = readRecord(frameNo);
+	dst.resize(record.dataSize);
+	readAt(m_index[frameNo] + sizeof(record), dst.data(), record.dataSize);
+	return record.sequenceNo;
+}
+
+FrameRecord FrameReader::readRecord(int frameNo)
+{
+	checkFrameNo(frameNo);
+
+	FrameRecord record;
+	readAt(m_index[frameNo], &record, sizeof(record));
+	return record;
+}
+
+void FrameReader::readAt(uint64_t offset, void* dst, size_t size)
+{
+	if (m_file == INVALID_HANDLE_VALUE) {
+		throw(WrapperException("file is already closed."));
+	}
+
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)offset;
+	if (!SetFilePointerEx(m_file, pos, nullptr, FILE_BEGIN)) {
+		throw(WrapperException("failed to read file."));
+	}
+
+	uint8_t* p = (uint8_t*)dst;
+	while (size > 0)
+	{
+		DWORD chunk = (DWORD)std::min<size_t>(size, 0x40000000);
+		DWORD read = 0;
+		if (!ReadFile(m_file, p, chunk, &read, nullptr) || read != chunk) {
+			throw(WrapperException("failed to read file."));
+		}
+		p += chunk;
+		size -= chunk;
+	}
+}
+
+void FrameReader::checkFrameNo(int frameNo) const
+{
+	if (frameNo < 0 || (uint64_t)frameNo >= m_index.size()) {
+		throw(WrapperException("frame number is out of file."));
+	}
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+#include "XferData.h"
+
+namespace py = pybind11;
+
+class Camera;
+class Decoder;
+
+// File layout
+//   FrameFileHeader
+//   FrameRecord + compressed data  (repeated)
+//   uint64 offset of each record    (written on close)
+struct FrameFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t width;
+	uint32_t height;
+	uint32_t framerate;
+	uint32_t shutter;
+	uint32_t colortype;
+	uint32_t reserved0;
+	uint64_t frameCount;
+	uint64_t indexOffset;
+	uint16_t quantization[PUC_Q_COUNT];
+	uint8_t reserved1[72];
+};
+static_assert(sizeof(FrameFileHeader) == 256, "FrameFileHeader must be 256 bytes");
+
+struct FrameRecord
+{
+	uint32_t dataSize;
+	uint16_t sequenceNo;
+	uint16_t reserved;
+};
+static_assert(sizeof(FrameRecord) == 8, "FrameRecord must be 8 bytes");
+
+static constexpr char FRAME_FILE_MAGIC[8] = { 'P', 'U', 'C', 'F', 'R', 'M', '\0', '\0' };
+static constexpr uint32_t FRAME_FILE_VERSION = 1;
+
+class FrameWriter
+{
+public:
+	FrameWriter(const std::string& path, Camera* cam);
+	FrameWriter(const std::string& path, const Resolution& res, const std::vector<int>& q,
+		int framerate = 0, int shutter = 0);
+	~FrameWriter();
+
+	PY_DOC(DOC_WRITE_A,
+	"\"\"Append compressed data to the file.           \n"
+	"                                                  \n"
+	"Data is copied to write-behind queue and written  \n"
+	"by internal thread in large batches.              \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to append.                           \n"
+	"\"\"                                              \n");
+	void write(XferData* data);
+
+	PY_DOC(DOC_WRITE_B,
+	"\"\"Append compressed data to the file.           \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"sequenceNo : int                                  \n"
+	"    Sequence number of the data.                  \n"
+	"\"\"                                              \n");
+	void write(py::array_t<uint8_t>& array, int sequenceNo);
+
+	PY_DOC(DOC_FLUSH,
+	"\"\"Wait until queued data is written to the file.\n"
+	"\"\"                                              \n");
+	void flush();
+
+	PY_DOC(DOC_WRITER_CLOSE,
+	"\"\"Flush and close the file.                     \n"
+	"                                                  \n"
+	"Frame index is written and header is completed.   \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_WRITER_FRAME_COUNT,
+	"\"\"Get number of frames appended.                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	uint64_t frameCount() const;
+
+	PY_DOC(DOC_BYTES_WRITTEN,
+	"\"\"Get bytes written to the file.                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Bytes already written, queued data excluded.  \n"
+	"\"\"                                              \n");
+	uint64_t bytesWritten() const;
+
+private:
+	void open(const std::string& path);
+	void append(const uint8_t* data, uint32_t size, uint16_t seq);
+	void writeWork();
+	void checkError();
+
+	static constexpr size_t BATCH_BYTES = 8 * 1024 * 1024;
+	static constexpr size_t MAX_PENDING_BYTES = 256 * 1024 * 1024;
+
+	HANDLE m_file;
+	FrameFileHeader m_header;
+	std::vector<uint64_t> m_index;
+	uint64_t m_fileOffset;
+	uint64_t m_written;
+
+	std::vector<uint8_t> m_pending;
+	bool m_busy;
+	bool m_flushRequested;
+	bool m_stop;
+	bool m_error;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::thread m_thread;
+};
+
+class FrameReader
+{
+public:
+	FrameReader(const std::string& path);
+	~FrameReader();
+
+	PY_DOC(DOC_READER_CLOSE,
+	"\"\"Close the file.                               \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_READER_FRAME_COUNT,
+	"\"\"Get number of frames in the file.             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	uint64_t frameCount() const { return m_index.size(); }
+
+	PY_DOC(DOC_READER_RESOLUTION,
+	"\"\"Get resolution of recorded data.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Resolution obj                                    \n"
+	"    Resolution of recorded data.                  \n"
+	"\"\"                                              \n");
+	Resolution resolution() const { return Resolution(m_header.width, m_header.height); }
+
+	PY_DOC(DOC_READER_FRAMERATE_SHUTTER,
+	"\"\"Get framerate and shutter speed of recording. \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int)                                        \n"
+	"    (framerate, shutter speed 1/x[sec])           \n"
+	"\"\"                                              \n");
+	std::tuple<int, int> framerateShutter() const
+	{
+		return std::tuple<int, int>(m_header.framerate, m_header.shutter);
+	}
+
+	PY_DOC(DOC_READER_QUANTIZATION,
+	"\"\"Get quantization of recorded data.            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"list(int)                                         \n"
+	"    Quantization value list.                      \n"
+	"\"\"                                              \n");
+	std::vector<int> quantization() const
+	{
+		return std::vector<int>(std::begin(m_header.quantization), std::end(m_header.quantization));
+	}
+
+	PY_DOC(DOC_READER_DECODER,
+	"\"\"Get Decoder obj for recorded data.            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Decoder obj                                       \n"
+	"    Decoder obj based on recorded quantization.   \n"
+	"\"\"                                              \n");
+	std::unique_ptr<Decoder> decoder();
+
+	PY_DOC(DOC_READER_SEQUENCENO,
+	"\"\"Get sequence number of the frame.             \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"frameNo : int                                     \n"
+	"    Frame number in the file.                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Sequence number of the frame.                 \n"
+	"\"\"                                              \n");
+	int sequenceNo(int frameNo);
+
+	PY_DOC(DOC_READ,
+	"\"\"Read compressed data of the frame.            \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"frameNo : int                                     \n"
+	"    Frame number in the file.                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> read(int frameNo);
+
+	PY_DOC(DOC_READ_RANGE,
+	"\"\"Read compressed data of frames at once.       \n"
+	"                                                  \n"
+	"Frames are loaded to one contiguous array by one  \n"
+	"file read.                                        \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"start : int                                       \n"
+	"    First frame number.                           \n"
+	"count : int                                       \n"
+	"    Number of frames.                             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(numpy array(uint8), numpy array(int64),          \n"
+	" numpy array(uint16))                             \n"
+	"    (data, offsets, sequenceNo). Frame i is       \n"
+	"    data[offsets[i]:offsets[i+1]].                \n"
+	"\"\"                                              \n");
+	std::tuple<py::array_t<uint8_t>, py::array_t<int64_t>, py::array_t<uint16_t>> readRange(int start, int count);
+
+	// Reads compressed data of the frame into dst without GIL, for exporter
+	// threads. Returns the sequence number.
+	uint16_t readInto(int frameNo, std::vector<uint8_t>& dst);
+
+private:
+	void buildIndex();
+	FrameRecord readRecord(int frameNo);
+	void readAt(uint64_t offset, void* dst, size_t size);
+	void checkFrameNo(int frameNo) const;
+
+	HANDLE m_file;
+	uint64_t m_fileSize;
+	FrameFileHeader m_header;
+	std::vector<uint64_t> m_index;
+};
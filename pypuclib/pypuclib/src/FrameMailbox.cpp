@@ -0,0 +1,214 @@
+#include "FrameMailbox.h"
+#include <thread>
+#include "Camera.h"
+#include "Decoder.h"
+
+FrameMailbox::FrameMailbox(Camera* cam, bool decoded, const std::string& decode)
+{
+	if (!cam) {
+		throw(WrapperException("camera is not specified."));
+	}
+
+	auto q = cam->decoder()->quantization();
+	unsigned short quantize[PUC_Q_COUNT];
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		quantize[i] = (unsigned short)q[i];
+	}
+
+	create(cam->resolution(), quantize, decoded, decode, cam->maxXferDataSize());
+}
+
+FrameMailbox::FrameMailbox(const Resolution& res, const std::vector<int>& q, bool decoded, int dataCapacity,
+	const std::string& decode)
+{
+	if (q.size() != PUC_Q_COUNT) {
+		throw(WrapperException("quantization may be illegal size."));
+	}
+
+	unsigned short quantize[PUC_Q_COUNT];
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		quantize[i] = (unsigned short)std::min(std::max(q[i], 0), (int)USHRT_MAX);
+	}
+
+	// compressed data doesn't exceed 8bit raw image
+	if (dataCapacity == 0) {
+		dataCapacity = res.width * res.height;
+	}
+	if (dataCapacity < 0) {
+		throw(WrapperException("data capacity may be illegal."));
+	}
+
+	create(res, quantize, decoded, decode, (uint32_t)dataCapacity);
+}
+
+void FrameMailbox::create(const Resolution& res, const unsigned short* q, bool decoded, const std::string& decode,
+	uint32_t dataCapacity)
+{
+	if (res.width <= 0 || res.height <= 0) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+	if (decode != "read" && decode != "publish") {
+		throw(WrapperException("decode may be illegal."));
+	}
+
+	m_resolution = res;
+	memcpy(m_quantization, q, sizeof(m_quantization));
+	m_decoded = decoded;
+	m_decodeOnPublish = decoded && decode == "publish";
+	m_lineBytes = ALIGN(res.width, 4);
+	m_numThread = std::max(1, (int)std::thread::hardware_concurrency());
+
+	// every slot is allocated here, so posting never allocates
+	for (auto& s : m_slots)
+	{
+		s.data.resize(dataCapacity);
+		s.size = 0;
+		s.sequenceNo = 0;
+		if (decoded) {
+			s.image.resize((size_t)m_lineBytes * res.height);
+		}
+		s.decoded = false;
+		s.imageValid = false;
+	}
+
+	m_back = 0;
+	m_middle.store(1, std::memory_order_relaxed);
+	m_front = 2;
+	m_frontValid = false;
+	m_count.store(0, std::memory_order_relaxed);
+	m_dropped.store(0, std::memory_order_relaxed);
+}
+
+void FrameMailbox::post(XferData* data)
+{
+	if (!data) {
+		throw(WrapperException("xferdata is not specified."));
+	}
+
+	auto res = data->resolution();
+	if (res.width != m_resolution.width || res.height != m_resolution.height) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+	if (data->dataSize() > m_slots[0].data.size()) {
+		throw(WrapperException("data size may be illegal."));
+	}
+
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_writeMutex);
+	write(data->dataInfo()->pData, data->dataSize(), data->sequenceNo());
+}
+
+void FrameMailbox::post(py::array_t<uint8_t>& array, int sequenceNo)
+{
+	if ((size_t)array.size() > m_slots[0].data.size()) {
+		throw(WrapperException("data size may be illegal."));
+	}
+
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_writeMutex);
+	write(array.data(), (uint32_t)array.size(), (uint16_t)sequenceNo);
+}
+
+void FrameMailbox::post(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+{
+	if (res.width != m_resolution.width || res.height != m_resolution.height ||
+		info->nDataSize > m_slots[0].data.size())
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_writeMutex);
+	write(info->pData, info->nDataSize, info->nSequenceNo);
+}
+
+// Caller holds m_writeMutex. Readers never touch the back slot, so it is
+// filled without waiting for them and handed over by one exchange. Decode
+// is left to readImage() unless decoded on publish.
+void FrameMailbox::write(const uint8_t* src, uint32_t size, uint16_t seq)
+{
+	Slot& s = m_slots[m_back];
+	memcpy(s.data.data(), src, size);
+	s.size = size;
+	s.sequenceNo = seq;
+	s.decoded = false;
+	if (m_decodeOnPublish)
+	{
+		auto ret = PUC_DecodeDataMultiThread(s.image.data(), 0, 0, m_resolution.width, m_resolution.height,
+			m_lineBytes, s.data.data(), m_quantization, m_numThread);
+		s.imageValid = !PUC_CHK_FAILED(ret);
+		s.decoded = true;
+	}
+
+	m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & 3;
+	m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool FrameMailbox::front()
+{
+	if (m_middle.load(std::memory_order_relaxed) & FRESH)
+	{
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & 3;
+		m_frontValid = true;
+	}
+	return m_frontValid;
+}
+
+std::unique_ptr<XferData> FrameMailbox::read()
+{
+	auto data = std::make_unique<XferData>((int)m_slots[0].data.size(), m_resolution);
+
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_readMutex);
+	if (!front()) {
+		return nullptr;
+	}
+
+	const Slot& s = m_slots[m_front];
+	auto info = data->dataInfo();
+	memcpy(info->pData, s.data.data(), s.size);
+	info->nDataSize = s.size;
+	info->nSequenceNo = s.sequenceNo;
+	return data;
+}
+
+py::object FrameMailbox::readImage()
+{
+	if (!m_decoded) {
+		throw(WrapperException("decoded frame is not posted."));
+	}
+
+	py::array_t<uint8_t> buf({ m_resolution.height, m_resolution.width });
+	uint8_t* dst = buf.mutable_data();
+	uint16_t seq = 0;
+	bool valid = false;
+	{
+		OptionalGilRelease release;
+
+		std::lock_guard<std::mutex> lock(m_readMutex);
+		valid = front();
+		Slot& s = m_slots[m_front];
+		if (valid && !s.decoded)
+		{
+			auto ret = PUC_DecodeDataMultiThread(s.image.data(), 0, 0, m_resolution.width, m_resolution.height,
+				m_lineBytes, s.data.data(), m_quantization, m_numThread);
+			s.imageValid = !PUC_CHK_FAILED(ret);
+			s.decoded = true;
+		}
+		if (valid && !s.imageValid) {
+			throw(WrapperException("decoded frame is broken."));
+		}
+		for (int y = 0; valid && y < m_resolution.height; ++y) {
+			memcpy(dst + (size_t)y * m_resolution.width, s.image.data() + (size_t)y * m_lineBytes, m_resolution.width);
+		}
+		seq = s.sequenceNo;
+	}
+
+	if (!valid) {
+		return py::none();
+	}
+	return py::make_tuple(buf, seq);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+#include "XferData.h"
+
+namespace py = pybind11;
+
+class Camera;
+
+// Triple buffer of the latest frame. The writer fills the back slot and
+// swaps it with the middle slot by one atomic exchange, and a reader swaps
+// the middle slot with the front slot when it is fresh. The writer never
+// waits for readers. Readers wait for each other while the front slot is
+// decoded or copied out, and the image decoded is cached in the slot until
+// it goes back to the writer. Decode on publish moves the decode into the
+// back slot, so the writer decodes every frame and readers only copy.
+class FrameMailbox
+{
+public:
+	PY_DOC(DOC_CLASS_FRAME_MAILBOX,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Mailbox holding only the latest frame.            \n"
+	"                                                  \n"
+	"Frames are posted by transfer thread of continuous\n"
+	"transfer when set by Camera.setFrameMailbox(), and\n"
+	"only copied there. Readers get the newest frame   \n"
+	"without queueing, and slow readers never hold back\n"
+	"the transfer.                                     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"cam : Camera obj                                  \n"
+	"    Camera to take resolution and quantization.   \n"
+	"decoded : bool                                    \n"
+	"    Enable readImage(). (default=False)           \n"
+	"decode : str                                      \n"
+	"    'read' decodes a frame by its first read, so  \n"
+	"    the transfer thread only copies.              \n"
+	"    'publish' decodes every frame when posted, so \n"
+	"    readImage() only copies. (default='read')     \n"
+	"\"\"                                              \n");
+	FrameMailbox(Camera* cam, bool decoded = false, const std::string& decode = "read");
+	FrameMailbox(const Resolution& res, const std::vector<int>& q, bool decoded = false, int dataCapacity = 0,
+		const std::string& decode = "read");
+	~FrameMailbox() {}
+	FrameMailbox(const FrameMailbox& obj) = delete;
+	FrameMailbox& operator=(const FrameMailbox& obj) = delete;
+
+	PY_DOC(DOC_MAILBOX_POST_A,
+	"\"\"Post compressed data to the mailbox.          \n"
+	"                                                  \n"
+	"Data replaces the frame posted before.            \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to post.                             \n"
+	"\"\"                                              \n");
+	void post(XferData* data);
+
+	PY_DOC(DOC_MAILBOX_POST_B,
+	"\"\"Post compressed data to the mailbox.          \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"sequenceNo : int                                  \n"
+	"    Sequence number of the data.                  \n"
+	"\"\"                                              \n");
+	void post(py::array_t<uint8_t>& array, int sequenceNo);
+
+	// Called on the transfer thread of the SDK. Frames of other resolution
+	// or over the capacity are counted as dropped instead of thrown.
+	void post(const PUC_XFER_DATA_INFO* info, const Resolution& res);
+
+	PY_DOC(DOC_MAILBOX_READ,
+	"\"\"Read the newest frame.                        \n"
+	"                                                  \n"
+	"The same frame is returned until a new frame is   \n"
+	"posted.                                           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"XferData obj                                      \n"
+	"    Copy of the newest frame. None if no frame is \n"
+	"    posted.                                       \n"
+	"\"\"                                              \n");
+	std::unique_ptr<XferData> read();
+
+	PY_DOC(DOC_MAILBOX_READ_IMAGE,
+	"\"\"Read decoded image of the newest frame.       \n"
+	"                                                  \n"
+	"Mailbox must be created with decoded. The frame is\n"
+	"decoded by the first read, or when posted if      \n"
+	"decode is 'publish', and the image is reused until\n"
+	"a new frame is posted.                            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(numpy array(uint8), int)                         \n"
+	"    (image, sequenceNo) of the newest frame. Array\n"
+	"    size is (h, w). None if no frame is posted.   \n"
+	"\"\"                                              \n");
+	py::object readImage();
+
+	PY_DOC(DOC_MAILBOX_FRAME_COUNT,
+	"\"\"Get number of frames posted.                  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	uint64_t frameCount() const { return m_count.load(std::memory_order_relaxed); }
+
+	PY_DOC(DOC_MAILBOX_DROPPED_COUNT,
+	"\"\"Get number of frames dropped.                 \n"
+	"                                                  \n"
+	"Frames of continuous transfer are dropped when the\n"
+	"resolution differs from the mailbox or data is    \n"
+	"over the capacity, e.g. after resolution of the   \n"
+	"camera is changed. Create a new mailbox then.     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames dropped.                     \n"
+	"\"\"                                              \n");
+	uint64_t droppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	PY_DOC(DOC_MAILBOX_RESOLUTION,
+	"\"\"Get resolution of frames.                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Resolution obj                                    \n"
+	"    Resolution of frames.                         \n"
+	"\"\"                                              \n");
+	Resolution resolution() const { return m_resolution; }
+
+private:
+	struct Slot
+	{
+		std::vector<uint8_t> data;
+		uint32_t size;
+		uint16_t sequenceNo;
+		std::vector<uint8_t> image;
+		bool decoded;     // image is for the data, valid or not
+		bool imageValid;
+	};
+
+	void create(const Resolution& res, const unsigned short* q, bool decoded, const std::string& decode,
+		uint32_t dataCapacity);
+	void write(const uint8_t* src, uint32_t size, uint16_t seq);
+	// Swaps in the fresh middle slot, caller holds m_readMutex.
+	bool front();
+
+	static constexpr uint32_t FRESH = 4;
+
+	Resolution m_resolution;
+	unsigned short m_quantization[PUC_Q_COUNT];
+	bool m_decoded;
+	bool m_decodeOnPublish;
+	int m_lineBytes;
+	int m_numThread;
+
+	Slot m_slots[3];
+	uint32_t m_back;                // owned by the writer
+	std::atomic<uint32_t> m_middle; // slot index | FRESH
+	uint32_t m_front;               // owned by readers
+	bool m_frontValid;
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_dropped;
+	std::mutex m_writeMutex;
+	std::mutex m_readMutex;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <mutex>
+#include "Common.h"
+#include "Kernel.h"
+
+class FrameStats
+{
+public:
+	PY_DOC(DOC_CLASS_FRAME_STATS,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Statistics of decoded pixels.                     \n"
+	"                                                  \n"
+	"Attributes                                        \n"
+	"----------                                        \n"
+	"pixelCount : int                                  \n"
+	"    Number of pixels counted.                     \n"
+	"mean : float                                      \n"
+	"    Mean of pixel values.                         \n"
+	"min : int                                         \n"
+	"    Minimum pixel value.                          \n"
+	"max : int                                         \n"
+	"    Maximum pixel value.                          \n"
+	"histogram : list(int)                             \n"
+	"    Number of pixels of each value from 0 to 255. \n"
+	"saturated : int                                   \n"
+	"    Number of pixels of 255.                      \n"
+	"dark : int                                        \n"
+	"    Number of pixels of 0.                        \n"
+	"\"\"                                              \n");
+public:
+	FrameStats()
+		: pixelCount(0), mean(0), min(0), max(0), histogram(256, 0), saturated(0), dark(0) {}
+	~FrameStats() {}
+
+	int64_t pixelCount;
+	double mean;
+	int min;
+	int max;
+	std::vector<int64_t> histogram;
+	int64_t saturated;
+	int64_t dark;
+};
+
+// Collects histogram of decoded stripes from several threads. Each stripe
+// is counted into local bins and merged once, other statistics are derived
+// from the histogram at the end.
+class HistogramAccumulator
+{
+public:
+	struct Bins
+	{
+		Bins()
+		{
+			memset(count, 0, sizeof(count));
+		}
+
+		void addLine(const uint8_t* src, int w)
+		{
+			histogramLine(src, w, count);
+		}
+
+		uint32_t count[HISTOGRAM_WAYS][256];
+	};
+
+	HistogramAccumulator()
+		: m_bins(256, 0)
+	{
+	}
+
+	void merge(const Bins& bins)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = 0; i < 256; ++i)
+		{
+			for (int k = 0; k < HISTOGRAM_WAYS; ++k) {
+				m_bins[i] += bins.count[k][i];
+			}
+		}
+	}
+
+	FrameStats stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		FrameStats s;
+		s.histogram = m_bins;
+		s.dark = m_bins[0];
+		s.saturated = m_bins[255];
+
+		int64_t sum = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			if (m_bins[i] == 0) {
+				continue;
+			}
+			if (s.pixelCount == 0) {
+				s.min = i;
+			}
+			s.max = i;
+			s.pixelCount += m_bins[i];
+			sum += m_bins[i] * i;
+		}
+		if (s.pixelCount > 0) {
+			s.mean = (double)sum / s.pixelCount;
+		}
+		return s;
+	}
+
+private:
+	mutable std::mutex m_mutex;
+	std::vector<int64_t> m_bins;
+};
@@ -0,0 +1,519 @@
+#include "FrameStream.h"
+#include "Camera.h"
+#include "Decoder.h"
+#include <ws2tcpip.h>
+#include <afunix.h>
+#include <chrono>
+#pragma comment(lib, "ws2_32.lib")
+
+static constexpr int SOCKET_BUFFER_BYTES = 4 * 1024 * 1024;
+static constexpr uint32_t MAX_STREAM_DATA_SIZE = 256 * 1024 * 1024;
+
+struct StreamAddress
+{
+	int family;
+	sockaddr_storage addr;
+	int length;
+	std::wstring path;
+};
+
+static void initSocket()
+{
+	static std::once_flag once;
+	std::call_once(once, []() {
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+			throw(WrapperException("couldn't initialize winsock."));
+		}
+	});
+}
+
+// "tcp://host:port" or "unix://path"
+static StreamAddress parseAddress(const std::string& address)
+{
+	StreamAddress a;
+	memset(&a.addr, 0, sizeof(a.addr));
+
+	if (address.compare(0, 6, "tcp://") == 0)
+	{
+		auto hostPort = address.substr(6);
+		auto colon = hostPort.rfind(':');
+		if (colon == std::string::npos) {
+			throw(WrapperException("address may be illegal: " + address));
+		}
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+		addrinfo* info = nullptr;
+		if (getaddrinfo(hostPort.substr(0, colon).c_str(), hostPort.substr(colon + 1).c_str(), &hints, &info) != 0 || !info) {
+			throw(WrapperException("address may be illegal: " + address));
+		}
+		memcpy(&a.addr, info->ai_addr, info->ai_addrlen);
+		a.length = (int)info->ai_addrlen;
+		a.family = AF_INET;
+		freeaddrinfo(info);
+	}
+	else if (address.compare(0, 7, "unix://") == 0)
+	{
+		auto path = address.substr(7);
+		auto un = (sockaddr_un*)&a.addr;
+		if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+			throw(WrapperException("address may be illegal: " + address));
+		}
+		un->sun_family = AF_UNIX;
+		memcpy(un->sun_path, path.c_str(), path.size());
+		a.length = sizeof(sockaddr_un);
+		a.family = AF_UNIX;
+
+		int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+		std::vector<wchar_t> wpath(len > 0 ? len : 1, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath.data(), len);
+		a.path = wpath.data();
+	}
+	else {
+		throw(WrapperException("address may be illegal: " + address));
+	}
+	return a;
+}
+
+// Gather write of all buffers. Blocking send may still return partially
+// when interrupted, so the rest is sent again.
+static bool sendBuffers(SOCKET s, WSABUF* bufs, DWORD count)
+{
+	while (count > 0)
+	{
+		DWORD sent = 0;
+		if (WSASend(s, bufs, count, &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+			return false;
+		}
+		while (count > 0 && sent >= bufs->len)
+		{
+			sent -= bufs->len;
+			++bufs;
+			--count;
+		}
+		if (count > 0)
+		{
+			bufs->buf += sent;
+			bufs->len -= sent;
+		}
+	}
+	return true;
+}
+
+static int64_t steadyNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+FrameServer::FrameServer(const std::string& address, Camera* cam, int sendTimeout)
+	:
+	m_listen(INVALID_SOCKET),
+	m_sendTimeout(sendTimeout),
+	m_stop(false),
+	m_frames(0),
+	m_bytes(0),
+	m_dropped(0)
+{
+	if (!cam) {
+		throw(WrapperException("camera is not specified."));
+	}
+
+	memset(&m_header, 0, sizeof(m_header));
+	auto res = cam->resolution();
+	auto fs = cam->framerateShutter();
+	auto q = cam->decoder()->quantization();
+
+	m_header.width = res.width;
+	m_header.height = res.height;
+	m_header.framerate = std::get<0>(fs);
+	m_header.shutter = std::get<1>(fs);
+	m_header.colortype = cam->colortype();
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		m_header.quantization[i] = (uint16_t)q[i];
+	}
+
+	open(address);
+}
+
+FrameServer::FrameServer(const std::string& address, const Resolution& res, const std::vector<int>& q,
+	int framerate, int shutter, int sendTimeout)
+	:
+	m_listen(INVALID_SOCKET),
+	m_sendTimeout(sendTimeout),
+	m_stop(false),
+	m_frames(0),
+	m_bytes(0),
+	m_dropped(0)
+{
+	if (q.size() != PUC_Q_COUNT) {
+		throw(WrapperException("quantization may be illegal size."));
+	}
+
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.width = res.width;
+	m_header.height = res.height;
+	m_header.framerate = framerate;
+	m_header.shutter = shutter;
+	m_header.colortype = PUC_COLOR_MONO;
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		m_header.quantization[i] = (uint16_t)std::min(std::max(q[i], 0), (int)USHRT_MAX);
+	}
+
+	open(address);
+}
+
+FrameServer::~FrameServer()
+{
+	close();
+}
+
+void FrameServer::open(const std::string& address)
+{
+	if (m_sendTimeout <= 0) {
+		throw(WrapperException("send timeout may be illegal."));
+	}
+
+	memcpy(m_header.magic, STREAM_MAGIC, sizeof(m_header.magic));
+	m_header.version = STREAM_VERSION;
+	m_header.headerSize = sizeof(StreamHeader);
+
+	initSocket();
+	auto a = parseAddress(address);
+
+	m_listen = socket(a.family, SOCK_STREAM, a.family == AF_INET ? IPPROTO_TCP : 0);
+	if (m_listen == INVALID_SOCKET) {
+		throw(WrapperException("couldn't create socket."));
+	}
+	if (::bind(m_listen, (sockaddr*)&a.addr, a.length) == SOCKET_ERROR ||
+		::listen(m_listen, SOMAXCONN) == SOCKET_ERROR)
+	{
+		closesocket(m_listen);
+		m_listen = INVALID_SOCKET;
+		throw(WrapperException("couldn't listen on: " + address));
+	}
+
+	if (a.family == AF_INET)
+	{
+		sockaddr_in in;
+		int len = sizeof(in);
+		char host[INET_ADDRSTRLEN] = { 0 };
+		getsockname(m_listen, (sockaddr*)&in, &len);
+		inet_ntop(AF_INET, &in.sin_addr, host, sizeof(host));
+		m_address = "tcp://" + std::string(host) + ":" + std::to_string(ntohs(in.sin_port));
+	}
+	else
+	{
+		m_address = address;
+		m_unixPath = a.path;
+	}
+
+	m_thread = std::thread(&FrameServer::acceptWork, this);
+}
+
+void FrameServer::acceptWork()
+{
+	while (!m_stop)
+	{
+		SOCKET s = accept(m_listen, nullptr, nullptr);
+		if (s == INVALID_SOCKET)
+		{
+			if (!m_stop) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			continue;
+		}
+
+		// slow client fails the send after timeout instead of blocking the
+		// transfer thread forever
+		DWORD timeout = (DWORD)m_sendTimeout;
+		int bufferBytes = SOCKET_BUFFER_BYTES;
+		BOOL noDelay = TRUE;
+		setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+		setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&bufferBytes, sizeof(bufferBytes));
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+		WSABUF buf;
+		buf.buf = (char*)&m_header;
+		buf.len = sizeof(m_header);
+		if (!sendBuffers(s, &buf, 1))
+		{
+			closesocket(s);
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_clients.push_back(s);
+	}
+}
+
+void FrameServer::send(XferData* data)
+{
+	if (!data) {
+		throw(WrapperException("xferdata is not specified."));
+	}
+
+	auto res = data->resolution();
+	if (res.width != (int)m_header.width || res.height != (int)m_header.height) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_stop) {
+		throw(WrapperException("server is already closed."));
+	}
+	sendFrame(data->dataInfo()->pData, data->dataSize(), data->sequenceNo());
+}
+
+void FrameServer::send(py::array_t<uint8_t>& array, int sequenceNo)
+{
+	OptionalGilRelease release;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_stop) {
+		throw(WrapperException("server is already closed."));
+	}
+	sendFrame(array.data(), (uint32_t)array.size(), (uint16_t)sequenceNo);
+}
+
+bool FrameServer::send(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+{
+	if (res.width != (int)m_header.width || res.height != (int)m_header.height) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_stop) {
+		return false;
+	}
+	sendFrame(info->pData, info->nDataSize, info->nSequenceNo);
+	return true;
+}
+
+// Caller holds m_mutex. Record and data go out by one WSASend per client,
+// so compressed data is never copied in user space.
+void FrameServer::sendFrame(const uint8_t* data, uint32_t size, uint16_t seq)
+{
+	StreamRecord rec;
+	rec.dataSize = size;
+	rec.sequenceNo = seq;
+	rec.reserved = 0;
+	rec.timestamp = steadyNow();
+
+	for (auto it = m_clients.begin(); it != m_clients.end();)
+	{
+		WSABUF bufs[2];
+		bufs[0].buf = (char*)&rec;
+		bufs[0].len = sizeof(rec);
+		bufs[1].buf = (char*)data;
+		bufs[1].len = size;
+		if (sendBuffers(*it, bufs, 2))
+		{
+			++it;
+			continue;
+		}
+		closesocket(*it);
+		it = m_clients.erase(it);
+		++m_dropped;
+	}
+
+	++m_frames;
+	m_bytes += sizeof(rec) + size;
+}
+
+void FrameServer::close()
+{
+	OptionalGilRelease release;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	// closing the socket wakes up accept
+	if (m_listen != INVALID_SOCKET) {
+		closesocket(m_listen);
+	}
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+	m_listen = INVALID_SOCKET;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto s : m_clients) {
+		closesocket(s);
+	}
+	m_clients.clear();
+
+	if (!m_unixPath.empty())
+	{
+		DeleteFileW(m_unixPath.c_str());
+		m_unixPath.clear();
+	}
+}
+
+int FrameServer::clientCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (int)m_clients.size();
+}
+
+std::tuple<uint64_t, uint64_t, uint64_t> FrameServer::stats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return std::tuple<uint64_t, uint64_t, uint64_t>(m_frames, m_bytes, m_dropped);
+}
+
+
+FrameClient::FrameClient(const std::string& address, int timeout)
+	:
+	m_socket(INVALID_SOCKET),
+	m_timestamp(0),
+	m_frameCount(0)
+{
+	initSocket();
+	auto a = parseAddress(address);
+
+	m_socket = socket(a.family, SOCK_STREAM, a.family == AF_INET ? IPPROTO_TCP : 0);
+	if (m_socket == INVALID_SOCKET) {
+		throw(WrapperException("couldn't create socket."));
+	}
+
+	int bufferBytes = SOCKET_BUFFER_BYTES;
+	setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferBytes, sizeof(bufferBytes));
+
+	if (connect(m_socket, (sockaddr*)&a.addr, a.length) == SOCKET_ERROR)
+	{
+		close();
+		throw(WrapperException("couldn't connect to: " + address));
+	}
+
+	if (!wait(timeout) || !receive(&m_header, sizeof(m_header), timeout))
+	{
+		close();
+		throw(WrapperException("couldn't receive stream header: " + address));
+	}
+	if (memcmp(m_header.magic, STREAM_MAGIC, sizeof(m_header.magic)) != 0 || m_header.version != STREAM_VERSION)
+	{
+		close();
+		throw(WrapperException("not a frame stream: " + address));
+	}
+}
+
+FrameClient::~FrameClient()
+{
+	close();
+}
+
+std::unique_ptr<XferData> FrameClient::read(int timeout)
+{
+	if (!isConnected()) {
+		return nullptr;
+	}
+
+	OptionalGilRelease release;
+
+	if (!wait(timeout)) {
+		return nullptr;
+	}
+
+	// server stalled in a record can't be resumed, the stream is closed
+	int stall = timeout < 0 ? timeout : std::max(timeout, MIN_STALL_TIMEOUT);
+
+	StreamRecord rec;
+	if (!receive(&rec, sizeof(rec), stall))
+	{
+		close();
+		return nullptr;
+	}
+	if (rec.dataSize > MAX_STREAM_DATA_SIZE)
+	{
+		close();
+		throw(WrapperException("stream may be broken."));
+	}
+
+	std::unique_ptr<XferData> p =
+		std::make_unique<XferData>((int)rec.dataSize, resolution());
+
+	if (!p) {
+		throw(WrapperException("bad memory allocation"));
+	}
+
+	auto info = p->dataInfo();
+	if (!receive(info->pData, rec.dataSize, stall))
+	{
+		close();
+		return nullptr;
+	}
+	info->nDataSize = rec.dataSize;
+	info->nSequenceNo = rec.sequenceNo;
+
+	m_timestamp = rec.timestamp;
+	++m_frameCount;
+	return p;
+}
+
+void FrameClient::close()
+{
+	if (m_socket != INVALID_SOCKET)
+	{
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+}
+
+std::unique_ptr<Decoder> FrameClient::decoder()
+{
+	std::unique_ptr<Decoder> p =
+		std::make_unique<Decoder>(m_header.quantization, PUC_Q_COUNT);
+
+	if (!p) {
+		throw(WrapperException("bad memory allocation"));
+	}
+
+	return p;
+}
+
+// Returns false on timeout. Negative timeout waits without limit.
+bool FrameClient::wait(int timeout)
+{
+	if (timeout < 0) {
+		return true;
+	}
+
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(m_socket, &fds);
+	timeval tv;
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	return select(0, &fds, nullptr, nullptr, &tv) > 0;
+}
+
+// Returns false on disconnection, or when no byte arrives within timeout.
+bool FrameClient::receive(void* dst, size_t size, int timeout)
+{
+	char* p = (char*)dst;
+	while (size > 0)
+	{
+		if (!wait(timeout)) {
+			return false;
+		}
+
+		int chunk = (int)std::min<size_t>(size, 0x40000000);
+		int received = recv(m_socket, p, chunk, 0);
+		if (received <= 0) {
+			return false;
+		}
+		p += received;
+		size -= received;
+	}
+	return true;
+}
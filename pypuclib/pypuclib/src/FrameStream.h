@@ -0,0 +1,267 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+#include "XferData.h"
+
+namespace py = pybind11;
+
+class Camera;
+class Decoder;
+
+// Stream layout
+//   StreamHeader                     (once, when client is accepted)
+//   StreamRecord + compressed data   (each frame)
+struct StreamHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t width;
+	uint32_t height;
+	uint32_t framerate;
+	uint32_t shutter;
+	uint32_t colortype;
+	uint32_t reserved0;
+	uint16_t quantization[PUC_Q_COUNT];
+	uint8_t reserved1[88];
+};
+static_assert(sizeof(StreamHeader) == 256, "StreamHeader must be 256 bytes");
+
+struct StreamRecord
+{
+	uint32_t dataSize;
+	uint16_t sequenceNo;
+	uint16_t reserved;
+	int64_t timestamp;      // steady clock of the server [nsec]
+};
+static_assert(sizeof(StreamRecord) == 16, "StreamRecord must be 16 bytes");
+
+static constexpr char STREAM_MAGIC[8] = { 'P', 'U', 'C', 'S', 'T', 'R', 'M', '\0' };
+static constexpr uint32_t STREAM_VERSION = 1;
+
+// Address is "tcp://host:port" or "unix://path".
+class FrameServer
+{
+public:
+	FrameServer(const std::string& address, Camera* cam, int sendTimeout = 1000);
+	FrameServer(const std::string& address, const Resolution& res, const std::vector<int>& q,
+		int framerate = 0, int shutter = 0, int sendTimeout = 1000);
+	~FrameServer();
+
+	PY_DOC(DOC_SERVER_SEND_A,
+	"\"\"Send compressed data to all clients.          \n"
+	"                                                  \n"
+	"Record header and data are written by one gather  \n"
+	"write to each socket without copy. A client which \n"
+	"doesn't receive within send timeout is dropped.   \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to send.                             \n"
+	"\"\"                                              \n");
+	void send(XferData* data);
+
+	PY_DOC(DOC_SERVER_SEND_B,
+	"\"\"Send compressed data to all clients.          \n"
+	"                                                  \n"
+	"This is overload function using numpy array input.\n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Numpy array of 1d compressed data.            \n"
+	"sequenceNo : int                                  \n"
+	"    Sequence number of the data.                  \n"
+	"\"\"                                              \n");
+	void send(py::array_t<uint8_t>& array, int sequenceNo);
+
+	// Called on the transfer thread of the SDK, errors are not thrown.
+	bool send(const PUC_XFER_DATA_INFO* info, const Resolution& res);
+
+	PY_DOC(DOC_SERVER_CLOSE,
+	"\"\"Stop accepting and disconnect all clients.    \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_SERVER_ADDRESS,
+	"\"\"Get address the server listens on.            \n"
+	"                                                  \n"
+	"Port 0 of tcp address is replaced with the port   \n"
+	"assigned by the system.                           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"str                                               \n"
+	"    Address to connect clients.                   \n"
+	"\"\"                                              \n");
+	std::string address() const { return m_address; }
+
+	PY_DOC(DOC_SERVER_CLIENT_COUNT,
+	"\"\"Get number of connected clients.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of clients.                            \n"
+	"\"\"                                              \n");
+	int clientCount() const;
+
+	PY_DOC(DOC_SERVER_STATS,
+	"\"\"Get statistics of the server.                 \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int, int)                                   \n"
+	"    (frames, bytes, dropped clients). Frames and  \n"
+	"    bytes are counted once for all clients.       \n"
+	"\"\"                                              \n");
+	std::tuple<uint64_t, uint64_t, uint64_t> stats() const;
+
+private:
+	void open(const std::string& address);
+	void acceptWork();
+	void sendFrame(const uint8_t* data, uint32_t size, uint16_t seq);
+
+	SOCKET m_listen;
+	std::string m_address;
+	std::wstring m_unixPath;
+	StreamHeader m_header;
+	int m_sendTimeout;
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+
+	mutable std::mutex m_mutex;
+	std::vector<SOCKET> m_clients;
+	uint64_t m_frames;
+	uint64_t m_bytes;
+	uint64_t m_dropped;
+};
+
+class FrameClient
+{
+public:
+	FrameClient(const std::string& address, int timeout = 5000);
+	~FrameClient();
+
+	PY_DOC(DOC_CLIENT_READ,
+	"\"\"Receive next frame from the server.           \n"
+	"                                                  \n"
+	"Data is received directly into the XferData. When \n"
+	"the rest of a frame doesn't arrive within timeout,\n"
+	"1000 msec at least, the connection is closed.     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"timeout : int                                     \n"
+	"    Timeout [msec]. Negative waits without limit. \n"
+	"    (default=1000)                                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"XferData obj                                      \n"
+	"    Frame received. None if timed out or          \n"
+	"    disconnected.                                 \n"
+	"\"\"                                              \n");
+	std::unique_ptr<XferData> read(int timeout = 1000);
+
+	PY_DOC(DOC_CLIENT_CLOSE,
+	"\"\"Disconnect from the server.                   \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_CLIENT_IS_CONNECTED,
+	"\"\"Check if connected to the server.             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if connected, false otherwise.           \n"
+	"\"\"                                              \n");
+	bool isConnected() const { return m_socket != INVALID_SOCKET; }
+
+	PY_DOC(DOC_CLIENT_TIMESTAMP,
+	"\"\"Get timestamp of the frame received last.     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Steady clock of the server when the frame was \n"
+	"    sent [nsec].                                  \n"
+	"\"\"                                              \n");
+	int64_t timestamp() const { return m_timestamp; }
+
+	PY_DOC(DOC_CLIENT_FRAME_COUNT,
+	"\"\"Get number of frames received.                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	uint64_t frameCount() const { return m_frameCount; }
+
+	PY_DOC(DOC_CLIENT_RESOLUTION,
+	"\"\"Get resolution of streamed frames.            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Resolution obj                                    \n"
+	"    Resolution of streamed frames.                \n"
+	"\"\"                                              \n");
+	Resolution resolution() const { return Resolution(m_header.width, m_header.height); }
+
+	PY_DOC(DOC_CLIENT_FRAMERATE_SHUTTER,
+	"\"\"Get framerate and shutter speed of the server.\n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int)                                        \n"
+	"    (framerate, shutter speed 1/x[sec])           \n"
+	"\"\"                                              \n");
+	std::tuple<int, int> framerateShutter() const
+	{
+		return std::tuple<int, int>(m_header.framerate, m_header.shutter);
+	}
+
+	PY_DOC(DOC_CLIENT_QUANTIZATION,
+	"\"\"Get quantization of streamed frames.          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"list(int)                                         \n"
+	"    Quantization value list.                      \n"
+	"\"\"                                              \n");
+	std::vector<int> quantization() const
+	{
+		return std::vector<int>(std::begin(m_header.quantization), std::end(m_header.quantization));
+	}
+
+	PY_DOC(DOC_CLIENT_DECODER,
+	"\"\"Get Decoder obj for streamed frames.          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Decoder obj                                       \n"
+	"    Decoder obj based on streamed quantization.   \n"
+	"\"\"                                              \n");
+	std::unique_ptr<Decoder> decoder();
+
+private:
+	bool wait(int timeout);
+	bool receive(void* dst, size_t size, int timeout);
+
+	// a record once started is waited at least this long [msec]
+	static constexpr int MIN_STALL_TIMEOUT = 1000;
+
+	SOCKET m_socket;
+	StreamHeader m_header;
+	int64_t m_timestamp;
+	uint64_t m_frameCount;
+};
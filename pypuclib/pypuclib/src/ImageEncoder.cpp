@@ -0,0 +1,579 @@
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+namespace
+{
+	// Base and extra bits of length codes 257 to 285 and distance codes
+	const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const int DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const int DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	// Order of code length code lengths in block header
+	const int CL_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	constexpr int LIT_COUNT = 286;
+	constexpr int DIST_COUNT = 30;
+	constexpr int CL_COUNT = 19;
+	constexpr int END_OF_BLOCK = 256;
+
+	template<int M>
+	struct CodeTable
+	{
+		CodeTable(const int* base, int count)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				int end = i + 1 < count ? base[i + 1] : M;
+				for (int v = base[i]; v < end && v < M; ++v) {
+					code[v] = (uint8_t)i;
+				}
+			}
+		}
+		uint8_t code[M];
+	};
+
+	// Code of each length 3 to 258 and distance 1 to 32768
+	const CodeTable<259> LENGTH_CODE(LENGTH_BASE, 29);
+	const CodeTable<32769> DIST_CODE(DIST_BASE, 30);
+
+	struct Crc32Table
+	{
+		Crc32Table()
+		{
+			for (uint32_t n = 0; n < 256; ++n)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				value[n] = c;
+			}
+		}
+		uint32_t value[256];
+	};
+	const Crc32Table CRC32;
+
+	uint32_t crc32(const uint8_t* p, size_t size)
+	{
+		uint32_t c = 0xFFFFFFFFu;
+		for (size_t i = 0; i < size; ++i) {
+			c = CRC32.value[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+		}
+		return c ^ 0xFFFFFFFFu;
+	}
+
+	uint32_t adler32(const uint8_t* p, size_t size)
+	{
+		uint32_t a = 1, b = 0;
+		while (size > 0)
+		{
+			// largest n that b does not overflow
+			size_t n = std::min<size_t>(size, 5552);
+			size -= n;
+			for (; n; --n)
+			{
+				a += *p++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	void putBE32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back((uint8_t)(v >> 24));
+		out.push_back((uint8_t)(v >> 16));
+		out.push_back((uint8_t)(v >> 8));
+		out.push_back((uint8_t)v);
+	}
+
+	void putLE16(std::vector<uint8_t>& out, uint16_t v)
+	{
+		out.push_back((uint8_t)v);
+		out.push_back((uint8_t)(v >> 8));
+	}
+
+	void putLE32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		putLE16(out, (uint16_t)v);
+		putLE16(out, (uint16_t)(v >> 16));
+	}
+
+	void setLE32(std::vector<uint8_t>& out, size_t pos, uint32_t v)
+	{
+		for (int i = 0; i < 4; ++i) {
+			out[pos + i] = (uint8_t)(v >> (8 * i));
+		}
+	}
+
+	// Huffman code lengths limited to maxLength. Lengths over the limit are
+	// cut and the counts are rebalanced to a complete code, then assigned
+	// again from the most frequent symbol.
+	void buildLengths(const uint32_t* freq, int n, int maxLength, uint8_t* lengths)
+	{
+		std::fill(lengths, lengths + n, (uint8_t)0);
+		std::vector<int> symbols;
+		for (int i = 0; i < n; ++i) {
+			if (freq[i]) {
+				symbols.push_back(i);
+			}
+		}
+
+		// a complete code needs two symbols at least
+		if (symbols.size() < 2)
+		{
+			int used = symbols.empty() ? 0 : symbols[0];
+			lengths[used] = 1;
+			lengths[used == 0 ? 1 : 0] = 1;
+			return;
+		}
+
+		std::stable_sort(symbols.begin(), symbols.end(), [&](int a, int b) { return freq[a] < freq[b]; });
+
+		// two queues of leaves and merged nodes, both in ascending order
+		const size_t m = symbols.size();
+		std::vector<uint64_t> weight(2 * m - 1);
+		std::vector<int> parent(2 * m - 1, -1);
+		for (size_t i = 0; i < m; ++i) {
+			weight[i] = freq[symbols[i]];
+		}
+		size_t leaf = 0, node = m;
+		for (size_t next = m; next < 2 * m - 1; ++next)
+		{
+			size_t pair[2];
+			for (auto& p : pair) {
+				p = (leaf < m && (node >= next || weight[leaf] <= weight[node])) ? leaf++ : node++;
+			}
+			weight[next] = weight[pair[0]] + weight[pair[1]];
+			parent[pair[0]] = parent[pair[1]] = (int)next;
+		}
+
+		std::vector<int> depth(2 * m - 1, 0);
+		std::vector<int> count(maxLength + 1, 0);
+		for (int i = (int)(2 * m) - 3; i >= 0; --i)
+		{
+			depth[i] = depth[parent[i]] + 1;
+			if (i < (int)m) {
+				count[std::min(depth[i], maxLength)]++;
+			}
+		}
+
+		uint32_t total = 0;
+		for (int l = 1; l <= maxLength; ++l) {
+			total += (uint32_t)count[l] << (maxLength - l);
+		}
+		while (total > (1u << maxLength))
+		{
+			count[maxLength]--;
+			for (int l = maxLength - 1; l > 0; --l)
+			{
+				if (count[l])
+				{
+					count[l]--;
+					count[l + 1] += 2;
+					break;
+				}
+			}
+			total--;
+		}
+
+		size_t k = 0;
+		for (int l = maxLength; l >= 1; --l) {
+			for (int c = 0; c < count[l]; ++c) {
+				lengths[symbols[k++]] = (uint8_t)l;
+			}
+		}
+	}
+
+	// Canonical codes, bit reversed since deflate packs bits from LSB
+	void buildCodes(const uint8_t* lengths, int n, uint16_t* codes)
+	{
+		int count[16] = { 0 };
+		for (int i = 0; i < n; ++i) {
+			count[lengths[i]]++;
+		}
+		count[0] = 0;
+
+		int next[16] = { 0 };
+		int code = 0;
+		for (int bits = 1; bits < 16; ++bits)
+		{
+			code = (code + count[bits - 1]) << 1;
+			next[bits] = code;
+		}
+
+		for (int i = 0; i < n; ++i)
+		{
+			int len = lengths[i];
+			codes[i] = 0;
+			if (len == 0) {
+				continue;
+			}
+			int c = next[len]++;
+			int r = 0;
+			for (int b = 0; b < len; ++b) {
+				r |= ((c >> b) & 1) << (len - 1 - b);
+			}
+			codes[i] = (uint16_t)r;
+		}
+	}
+
+	inline int paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) {
+			return a;
+		}
+		return pb <= pc ? b : c;
+	}
+
+	// PNG filter of type to x of line, a/b/c are left, up and up left
+	inline uint8_t filter(int type, const uint8_t* line, const uint8_t* prev, int x)
+	{
+		int a = x > 0 ? line[x - 1] : 0;
+		int b = prev ? prev[x] : 0;
+		int c = (x > 0 && prev) ? prev[x - 1] : 0;
+		switch (type)
+		{
+		case 1: return (uint8_t)(line[x] - a);
+		case 2: return (uint8_t)(line[x] - b);
+		case 3: return (uint8_t)(line[x] - ((a + b) >> 1));
+		case 4: return (uint8_t)(line[x] - paeth(a, b, c));
+		default: return line[x];
+		}
+	}
+}
+
+// Each line takes the filter of the minimum sum of absolute signed bytes,
+// the heuristic recommended by PNG specification.
+void ImageEncoder::png(const uint8_t* src, int w, int h, int lineBytes, std::vector<uint8_t>& out)
+{
+	m_filtered.resize((size_t)(w + 1) * h);
+	for (int y = 0; y < h; ++y)
+	{
+		const uint8_t* line = src + (size_t)lineBytes * y;
+		const uint8_t* prev = y > 0 ? line - lineBytes : nullptr;
+
+		int best = 0;
+		uint64_t bestSum = UINT64_MAX;
+		for (int type = 0; type < 5; ++type)
+		{
+			uint64_t sum = 0;
+			for (int x = 0; x < w && sum < bestSum; ++x) {
+				sum += std::abs((int8_t)filter(type, line, prev, x));
+			}
+			if (sum < bestSum)
+			{
+				bestSum = sum;
+				best = type;
+			}
+		}
+
+		uint8_t* dst = m_filtered.data() + (size_t)(w + 1) * y;
+		dst[0] = (uint8_t)best;
+		for (int x = 0; x < w; ++x) {
+			dst[x + 1] = filter(best, line, prev, x);
+		}
+	}
+
+	static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.assign(SIGNATURE, SIGNATURE + 8);
+
+	putBE32(out, 13);
+	size_t begin = out.size();
+	out.insert(out.end(), { 'I', 'H', 'D', 'R' });
+	putBE32(out, (uint32_t)w);
+	putBE32(out, (uint32_t)h);
+	out.insert(out.end(), { 8, 0, 0, 0, 0 });
+	putBE32(out, crc32(out.data() + begin, out.size() - begin));
+
+	size_t lengthPos = out.size();
+	putBE32(out, 0);
+	begin = out.size();
+	out.insert(out.end(), { 'I', 'D', 'A', 'T' });
+	deflate(m_filtered.data(), m_filtered.size(), out);
+	uint32_t length = (uint32_t)(out.size() - begin - 4);
+	for (int i = 0; i < 4; ++i) {
+		out[lengthPos + i] = (uint8_t)(length >> (24 - 8 * i));
+	}
+	putBE32(out, crc32(out.data() + begin, out.size() - begin));
+
+	putBE32(out, 0);
+	begin = out.size();
+	out.insert(out.end(), { 'I', 'E', 'N', 'D' });
+	putBE32(out, crc32(out.data() + begin, out.size() - begin));
+}
+
+// Little endian TIFF of a single strip, deflate with horizontal predictor
+void ImageEncoder::tiff(const uint8_t* src, int w, int h, int lineBytes, std::vector<uint8_t>& out)
+{
+	m_filtered.resize((size_t)w * h);
+	for (int y = 0; y < h; ++y)
+	{
+		const uint8_t* line = src + (size_t)lineBytes * y;
+		uint8_t* dst = m_filtered.data() + (size_t)w * y;
+		dst[0] = line[0];
+		for (int x = 1; x < w; ++x) {
+			dst[x] = (uint8_t)(line[x] - line[x - 1]);
+		}
+	}
+
+	static constexpr uint16_t SHORT = 3;
+	static constexpr uint16_t LONG = 4;
+	static constexpr int ENTRY_COUNT = 10;
+	const uint32_t dataOffset = 8 + 2 + ENTRY_COUNT * 12 + 4;
+
+	out.clear();
+	out.insert(out.end(), { 'I', 'I', 42, 0 });
+	putLE32(out, 8);
+
+	size_t byteCountPos = 0;
+	auto entry = [&](uint16_t tag, uint16_t type, uint32_t value)
+	{
+		putLE16(out, tag);
+		putLE16(out, type);
+		putLE32(out, 1);
+		if (type == SHORT)
+		{
+			putLE16(out, (uint16_t)value);
+			putLE16(out, 0);
+		}
+		else {
+			putLE32(out, value);
+		}
+	};
+	putLE16(out, ENTRY_COUNT);
+	entry(256, LONG, (uint32_t)w);		// ImageWidth
+	entry(257, LONG, (uint32_t)h);		// ImageLength
+	entry(258, SHORT, 8);				// BitsPerSample
+	entry(259, SHORT, 8);				// Compression, deflate
+	entry(262, SHORT, 1);				// PhotometricInterpretation, BlackIsZero
+	entry(273, LONG, dataOffset);		// StripOffsets
+	entry(277, SHORT, 1);				// SamplesPerPixel
+	entry(278, LONG, (uint32_t)h);		// RowsPerStrip
+	byteCountPos = out.size() + 8;
+	entry(279, LONG, 0);				// StripByteCounts
+	entry(317, SHORT, 2);				// Predictor, horizontal differencing
+	putLE32(out, 0);
+
+	deflate(m_filtered.data(), m_filtered.size(), out);
+	setLE32(out, byteCountPos, (uint32_t)(out.size() - dataOffset));
+}
+
+// zlib stream of src appended to out
+void ImageEncoder::deflate(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+{
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	m_bits = 0;
+	m_count = 0;
+	m_tokens.clear();
+	m_tokens.reserve(BLOCK_TOKENS);
+	m_head.assign((size_t)1 << HASH_BITS, -1);
+
+	auto hash = [&](size_t i)
+	{
+		uint32_t v;
+		memcpy(&v, src + i, sizeof(v));
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	};
+
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t best = 0;
+		size_t dist = 0;
+		if (i + MIN_MATCH <= size)
+		{
+			uint32_t h = hash(i);
+			int32_t cand = m_head[h];
+			m_head[h] = (int32_t)i;
+			if (cand >= 0 && i - cand <= WINDOW)
+			{
+				size_t maxLen = std::min<size_t>(MAX_MATCH, size - i);
+				size_t len = 0;
+				while (len < maxLen && src[cand + len] == src[i + len]) {
+					++len;
+				}
+				if (len >= MIN_MATCH)
+				{
+					best = len;
+					dist = i - cand;
+				}
+			}
+		}
+
+		if (best)
+		{
+			m_tokens.push_back((uint32_t)(best << 16 | dist));
+			size_t end = i + best;
+			for (++i; i < end; ++i) {
+				if (i + MIN_MATCH <= size) {
+					m_head[hash(i)] = (int32_t)i;
+				}
+			}
+		}
+		else
+		{
+			m_tokens.push_back(src[i]);
+			++i;
+		}
+
+		if (m_tokens.size() >= BLOCK_TOKENS) {
+			writeBlock(out, false);
+		}
+	}
+	writeBlock(out, true);
+	if (m_count > 0) {
+		put(out, 0, 8 - m_count);
+	}
+
+	putBE32(out, adler32(src, size));
+}
+
+// Dynamic Huffman block of the tokens so far
+void ImageEncoder::writeBlock(std::vector<uint8_t>& out, bool last)
+{
+	uint32_t litFreq[LIT_COUNT] = { 0 };
+	uint32_t distFreq[DIST_COUNT] = { 0 };
+	for (auto t : m_tokens)
+	{
+		if (t < 256) {
+			litFreq[t]++;
+		}
+		else
+		{
+			litFreq[257 + LENGTH_CODE.code[t >> 16]]++;
+			distFreq[DIST_CODE.code[t & 0xFFFF]]++;
+		}
+	}
+	litFreq[END_OF_BLOCK] = 1;
+
+	uint8_t litLen[LIT_COUNT];
+	uint8_t distLen[DIST_COUNT];
+	uint16_t litCode[LIT_COUNT];
+	uint16_t distCode[DIST_COUNT];
+	buildLengths(litFreq, LIT_COUNT, 15, litLen);
+	buildLengths(distFreq, DIST_COUNT, 15, distLen);
+	buildCodes(litLen, LIT_COUNT, litCode);
+	buildCodes(distLen, DIST_COUNT, distCode);
+
+	int hlit = LIT_COUNT;
+	while (hlit > 257 && litLen[hlit - 1] == 0) {
+		--hlit;
+	}
+	int hdist = DIST_COUNT;
+	while (hdist > 1 && distLen[hdist - 1] == 0) {
+		--hdist;
+	}
+	uint8_t lengths[LIT_COUNT + DIST_COUNT];
+	memcpy(lengths, litLen, hlit);
+	memcpy(lengths + hlit, distLen, hdist);
+
+	// run length of code lengths, symbol and extra bits
+	std::vector<std::pair<uint8_t, uint8_t>> runs;
+	uint32_t clFreq[CL_COUNT] = { 0 };
+	const int total = hlit + hdist;
+	for (int i = 0; i < total;)
+	{
+		int len = lengths[i];
+		int run = 1;
+		while (i + run < total && lengths[i + run] == len) {
+			++run;
+		}
+		i += run;
+
+		if (len == 0)
+		{
+			for (; run >= 11; run -= std::min(run, 138)) {
+				runs.emplace_back(18, (uint8_t)(std::min(run, 138) - 11));
+			}
+			if (run >= 3)
+			{
+				runs.emplace_back(17, (uint8_t)(run - 3));
+				run = 0;
+			}
+		}
+		else
+		{
+			runs.emplace_back(len, 0);
+			for (--run; run >= 3; run -= std::min(run, 6)) {
+				runs.emplace_back(16, (uint8_t)(std::min(run, 6) - 3));
+			}
+		}
+		for (; run > 0; --run) {
+			runs.emplace_back(len, 0);
+		}
+	}
+	for (auto& r : runs) {
+		clFreq[r.first]++;
+	}
+
+	uint8_t clLen[CL_COUNT];
+	uint16_t clCode[CL_COUNT];
+	buildLengths(clFreq, CL_COUNT, 7, clLen);
+	buildCodes(clLen, CL_COUNT, clCode);
+	int hclen = CL_COUNT;
+	while (hclen > 4 && clLen[CL_ORDER[hclen - 1]] == 0) {
+		--hclen;
+	}
+
+	put(out, last ? 1 : 0, 1);
+	put(out, 2, 2);
+	put(out, hlit - 257, 5);
+	put(out, hdist - 1, 5);
+	put(out, hclen - 4, 4);
+	for (int i = 0; i < hclen; ++i) {
+		put(out, clLen[CL_ORDER[i]], 3);
+	}
+	for (auto& r : runs)
+	{
+		put(out, clCode[r.first], clLen[r.first]);
+		if (r.first == 16) {
+			put(out, r.second, 2);
+		}
+		else if (r.first == 17) {
+			put(out, r.second, 3);
+		}
+		else if (r.first == 18) {
+			put(out, r.second, 7);
+		}
+	}
+
+	for (auto t : m_tokens)
+	{
+		if (t < 256)
+		{
+			put(out, litCode[t], litLen[t]);
+			continue;
+		}
+		int len = t >> 16;
+		int dist = t & 0xFFFF;
+		int lc = LENGTH_CODE.code[len];
+		int dc = DIST_CODE.code[dist];
+		put(out, litCode[257 + lc], litLen[257 + lc]);
+		put(out, len - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+		put(out, distCode[dc], distLen[dc]);
+		put(out, dist - DIST_BASE[dc], DIST_EXTRA[dc]);
+	}
+	put(out, litCode[END_OF_BLOCK], litLen[END_OF_BLOCK]);
+	m_tokens.clear();
+}
+
+void ImageEncoder::put(std::vector<uint8_t>& out, uint32_t value, int size)
+{
+	m_bits |= (uint64_t)value << m_count;
+	m_count += size;
+	while (m_count >= 8)
+	{
+		out.push_back((uint8_t)m_bits);
+		m_bits >>= 8;
+		m_count -= 8;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Lossless 8 bit grayscale PNG and TIFF encoder. Both are zlib streams of
+// filtered lines, by greedy LZ77 and dynamic Huffman blocks of deflate.
+// Scratch buffers are kept, so each thread should own one encoder.
+class ImageEncoder
+{
+public:
+	ImageEncoder() : m_bits(0), m_count(0) {}
+	~ImageEncoder() {}
+	ImageEncoder(const ImageEncoder& obj) = delete;
+	ImageEncoder& operator=(const ImageEncoder& obj) = delete;
+
+	// Lines of src are w bytes at every lineBytes. out is replaced.
+	void png(const uint8_t* src, int w, int h, int lineBytes, std::vector<uint8_t>& out);
+	void tiff(const uint8_t* src, int w, int h, int lineBytes, std::vector<uint8_t>& out);
+
+private:
+	void deflate(const uint8_t* src, size_t size, std::vector<uint8_t>& out);
+	void writeBlock(std::vector<uint8_t>& out, bool last);
+	void put(std::vector<uint8_t>& out, uint32_t value, int size);
+
+	static constexpr int WINDOW = 32768;
+	static constexpr int HASH_BITS = 15;
+	static constexpr int MIN_MATCH = 4;
+	static constexpr int MAX_MATCH = 258;
+	static constexpr size_t BLOCK_TOKENS = 1 << 16;
+
+	std::vector<uint8_t> m_filtered;
+	std::vector<int32_t> m_head;
+	// literal or (length << 16 | distance) of each LZ77 token
+	std::vector<uint32_t> m_tokens;
+	uint64_t m_bits;
+	int m_count;
+};
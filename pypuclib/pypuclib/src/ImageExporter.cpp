@@ -0,0 +1,303 @@
+#include "ImageExporter.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <exception>
+#include "ImageEncoder.h"
+#include "CameraFactory.h"
+
+static void writeFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+	int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::vector<wchar_t> wpath(len > 0 ? len : 1, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath.data(), len);
+
+	HANDLE h = CreateFileW(wpath.data(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (h == INVALID_HANDLE_VALUE) {
+		throw(WrapperException("couldn't open file: " + path));
+	}
+
+	DWORD written = 0;
+	BOOL ok = WriteFile(h, data.data(), (DWORD)data.size(), &written, nullptr);
+	CloseHandle(h);
+	if (!ok || written != data.size()) {
+		throw(WrapperException("failed to write file: " + path));
+	}
+}
+
+ImageExporter::ImageExporter(const std::string& directory, const std::string& format,
+	const std::string& prefix, int numThread, int maxPending)
+	:
+	m_directory(directory),
+	m_prefix(prefix),
+	m_numThread(numThread),
+	m_maxPending(maxPending)
+{
+	if (format == "png") {
+		m_extension = ".png";
+	}
+	else if (format == "tiff") {
+		m_extension = ".tif";
+	}
+	else {
+		throw(WrapperException("format may be illegal."));
+	}
+
+	if (numThread < 0 || maxPending < 0) {
+		throw(WrapperException("number of thread may be illegal."));
+	}
+	if (m_numThread == 0) {
+		m_numThread = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	if (m_maxPending == 0) {
+		m_maxPending = m_numThread * 2;
+	}
+
+	if (!m_directory.empty() && m_directory.back() != '/' && m_directory.back() != '\\') {
+		m_directory += '\\';
+	}
+	CameraFactory::initialize();
+}
+
+std::string ImageExporter::fileName(int64_t sequenceNo) const
+{
+	char number[32];
+	snprintf(number, sizeof(number), "%06lld", (long long)sequenceNo);
+	return m_directory + m_prefix + number + m_extension;
+}
+
+ExportStats ImageExporter::write(FrameReader& reader, int start, int count)
+{
+	const int64_t frameCount = (int64_t)reader.frameCount();
+	if (count < 0) {
+		count = (int)(frameCount - start);
+	}
+	if (start < 0 || count <= 0 || start + (int64_t)count > frameCount) {
+		throw(WrapperException("frame range is out of file."));
+	}
+
+	auto q = reader.quantization();
+	return run(count, reader.resolution(), Quantization(q.begin(), q.end()),
+		[&](int64_t i, std::vector<uint8_t>& dst) { return reader.readInto((int)(start + i), dst); });
+}
+
+ExportStats ImageExporter::write(py::array_t<uint8_t>& data, py::array_t<int64_t>& offsets, py::array_t<uint16_t>& sequenceNo,
+	const Resolution& res, const std::vector<int>& q)
+{
+	if (q.size() != PUC_Q_COUNT) {
+		throw(WrapperException("quantization may be illegal size."));
+	}
+
+	const int64_t count = (int64_t)sequenceNo.size();
+	const int64_t* off = offsets.data();
+	if (count <= 0 || offsets.size() != count + 1) {
+		throw(WrapperException("offsets may be illegal size."));
+	}
+	for (int64_t i = 0; i < count; ++i) {
+		if (off[i] < 0 || off[i] > off[i + 1] || off[i + 1] > (int64_t)data.size()) {
+			throw(WrapperException("offsets may be illegal."));
+		}
+	}
+
+	Quantization table(PUC_Q_COUNT);
+	for (int i = 0; i < PUC_Q_COUNT; ++i) {
+		table[i] = (unsigned short)std::min(std::max(q[i], 0), USHRT_MAX);
+	}
+
+	const uint8_t* src = data.data();
+	const uint16_t* seq = sequenceNo.data();
+	return run(count, res, table, [&](int64_t i, std::vector<uint8_t>& dst)
+	{
+		dst.assign(src + off[i], src + off[i + 1]);
+		return seq[i];
+	});
+}
+
+// The calling thread reads frames, numThread workers decode and encode, and
+// a writer thread writes files in frame order. Workers and the writer reuse
+// frames the writer returns, so memory is bounded by maxPending frames.
+ExportStats ImageExporter::run(int64_t count, const Resolution& res, const Quantization& q, const ReadFn& read)
+{
+	if (res.width <= 0 || res.height <= 0) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+
+	struct Frame
+	{
+		std::string path;
+		std::vector<uint8_t> data;
+		std::vector<uint8_t> image;
+		std::vector<uint8_t> file;
+		bool done;
+	};
+
+	const int w = res.width;
+	const int h = res.height;
+	const int lineBytes = ALIGN(w, 4);
+	const bool png = m_extension == ".png";
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::unique_ptr<Frame>> pending;		// in frame order
+	std::deque<Frame*> todo;
+	std::vector<std::unique_ptr<Frame>> spare;
+	bool readDone = false;
+	bool stop = false;
+	std::exception_ptr error;
+	ExportStats stats;
+
+	auto fail = [&]()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!error) {
+			error = std::current_exception();
+		}
+		stop = true;
+		cond.notify_all();
+	};
+
+	auto work = [&]()
+	{
+		ImageEncoder encoder;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			cond.wait(lock, [&] { return stop || !todo.empty() || readDone; });
+			if (stop || todo.empty()) {
+				break;
+			}
+			Frame* frame = todo.front();
+			todo.pop_front();
+			lock.unlock();
+
+			try
+			{
+				frame->image.resize((size_t)lineBytes * h);
+				auto ret = PUC_DecodeData(frame->image.data(), 0, 0, w, h, lineBytes, frame->data.data(), (PUSHORT)q.data());
+				if (PUC_CHK_FAILED(ret)) {
+					throw(PUCException("PUC_DecodeData", ret));
+				}
+				if (png) {
+					encoder.png(frame->image.data(), w, h, lineBytes, frame->file);
+				}
+				else {
+					encoder.tiff(frame->image.data(), w, h, lineBytes, frame->file);
+				}
+			}
+			catch (...)
+			{
+				fail();
+				lock.lock();
+				break;
+			}
+
+			lock.lock();
+			frame->done = true;
+			cond.notify_all();
+		}
+	};
+
+	auto writeWork = [&]()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			cond.wait(lock, [&] { return stop || (!pending.empty() && pending.front()->done) || (readDone && pending.empty()); });
+			if (stop || pending.empty()) {
+				break;
+			}
+			std::unique_ptr<Frame> frame = std::move(pending.front());
+			pending.pop_front();
+			lock.unlock();
+
+			try {
+				writeFile(frame->path, frame->file);
+			}
+			catch (...)
+			{
+				fail();
+				lock.lock();
+				break;
+			}
+
+			lock.lock();
+			stats.frames++;
+			stats.bytes += frame->file.size();
+			spare.push_back(std::move(frame));
+			cond.notify_all();
+		}
+	};
+
+	auto begin = std::chrono::steady_clock::now();
+	{
+		OptionalGilRelease release;
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < m_numThread; ++t) {
+			threads.emplace_back(work);
+		}
+		threads.emplace_back(writeWork);
+
+		// sequence number keeps counting up over 65535
+		int64_t sequenceNo = 0;
+		uint16_t last = 0;
+		for (int64_t i = 0; i < count; ++i)
+		{
+			std::unique_ptr<Frame> frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&] { return stop || (int)pending.size() < m_maxPending; });
+				if (stop) {
+					break;
+				}
+				if (!spare.empty())
+				{
+					frame = std::move(spare.back());
+					spare.pop_back();
+				}
+			}
+			if (!frame) {
+				frame = std::make_unique<Frame>();
+			}
+
+			try
+			{
+				uint16_t seq = read(i, frame->data);
+				sequenceNo = i == 0 ? seq : sequenceNo + (uint16_t)(seq - last);
+				last = seq;
+				frame->path = fileName(sequenceNo);
+				frame->done = false;
+			}
+			catch (...)
+			{
+				fail();
+				break;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			todo.push_back(frame.get());
+			pending.push_back(std::move(frame));
+			cond.notify_all();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			readDone = true;
+			cond.notify_all();
+		}
+		for (auto& th : threads) {
+			th.join();
+		}
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	stats.fps = stats.seconds > 0 ? stats.frames / stats.seconds : 0;
+	return stats;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <functional>
+#include <memory>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+#include "FrameFile.h"
+
+namespace py = pybind11;
+
+class ExportStats
+{
+public:
+	PY_DOC(DOC_CLASS_EXPORT_STATS,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Result of image export.                           \n"
+	"                                                  \n"
+	"Attributes                                        \n"
+	"----------                                        \n"
+	"frames : int                                      \n"
+	"    Number of image files written.                \n"
+	"bytes : int                                       \n"
+	"    Total bytes of the files.                     \n"
+	"seconds : float                                   \n"
+	"    Elapsed time of the export.                   \n"
+	"fps : float                                       \n"
+	"    Frames per second of the export.              \n"
+	"\"\"                                              \n");
+public:
+	ExportStats() : frames(0), bytes(0), seconds(0), fps(0) {}
+	~ExportStats() {}
+
+	int64_t frames;
+	int64_t bytes;
+	double seconds;
+	double fps;
+};
+
+// Exports compressed frames to numbered PNG or TIFF files. Frames are read
+// in order, decoded and encoded on worker threads, and written by one
+// thread in frame order, so files of an interrupted export are always the
+// first frames. At most maxPending frames are in the pipeline.
+class ImageExporter
+{
+public:
+	PY_DOC(DOC_CLASS_IMAGE_EXPORTER,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Exporter of compressed frames to image files.     \n"
+	"                                                  \n"
+	"Frames are decoded and compressed to 8 bit        \n"
+	"grayscale PNG or TIFF on several threads. Files   \n"
+	"are named by sequence number, which keeps         \n"
+	"counting up over 65535, as prefix000123.png.      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"directory : str                                   \n"
+	"    Existing directory to write files.            \n"
+	"format : str                                      \n"
+	"    'png' or 'tiff'. (default='png')              \n"
+	"prefix : str                                      \n"
+	"    Prefix of file names. (default='')            \n"
+	"numThread : int                                   \n"
+	"    Number of encode threads. 0 for number of     \n"
+	"    processors. (default=0)                       \n"
+	"maxPending : int                                  \n"
+	"    Max frames in the pipeline. 0 for twice the   \n"
+	"    number of threads. (default=0)                \n"
+	"\"\"                                              \n");
+	ImageExporter(const std::string& directory, const std::string& format = "png",
+		const std::string& prefix = "", int numThread = 0, int maxPending = 0);
+	~ImageExporter() {}
+	ImageExporter(const ImageExporter& obj) = delete;
+	ImageExporter& operator=(const ImageExporter& obj) = delete;
+
+	PY_DOC(DOC_EXPORT_A,
+	"\"\"Export frames of recorded file.               \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"reader : FrameReader obj                          \n"
+	"    Recorded file to export.                      \n"
+	"start : int                                       \n"
+	"    First frame number. (default=0)               \n"
+	"count : int                                       \n"
+	"    Number of frames. -1 for all frames from      \n"
+	"    start. (default=-1)                           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"ExportStats obj                                   \n"
+	"    Number of files, bytes and speed.             \n"
+	"\"\"                                              \n");
+	ExportStats write(FrameReader& reader, int start, int count);
+
+	PY_DOC(DOC_EXPORT_B,
+	"\"\"Export frames in memory.                      \n"
+	"                                                  \n"
+	"Frames are packed back to back as returned by     \n"
+	"FrameReader.readRange().                          \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : numpy array(uint8)                         \n"
+	"    Compressed data of frames.                    \n"
+	"offsets : numpy array(int64)                      \n"
+	"    Frame i is data[offsets[i]:offsets[i+1]].     \n"
+	"sequenceNo : numpy array(uint16)                  \n"
+	"    Sequence number of each frame.                \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of frames.                         \n"
+	"q : list(int)                                     \n"
+	"    Quantization list of frames.                  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"ExportStats obj                                   \n"
+	"    Number of files, bytes and speed.             \n"
+	"\"\"                                              \n");
+	ExportStats write(py::array_t<uint8_t>& data, py::array_t<int64_t>& offsets, py::array_t<uint16_t>& sequenceNo,
+		const Resolution& res, const std::vector<int>& q);
+
+	PY_DOC(DOC_EXPORT_FILE_NAME,
+	"\"\"Get file name of sequence number.             \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"sequenceNo : int                                  \n"
+	"    Sequence number counted over 65535.           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"str                                               \n"
+	"    Path of the file.                             \n"
+	"\"\"                                              \n");
+	std::string fileName(int64_t sequenceNo) const;
+
+private:
+	using Quantization = std::vector<unsigned short>;
+	// Reads frame i into the buffer and returns its sequence number.
+	using ReadFn = std::function<uint16_t(int64_t, std::vector<uint8_t>&)>;
+
+	ExportStats run(int64_t count, const Resolution& res, const Quantization& q, const ReadFn& read);
+
+	std::string m_directory;
+	std::string m_extension;
+	std::string m_prefix;
+	int m_numThread;
+	int m_maxPending;
+};
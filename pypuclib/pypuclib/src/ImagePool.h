@@ -0,0 +1,116 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include "Common.h"
+#include "Exception.h"
+
+namespace py = pybind11;
+
+// Recycles aligned image buffers, so memoized images of consecutive
+// frames reuse the same few buffers. A buffer returns to the pool when the
+// last cache or numpy array referring it is released, and is freed instead
+// if the pool is already gone.
+class ImagePool : public std::enable_shared_from_this<ImagePool>
+{
+public:
+	ImagePool(size_t capacity = DEFAULT_CAPACITY)
+		:
+		m_capacity(capacity)
+	{
+		m_free.reserve(capacity);
+	}
+	~ImagePool()
+	{
+		for (auto& f : m_free) {
+			_aligned_free(f.p);
+		}
+	}
+	ImagePool(const ImagePool& obj) = delete;
+	ImagePool& operator=(const ImagePool& obj) = delete;
+
+	std::shared_ptr<uint8_t> acquire(size_t size, size_t align)
+	{
+		uint8_t* p = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = m_free.size(); i > 0; --i)
+			{
+				if (m_free[i - 1].size == size && m_free[i - 1].align == align)
+				{
+					p = m_free[i - 1].p;
+					m_free.erase(m_free.begin() + (i - 1));
+					break;
+				}
+			}
+		}
+		if (!p)
+		{
+			p = (uint8_t*)_aligned_malloc(size, align);
+			if (!p) {
+				throw(WrapperException("bad memory allocation"));
+			}
+		}
+
+		std::weak_ptr<ImagePool> pool = shared_from_this();
+		return std::shared_ptr<uint8_t>(p, [pool, size, align](uint8_t* p)
+		{
+			if (auto owner = pool.lock()) {
+				owner->recycle(Buffer{ p, size, align });
+			}
+			else {
+				_aligned_free(p);
+			}
+		});
+	}
+
+	// Numpy array of (h, w) with lineBytes on the buffer. The array keeps
+	// the buffer alive.
+	static py::array_t<uint8_t> view(const std::shared_ptr<uint8_t>& buffer, int w, int h, int lineBytes)
+	{
+		auto holder = new std::shared_ptr<uint8_t>(buffer);
+		py::capsule owner(holder, [](void* f) { delete (std::shared_ptr<uint8_t>*)f; });
+		return py::array_t<uint8_t>({ h, w }, { lineBytes, 1 }, buffer.get(), owner);
+	}
+
+	size_t freeCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_free.size();
+	}
+
+private:
+	struct Buffer
+	{
+		uint8_t* p;
+		size_t size;
+		size_t align;
+	};
+
+	// The oldest buffer is dropped when full, so sizes no longer used
+	// leave the pool soon.
+	void recycle(const Buffer& buffer)
+	{
+		Buffer drop = { nullptr, 0, 0 };
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_free.size() >= m_capacity)
+			{
+				drop = m_free.front();
+				m_free.erase(m_free.begin());
+			}
+			m_free.push_back(buffer);
+		}
+		if (drop.p) {
+			_aligned_free(drop.p);
+		}
+	}
+
+	static constexpr size_t DEFAULT_CAPACITY = 8;
+
+	mutable std::mutex m_mutex;
+	size_t m_capacity;
+	std::vector<Buffer> m_free;
+};
@@ -0,0 +1,461 @@
+#pragma once
+
+#include "Common.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNEL_SSE2
+#endif
+
+// AVX2 kernels are compiled always and selected at runtime by cpuHasAVX2(),
+// so the module still loads on CPUs without AVX2.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define KERNEL_AVX2
+#define KERNEL_AVX2_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define KERNEL_AVX2
+#define KERNEL_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+inline bool cpuHasAVX2()
+{
+#if defined(KERNEL_AVX2) && defined(_MSC_VER)
+	static const bool has = []
+	{
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		// OS must save ymm registers
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+			return false;
+		}
+		if ((_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}();
+	return has;
+#elif defined(KERNEL_AVX2)
+	static const bool has = __builtin_cpu_supports("avx2");
+	return has;
+#else
+	return false;
+#endif
+}
+
+// Sum `rows` lines of 8bit pixels column by column into 16bit.
+// rows must be 256 or less to avoid overflow.
+inline void sumColumns(const uint8_t* src, int lineBytes, int rows, int w, uint16_t* colsum)
+{
+	int x = 0;
+#ifdef KERNEL_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= w; x += 16)
+	{
+		__m128i lo = zero;
+		__m128i hi = zero;
+		for (int r = 0; r < rows; ++r)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + lineBytes * r + x));
+			lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+			hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+		}
+		_mm_storeu_si128((__m128i*)(colsum + x), lo);
+		_mm_storeu_si128((__m128i*)(colsum + x + 8), hi);
+	}
+#endif
+	for (; x < w; ++x)
+	{
+		uint16_t sum = 0;
+		for (int r = 0; r < rows; ++r) {
+			sum += src[lineBytes * r + x];
+		}
+		colsum[x] = sum;
+	}
+}
+
+// Average scale x scale blocks of `scale` lines into one line of ow pixels.
+// scale must be power of 2.
+inline void boxReduceLine(const uint8_t* src, int lineBytes, int scale, uint16_t* colsum, uint8_t* dst, int ow)
+{
+	sumColumns(src, lineBytes, scale, ow * scale, colsum);
+
+	int shift = 0;
+	while ((1 << shift) < scale * scale) {
+		++shift;
+	}
+	const unsigned int round = 1u << (shift - 1);
+
+	for (int ox = 0; ox < ow; ++ox)
+	{
+		const uint16_t* p = colsum + ox * scale;
+		unsigned int sum = 0;
+		for (int i = 0; i < scale; ++i) {
+			sum += p[i];
+		}
+		dst[ox] = (uint8_t)((sum + round) >> shift);
+	}
+}
+
+// Pick every `scale` pixel of one line.
+inline void subsampleLine(const uint8_t* src, int scale, uint8_t* dst, int ow)
+{
+	for (int ox = 0; ox < ow; ++ox) {
+		dst[ox] = src[ox * scale];
+	}
+}
+
+// Copy each pixel of one line to `channels` interleaved channels.
+inline void replicateLine(const uint8_t* src, uint8_t* dst, int w, int channels)
+{
+	if (channels == 1) {
+		memcpy(dst, src, w);
+		return;
+	}
+	for (int x = 0; x < w; ++x)
+	{
+		uint8_t v = src[x];
+		for (int c = 0; c < channels; ++c) {
+			dst[x * channels + c] = v;
+		}
+	}
+}
+
+// Convert one line of 8bit pixels to float by 256 entries lookup table.
+inline void lookupLine(const uint8_t* src, const float* lut, float* dst, int w)
+{
+	for (int x = 0; x < w; ++x) {
+		dst[x] = lut[src[x]];
+	}
+}
+
+static constexpr int HISTOGRAM_WAYS = 4;
+
+// Count one line of 8bit pixels into HISTOGRAM_WAYS histograms by turns,
+// so runs of same value don't wait for increment of one counter.
+inline void histogramLine(const uint8_t* src, int w, uint32_t count[HISTOGRAM_WAYS][256])
+{
+	int x = 0;
+	for (; x + 8 <= w; x += 8)
+	{
+		uint64_t v;
+		memcpy(&v, src + x, sizeof(v));
+		++count[0][v & 0xff];
+		++count[1][(v >> 8) & 0xff];
+		++count[2][(v >> 16) & 0xff];
+		++count[3][(v >> 24) & 0xff];
+		++count[0][(v >> 32) & 0xff];
+		++count[1][(v >> 40) & 0xff];
+		++count[2][(v >> 48) & 0xff];
+		++count[3][v >> 56];
+	}
+	for (; x < w; ++x) {
+		++count[0][src[x]];
+	}
+}
+
+#ifdef KERNEL_AVX2
+KERNEL_AVX2_TARGET inline int absDiffLineAVX2(const uint8_t* a, const uint8_t* b, uint8_t* dst, int w, int threshold)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_cmpeq_epi8(zero, zero);
+	const __m256i thr = _mm256_set1_epi8((char)std::min(std::max(threshold, 0), 255));
+	int x = 0;
+	for (; x + 32 <= w; x += 32)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+		__m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+		if (threshold >= 0) {
+			d = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(d, thr), zero), ones);
+		}
+		_mm256_storeu_si256((__m256i*)(dst + x), d);
+	}
+	return x;
+}
+
+KERNEL_AVX2_TARGET inline int accumulateLineAVX2(const uint8_t* src, const uint8_t* old, uint16_t* sum, int w)
+{
+	int x = 0;
+	for (; x + 16 <= w; x += 16)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)(sum + x));
+		__m256i n = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x)));
+		__m256i o = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(old + x)));
+		_mm256_storeu_si256((__m256i*)(sum + x), _mm256_sub_epi16(_mm256_add_epi16(s, n), o));
+	}
+	return x;
+}
+
+KERNEL_AVX2_TARGET inline int backgroundLineAVX2(const uint8_t* src, float* mean, float* var, uint8_t* mask, int w,
+	float alpha, float k2, float minVar)
+{
+	const __m256 va = _mm256_set1_ps(alpha);
+	const __m256 vb = _mm256_set1_ps(1.0f - alpha);
+	const __m256 vk2 = _mm256_set1_ps(k2);
+	const __m256 vmin = _mm256_set1_ps(minVar);
+	int x = 0;
+	for (; x + 8 <= w; x += 8)
+	{
+		__m256 p = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x))));
+		__m256 m = _mm256_loadu_ps(mean + x);
+		__m256 v = _mm256_loadu_ps(var + x);
+		__m256 d = _mm256_sub_ps(p, m);
+		__m256 d2 = _mm256_mul_ps(d, d);
+		__m256 fg = _mm256_cmp_ps(d2, _mm256_mul_ps(vk2, _mm256_max_ps(v, vmin)), _CMP_GT_OQ);
+		_mm256_storeu_ps(mean + x, _mm256_add_ps(m, _mm256_mul_ps(va, d)));
+		_mm256_storeu_ps(var + x, _mm256_mul_ps(vb, _mm256_add_ps(v, _mm256_mul_ps(va, d2))));
+
+		__m256i c = _mm256_castps_si256(fg);
+		__m128i c16 = _mm_packs_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+		_mm_storel_epi64((__m128i*)(mask + x), _mm_packs_epi16(c16, c16));
+	}
+	return x;
+}
+#endif
+
+// Absolute difference of two lines. If threshold is 0 or more, pixels
+// where the difference exceeds it are 255 and others are 0.
+inline void absDiffLine(const uint8_t* a, const uint8_t* b, uint8_t* dst, int w, int threshold)
+{
+	int x = 0;
+#ifdef KERNEL_AVX2
+	if (cpuHasAVX2()) {
+		x = absDiffLineAVX2(a, b, dst, w, threshold);
+	}
+#endif
+#ifdef KERNEL_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_cmpeq_epi8(zero, zero);
+	const __m128i thr = _mm_set1_epi8((char)std::min(std::max(threshold, 0), 255));
+	for (; x + 16 <= w; x += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+		__m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+		if (threshold >= 0) {
+			d = _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(d, thr), zero), ones);
+		}
+		_mm_storeu_si128((__m128i*)(dst + x), d);
+	}
+#endif
+	for (; x < w; ++x)
+	{
+		int d = std::abs((int)a[x] - (int)b[x]);
+		dst[x] = threshold < 0 ? (uint8_t)d : (d > threshold ? 255 : 0);
+	}
+}
+
+// Slide window sum of one line, sum += src - old. Wrap around of 16bit is
+// harmless while the true sum fits in 16bit.
+inline void accumulateLine(const uint8_t* src, const uint8_t* old, uint16_t* sum, int w)
+{
+	int x = 0;
+#ifdef KERNEL_AVX2
+	if (cpuHasAVX2()) {
+		x = accumulateLineAVX2(src, old, sum, w);
+	}
+#endif
+#ifdef KERNEL_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= w; x += 16)
+	{
+		__m128i n = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i o = _mm_loadu_si128((const __m128i*)(old + x));
+		__m128i lo = _mm_loadu_si128((const __m128i*)(sum + x));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(sum + x + 8));
+		lo = _mm_sub_epi16(_mm_add_epi16(lo, _mm_unpacklo_epi8(n, zero)), _mm_unpacklo_epi8(o, zero));
+		hi = _mm_sub_epi16(_mm_add_epi16(hi, _mm_unpackhi_epi8(n, zero)), _mm_unpackhi_epi8(o, zero));
+		_mm_storeu_si128((__m128i*)(sum + x), lo);
+		_mm_storeu_si128((__m128i*)(sum + x + 8), hi);
+	}
+#endif
+	for (; x < w; ++x) {
+		sum[x] = (uint16_t)(sum[x] + src[x] - old[x]);
+	}
+}
+
+// Rounded average of one line of window sums. count must be 1 to 257.
+inline void averageLine(const uint16_t* sum, int count, uint8_t* dst, int w)
+{
+	// x / count == (x * ceil(2^32 / count)) >> 32 for all x below 2^17
+	const uint64_t m = ((1ull << 32) + count - 1) / count;
+	const uint32_t round = (uint32_t)count / 2;
+	for (int x = 0; x < w; ++x) {
+		dst[x] = (uint8_t)(((sum[x] + round) * m) >> 32);
+	}
+}
+
+// Exponentially weighted running mean and variance of one line. Pixels
+// where (p - mean)^2 > k2 * max(var, minVar) before the update are 255 in
+// mask, others are 0.
+inline void backgroundLine(const uint8_t* src, float* mean, float* var, uint8_t* mask, int w,
+	float alpha, float k2, float minVar)
+{
+	int x = 0;
+#ifdef KERNEL_AVX2
+	if (cpuHasAVX2()) {
+		x = backgroundLineAVX2(src, mean, var, mask, w, alpha, k2, minVar);
+	}
+#endif
+#ifdef KERNEL_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 va = _mm_set1_ps(alpha);
+	const __m128 vb = _mm_set1_ps(1.0f - alpha);
+	const __m128 vk2 = _mm_set1_ps(k2);
+	const __m128 vmin = _mm_set1_ps(minVar);
+	for (; x + 4 <= w; x += 4)
+	{
+		int32_t packed;
+		memcpy(&packed, src + x, sizeof(packed));
+		__m128i p8 = _mm_cvtsi32_si128(packed);
+		__m128 p = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(p8, zero), zero));
+		__m128 m = _mm_loadu_ps(mean + x);
+		__m128 v = _mm_loadu_ps(var + x);
+		__m128 d = _mm_sub_ps(p, m);
+		__m128 d2 = _mm_mul_ps(d, d);
+		__m128 fg = _mm_cmpgt_ps(d2, _mm_mul_ps(vk2, _mm_max_ps(v, vmin)));
+		_mm_storeu_ps(mean + x, _mm_add_ps(m, _mm_mul_ps(va, d)));
+		_mm_storeu_ps(var + x, _mm_mul_ps(vb, _mm_add_ps(v, _mm_mul_ps(va, d2))));
+
+		__m128i c16 = _mm_packs_epi32(_mm_castps_si128(fg), _mm_castps_si128(fg));
+		packed = _mm_cvtsi128_si32(_mm_packs_epi16(c16, c16));
+		memcpy(mask + x, &packed, sizeof(packed));
+	}
+#endif
+	for (; x < w; ++x)
+	{
+		float d = src[x] - mean[x];
+		float d2 = d * d;
+		mask[x] = d2 > k2 * std::max(var[x], minVar) ? 255 : 0;
+		mean[x] = mean[x] + alpha * d;
+		var[x] = (1.0f - alpha) * (var[x] + alpha * d2);
+	}
+}
+
+#ifdef KERNEL_AVX2
+KERNEL_AVX2_TARGET inline int avg2LineAVX2(const uint8_t* a, const uint8_t* b, uint8_t* dst, int w)
+{
+	int x = 0;
+	for (; x + 32 <= w; x += 32)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+		_mm256_storeu_si256((__m256i*)(dst + x), _mm256_avg_epu8(va, vb));
+	}
+	return x;
+}
+
+KERNEL_AVX2_TARGET inline int avg4LineAVX2(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d, uint8_t* dst, int w)
+{
+	const __m256i two = _mm256_set1_epi16(2);
+	int x = 0;
+	for (; x + 16 <= w; x += 16)
+	{
+		__m256i s = _mm256_add_epi16(
+			_mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + x))), _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + x)))),
+			_mm256_add_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(c + x))), _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(d + x)))));
+		s = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2);
+		__m128i p = _mm_packus_epi16(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+		_mm_storeu_si128((__m128i*)(dst + x), p);
+	}
+	return x;
+}
+
+KERNEL_AVX2_TARGET inline int blendParityLineAVX2(const uint8_t* a, const uint8_t* b, int phase, uint8_t* dst, int w)
+{
+	const __m256i mask = _mm256_set1_epi16(phase ? (short)0xff00 : (short)0x00ff);
+	int x = 0;
+	for (; x + 32 <= w; x += 32)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+		_mm256_storeu_si256((__m256i*)(dst + x), _mm256_or_si256(_mm256_and_si256(mask, va), _mm256_andnot_si256(mask, vb)));
+	}
+	return x;
+}
+#endif
+
+// Rounded average of two lines, (a + b + 1) >> 1.
+inline void avg2Line(const uint8_t* a, const uint8_t* b, uint8_t* dst, int w)
+{
+	int x = 0;
+#ifdef KERNEL_AVX2
+	if (cpuHasAVX2()) {
+		x = avg2LineAVX2(a, b, dst, w);
+	}
+#endif
+#ifdef KERNEL_SSE2
+	for (; x + 16 <= w; x += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_avg_epu8(va, vb));
+	}
+#endif
+	for (; x < w; ++x) {
+		dst[x] = (uint8_t)((a[x] + b[x] + 1) >> 1);
+	}
+}
+
+// Rounded average of four lines, (a + b + c + d + 2) >> 2.
+inline void avg4Line(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d, uint8_t* dst, int w)
+{
+	int x = 0;
+#ifdef KERNEL_AVX2
+	if (cpuHasAVX2()) {
+		x = avg4LineAVX2(a, b, c, d, dst, w);
+	}
+#endif
+#ifdef KERNEL_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	for (; x + 16 <= w; x += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+		__m128i vc = _mm_loadu_si128((const __m128i*)(c + x));
+		__m128i vd = _mm_loadu_si128((const __m128i*)(d + x));
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)),
+			_mm_add_epi16(_mm_unpacklo_epi8(vc, zero), _mm_unpacklo_epi8(vd, zero)));
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)),
+			_mm_add_epi16(_mm_unpackhi_epi8(vc, zero), _mm_unpackhi_epi8(vd, zero)));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (; x < w; ++x) {
+		dst[x] = (uint8_t)((a[x] + b[x] + c[x] + d[x] + 2) >> 2);
+	}
+}
+
+// Pixels of x where (x & 1) == phase are taken from a, others from b.
+inline void blendParityLine(const uint8_t* a, const uint8_t* b, int phase, uint8_t* dst, int w)
+{
+	int x = 0;
+#ifdef KERNEL_AVX2
+	if (cpuHasAVX2()) {
+		x = blendParityLineAVX2(a, b, phase, dst, w);
+	}
+#endif
+#ifdef KERNEL_SSE2
+	const __m128i mask = _mm_set1_epi16(phase ? (short)0xff00 : (short)0x00ff);
+	for (; x + 16 <= w; x += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_and_si128(mask, va), _mm_andnot_si128(mask, vb)));
+	}
+#endif
+	for (; x < w; ++x) {
+		dst[x] = ((x & 1) == phase) ? a[x] : b[x];
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include "Common.h"
+#include "Utility.h"
+
+// Latest frame of continuous transfer for grabNext() and grabLatest(). The
+// transfer thread copies a frame to the spare buffer without the lock and
+// swaps it in, so readers hold the lock only while copying the frame out.
+// Frames are copied only after the first take() of the transfer, so a
+// transfer without a reader copies nothing.
+class LatestFrame
+{
+public:
+	LatestFrame() : m_count(0), m_opened(0), m_taken(0), m_size(0), m_sequenceNo(0), m_open(false), m_active(false) {}
+	~LatestFrame() {}
+	LatestFrame(const LatestFrame& obj) = delete;
+	LatestFrame& operator=(const LatestFrame& obj) = delete;
+
+	// Frames of the previous transfer are not returned after open.
+	void open()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_opened = m_count;
+		m_taken = m_count;
+		m_open = true;
+		m_active.store(false, std::memory_order_relaxed);
+	}
+
+	// Wakes up waiting readers.
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_open = false;
+		m_cond.notify_all();
+	}
+
+	// Called only from the transfer thread.
+	void store(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+	{
+		if (!m_active.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		if (m_spare.size() < info->nDataSize) {
+			m_spare.resize(info->nDataSize);
+		}
+		memcpy(m_spare.data(), info->pData, info->nDataSize);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_data.swap(m_spare);
+		m_size = info->nDataSize;
+		m_sequenceNo = info->nSequenceNo;
+		m_resolution = res;
+		++m_count;
+		m_cond.notify_all();
+	}
+
+	// Copies the latest frame to the buffer alloc(size, resolution) returns.
+	// With next, waits up to timeout [msec] (negative for no limit) for a
+	// frame newer than the one taken last. Returns false if no frame is
+	// copied.
+	template<class Alloc>
+	bool take(bool next, int timeout, Alloc alloc)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_active.store(m_open, std::memory_order_relaxed);
+
+		const uint64_t last = next ? m_taken : m_opened;
+		auto ready = [&] { return !m_open || m_count > last; };
+		if (next && timeout < 0) {
+			m_cond.wait(lock, ready);
+		}
+		else if (next && timeout > 0) {
+			m_cond.wait_for(lock, std::chrono::milliseconds(timeout), ready);
+		}
+
+		if (!m_open || m_count <= last) {
+			return false;
+		}
+
+		PUC_XFER_DATA_INFO* dst = alloc(m_size, m_resolution);
+		memcpy(dst->pData, m_data.data(), m_size);
+		dst->nDataSize = (UINT32)m_size;
+		dst->nSequenceNo = m_sequenceNo;
+		m_taken = m_count;
+		return true;
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::vector<uint8_t> m_data;
+	std::vector<uint8_t> m_spare;
+	uint64_t m_count;
+	uint64_t m_opened;
+	uint64_t m_taken;
+	size_t m_size;
+	unsigned short m_sequenceNo;
+	Resolution m_resolution;
+	bool m_open;
+	std::atomic<bool> m_active;  // a reader took a frame in the transfer
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <climits>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+
+enum class SheddingPolicy
+{
+	NONE,
+	DECIMATE,
+	DC_PREVIEW,
+	DC_CHANGE,
+};
+
+// Decides in the continuous callback which frames reach the consumer.
+// Backlog is estimated from sequence numbers against the wall clock, so it
+// needs no query to the SDK ring buffer: frames that should have arrived
+// by now but not yet delivered are the backlog.
+class LoadShedder
+{
+public:
+	struct Decision
+	{
+		bool deliver;
+		bool payload;     // false for a frame delivered as preview only
+		SheddingPolicy policy;
+		int backlog;
+		std::vector<uint8_t> preview;
+		int previewWidth;
+		int previewHeight;
+	};
+
+	LoadShedder()
+		:
+		m_policy(SheddingPolicy::NONE),
+		m_high(0),
+		m_low(0),
+		m_interval(1),
+		m_threshold(0.0),
+		m_framerate(0),
+		m_started(false),
+		m_active(false),
+		m_prevSeq(0),
+		m_seq(0),
+		m_lastDelivered(0),
+		m_delivered(0),
+		m_shed(0),
+		m_activations(0)
+	{
+	}
+
+	void configure(SheddingPolicy policy, int high, int low, int interval, double threshold)
+	{
+		if (low < 0 || high <= low) {
+			throw(WrapperException("backlog threshold may be illegal."));
+		}
+		if (interval < 0 || (policy == SheddingPolicy::DECIMATE && interval < 1)) {
+			throw(WrapperException("shedding interval may be illegal."));
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_policy = policy;
+		m_high = high;
+		m_low = low;
+		m_interval = interval;
+		m_threshold = threshold;
+		m_active = false;
+		m_lastDC.clear();
+	}
+
+	SheddingPolicy policy() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_policy;
+	}
+
+	bool isActive() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_active;
+	}
+
+	void start(int framerate)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_framerate = framerate;
+		m_started = false;
+		m_active = false;
+		m_lastDC.clear();
+	}
+
+	// (delivered, shed, activations)
+	std::tuple<int64_t, int64_t, int64_t> stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return std::tuple<int64_t, int64_t, int64_t>(m_delivered, m_shed, m_activations);
+	}
+
+	void resetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_delivered = 0;
+		m_shed = 0;
+		m_activations = 0;
+	}
+
+	void decide(const PUC_XFER_DATA_INFO* info, const Resolution& res, Decision& d)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		d.deliver = true;
+		d.payload = true;
+		d.policy = SheddingPolicy::NONE;
+		d.preview.clear();
+		d.backlog = updateBacklog(info->nSequenceNo);
+
+		if (m_policy != SheddingPolicy::NONE)
+		{
+			if (!m_active && d.backlog >= m_high)
+			{
+				m_active = true;
+				++m_activations;
+				m_lastDC.clear();
+			}
+			else if (m_active && d.backlog <= m_low) {
+				m_active = false;
+			}
+		}
+
+		if (m_active)
+		{
+			d.policy = m_policy;
+			switch (m_policy)
+			{
+			case SheddingPolicy::DECIMATE:
+				d.deliver = (m_seq % m_interval) == 0;
+				break;
+			case SheddingPolicy::DC_PREVIEW:
+				// every interval-th frame keeps its data, and the others are
+				// delivered as preview only. Broken frame is left to the
+				// consumer with its data.
+				d.payload = m_interval > 0 && (m_seq % m_interval) == 0;
+				if (!d.payload && !decodeDC(info, res, d.preview, d.previewWidth, d.previewHeight))
+				{
+					d.preview.clear();
+					d.payload = true;
+				}
+				break;
+			case SheddingPolicy::DC_CHANGE:
+				d.deliver = isChanged(info, res);
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (d.deliver && d.payload)
+		{
+			m_lastDelivered = m_seq;
+			++m_delivered;
+		}
+		else {
+			++m_shed;
+		}
+	}
+
+private:
+	int updateBacklog(unsigned short seqNo)
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (!m_started)
+		{
+			m_started = true;
+			m_prevSeq = seqNo;
+			m_seq = 0;
+			m_lastDelivered = 0;
+			m_origin = now;
+			return 0;
+		}
+
+		// 16bit sequence number wraps, count the forward distance
+		m_seq += (unsigned short)(seqNo - m_prevSeq);
+		m_prevSeq = seqNo;
+
+		if (m_framerate <= 0) {
+			return 0;
+		}
+
+		// Arrival time of this frame if nothing were queued. When it came
+		// earlier than expected, the origin was late, so move it.
+		auto expected = m_origin + std::chrono::nanoseconds(m_seq * 1000000000LL / m_framerate);
+		if (now < expected)
+		{
+			m_origin -= expected - now;
+			return 0;
+		}
+		auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - expected).count();
+		return (int)std::min<int64_t>(lag * m_framerate / 1000000000LL, INT_MAX);
+	}
+
+	bool isChanged(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+	{
+		// broken frame is delivered and left to the consumer
+		int w, h;
+		if (!decodeDC(info, res, m_dc, w, h)) {
+			return true;
+		}
+
+		bool forced = m_interval > 0 && m_seq - m_lastDelivered >= m_interval;
+		bool changed = m_lastDC.size() != m_dc.size() || forced;
+		if (!changed)
+		{
+			int64_t sum = 0;
+			for (size_t i = 0; i < m_dc.size(); ++i) {
+				sum += std::abs((int)m_dc[i] - (int)m_lastDC[i]);
+			}
+			changed = (double)sum / m_dc.size() >= m_threshold;
+		}
+
+		if (changed) {
+			m_lastDC.swap(m_dc);
+		}
+		return changed;
+	}
+
+	// Runs on the transfer thread of the SDK, so errors are not thrown.
+	static bool decodeDC(const PUC_XFER_DATA_INFO* info, const Resolution& res,
+		std::vector<uint8_t>& dst, int& countX, int& countY)
+	{
+		countX = (ALIGN(res.width, 4) + 7) / 8;
+		countY = (res.height + 7) / 8;
+		dst.resize((size_t)countX * countY);
+
+		auto ret = PUC_DecodeDCData(dst.data(), 0, 0, countX, countY, info->pData);
+		return !PUC_CHK_FAILED(ret);
+	}
+
+	mutable std::mutex m_mutex;
+
+	SheddingPolicy m_policy;
+	int m_high;
+	int m_low;
+	int m_interval;
+	double m_threshold;
+
+	int m_framerate;
+	bool m_started;
+	bool m_active;
+	std::chrono::steady_clock::time_point m_origin;
+	unsigned short m_prevSeq;
+	int64_t m_seq;
+	int64_t m_lastDelivered;
+	std::vector<uint8_t> m_dc;
+	std::vector<uint8_t> m_lastDC;
+
+	int64_t m_delivered;
+	int64_t m_shed;
+	int64_t m_activations;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Common.h"
+
+// Counts heap allocations by operator new of this module, so tests can
+// check native code makes no allocation per frame. Allocations of python
+// and the SDK are not counted. Only built with PYPUCLIB_COUNT_ALLOCATIONS,
+// since replaced operators add an atomic operation to every allocation.
+class NativeAllocation
+{
+public:
+	PY_DOC(DOC_NATIVE_ALLOCATIONS,
+	"\"\"Get number of native heap allocations.        \n"
+	"                                                  \n"
+	"Allocations by operator new of this module are    \n"
+	"counted, python objects are not. Available only in\n"
+	"module built with PYPUCLIB_COUNT_ALLOCATIONS.     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of allocations since the module loaded.\n"
+	"\"\"                                              \n");
+	static uint64_t count();
+};
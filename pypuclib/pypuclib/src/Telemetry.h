@@ -0,0 +1,280 @@
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "Common.h"
+#include "Exception.h"
+
+namespace py = pybind11;
+
+class Telemetry
+{
+public:
+	PY_DOC(DOC_CLASS_TELEMETRY,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Latest device values sampled by telemetry thread. \n"
+	"                                                  \n"
+	"Attributes                                        \n"
+	"----------                                        \n"
+	"temperature : int                                 \n"
+	"    Sensor temperature.                           \n"
+	"fanState : bool                                   \n"
+	"    True if fan is on.                            \n"
+	"xferring : bool                                   \n"
+	"    True if transfer is in progress.              \n"
+	"framerate : int                                   \n"
+	"    Framerate read back from the device.          \n"
+	"shutter : int                                     \n"
+	"    Shutter speed read back from the device.      \n"
+	"sampleCount : int                                 \n"
+	"    Number of samples. 0 if not sampled yet.      \n"
+	"errorCount : int                                  \n"
+	"    Number of samples failed.                     \n"
+	"age : float                                       \n"
+	"    Elapsed time since the sample [sec].          \n"
+	"\"\"                                              \n");
+public:
+	Telemetry()
+		: temperature(0), fanState(false), xferring(false), framerate(0), shutter(0),
+		sampleCount(0), errorCount(0), age(0.0) {}
+	~Telemetry() {}
+
+	int temperature;
+	bool fanState;
+	bool xferring;
+	int framerate;
+	int shutter;
+	int64_t sampleCount;
+	int64_t errorCount;
+	double age;
+};
+
+// Samples device values on its own thread. The latest sample is published
+// through a seqlock, so readers never wait for the device or the sampler.
+class TelemetrySampler
+{
+public:
+	using Callback = std::function<void(const Telemetry&, bool)>;
+
+	TelemetrySampler()
+		:
+		m_handle(nullptr),
+		m_interval(0),
+		m_stop(false),
+		m_seq(0),
+		m_temperature(0),
+		m_fanState(false),
+		m_xferring(false),
+		m_framerate(0),
+		m_shutter(0),
+		m_sampleCount(0),
+		m_errorCount(0),
+		m_time(0),
+		m_high(0),
+		m_low(0),
+		m_hot(false),
+		m_hasCallback(false)
+	{
+	}
+	~TelemetrySampler()
+	{
+		stop();
+	}
+	TelemetrySampler(const TelemetrySampler& obj) = delete;
+	TelemetrySampler& operator=(const TelemetrySampler& obj) = delete;
+
+	void start(void* handle, int intervalMs)
+	{
+		if (intervalMs <= 0) {
+			throw(WrapperException("telemetry interval may be illegal."));
+		}
+
+		stop();
+		m_handle = handle;
+		m_interval = intervalMs;
+		m_stop = false;
+		m_thread = std::thread(&TelemetrySampler::work, this);
+	}
+
+	void stop()
+	{
+		if (!m_thread.joinable()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_all();
+
+		// thermal callback of the sampler may be waiting for the GIL
+		OptionalGilRelease release;
+		m_thread.join();
+	}
+
+	bool isRunning() const { return m_thread.joinable(); }
+
+	Telemetry snapshot() const
+	{
+		Telemetry t;
+		int64_t time;
+		while (true)
+		{
+			uint32_t s1 = m_seq.load(std::memory_order_acquire);
+			if (s1 & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			t.temperature = m_temperature.load(std::memory_order_relaxed);
+			t.fanState = m_fanState.load(std::memory_order_relaxed);
+			t.xferring = m_xferring.load(std::memory_order_relaxed);
+			t.framerate = m_framerate.load(std::memory_order_relaxed);
+			t.shutter = m_shutter.load(std::memory_order_relaxed);
+			t.sampleCount = m_sampleCount.load(std::memory_order_relaxed);
+			t.errorCount = m_errorCount.load(std::memory_order_relaxed);
+			time = m_time.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_seq.load(std::memory_order_relaxed) == s1) {
+				break;
+			}
+		}
+
+		if (t.sampleCount > 0) {
+			t.age = (now() - time) * 1e-9;
+		}
+		return t;
+	}
+
+	// Callback is called with True when temperature reaches high, and with
+	// False when it goes down to low again.
+	void setThermalCallback(int high, int low, Callback f)
+	{
+		if (low > high) {
+			throw(WrapperException("thermal threshold may be illegal."));
+		}
+
+		std::lock_guard<std::mutex> lock(m_callbackMutex);
+		m_high = high;
+		m_low = low;
+		m_hot = false;
+		m_callback = f;
+		m_hasCallback = (bool)f;
+	}
+
+private:
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop)
+		{
+			lock.unlock();
+			sample();
+			lock.lock();
+			m_cond.wait_for(lock, std::chrono::milliseconds(m_interval), [&] { return m_stop; });
+		}
+	}
+
+	void sample()
+	{
+		UINT32 temp = 0, f = 0, s = 0;
+		PUC_MODE fan = PUC_OFF;
+		BOOL xferring = FALSE;
+
+		bool ok =
+			!PUC_CHK_FAILED(PUC_GetSensorTemperature(m_handle, &temp)) &&
+			!PUC_CHK_FAILED(PUC_GetFanState(m_handle, &fan)) &&
+			!PUC_CHK_FAILED(PUC_IsXferring(m_handle, &xferring)) &&
+			!PUC_CHK_FAILED(PUC_GetFramerateShutter(m_handle, &f, &s));
+
+		if (!ok)
+		{
+			m_errorCount.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		uint32_t seq = m_seq.load(std::memory_order_relaxed);
+		m_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_temperature.store((int)temp, std::memory_order_relaxed);
+		m_fanState.store(fan != PUC_OFF, std::memory_order_relaxed);
+		m_xferring.store(xferring == TRUE, std::memory_order_relaxed);
+		m_framerate.store((int)f, std::memory_order_relaxed);
+		m_shutter.store((int)s, std::memory_order_relaxed);
+		m_sampleCount.fetch_add(1, std::memory_order_relaxed);
+		m_time.store(now(), std::memory_order_relaxed);
+		m_seq.store(seq + 2, std::memory_order_release);
+
+		checkThermal((int)temp);
+	}
+
+	void checkThermal(int temp)
+	{
+		if (!m_hasCallback || !Py_IsInitialized()) {
+			return;
+		}
+
+		// Always GIL first, then m_callbackMutex. Copying the python
+		// callback needs the GIL, and setThermalCallback holds it.
+		py::gil_scoped_acquire acquire;
+
+		Callback f;
+		bool hot;
+		{
+			std::lock_guard<std::mutex> lock(m_callbackMutex);
+			hot = m_hot ? (temp > m_low) : (temp >= m_high);
+			if (hot == m_hot || !m_callback) {
+				return;
+			}
+			m_hot = hot;
+			f = m_callback;
+		}
+
+		try
+		{
+			f(snapshot(), hot);
+		}
+		catch (py::error_already_set& e)
+		{
+			// no python caller on this thread, report to sys.unraisablehook
+			e.discard_as_unraisable(__func__);
+		}
+	}
+
+	static int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void* m_handle;
+	int m_interval;
+	bool m_stop;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::thread m_thread;
+
+	// seqlock protected snapshot
+	std::atomic<uint32_t> m_seq;
+	std::atomic<int> m_temperature;
+	std::atomic<bool> m_fanState;
+	std::atomic<bool> m_xferring;
+	std::atomic<int> m_framerate;
+	std::atomic<int> m_shutter;
+	std::atomic<int64_t> m_sampleCount;
+	std::atomic<int64_t> m_errorCount;
+	std::atomic<int64_t> m_time;
+
+	std::mutex m_callbackMutex;
+	int m_high;
+	int m_low;
+	bool m_hot;
+	std::atomic<bool> m_hasCallback;
+	Callback m_callback;
+};
@@ -0,0 +1,232 @@
+#include "TemporalProcessor.h"
+#include "DecodePool.h"
+#include "Utility.h"
+
+TemporalProcessor::TemporalProcessor(int width, int height, int window)
+	:
+	m_width(width),
+	m_height(height),
+	m_plane((size_t)std::max(width, 0) * std::max(height, 0)),
+	m_alpha(0.05f),
+	m_k2(9.0f),
+	m_minVar(16.0f),
+	m_backgroundCount(0),
+	m_differenceCount(0),
+	m_window(0),
+	m_head(0),
+	m_count(0)
+{
+	if (width <= 0 || height <= 0) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+
+	m_mean.resize(m_plane);
+	m_var.resize(m_plane);
+	m_prev.resize(m_plane);
+	m_sum.resize(m_plane);
+	setWindow(window);
+}
+
+void TemporalProcessor::setBackground(float alpha, float k, float minStd)
+{
+	if (!(alpha > 0 && alpha <= 1) || k < 0 || minStd < 0) {
+		throw(WrapperException("background parameter may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_alpha = alpha;
+	m_k2 = k * k;
+	m_minVar = minStd * minStd;
+}
+
+void TemporalProcessor::setWindow(int window)
+{
+	if (window < 1 || window > MAX_WINDOW) {
+		throw(WrapperException("window may be illegal."));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_window = window;
+	m_ring.assign(m_plane * window, 0);
+	resetOp(Op::ACCUMULATE);
+}
+
+int TemporalProcessor::window() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_window;
+}
+
+py::array_t<uint8_t> TemporalProcessor::background(py::array_t<uint8_t>& frame)
+{
+	return apply(Op::BACKGROUND, frameSource(frame));
+}
+
+py::array_t<uint8_t> TemporalProcessor::difference(py::array_t<uint8_t>& frame, int threshold)
+{
+	return apply(Op::DIFFERENCE, frameSource(frame), threshold);
+}
+
+py::array_t<uint8_t> TemporalProcessor::accumulate(py::array_t<uint8_t>& frame)
+{
+	return apply(Op::ACCUMULATE, frameSource(frame));
+}
+
+py::array_t<uint8_t> TemporalProcessor::apply(Op op, const Source& source, int threshold)
+{
+	py::array_t<uint8_t> buf({ m_height, m_width });
+	uint8_t* dst = buf.mutable_data();
+
+	{
+		OptionalGilRelease release;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		try
+		{
+			source([&](int y, int rows, const uint8_t* src, int lineBytes)
+			{
+				for (int r = 0; r < rows; ++r) {
+					processLine(op, y + r, src + (size_t)lineBytes * r, dst + (size_t)m_width * (y + r), threshold);
+				}
+			});
+		}
+		catch (...)
+		{
+			// frame is half processed
+			resetOp(op);
+			throw;
+		}
+
+		switch (op)
+		{
+		case Op::BACKGROUND:
+			++m_backgroundCount;
+			break;
+		case Op::DIFFERENCE:
+			++m_differenceCount;
+			break;
+		case Op::ACCUMULATE:
+			m_head = (m_head + 1) % m_window;
+			m_count = std::min(m_count + 1, m_window);
+			break;
+		}
+	}
+	return buf;
+}
+
+// Frame counters and ring head are updated after the whole frame, so
+// every line of one frame sees the same state.
+void TemporalProcessor::processLine(Op op, int y, const uint8_t* src, uint8_t* dst, int threshold)
+{
+	const size_t offset = (size_t)m_width * y;
+
+	switch (op)
+	{
+	case Op::BACKGROUND:
+		if (m_backgroundCount == 0)
+		{
+			for (int x = 0; x < m_width; ++x) {
+				m_mean[offset + x] = src[x];
+			}
+			std::fill_n(m_var.begin() + offset, m_width, 0.0f);
+			memset(dst, 0, m_width);
+			return;
+		}
+		backgroundLine(src, &m_mean[offset], &m_var[offset], dst, m_width, m_alpha, m_k2, m_minVar);
+		return;
+
+	case Op::DIFFERENCE:
+	{
+		uint8_t* prev = &m_prev[offset];
+		if (m_differenceCount == 0) {
+			memcpy(prev, src, m_width);
+		}
+		absDiffLine(src, prev, dst, m_width, threshold);
+		memcpy(prev, src, m_width);
+		return;
+	}
+
+	case Op::ACCUMULATE:
+	{
+		uint8_t* old = &m_ring[m_plane * m_head + offset];
+		uint16_t* sum = &m_sum[offset];
+		accumulateLine(src, old, sum, m_width);
+		memcpy(old, src, m_width);
+		averageLine(sum, std::min(m_count + 1, m_window), dst, m_width);
+		return;
+	}
+	}
+}
+
+// Bands of the frame are processed on the decode pool.
+TemporalProcessor::Source TemporalProcessor::frameSource(py::array_t<uint8_t>& frame)
+{
+	if (frame.ndim() != 2 || frame.shape(0) != m_height || frame.shape(1) != m_width || frame.strides(1) != 1) {
+		throw(WrapperException("frame may be illegal shape."));
+	}
+
+	const uint8_t* data = frame.data();
+	const int lineBytes = (int)frame.strides(0);
+	const int height = m_height;
+	return [data, lineBytes, height](const LineFn& line)
+	{
+		std::vector<std::function<void()>> tasks;
+		for (int y = 0; y < height; y += BAND_HEIGHT)
+		{
+			int rows = std::min(BAND_HEIGHT, height - y);
+			tasks.emplace_back([=, &line]() { line(y, rows, data + (size_t)lineBytes * y, lineBytes); });
+		}
+		DecodePool::instance().run(tasks);
+	};
+}
+
+py::array_t<float> TemporalProcessor::mean() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return py::array_t<float>({ m_height, m_width }, m_mean.data());
+}
+
+py::array_t<float> TemporalProcessor::variance() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return py::array_t<float>({ m_height, m_width }, m_var.data());
+}
+
+py::array_t<uint16_t> TemporalProcessor::sum() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return py::array_t<uint16_t>({ m_height, m_width }, m_sum.data());
+}
+
+int TemporalProcessor::count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_count;
+}
+
+void TemporalProcessor::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	resetOp(Op::BACKGROUND);
+	resetOp(Op::DIFFERENCE);
+	resetOp(Op::ACCUMULATE);
+}
+
+void TemporalProcessor::resetOp(Op op)
+{
+	switch (op)
+	{
+	case Op::BACKGROUND:
+		m_backgroundCount = 0;
+		break;
+	case Op::DIFFERENCE:
+		m_differenceCount = 0;
+		break;
+	case Op::ACCUMULATE:
+		std::fill(m_ring.begin(), m_ring.end(), 0);
+		std::fill(m_sum.begin(), m_sum.end(), 0);
+		m_head = 0;
+		m_count = 0;
+		break;
+	}
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <mutex>
+#include <functional>
+#include "Common.h"
+#include "Exception.h"
+#include "Kernel.h"
+
+namespace py = pybind11;
+
+// Per pixel state over consecutive frames. Frames are consumed line by
+// line, so Decoder can feed each stripe while it is on cache and the
+// image is never written out. All state is allocated in advance.
+class TemporalProcessor
+{
+public:
+	enum class Op
+	{
+		BACKGROUND,
+		DIFFERENCE,
+		ACCUMULATE,
+	};
+
+	// Consumes lines [y, y + rows) of a frame at src with lineBytes.
+	using LineFn = std::function<void(int, int, const uint8_t*, int)>;
+	// Calls LineFn once for every line of a frame, possibly on several
+	// threads at the same time for disjoint lines.
+	using Source = std::function<void(const LineFn&)>;
+
+	PY_DOC(DOC_CLASS_TEMPORAL_PROCESSOR,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Per pixel processing over consecutive frames.     \n"
+	"                                                  \n"
+	"Running mean and variance background model, frame \n"
+	"differencing and N frames sum or average, with    \n"
+	"state kept in preallocated buffers. Frames are    \n"
+	"numpy arrays, or compressed data processed while  \n"
+	"decoding by Decoder.decodeTemporal().             \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"width : int                                       \n"
+	"    Width of frames.                              \n"
+	"height : int                                      \n"
+	"    Height of frames.                             \n"
+	"window : int                                      \n"
+	"    Number of frames to accumulate, 1 to 257.     \n"
+	"    (default=8)                                   \n"
+	"\"\"                                              \n");
+	TemporalProcessor(int width, int height, int window = 8);
+	~TemporalProcessor() {}
+	TemporalProcessor(const TemporalProcessor& obj) = delete;
+	TemporalProcessor& operator=(const TemporalProcessor& obj) = delete;
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+	PY_DOC(DOC_TP_SET_BACKGROUND,
+	"\"\"Set parameters of background model.           \n"
+	"                                                  \n"
+	"Each frame updates mean += alpha * d and          \n"
+	"var = (1 - alpha) * (var + alpha * d^2), where    \n"
+	"d = pixel - mean.                                 \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"alpha : float                                     \n"
+	"    Learning rate from 0 to 1. (default=0.05)     \n"
+	"k : float                                         \n"
+	"    Pixel is foreground if |d| > k * std.         \n"
+	"    (default=3.0)                                 \n"
+	"minStd : float                                    \n"
+	"    Lower bound of std, so the first frames and   \n"
+	"    static pixels are not all foreground.         \n"
+	"    (default=4.0)                                 \n"
+	"\"\"                                              \n");
+	void setBackground(float alpha, float k, float minStd);
+
+	PY_DOC(DOC_TP_SET_WINDOW,
+	"\"\"Set number of frames to accumulate.           \n"
+	"                                                  \n"
+	"Accumulation starts over.                         \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"window : int                                      \n"
+	"    Number of frames, 1 to 257.                   \n"
+	"\"\"                                              \n");
+	void setWindow(int window);
+
+	PY_DOC(DOC_TP_WINDOW,
+	"\"\"Get number of frames to accumulate.           \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	int window() const;
+
+	PY_DOC(DOC_TP_BACKGROUND,
+	"\"\"Update background model and get foreground.   \n"
+	"                                                  \n"
+	"First frame initializes the model.                \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"frame : numpy array(uint8)                        \n"
+	"    Image of (height, width).                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Foreground mask, 255 for foreground pixels and\n"
+	"    0 for others.                                 \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> background(py::array_t<uint8_t>& frame);
+
+	PY_DOC(DOC_TP_DIFFERENCE,
+	"\"\"Get difference from the previous frame.       \n"
+	"                                                  \n"
+	"First frame is compared with itself.              \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"frame : numpy array(uint8)                        \n"
+	"    Image of (height, width).                     \n"
+	"threshold : int                                   \n"
+	"    If 0 or more, mask of 255 where the absolute  \n"
+	"    difference exceeds this and 0 for others.     \n"
+	"    Absolute difference if negative. (default=-1) \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Absolute difference or mask.                  \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> difference(py::array_t<uint8_t>& frame, int threshold);
+
+	PY_DOC(DOC_TP_ACCUMULATE,
+	"\"\"Add frame to window and get average of it.    \n"
+	"                                                  \n"
+	"The oldest frame leaves the window when it is     \n"
+	"full. Average is of the frames in the window.     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"frame : numpy array(uint8)                        \n"
+	"    Image of (height, width).                     \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Rounded average of the window.                \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> accumulate(py::array_t<uint8_t>& frame);
+
+	// Runs op on the frame fed by source. threshold is used by DIFFERENCE.
+	py::array_t<uint8_t> apply(Op op, const Source& source, int threshold = -1);
+
+	PY_DOC(DOC_TP_MEAN,
+	"\"\"Get mean of background model.                 \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(float32)                              \n"
+	"    Copy of running mean of (height, width).      \n"
+	"\"\"                                              \n");
+	py::array_t<float> mean() const;
+
+	PY_DOC(DOC_TP_VARIANCE,
+	"\"\"Get variance of background model.             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(float32)                              \n"
+	"    Copy of running variance of (height, width).  \n"
+	"\"\"                                              \n");
+	py::array_t<float> variance() const;
+
+	PY_DOC(DOC_TP_SUM,
+	"\"\"Get sum of frames in window.                  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint16)                               \n"
+	"    Copy of sum of (height, width).               \n"
+	"\"\"                                              \n");
+	py::array_t<uint16_t> sum() const;
+
+	PY_DOC(DOC_TP_COUNT,
+	"\"\"Get number of frames in window.               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames, up to window.               \n"
+	"\"\"                                              \n");
+	int count() const;
+
+	PY_DOC(DOC_TP_RESET,
+	"\"\"Clear background model, previous frame and    \n"
+	"window.                                           \n"
+	"\"\"                                              \n");
+	void reset();
+
+private:
+	Source frameSource(py::array_t<uint8_t>& frame);
+	void processLine(Op op, int y, const uint8_t* src, uint8_t* dst, int threshold);
+	void resetOp(Op op);
+
+	static constexpr int MAX_WINDOW = 257;  // 255 * 257 fits in 16bit
+	static constexpr int BAND_HEIGHT = 64;
+
+	mutable std::mutex m_mutex;
+	int m_width;
+	int m_height;
+	size_t m_plane;
+
+	// background model
+	float m_alpha;
+	float m_k2;
+	float m_minVar;
+	int64_t m_backgroundCount;
+	std::vector<float> m_mean;
+	std::vector<float> m_var;
+
+	// difference
+	int64_t m_differenceCount;
+	std::vector<uint8_t> m_prev;
+
+	// accumulation, m_ring keeps the last m_window frames
+	int m_window;
+	int m_head;
+	int m_count;
+	std::vector<uint8_t> m_ring;
+	std::vector<uint16_t> m_sum;
+};
@@ -0,0 +1,437 @@
+#include "ThumbnailIndex.h"
+#include <cstddef>
+#include <numeric>
+#include <chrono>
+#include "FrameFile.h"
+#include "CameraFactory.h"
+
+static HANDLE openFile(const std::string& path, bool write)
+{
+	int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::vector<wchar_t> wpath(len > 0 ? len : 1, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath.data(), len);
+
+	// the file is shared so that it can be read while it is built
+	HANDLE h;
+	if (write) {
+		h = CreateFileW(wpath.data(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+	else {
+		h = CreateFileW(wpath.data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+
+	if (h == INVALID_HANDLE_VALUE) {
+		throw(WrapperException("couldn't open file: " + path));
+	}
+	return h;
+}
+
+// 2x2 average, the last line and column are repeated for odd size
+static void reduce(const uint8_t* src, int sw, int sh, uint8_t* dst, int dw, int dh)
+{
+	for (int y = 0; y < dh; ++y)
+	{
+		const uint8_t* s0 = src + (size_t)std::min(2 * y, sh - 1) * sw;
+		const uint8_t* s1 = src + (size_t)std::min(2 * y + 1, sh - 1) * sw;
+		for (int x = 0; x < dw; ++x)
+		{
+			int x0 = std::min(2 * x, sw - 1);
+			int x1 = std::min(2 * x + 1, sw - 1);
+			dst[x] = (uint8_t)((s0[x0] + s0[x1] + s1[x0] + s1[x1] + 2) >> 2);
+		}
+		dst += dw;
+	}
+}
+
+
+ThumbnailIndexer::ThumbnailIndexer(const std::string& recordPath, const std::string& path, int numThread)
+	:
+	m_path(path.empty() ? recordPath + ".thumb" : path),
+	m_file(INVALID_HANDLE_VALUE),
+	m_numThread(numThread),
+	m_progress(0),
+	m_stop(false),
+	m_done(false)
+{
+	if (numThread < 0) {
+		throw(WrapperException("number of thread may be illegal."));
+	}
+	if (m_numThread == 0) {
+		m_numThread = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	m_reader = std::make_unique<FrameReader>(recordPath);
+	auto res = m_reader->resolution();
+
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, THUMBNAIL_FILE_MAGIC, sizeof(m_header.magic));
+	m_header.version = THUMBNAIL_FILE_VERSION;
+	m_header.headerSize = sizeof(ThumbnailFileHeader);
+	m_header.width = res.width;
+	m_header.height = res.height;
+	m_header.levelCount = THUMBNAIL_LEVEL_COUNT;
+	m_header.capacity = m_reader->frameCount();
+
+	// level 0 is one pixel per block of the line aligned image
+	m_header.levelWidth[0] = (ALIGN(res.width, 4) + 7) / 8;
+	m_header.levelHeight[0] = (res.height + 7) / 8;
+	for (int l = 1; l < THUMBNAIL_LEVEL_COUNT; ++l)
+	{
+		m_header.levelWidth[l] = (m_header.levelWidth[l - 1] + 1) / 2;
+		m_header.levelHeight[l] = (m_header.levelHeight[l - 1] + 1) / 2;
+	}
+
+	uint64_t offset = m_header.headerSize;
+	m_header.sequenceOffset = offset;
+	offset += m_header.capacity * sizeof(uint16_t);
+	for (int l = 0; l < THUMBNAIL_LEVEL_COUNT; ++l)
+	{
+		m_header.levelOffset[l] = offset;
+		offset += m_header.capacity * m_header.levelWidth[l] * m_header.levelHeight[l];
+	}
+
+	CameraFactory::initialize();
+	m_file = openFile(m_path, true);
+	try
+	{
+		writeAt(0, &m_header, sizeof(m_header));
+	}
+	catch (WrapperException&)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+		throw;
+	}
+
+	m_thread = std::thread(&ThumbnailIndexer::buildWork, this);
+}
+
+ThumbnailIndexer::~ThumbnailIndexer()
+{
+	cancel();
+}
+
+void ThumbnailIndexer::cancel()
+{
+	m_stop = true;
+	if (m_thread.joinable())
+	{
+		OptionalGilRelease release;
+		m_thread.join();
+	}
+}
+
+bool ThumbnailIndexer::wait(int timeout)
+{
+	bool done;
+	{
+		OptionalGilRelease release;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (timeout < 0) {
+			m_cond.wait(lock, [&] { return m_done; });
+		}
+		else {
+			m_cond.wait_for(lock, std::chrono::milliseconds(timeout), [&] { return m_done; });
+		}
+		done = m_done;
+	}
+
+	if (done && m_error) {
+		std::rethrow_exception(m_error);
+	}
+	return done;
+}
+
+// Frames are read in batches in order, DC images of the batch are decoded on
+// numThread threads, and each level of the batch is written by one write.
+void ThumbnailIndexer::buildWork()
+{
+	const uint64_t capacity = m_header.capacity;
+	size_t sizes[THUMBNAIL_LEVEL_COUNT];
+	std::vector<uint8_t> thumbs[THUMBNAIL_LEVEL_COUNT];
+	for (int l = 0; l < THUMBNAIL_LEVEL_COUNT; ++l)
+	{
+		sizes[l] = (size_t)m_header.levelWidth[l] * m_header.levelHeight[l];
+		thumbs[l].resize(sizes[l] * BATCH_FRAMES);
+	}
+	std::vector<std::vector<uint8_t>> data(BATCH_FRAMES);
+	std::vector<uint16_t> seqs(BATCH_FRAMES);
+	std::vector<PUCRESULT> results(BATCH_FRAMES);
+
+	auto decode = [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			uint8_t* dc = thumbs[0].data() + sizes[0] * i;
+			results[i] = PUC_DecodeDCData(dc, 0, 0, m_header.levelWidth[0], m_header.levelHeight[0], data[i].data());
+			if (PUC_CHK_FAILED(results[i])) {
+				continue;
+			}
+			for (int l = 1; l < THUMBNAIL_LEVEL_COUNT; ++l)
+			{
+				reduce(thumbs[l - 1].data() + sizes[l - 1] * i, m_header.levelWidth[l - 1], m_header.levelHeight[l - 1],
+					thumbs[l].data() + sizes[l] * i, m_header.levelWidth[l], m_header.levelHeight[l]);
+			}
+		}
+	};
+
+	try
+	{
+		for (uint64_t start = 0; start < capacity && !m_stop; start += BATCH_FRAMES)
+		{
+			int n = (int)std::min<uint64_t>(BATCH_FRAMES, capacity - start);
+			for (int i = 0; i < n; ++i) {
+				seqs[i] = m_reader->readInto((int)(start + i), data[i]);
+			}
+
+			int threads = std::min(m_numThread, n);
+			std::vector<std::thread> workers;
+			for (int t = 1; t < threads; ++t) {
+				workers.emplace_back(decode, n * t / threads, n * (t + 1) / threads);
+			}
+			decode(0, n / threads);
+			for (auto& th : workers) {
+				th.join();
+			}
+			for (int i = 0; i < n; ++i)
+			{
+				if (PUC_CHK_FAILED(results[i])) {
+					throw(PUCException("PUC_DecodeDCData", results[i]));
+				}
+			}
+
+			writeAt(m_header.sequenceOffset + start * sizeof(uint16_t), seqs.data(), n * sizeof(uint16_t));
+			for (int l = 0; l < THUMBNAIL_LEVEL_COUNT; ++l) {
+				writeAt(m_header.levelOffset[l] + start * sizes[l], thumbs[l].data(), n * sizes[l]);
+			}
+
+			// frames are visible to readers after the header is updated
+			m_header.frameCount = start + n;
+			writeAt(0, &m_header, sizeof(m_header));
+			m_progress = m_header.frameCount;
+		}
+	}
+	catch (...)
+	{
+		m_error = std::current_exception();
+	}
+
+	CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	m_reader->close();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_done = true;
+	m_cond.notify_all();
+}
+
+void ThumbnailIndexer::writeAt(uint64_t offset, const void* src, size_t size)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)offset;
+	if (!SetFilePointerEx(m_file, pos, nullptr, FILE_BEGIN)) {
+		throw(WrapperException("failed to write file."));
+	}
+
+	const uint8_t* p = (const uint8_t*)src;
+	while (size > 0)
+	{
+		DWORD chunk = (DWORD)std::min<size_t>(size, 0x40000000);
+		DWORD written = 0;
+		if (!WriteFile(m_file, p, chunk, &written, nullptr) || written != chunk) {
+			throw(WrapperException("failed to write file."));
+		}
+		p += chunk;
+		size -= chunk;
+	}
+}
+
+
+ThumbnailIndex::ThumbnailIndex(const std::string& path)
+	:
+	m_file(INVALID_HANDLE_VALUE)
+{
+	m_file = openFile(path, false);
+
+	try
+	{
+		readAt(0, &m_header, sizeof(m_header));
+		if (memcmp(m_header.magic, THUMBNAIL_FILE_MAGIC, sizeof(m_header.magic)) != 0 ||
+			m_header.version != THUMBNAIL_FILE_VERSION ||
+			m_header.levelCount != THUMBNAIL_LEVEL_COUNT) {
+			throw(WrapperException("illegal file format: " + path));
+		}
+	}
+	catch (WrapperException&)
+	{
+		close();
+		throw;
+	}
+}
+
+ThumbnailIndex::~ThumbnailIndex()
+{
+	close();
+}
+
+void ThumbnailIndex::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+}
+
+uint64_t ThumbnailIndex::frameCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	update();
+	return m_header.frameCount;
+}
+
+Resolution ThumbnailIndex::levelSize(int level) const
+{
+	checkLevel(level);
+	return Resolution(m_header.levelWidth[level], m_header.levelHeight[level]);
+}
+
+py::array_t<uint16_t> ThumbnailIndex::sequenceNo(int start, int count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	checkRange(start, count);
+
+	py::array_t<uint16_t> buf(count);
+	readAt(m_header.sequenceOffset + (uint64_t)start * sizeof(uint16_t), buf.mutable_data(), count * sizeof(uint16_t));
+	return buf;
+}
+
+py::array_t<uint8_t> ThumbnailIndex::read(int start, int count, int level)
+{
+	checkLevel(level);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	checkRange(start, count);
+
+	const int w = m_header.levelWidth[level];
+	const int h = m_header.levelHeight[level];
+	py::array_t<uint8_t> buf({ count, h, w });
+	readAt(m_header.levelOffset[level] + (uint64_t)start * w * h, buf.mutable_data(), (size_t)count * w * h);
+	return buf;
+}
+
+std::tuple<py::array_t<int64_t>, py::array_t<double>> ThumbnailIndex::search(py::array_t<uint8_t>& query, int level, int top)
+{
+	checkLevel(level);
+	const size_t w = m_header.levelWidth[level];
+	const size_t h = m_header.levelHeight[level];
+	if (query.ndim() != 2 || (size_t)query.shape(0) != h || (size_t)query.shape(1) != w || query.strides(1) != 1) {
+		throw(WrapperException("query may be illegal size."));
+	}
+	if (top <= 0) {
+		throw(WrapperException("top may be illegal."));
+	}
+
+	const size_t size = w * h;
+	std::vector<uint8_t> q(size);
+	for (size_t y = 0; y < h; ++y) {
+		memcpy(q.data() + y * w, query.data() + y * query.strides(0), w);
+	}
+
+	std::vector<double> scores;
+	{
+		OptionalGilRelease release;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		update();
+		const uint64_t count = m_header.frameCount;
+		scores.resize(count);
+
+		std::vector<uint8_t> buf(size * SEARCH_FRAMES);
+		for (uint64_t start = 0; start < count; start += SEARCH_FRAMES)
+		{
+			size_t n = (size_t)std::min<uint64_t>(SEARCH_FRAMES, count - start);
+			readAt(m_header.levelOffset[level] + start * size, buf.data(), n * size);
+			for (size_t i = 0; i < n; ++i)
+			{
+				const uint8_t* p = buf.data() + i * size;
+				uint64_t sum = 0;
+				for (size_t k = 0; k < size; ++k) {
+					sum += std::abs(p[k] - q[k]);
+				}
+				scores[start + i] = (double)sum / size;
+			}
+		}
+	}
+
+	std::vector<int64_t> order(scores.size());
+	std::iota(order.begin(), order.end(), 0);
+	size_t n = std::min(order.size(), (size_t)top);
+	std::partial_sort(order.begin(), order.begin() + n, order.end(),
+		[&](int64_t a, int64_t b) { return scores[a] < scores[b] || (scores[a] == scores[b] && a < b); });
+
+	py::array_t<int64_t> frames(n);
+	py::array_t<double> diffs(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		frames.mutable_data()[i] = order[i];
+		diffs.mutable_data()[i] = scores[order[i]];
+	}
+	return std::make_tuple(frames, diffs);
+}
+
+// frameCount of the header grows while the file is built
+void ThumbnailIndex::update()
+{
+	uint64_t count;
+	readAt(offsetof(ThumbnailFileHeader, frameCount), &count, sizeof(count));
+	m_header.frameCount = std::min(count, m_header.capacity);
+}
+
+void ThumbnailIndex::checkRange(int start, int count)
+{
+	if (count <= 0 || start < 0) {
+		throw(WrapperException("frame range is out of file."));
+	}
+	if ((uint64_t)start + count > m_header.frameCount) {
+		update();
+	}
+	if ((uint64_t)start + count > m_header.frameCount) {
+		throw(WrapperException("frame range is out of file."));
+	}
+}
+
+void ThumbnailIndex::checkLevel(int level) const
+{
+	if (level < 0 || level >= THUMBNAIL_LEVEL_COUNT) {
+		throw(WrapperException("level may be illegal."));
+	}
+}
+
+void ThumbnailIndex::readAt(uint64_t offset, void* dst, size_t size)
+{
+	if (m_file == INVALID_HANDLE_VALUE) {
+		throw(WrapperException("file is already closed."));
+	}
+
+	LARGE_INTEGER pos;
+	pos.QuadPart = (LONGLONG)offset;
+	if (!SetFilePointerEx(m_file, pos, nullptr, FILE_BEGIN)) {
+		throw(WrapperException("failed to read file."));
+	}
+
+	uint8_t* p = (uint8_t*)dst;
+	while (size > 0)
+	{
+		DWORD chunk = (DWORD)std::min<size_t>(size, 0x40000000);
+		DWORD read = 0;
+		if (!ReadFile(m_file, p, chunk, &read, nullptr) || read != chunk) {
+			throw(WrapperException("failed to read file."));
+		}
+		p += chunk;
+		size -= chunk;
+	}
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include "Common.h"
+#include "Exception.h"
+#include "Utility.h"
+
+namespace py = pybind11;
+
+class FrameReader;
+
+// File layout
+//   ThumbnailFileHeader
+//   uint16 sequence number of each frame             (capacity)
+//   level 0..2 thumbnails, each level back to back   (capacity * w * h)
+// frameCount of the header is updated after each batch, so the file can be
+// read while it is built.
+struct ThumbnailFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t reserved0;
+	uint64_t capacity;
+	uint64_t frameCount;
+	uint32_t levelWidth[4];
+	uint32_t levelHeight[4];
+	uint64_t levelOffset[4];
+	uint64_t sequenceOffset;
+	uint8_t reserved1[136];
+};
+static_assert(sizeof(ThumbnailFileHeader) == 256, "ThumbnailFileHeader must be 256 bytes");
+
+static constexpr char THUMBNAIL_FILE_MAGIC[8] = { 'P', 'U', 'C', 'T', 'H', 'M', 'B', '\0' };
+static constexpr uint32_t THUMBNAIL_FILE_VERSION = 1;
+static constexpr int THUMBNAIL_LEVEL_COUNT = 3;
+
+// Builds thumbnail file of a recorded file on a background thread. Level 0
+// is DC image (1/8), and level 1 and 2 are 2x2 averages of the level above.
+class ThumbnailIndexer
+{
+public:
+	PY_DOC(DOC_CLASS_THUMBNAIL_INDEXER,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Background builder of thumbnail file.             \n"
+	"                                                  \n"
+	"DC image of every frame of recorded file is       \n"
+	"decoded, and 1/8, 1/16 and 1/32 scale thumbnails  \n"
+	"are written to the thumbnail file. Building starts\n"
+	"on construction, and written frames can be read by\n"
+	"ThumbnailIndex while building.                    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"recordPath : str                                  \n"
+	"    Path of recorded file.                        \n"
+	"path : str                                        \n"
+	"    Path of thumbnail file. Empty for recordPath  \n"
+	"    + '.thumb'. (default='')                      \n"
+	"numThread : int                                   \n"
+	"    Number of decode threads. 0 for number of     \n"
+	"    processors. (default=0)                       \n"
+	"\"\"                                              \n");
+	ThumbnailIndexer(const std::string& recordPath, const std::string& path = "", int numThread = 0);
+	~ThumbnailIndexer();
+	ThumbnailIndexer(const ThumbnailIndexer& obj) = delete;
+	ThumbnailIndexer& operator=(const ThumbnailIndexer& obj) = delete;
+
+	PY_DOC(DOC_INDEXER_WAIT,
+	"\"\"Wait until building is finished.              \n"
+	"                                                  \n"
+	"Error of building is raised.                      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"timeout : int                                     \n"
+	"    Timeout [msec]. Negative waits without limit. \n"
+	"    (default=-1)                                  \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if finished, False if timed out.         \n"
+	"\"\"                                              \n");
+	bool wait(int timeout = -1);
+
+	PY_DOC(DOC_INDEXER_CANCEL,
+	"\"\"Stop building and wait for the thread.        \n"
+	"                                                  \n"
+	"Frames already written are kept in the file.      \n"
+	"\"\"                                              \n");
+	void cancel();
+
+	PY_DOC(DOC_INDEXER_PROGRESS,
+	"\"\"Get number of frames written.                 \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames in the thumbnail file.       \n"
+	"\"\"                                              \n");
+	uint64_t progress() const { return m_progress; }
+
+	PY_DOC(DOC_INDEXER_FRAME_COUNT,
+	"\"\"Get number of frames of recorded file.        \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames to be written.               \n"
+	"\"\"                                              \n");
+	uint64_t frameCount() const { return m_header.capacity; }
+
+	PY_DOC(DOC_INDEXER_PATH,
+	"\"\"Get path of thumbnail file.                   \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"str                                               \n"
+	"    Path of thumbnail file.                       \n"
+	"\"\"                                              \n");
+	std::string path() const { return m_path; }
+
+private:
+	void buildWork();
+	void writeAt(uint64_t offset, const void* src, size_t size);
+
+	static constexpr int BATCH_FRAMES = 256;
+
+	std::unique_ptr<FrameReader> m_reader;
+	std::string m_path;
+	HANDLE m_file;
+	ThumbnailFileHeader m_header;
+	int m_numThread;
+
+	std::atomic<uint64_t> m_progress;
+	std::atomic<bool> m_stop;
+	bool m_done;
+	std::exception_ptr m_error;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::thread m_thread;
+};
+
+class ThumbnailIndex
+{
+public:
+	PY_DOC(DOC_CLASS_THUMBNAIL_INDEX,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Reader of thumbnail file.                         \n"
+	"                                                  \n"
+	"Thumbnails of each level are stored back to back, \n"
+	"so a range of frames is read by one file read.    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"path : str                                        \n"
+	"    Path of thumbnail file.                       \n"
+	"\"\"                                              \n");
+	ThumbnailIndex(const std::string& path);
+	~ThumbnailIndex();
+	ThumbnailIndex(const ThumbnailIndex& obj) = delete;
+	ThumbnailIndex& operator=(const ThumbnailIndex& obj) = delete;
+
+	PY_DOC(DOC_INDEX_CLOSE,
+	"\"\"Close the file.                               \n"
+	"\"\"                                              \n");
+	void close();
+
+	PY_DOC(DOC_INDEX_FRAME_COUNT,
+	"\"\"Get number of frames in the file.             \n"
+	"                                                  \n"
+	"Frames written after opening are counted while    \n"
+	"the file is built.                                \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames.                             \n"
+	"\"\"                                              \n");
+	uint64_t frameCount();
+
+	PY_DOC(DOC_INDEX_RESOLUTION,
+	"\"\"Get resolution of recorded data.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Resolution obj                                    \n"
+	"    Resolution of recorded data.                  \n"
+	"\"\"                                              \n");
+	Resolution resolution() const { return Resolution(m_header.width, m_header.height); }
+
+	PY_DOC(DOC_INDEX_LEVEL_SIZE,
+	"\"\"Get size of thumbnails of the level.          \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"level : int                                       \n"
+	"    0 for 1/8, 1 for 1/16 and 2 for 1/32 scale.   \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"Resolution obj                                    \n"
+	"    Resolution of thumbnails.                     \n"
+	"\"\"                                              \n");
+	Resolution levelSize(int level) const;
+
+	PY_DOC(DOC_INDEX_SEQUENCENO,
+	"\"\"Get sequence number of frames.                \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"start : int                                       \n"
+	"    First frame number.                           \n"
+	"count : int                                       \n"
+	"    Number of frames.                             \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint16)                               \n"
+	"    Sequence number of each frame.                \n"
+	"\"\"                                              \n");
+	py::array_t<uint16_t> sequenceNo(int start, int count);
+
+	PY_DOC(DOC_INDEX_READ,
+	"\"\"Read thumbnails of frames.                    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"start : int                                       \n"
+	"    First frame number.                           \n"
+	"count : int                                       \n"
+	"    Number of frames.                             \n"
+	"level : int                                       \n"
+	"    0 for 1/8, 1 for 1/16 and 2 for 1/32 scale.   \n"
+	"    (default=0)                                   \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Array size is (count, h, w).                  \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> read(int start, int count, int level);
+
+	PY_DOC(DOC_INDEX_SEARCH,
+	"\"\"Search frames similar to the thumbnail.       \n"
+	"                                                  \n"
+	"Frames are ranked by mean absolute difference     \n"
+	"from the query.                                   \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"query : numpy array(uint8)                        \n"
+	"    Thumbnail of the level. Array size is (h, w). \n"
+	"level : int                                       \n"
+	"    Level of the query. (default=2)               \n"
+	"top : int                                         \n"
+	"    Number of frames to return. (default=10)      \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(numpy array(int64), numpy array(float64))        \n"
+	"    (frameNo, difference) in ascending order of   \n"
+	"    difference.                                   \n"
+	"\"\"                                              \n");
+	std::tuple<py::array_t<int64_t>, py::array_t<double>> search(py::array_t<uint8_t>& query, int level, int top);
+
+private:
+	void update();
+	void checkRange(int start, int count);
+	void checkLevel(int level) const;
+	void readAt(uint64_t offset, void* dst, size_t size);
+
+	static constexpr int SEARCH_FRAMES = 4096;
+
+	HANDLE m_file;
+	ThumbnailFileHeader m_header;
+	std::mutex m_mutex;
+};
@@ -0,0 +1,346 @@
+#include "Transcoder.h"
+#include <thread>
+#include "CameraFactory.h"
+
+namespace
+{
+	// Row major index of each zigzag position
+	const int ZIGZAG[64] =
+	{
+		 0,  1,  8, 16,  9,  2,  3, 10,
+		17, 24, 32, 25, 18, 11,  4,  5,
+		12, 19, 26, 33, 40, 48, 41, 34,
+		27, 20, 13,  6,  7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36,
+		29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46,
+		53, 60, 61, 54, 47, 55, 62, 63,
+	};
+
+	// Luminance tables of ITU-T T.81 Annex K.3
+	const uint8_t DC_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+	const uint8_t DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+	const uint8_t AC_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+	const uint8_t AC_VALUES[162] =
+	{
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+		0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+		0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa,
+	};
+
+	struct HuffmanCode
+	{
+		uint16_t code[256];
+		uint8_t size[256];
+	};
+
+	// Code of each symbol by the procedure of T.81 Annex C
+	HuffmanCode makeCode(const uint8_t* bits, const uint8_t* values)
+	{
+		HuffmanCode table = {};
+		int code = 0;
+		int k = 0;
+		for (int len = 1; len <= 16; ++len)
+		{
+			for (int i = 0; i < bits[len - 1]; ++i, ++k)
+			{
+				table.code[values[k]] = (uint16_t)code++;
+				table.size[values[k]] = (uint8_t)len;
+			}
+			code <<= 1;
+		}
+		return table;
+	}
+
+	const HuffmanCode DC_CODE = makeCode(DC_BITS, DC_VALUES);
+	const HuffmanCode AC_CODE = makeCode(AC_BITS, AC_VALUES);
+
+	inline int bitLength(int value)
+	{
+		int size = 0;
+		for (; value; value >>= 1) {
+			++size;
+		}
+		return size;
+	}
+
+	inline void putMarker(std::vector<uint8_t>& out, uint8_t marker, int length)
+	{
+		out.push_back(0xFF);
+		out.push_back(marker);
+		if (length > 0)
+		{
+			out.push_back((uint8_t)(length >> 8));
+			out.push_back((uint8_t)length);
+		}
+	}
+}
+
+Transcoder::Transcoder(const std::vector<int>& q)
+	:
+	m_numThread(1)
+{
+	if (q.size() != PUC_Q_COUNT) {
+		throw(WrapperException("quantization may be illegal size."));
+	}
+
+	CameraFactory::initialize();
+	for (int i = 0; i < PUC_Q_COUNT; ++i)
+	{
+		m_quantize[i] = (unsigned short)std::min(std::max(q[i], 0), USHRT_MAX);
+		m_table[i] = (uint8_t)std::min(std::max(q[i], 1), 255);
+	}
+}
+
+std::vector<int> Transcoder::quantization() const
+{
+	return std::vector<int>(m_table.begin(), m_table.end());
+}
+
+py::bytes Transcoder::transcode(XferData* data)
+{
+	auto res = data->resolution();
+	return transcode(data, 0, 0, res.width, res.height);
+}
+
+py::bytes Transcoder::transcode(XferData* data, int x, int y, int w, int h)
+{
+	auto jpeg = transcode(data->dataInfo()->pData, x, y, w, h);
+	return py::bytes((const char*)jpeg.data(), jpeg.size());
+}
+
+py::bytes Transcoder::transcode(py::array_t<uint8_t>& array, const Resolution& res)
+{
+	return transcode(array, 0, 0, res.width, res.height);
+}
+
+py::bytes Transcoder::transcode(py::array_t<uint8_t>& array, int x, int y, int w, int h)
+{
+	auto jpeg = transcode(array.mutable_data(), x, y, w, h);
+	return py::bytes((const char*)jpeg.data(), jpeg.size());
+}
+
+void Transcoder::setNumThread(int num)
+{
+	if (num < 1) {
+		throw(WrapperException("number of thread may be illegal."));
+	}
+	m_numThread = num;
+}
+
+std::vector<uint8_t> Transcoder::transcode(uint8_t* src, int x, int y, int w, int h)
+{
+	if (x < 0 || y < 0 || x % BLOCK || y % BLOCK || w <= 0 || h <= 0 || w > USHRT_MAX || h > USHRT_MAX) {
+		throw(WrapperException("roi may be illegal."));
+	}
+
+	// a stripe of coefficients is 8 lines of whole blocks
+	const int blocks = (w + BLOCK - 1) / BLOCK;
+	const int lineWidth = blocks * BLOCK;
+	const int stripeCount = (h + BLOCK - 1) / BLOCK;
+	const int numThread = std::max(1, std::min<int>(m_numThread, stripeCount));
+	std::vector<std::vector<uint8_t>> parts(numThread);
+	std::vector<PUCRESULT> results(numThread, PUC_SUCCEEDED);
+
+	// Each thread codes consecutive stripes, so parts are joined in order.
+	// Restart marker follows every stripe but the last.
+	auto loop = [&](int t)
+	{
+		std::vector<int16_t> coef((size_t)lineWidth * BLOCK);
+		std::vector<uint8_t>& out = parts[t];
+		out.reserve((size_t)lineWidth * BLOCK * (stripeCount / numThread + 1) / 4);
+		BitWriter writer(out);
+
+		const int first = stripeCount * t / numThread;
+		const int last = stripeCount * (t + 1) / numThread;
+		for (int s = first; s < last; ++s)
+		{
+			int oy = s * BLOCK;
+			int rows = std::min(BLOCK, h - oy);
+			if (rows < BLOCK || w < lineWidth) {
+				std::fill(coef.begin(), coef.end(), (int16_t)0);
+			}
+			auto ret = PUC_DecodeDCTData(coef.data(), x, y + oy, w, rows, lineWidth * sizeof(int16_t), src, (PUSHORT)m_quantize.data());
+			if (PUC_CHK_FAILED(ret)) {
+				results[t] = ret;
+				return;
+			}
+
+			encodeStripe(writer, coef.data(), lineWidth, blocks);
+			writer.flush();
+			if (s < stripeCount - 1) {
+				putMarker(out, (uint8_t)(0xD0 + (s & 7)), 0);
+			}
+		}
+	};
+
+	{
+		OptionalGilRelease release;
+
+		if (numThread == 1) {
+			loop(0);
+		}
+		else
+		{
+			std::vector<std::thread> threads;
+			for (int t = 0; t < numThread; ++t) {
+				threads.emplace_back(loop, t);
+			}
+			for (auto& th : threads) {
+				th.join();
+			}
+		}
+	}
+
+	for (auto ret : results) {
+		if (PUC_CHK_FAILED(ret)) {
+			throw(PUCException("PUC_DecodeDCTData", ret));
+		}
+	}
+
+	size_t size = 0;
+	for (auto& part : parts) {
+		size += part.size();
+	}
+
+	std::vector<uint8_t> jpeg;
+	jpeg.reserve(size + 1024);
+	writeHeader(jpeg, w, h, blocks);
+	for (auto& part : parts) {
+		jpeg.insert(jpeg.end(), part.begin(), part.end());
+	}
+	putMarker(jpeg, 0xD9, 0);
+	return jpeg;
+}
+
+// SOI, JFIF, tables, frame and scan header of a single component image
+void Transcoder::writeHeader(std::vector<uint8_t>& out, int w, int h, int restart) const
+{
+	putMarker(out, 0xD8, 0);
+
+	static const uint8_t JFIF[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	putMarker(out, 0xE0, 2 + sizeof(JFIF));
+	out.insert(out.end(), JFIF, JFIF + sizeof(JFIF));
+
+	putMarker(out, 0xDB, 2 + 1 + PUC_Q_COUNT);
+	out.push_back(0);
+	for (int k = 0; k < PUC_Q_COUNT; ++k) {
+		out.push_back(m_table[ZIGZAG[k]]);
+	}
+
+	putMarker(out, 0xC0, 2 + 6 + 3);
+	out.push_back(8);
+	out.push_back((uint8_t)(h >> 8));
+	out.push_back((uint8_t)h);
+	out.push_back((uint8_t)(w >> 8));
+	out.push_back((uint8_t)w);
+	out.push_back(1);
+	out.insert(out.end(), { 1, 0x11, 0 });
+
+	putMarker(out, 0xC4, 2 + 1 + 16 + sizeof(DC_VALUES));
+	out.push_back(0x00);
+	out.insert(out.end(), DC_BITS, DC_BITS + 16);
+	out.insert(out.end(), DC_VALUES, DC_VALUES + sizeof(DC_VALUES));
+
+	putMarker(out, 0xC4, 2 + 1 + 16 + sizeof(AC_VALUES));
+	out.push_back(0x10);
+	out.insert(out.end(), AC_BITS, AC_BITS + 16);
+	out.insert(out.end(), AC_VALUES, AC_VALUES + sizeof(AC_VALUES));
+
+	putMarker(out, 0xDD, 4);
+	out.push_back((uint8_t)(restart >> 8));
+	out.push_back((uint8_t)restart);
+
+	putMarker(out, 0xDA, 2 + 1 + 2 + 3);
+	out.insert(out.end(), { 1, 1, 0, 0, 63, 0 });
+}
+
+// Block of the stripe has coefficient (u, v) at line v, column 8 * bx + u.
+// DC prediction starts from 0 at every stripe, which is a restart interval.
+void Transcoder::encodeStripe(BitWriter& writer, const int16_t* coef, int lineWidth, int blocks) const
+{
+	int offset[PUC_Q_COUNT];
+	for (int k = 0; k < PUC_Q_COUNT; ++k) {
+		offset[k] = (ZIGZAG[k] / BLOCK) * lineWidth + ZIGZAG[k] % BLOCK;
+	}
+
+	int pred = 0;
+	for (int bx = 0; bx < blocks; ++bx)
+	{
+		const int16_t* block = coef + bx * BLOCK;
+
+		int dc = requantize(block[0], 0);
+		int diff = dc - pred;
+		pred = dc;
+		int size = bitLength(std::abs(diff));
+		writer.put(DC_CODE.code[size], DC_CODE.size[size]);
+		if (size) {
+			writer.put((diff < 0 ? diff - 1 : diff) & ((1 << size) - 1), size);
+		}
+
+		int run = 0;
+		for (int k = 1; k < PUC_Q_COUNT; ++k)
+		{
+			int c = block[offset[k]];
+			int v = c ? requantize(c, ZIGZAG[k]) : 0;
+			if (v == 0)
+			{
+				++run;
+				continue;
+			}
+			for (; run > 15; run -= 16) {
+				writer.put(AC_CODE.code[0xF0], AC_CODE.size[0xF0]);
+			}
+			size = bitLength(std::abs(v));
+			int symbol = (run << 4) | size;
+			writer.put(AC_CODE.code[symbol], AC_CODE.size[symbol]);
+			writer.put((v < 0 ? v - 1 : v) & ((1 << size) - 1), size);
+			run = 0;
+		}
+		if (run > 0) {
+			writer.put(AC_CODE.code[0x00], AC_CODE.size[0x00]);
+		}
+	}
+}
+
+// Coefficients are dequantized by the SDK table, in the scale and level
+// shift of JPEG. Levels are rounded to the JPEG table and limited to the
+// range of baseline Huffman tables.
+int Transcoder::requantize(int coef, int k) const
+{
+	int q = m_table[k];
+	int v = coef >= 0 ? (coef + q / 2) / q : -((-coef + q / 2) / q);
+	return std::min(std::max(v, -MAX_COEF), MAX_COEF);
+}
+
+void Transcoder::BitWriter::put(uint32_t code, int size)
+{
+	m_bits = (m_bits << size) | code;
+	m_count += size;
+	while (m_count >= 8)
+	{
+		m_count -= 8;
+		uint8_t byte = (uint8_t)(m_bits >> m_count);
+		m_out.push_back(byte);
+		if (byte == 0xFF) {
+			m_out.push_back(0);
+		}
+	}
+	m_bits &= (1u << m_count) - 1;
+}
+
+// Pads the last byte with 1 bits before a marker
+void Transcoder::BitWriter::flush()
+{
+	if (m_count > 0) {
+		put((1u << (8 - m_count)) - 1, 8 - m_count);
+	}
+}
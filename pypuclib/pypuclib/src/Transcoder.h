@@ -0,0 +1,191 @@
+#pragma once
+
+#include <pybind11/numpy.h>
+#include <array>
+#include <atomic>
+#include "Common.h"
+#include "Exception.h"
+#include "XferData.h"
+
+namespace py = pybind11;
+
+// Rewrites compressed data as baseline JPEG without IDCT and forward DCT.
+// Coefficients of PUC_DecodeDCTData are requantized by the equivalent
+// JPEG table and entropy coded with the standard luminance Huffman tables.
+// Each 8 lines stripe is a restart interval, so stripes are coded on
+// several threads and joined by RST markers.
+class Transcoder
+{
+public:
+	PY_DOC(DOC_CLASS_TRANSCODER,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Transcoder of compressed data to baseline JPEG.   \n"
+	"                                                  \n"
+	"DCT coefficients of compressed data are entropy   \n"
+	"coded to a grayscale JFIF image, which is also a  \n"
+	"frame of MJPEG stream. Image is not decoded, so   \n"
+	"this is faster than decode and encode to JPEG.    \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"q : list(int)                                     \n"
+	"    Quantization list of the camera. Size must be \n"
+	"    64, values over 255 are limited to 255.       \n"
+	"\"\"                                              \n");
+	Transcoder(const std::vector<int>& q);
+	~Transcoder() {}
+	Transcoder(const Transcoder& obj) = delete;
+	Transcoder& operator=(const Transcoder& obj) = delete;
+
+	PY_DOC(DOC_TC_QUANTIZATION,
+	"\"\"Get quantization table of JPEG.               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"list(int)                                         \n"
+	"    64 values in row major order, as written in   \n"
+	"    DQT segment after zigzag reordering.          \n"
+	"\"\"                                              \n");
+	std::vector<int> quantization() const;
+
+	PY_DOC(DOC_TRANSCODE_A,
+	"\"\"Transcode compressed data to JPEG.            \n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This transcodes data in XferData to full          \n"
+	"resolution.                                       \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to transcode.                        \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bytes                                             \n"
+	"    JFIF image.                                   \n"
+	"\"\"                                              \n");
+	py::bytes transcode(XferData* data);
+
+	PY_DOC(DOC_TRANSCODE_B,
+	"\"\"Transcode compressed data to JPEG.            \n"
+	"                                                  \n"
+	"This is overload function using XferData obj.     \n"
+	"This transcodes data in XferData to roi.          \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : XferData obj                               \n"
+	"    XferData to transcode.                        \n"
+	"x : int                                           \n"
+	"    Start position x. Must be multiple of 8.      \n"
+	"y : int                                           \n"
+	"    Start position y. Must be multiple of 8.      \n"
+	"w : int                                           \n"
+	"    Width to transcode.                           \n"
+	"h : int                                           \n"
+	"    Height to transcode.                          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bytes                                             \n"
+	"    JFIF image.                                   \n"
+	"\"\"                                              \n");
+	py::bytes transcode(XferData* data, int x, int y, int w, int h);
+
+	PY_DOC(DOC_TRANSCODE_C,
+	"\"\"Transcode compressed data to JPEG.            \n"
+	"                                                  \n"
+	"This is overload function using numpy array.      \n"
+	"This transcodes data to full resolution.          \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Compressed data to transcode.                 \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of the data.                       \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bytes                                             \n"
+	"    JFIF image.                                   \n"
+	"\"\"                                              \n");
+	py::bytes transcode(py::array_t<uint8_t>& array, const Resolution& res);
+
+	PY_DOC(DOC_TRANSCODE_D,
+	"\"\"Transcode compressed data to JPEG.            \n"
+	"                                                  \n"
+	"This is overload function using numpy array.      \n"
+	"This transcodes data to roi.                      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"array : numpy array(uint8)                        \n"
+	"    Compressed data to transcode.                 \n"
+	"x : int                                           \n"
+	"    Start position x. Must be multiple of 8.      \n"
+	"y : int                                           \n"
+	"    Start position y. Must be multiple of 8.      \n"
+	"w : int                                           \n"
+	"    Width to transcode.                           \n"
+	"h : int                                           \n"
+	"    Height to transcode.                          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bytes                                             \n"
+	"    JFIF image.                                   \n"
+	"\"\"                                              \n");
+	py::bytes transcode(py::array_t<uint8_t>& array, int x, int y, int w, int h);
+
+	PY_DOC(DOC_TC_NUM_THREAD,
+	"\"\"Get number of transcode threads.              \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of threads.                            \n"
+	"\"\"                                              \n");
+	int numThread() const { return m_numThread; }
+
+	PY_DOC(DOC_TC_SET_NUM_THREAD,
+	"\"\"Set number of transcode threads.              \n"
+	"                                                  \n"
+	"Stripes of 8 lines are coded on each thread.      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"num : int                                         \n"
+	"    Number of threads, 1 or more.                 \n"
+	"\"\"                                              \n");
+	void setNumThread(int num);
+
+private:
+	// Appends bits to JPEG entropy coded segment with byte stuffing.
+	class BitWriter
+	{
+	public:
+		BitWriter(std::vector<uint8_t>& out) : m_out(out), m_bits(0), m_count(0) {}
+		void put(uint32_t code, int size);
+		void flush();
+	private:
+		std::vector<uint8_t>& m_out;
+		uint32_t m_bits;
+		int m_count;
+	};
+
+	std::vector<uint8_t> transcode(uint8_t* src, int x, int y, int w, int h);
+	void writeHeader(std::vector<uint8_t>& out, int w, int h, int restart) const;
+	void encodeStripe(BitWriter& writer, const int16_t* coef, int lineWidth, int blocks) const;
+	int requantize(int coef, int k) const;
+
+	static constexpr int BLOCK = 8;
+	static constexpr int MAX_COEF = 1023;
+
+	// SDK table values are in row major order, same as DCT coefficients
+	std::array<unsigned short, PUC_Q_COUNT> m_quantize;
+	std::array<uint8_t, PUC_Q_COUNT> m_table;
+	std::atomic<int> m_numThread;
+};
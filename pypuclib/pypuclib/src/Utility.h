@@ -1,7 +1,30 @@
 #pragma once
 
+#include <pybind11/pybind11.h>
+#include <memory>
 #include "Common.h"
 
+namespace py = pybind11;
+
+// Releases the GIL only if the calling thread holds it, so the same code
+// serves python calls and native threads. Release it before taking a lock
+// a GIL holder may wait for.
+class OptionalGilRelease
+{
+public:
+	OptionalGilRelease()
+	{
+		if (PyGILState_Check()) {
+			m_release = std::make_unique<py::gil_scoped_release>();
+		}
+	}
+	OptionalGilRelease(const OptionalGilRelease& obj) = delete;
+	OptionalGilRelease& operator=(const OptionalGilRelease& obj) = delete;
+
+private:
+	std::unique_ptr<py::gil_scoped_release> m_release;
+};
+
 class Resolution
 {
 public:
@@ -120,4 +143,36 @@ public:
 
 	int width;
 	int height;
-};
\ No newline at end of file
+};
+
+class CameraConfig
+{
+public:
+	PY_DOC(DOC_CLASS_CAMERA_CONFIG,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Set of device settings applied by Camera.apply(). \n"
+	"                                                  \n"
+	"Attributes                                        \n"
+	"----------                                        \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of the device.                     \n"
+	"framerate : int                                   \n"
+	"    Framerate of the device.                      \n"
+	"shutter : int                                     \n"
+	"    Shutter speed 1/x[sec].                       \n"
+	"exposeTime : int                                  \n"
+	"    Exposure period [nsec]. If not 0, this is used\n"
+	"    instead of shutter.                           \n"
+	"\"\"                                              \n");
+public:
+	CameraConfig() : framerate(0), shutter(0), exposeTime(0) {}
+	CameraConfig(const Resolution& res, const int& f, const int& s, const int& e = 0)
+		: resolution(res), framerate(f), shutter(s), exposeTime(e) {}
+	~CameraConfig() {}
+
+	Resolution resolution;
+	int framerate;
+	int shutter;
+	int exposeTime;
+};
@@ -11,13 +11,24 @@
 #include "Camera.h"
 #include "Decoder.h"
 #include "XferData.h"
+#include "XferDispatcher.h"
+#include "NativeAllocation.h"
+#include "FrameFile.h"
+#include "ImageExporter.h"
+#include "ThumbnailIndex.h"
+#include "FrameBus.h"
+#include "FrameStream.h"
+#include "FrameMailbox.h"
+#include "AutoExposure.h"
+#include "TemporalProcessor.h"
+#include "Transcoder.h"
 #include "Exception.h"
 
 using std::unique_ptr;
 using std::vector;
 namespace py = pybind11;
 
-PYBIND11_MODULE(pypuclib, m) {
+PYBIND11_MODULE(pypuclib, m, py::mod_gil_not_used()) {
     m.doc() = "This module is a Python Wrapper for SDK(PUCLIB) of PHOTRON high-speed camera INFINICAM \n"
         	  "See README to more instruction to control package \n"
               ""
@@ -28,7 +39,8 @@ PYBIND11_MODULE(pypuclib, m) {
             return unique_ptr<CameraFactory, py::nodelete>(&CameraFactory::instance());
     }))
         .def("detect", &CameraFactory::detect, CameraFactory::DOC_DETECT)
-        .def("create", &CameraFactory::create, CameraFactory::DOC_CREATE, py::arg("deviceNo") = 0, py::arg("openAuto") = true);
+        .def("create", &CameraFactory::create, CameraFactory::DOC_CREATE, py::arg("deviceNo") = 0, py::arg("openAuto") = true)
+        .def("createSimulated", &CameraFactory::createSimulated, CameraFactory::DOC_CREATE_SIMULATED);
 
     py::class_<Camera, unique_ptr<Camera, py::nodelete>>(m, "Camera")
         .def("open", &Camera::open, Camera::DOC_OPEN)
@@ -53,14 +65,51 @@ PYBIND11_MODULE(pypuclib, m) {
         .def("beginXfer", &Camera::beginXfer, Camera::DOC_BEGIN_XFER)
         .def("endXfer", &Camera::endXfer, Camera::DOC_END_XFER)
         .def("isXferring", &Camera::isXferring, Camera::DOC_IS_XFERRING)
+        .def("simulateXfer", &Camera::simulateXfer, Camera::DOC_SIMULATE_XFER,
+             py::arg("function"), py::arg("data"), py::arg("resolution"), py::arg("count"))
         .def("decoder", &Camera::decoder, Camera::DOC_DECODER)
         .def("grab", &Camera::grab, Camera::DOC_GRAB)
+        .def("grabNext", &Camera::grabNext, Camera::DOC_GRAB_NEXT, py::arg("timeout") = 1000)
+        .def("grabLatest", &Camera::grabLatest, Camera::DOC_GRAB_LATEST)
         .def("resetDevice", &Camera::resetDevice, Camera::DOC_RESETDEVICE)
         .def("resetSequenceNo", &Camera::resetSequenceNo, Camera::DOC_RESETSEQUENCENO)
         .def("framerateLimit", &Camera::framerateLimit, Camera::DOC_FRAMERATE_LIMIT)
         .def("fanState", &Camera::fanState, Camera::DOC_FAN_STATE)
         .def("setFanState", &Camera::setFanState, Camera::DOC_SET_FAN_STATE)
-        .def("sensorTemperature", &Camera::sensorTemperature, Camera::DOC_SENSOR_TEMPERATURE);
+        .def("sensorTemperature", &Camera::sensorTemperature, Camera::DOC_SENSOR_TEMPERATURE)
+        .def("frameArenaCount", &Camera::frameArenaCount, Camera::DOC_FRAME_ARENA_COUNT)
+        .def("setFrameArenaCount", &Camera::setFrameArenaCount, Camera::DOC_SET_FRAME_ARENA_COUNT, py::arg("count"), py::arg("lockMemory") = false)
+        .def("isFrameArenaLargePage", &Camera::isFrameArenaLargePage, Camera::DOC_IS_FRAME_ARENA_LARGE_PAGE)
+        .def("exposeTime", &Camera::exposeTime, Camera::DOC_EXPOSE_TIME)
+        .def("minExposeTime", &Camera::minExposeTime, Camera::DOC_MIN_EXPOSE_TIME)
+        .def("setExposeTime", &Camera::setExposeTime, Camera::DOC_SET_EXPOSE_TIME)
+        .def("config", &Camera::config, Camera::DOC_CONFIG)
+        .def("validate", &Camera::validate, Camera::DOC_VALIDATE)
+        .def("apply", &Camera::apply, Camera::DOC_APPLY)
+        .def("applyCommandCount", &Camera::applyCommandCount, Camera::DOC_APPLY_COMMAND_COUNT)
+        .def("serialNo", &Camera::serialNo, Camera::DOC_SERIAL_NO)
+        .def("capabilities", &Camera::capabilities, Camera::DOC_CAPABILITIES)
+        .def("startTelemetry", &Camera::startTelemetry, Camera::DOC_START_TELEMETRY, py::arg("interval") = 1000)
+        .def("stopTelemetry", &Camera::stopTelemetry, Camera::DOC_STOP_TELEMETRY)
+        .def("isTelemetryRunning", &Camera::isTelemetryRunning, Camera::DOC_IS_TELEMETRY_RUNNING)
+        .def("telemetry", &Camera::telemetry, Camera::DOC_TELEMETRY)
+        .def("setThermalCallback", &Camera::setThermalCallback, Camera::DOC_SET_THERMAL_CALLBACK, py::arg("high"), py::arg("low"), py::arg("callback"))
+        .def("setAdaptiveRingBuffer", &Camera::setAdaptiveRingBuffer, Camera::DOC_SET_ADAPTIVE_RING_BUFFER, py::arg("enable"), py::arg("budget") = 256)
+        .def("isAdaptiveRingBuffer", &Camera::isAdaptiveRingBuffer, Camera::DOC_IS_ADAPTIVE_RING_BUFFER)
+        .def("callbackStats", &Camera::callbackStats, Camera::DOC_CALLBACK_STATS)
+        .def("resetCallbackStats", &Camera::resetCallbackStats, Camera::DOC_RESET_CALLBACK_STATS)
+        .def("setLoadShedding", &Camera::setLoadShedding, Camera::DOC_SET_LOAD_SHEDDING,
+            py::arg("policy"), py::arg("high") = 64, py::arg("low") = 16, py::arg("interval") = 4, py::arg("threshold") = 2.0)
+        .def("loadShedding", &Camera::loadShedding, Camera::DOC_LOAD_SHEDDING)
+        .def("loadSheddingStats", &Camera::loadSheddingStats, Camera::DOC_LOAD_SHEDDING_STATS)
+        .def("setFramePublisher", &Camera::setFramePublisher, Camera::DOC_SET_FRAME_PUBLISHER, py::arg("publisher"))
+        .def("framePublisher", &Camera::framePublisher, Camera::DOC_FRAME_PUBLISHER)
+        .def("setFrameServer", &Camera::setFrameServer, Camera::DOC_SET_FRAME_SERVER, py::arg("server"))
+        .def("frameServer", &Camera::frameServer, Camera::DOC_FRAME_SERVER)
+        .def("setFrameMailbox", &Camera::setFrameMailbox, Camera::DOC_SET_FRAME_MAILBOX, py::arg("mailbox"))
+        .def("frameMailbox", &Camera::frameMailbox, Camera::DOC_FRAME_MAILBOX)
+        .def("setAutoExposure", &Camera::setAutoExposure, Camera::DOC_SET_AUTO_EXPOSURE, py::arg("controller"), py::arg("actuator") = "exposeTime")
+        .def("autoExposure", &Camera::autoExposure, Camera::DOC_AUTO_EXPOSURE);
 
     py::class_<Resolution>(m, "Resolution", Resolution::DOC_CLASS_RESOLUTION)
         .def(py::init<>())
@@ -90,6 +139,60 @@ PYBIND11_MODULE(pypuclib, m) {
         .def_readonly("limitMin", &FramerateLimit::min)
         .def_readonly("limitMax", &FramerateLimit::max);
 
+    py::class_<CameraConfig>(m, "CameraConfig", CameraConfig::DOC_CLASS_CAMERA_CONFIG)
+        .def(py::init<>())
+        .def(py::init<const Resolution&, const int&, const int&, const int&>(),
+            py::arg("resolution"), py::arg("framerate"), py::arg("shutter"), py::arg("exposeTime") = 0)
+        .def_readwrite("resolution", &CameraConfig::resolution)
+        .def_readwrite("framerate", &CameraConfig::framerate)
+        .def_readwrite("shutter", &CameraConfig::shutter)
+        .def_readwrite("exposeTime", &CameraConfig::exposeTime)
+        .def("__repr__", [](const CameraConfig& c) {
+            return "(resolution=(" + std::to_string(c.resolution.width) + "," + std::to_string(c.resolution.height) +
+                   "),framerate=" + std::to_string(c.framerate) +
+                   ",shutter=" + std::to_string(c.shutter) +
+                   ",exposeTime=" + std::to_string(c.exposeTime) + ")";
+        });
+
+    py::class_<Capabilities, std::shared_ptr<Capabilities>>(m, "Capabilities", Capabilities::DOC_CLASS_CAPABILITIES)
+        .def("serialNo", &Capabilities::serialNo, Capabilities::DOC_SERIAL_NO)
+        .def("isLegal", &Capabilities::isLegal, Capabilities::DOC_IS_LEGAL, py::arg("width"), py::arg("height"))
+        .def("framerateMax", &Capabilities::framerateMax, Capabilities::DOC_CAPS_FRAMERATE_MAX, py::arg("width"), py::arg("height"))
+        .def("xferDataSize", &Capabilities::xferDataSize, Capabilities::DOC_CAPS_XFER_DATA_SIZE, py::arg("width"), py::arg("height"))
+        .def("isFeasible", &Capabilities::isFeasible, Capabilities::DOC_IS_FEASIBLE, py::arg("width"), py::arg("height"), py::arg("framerate"))
+        .def("throughput", &Capabilities::throughput, Capabilities::DOC_THROUGHPUT, py::arg("width"), py::arg("height"), py::arg("framerate"))
+        .def("resolutions", &Capabilities::resolutions, Capabilities::DOC_RESOLUTIONS, py::arg("framerate") = 0);
+
+    py::class_<Telemetry>(m, "Telemetry", Telemetry::DOC_CLASS_TELEMETRY)
+        .def_readonly("temperature", &Telemetry::temperature)
+        .def_readonly("fanState", &Telemetry::fanState)
+        .def_readonly("xferring", &Telemetry::xferring)
+        .def_readonly("framerate", &Telemetry::framerate)
+        .def_readonly("shutter", &Telemetry::shutter)
+        .def_readonly("sampleCount", &Telemetry::sampleCount)
+        .def_readonly("errorCount", &Telemetry::errorCount)
+        .def_readonly("age", &Telemetry::age);
+
+    py::class_<CallbackStats>(m, "CallbackStats", CallbackStats::DOC_CLASS_CALLBACK_STATS)
+        .def_readonly("count", &CallbackStats::count)
+        .def_readonly("mean", &CallbackStats::mean)
+        .def_readonly("p50", &CallbackStats::p50)
+        .def_readonly("p99", &CallbackStats::p99)
+        .def_readonly("p999", &CallbackStats::p999)
+        .def_readonly("max", &CallbackStats::max)
+        .def_readonly("ringBufferCount", &CallbackStats::ringBufferCount)
+        .def_readonly("xferTimeout", &CallbackStats::xferTimeout)
+        .def_readonly("budgetLimited", &CallbackStats::budgetLimited);
+
+    py::class_<FrameStats>(m, "FrameStats", FrameStats::DOC_CLASS_FRAME_STATS)
+        .def_readonly("pixelCount", &FrameStats::pixelCount)
+        .def_readonly("mean", &FrameStats::mean)
+        .def_readonly("min", &FrameStats::min)
+        .def_readonly("max", &FrameStats::max)
+        .def_readonly("histogram", &FrameStats::histogram)
+        .def_readonly("saturated", &FrameStats::saturated)
+        .def_readonly("dark", &FrameStats::dark);
+
     py::class_<GPUSetup>(m, "GPUSetup", GPUSetup::DOC_CLASS_GPU_SETUP)
         .def(py::init<>())
         .def(py::init<const int&, const int&>())
@@ -97,22 +200,78 @@ PYBIND11_MODULE(pypuclib, m) {
         .def_readwrite("height", &GPUSetup::height);
 
     py::class_<XferData>(m, "XferData")
+        .def(py::init<const py::array_t<uint8_t>&, int, const Resolution&>(),
+             py::arg("data"), py::arg("sequenceNo"), py::arg("resolution"))
         .def("dataSize", &XferData::dataSize, XferData::DOC_DATASIZE)
         .def("sequenceNo", &XferData::sequenceNo, XferData::DOC_SEQUENCENO)
         .def("data", &XferData::data, XferData::DOC_DATA)
-        .def("resolution", &XferData::resolution, XferData::DOC_RESOLUTION);
+        .def("resolution", &XferData::resolution, XferData::DOC_RESOLUTION)
+        .def("sheddingPolicy", &XferData::sheddingPolicy, XferData::DOC_SHEDDING_POLICY)
+        .def("backlog", &XferData::backlog, XferData::DOC_BACKLOG)
+        .def("preview", &XferData::preview, XferData::DOC_PREVIEW)
+        .def("bindDecoder", &XferData::bindDecoder, XferData::DOC_BIND_DECODER, py::arg("decoder"))
+        .def_property_readonly("image", &XferData::image, XferData::DOC_IMAGE)
+        .def_property_readonly("dc", &XferData::dc, XferData::DOC_DC)
+        .def("imageRoi", &XferData::imageRoi, XferData::DOC_IMAGE_ROI, py::arg("x"), py::arg("y"), py::arg("w"), py::arg("h"))
+        .def("isDecoded", &XferData::isDecoded, XferData::DOC_IS_DECODED)
+        .def("__dlpack__", [](py::object self, py::object stream, py::kwargs) {
+            // max_version and copy of newer consumers are accepted, unversioned tensor is returned
+            if (!stream.is_none()) {
+                throw(WrapperException("stream must be None for host memory."));
+            }
+            return self.cast<XferData*>()->dlpack(self);
+        }, XferData::DOC_DLPACK, py::arg("stream") = py::none())
+        .def("__dlpack_device__", &XferData::dlpackDevice, XferData::DOC_DLPACK_DEVICE)
+        .def_property_readonly("__array_interface__", &XferData::arrayInterface);
+
+#ifdef PYPUCLIB_COUNT_ALLOCATIONS
+    m.def("nativeAllocations", &NativeAllocation::count, NativeAllocation::DOC_NATIVE_ALLOCATIONS);
+#endif
+
+    py::class_<XferDispatcher>(m, "XferDispatcher", XferDispatcher::DOC_CLASS_XFER_DISPATCHER)
+        .def(py::init<>())
+        .def("setCallback", &XferDispatcher::setCallback, XferDispatcher::DOC_XD_SET_CALLBACK, py::arg("function"))
+        .def("dispatch", py::overload_cast<py::array_t<uint8_t>&, unsigned short, const Resolution&>(&XferDispatcher::dispatch),
+            XferDispatcher::DOC_XD_DISPATCH, py::arg("data"), py::arg("sequenceNo"), py::arg("resolution"))
+        .def("allocations", &XferDispatcher::allocations, XferDispatcher::DOC_XD_ALLOCATIONS)
+        .def("count", &XferDispatcher::count, XferDispatcher::DOC_XD_COUNT);
 
     py::class_<Decoder>(m, "Decoder")
         .def(py::init<>())
         .def(py::init<const vector<int>&>())
         .def("quantization", &Decoder::quantization, Decoder::DOC_QUANTIZATION)
         .def("setQuantization", &Decoder::setQuantization, Decoder::DOC_SET_QUANTIZATION)
-        .def("decode", py::overload_cast<XferData*>(&Decoder::decode), Decoder::DOC_DECODE_A)
-        .def("decode", py::overload_cast<XferData*, int, int, int, int>(&Decoder::decode), Decoder::DOC_DECODE_B)
-        .def("decode", py::overload_cast<py::array_t<uint8_t>&, const Resolution&>(&Decoder::decode), Decoder::DOC_DECODE_C)
-        .def("decode", py::overload_cast<py::array_t<uint8_t>&, int, int, int, int>(&Decoder::decode), Decoder::DOC_DECODE_D)
+        .def("decode", py::overload_cast<XferData*, bool>(&Decoder::decode), Decoder::DOC_DECODE_A,
+             py::arg("data"), py::arg("stats") = false)
+        .def("decode", py::overload_cast<XferData*, int, int, int, int, bool>(&Decoder::decode), Decoder::DOC_DECODE_B,
+             py::arg("data"), py::arg("x"), py::arg("y"), py::arg("w"), py::arg("h"), py::arg("stats") = false)
+        .def("decode", py::overload_cast<py::array_t<uint8_t>&, const Resolution&, bool>(&Decoder::decode), Decoder::DOC_DECODE_C,
+             py::arg("array"), py::arg("resolution"), py::arg("stats") = false)
+        .def("decode", py::overload_cast<py::array_t<uint8_t>&, int, int, int, int, bool>(&Decoder::decode), Decoder::DOC_DECODE_D,
+             py::arg("array"), py::arg("x"), py::arg("y"), py::arg("w"), py::arg("h"), py::arg("stats") = false)
+        .def("decode", py::overload_cast<XferData*, int, const std::string&>(&Decoder::decode), Decoder::DOC_DECODE_SCALE_A, py::arg("data"), py::arg("scale"), py::arg("mode") = "box")
+        .def("decode", py::overload_cast<py::array_t<uint8_t>&, const Resolution&, int, const std::string&>(&Decoder::decode), Decoder::DOC_DECODE_SCALE_B, py::arg("array"), py::arg("resolution"), py::arg("scale"), py::arg("mode") = "box")
+        .def("decodeStats", py::overload_cast<XferData*>(&Decoder::decodeStats), Decoder::DOC_DECODE_STATS_A)
+        .def("decodeStats", py::overload_cast<py::array_t<uint8_t>&, const Resolution&>(&Decoder::decodeStats), Decoder::DOC_DECODE_STATS_B)
+        .def("decodeTensor", py::overload_cast<XferData*, const std::string&, int, float, float>(&Decoder::decodeTensor), Decoder::DOC_DECODE_TENSOR_A,
+             py::arg("data"), py::arg("layout") = "HWC", py::arg("channels") = 3, py::arg("mean") = 0.0f, py::arg("std") = 1.0f)
+        .def("decodeTensor", py::overload_cast<py::array_t<uint8_t>&, const Resolution&, const std::string&, int, float, float>(&Decoder::decodeTensor), Decoder::DOC_DECODE_TENSOR_B,
+             py::arg("array"), py::arg("resolution"), py::arg("layout") = "HWC", py::arg("channels") = 3, py::arg("mean") = 0.0f, py::arg("std") = 1.0f)
+        .def("decodeColor", py::overload_cast<XferData*, const std::string&, const std::string&, const std::string&, const vector<float>&>(&Decoder::decodeColor), Decoder::DOC_DECODE_COLOR_A,
+             py::arg("data"), py::arg("pattern") = "RGGB", py::arg("method") = "bilinear", py::arg("output") = "RGB", py::arg("wb") = vector<float>{ 1.0f, 1.0f, 1.0f })
+        .def("decodeColor", py::overload_cast<py::array_t<uint8_t>&, const Resolution&, const std::string&, const std::string&, const std::string&, const vector<float>&>(&Decoder::decodeColor), Decoder::DOC_DECODE_COLOR_B,
+             py::arg("array"), py::arg("resolution"), py::arg("pattern") = "RGGB", py::arg("method") = "bilinear", py::arg("output") = "RGB", py::arg("wb") = vector<float>{ 1.0f, 1.0f, 1.0f })
+        .def("decodeTemporal", py::overload_cast<XferData*, TemporalProcessor&, const std::string&, int>(&Decoder::decodeTemporal), Decoder::DOC_DECODE_TEMPORAL_A,
+             py::arg("data"), py::arg("processor"), py::arg("op"), py::arg("threshold") = -1)
+        .def("decodeTemporal", py::overload_cast<py::array_t<uint8_t>&, const Resolution&, TemporalProcessor&, const std::string&, int>(&Decoder::decodeTemporal), Decoder::DOC_DECODE_TEMPORAL_B,
+             py::arg("array"), py::arg("resolution"), py::arg("processor"), py::arg("op"), py::arg("threshold") = -1)
         .def("numDecodeThread", &Decoder::numDecodeThread, Decoder::DOC_NUM_DECODE_THREAD)
         .def("setNumDecodeThread", &Decoder::setNumDecodeThread, Decoder::DOC_SET_NUM_DECODE_THREAD)
+        .def("lineAlignment", &Decoder::lineAlignment, Decoder::DOC_LINE_ALIGNMENT)
+        .def("setLineAlignment", &Decoder::setLineAlignment, Decoder::DOC_SET_LINE_ALIGNMENT)
+        .def("isTileDecode", &Decoder::isTileDecode, Decoder::DOC_IS_TILE_DECODE)
+        .def("setTileDecode", &Decoder::setTileDecode, Decoder::DOC_SET_TILE_DECODE, py::arg("enable"), py::arg("tileWidth") = 256, py::arg("tileHeight") = 64)
+        .def("tileDecodeThread", &Decoder::tileDecodeThread, Decoder::DOC_TILE_DECODE_THREAD)
         .def("extractSequenceNo", &Decoder::extractSequenceNo, Decoder::DOC_EXTRACT_SEQUENCENO)
         .def("decodeDC", py::overload_cast<py::array_t<uint8_t>&, int, int, int, int>(&Decoder::decodeDC), Decoder::DOC_DECODE_DC_A)
         .def("decodeDC", py::overload_cast<XferData*, int, int, int, int>(&Decoder::decodeDC), Decoder::DOC_DECODE_DC_B)
@@ -124,11 +283,213 @@ PYBIND11_MODULE(pypuclib, m) {
         .def("isSetupGPUDecode", &Decoder::isSetupGPUDecode, Decoder::DOC_ISSETUP_GPU_DECODE)
         .def("getGPULastError", &Decoder::getGPULastError, Decoder::DOC_GET_GPU_LAST_ERROR);
 
+    py::class_<TemporalProcessor>(m, "TemporalProcessor", TemporalProcessor::DOC_CLASS_TEMPORAL_PROCESSOR)
+        .def(py::init<int, int, int>(), py::arg("width"), py::arg("height"), py::arg("window") = 8)
+        .def("setBackground", &TemporalProcessor::setBackground, TemporalProcessor::DOC_TP_SET_BACKGROUND,
+             py::arg("alpha") = 0.05f, py::arg("k") = 3.0f, py::arg("minStd") = 4.0f)
+        .def("setWindow", &TemporalProcessor::setWindow, TemporalProcessor::DOC_TP_SET_WINDOW)
+        .def("window", &TemporalProcessor::window, TemporalProcessor::DOC_TP_WINDOW)
+        .def("background", &TemporalProcessor::background, TemporalProcessor::DOC_TP_BACKGROUND, py::arg("frame"))
+        .def("difference", &TemporalProcessor::difference, TemporalProcessor::DOC_TP_DIFFERENCE, py::arg("frame"), py::arg("threshold") = -1)
+        .def("accumulate", &TemporalProcessor::accumulate, TemporalProcessor::DOC_TP_ACCUMULATE, py::arg("frame"))
+        .def("mean", &TemporalProcessor::mean, TemporalProcessor::DOC_TP_MEAN)
+        .def("variance", &TemporalProcessor::variance, TemporalProcessor::DOC_TP_VARIANCE)
+        .def("sum", &TemporalProcessor::sum, TemporalProcessor::DOC_TP_SUM)
+        .def("count", &TemporalProcessor::count, TemporalProcessor::DOC_TP_COUNT)
+        .def("reset", &TemporalProcessor::reset, TemporalProcessor::DOC_TP_RESET);
+
+    py::class_<Transcoder>(m, "Transcoder", Transcoder::DOC_CLASS_TRANSCODER)
+        .def(py::init<const vector<int>&>(), py::arg("q"))
+        .def("quantization", &Transcoder::quantization, Transcoder::DOC_TC_QUANTIZATION)
+        .def("transcode", py::overload_cast<XferData*>(&Transcoder::transcode), Transcoder::DOC_TRANSCODE_A)
+        .def("transcode", py::overload_cast<XferData*, int, int, int, int>(&Transcoder::transcode), Transcoder::DOC_TRANSCODE_B)
+        .def("transcode", py::overload_cast<py::array_t<uint8_t>&, const Resolution&>(&Transcoder::transcode), Transcoder::DOC_TRANSCODE_C)
+        .def("transcode", py::overload_cast<py::array_t<uint8_t>&, int, int, int, int>(&Transcoder::transcode), Transcoder::DOC_TRANSCODE_D)
+        .def("numThread", &Transcoder::numThread, Transcoder::DOC_TC_NUM_THREAD)
+        .def("setNumThread", &Transcoder::setNumThread, Transcoder::DOC_TC_SET_NUM_THREAD);
+
+    py::class_<FrameWriter>(m, "FrameWriter")
+        .def(py::init<const std::string&, Camera*>(), py::arg("path"), py::arg("cam"))
+        .def(py::init<const std::string&, const Resolution&, const vector<int>&, int, int>(),
+             py::arg("path"), py::arg("resolution"), py::arg("quantization"), py::arg("framerate") = 0, py::arg("shutter") = 0)
+        .def("write", py::overload_cast<XferData*>(&FrameWriter::write), FrameWriter::DOC_WRITE_A)
+        .def("write", py::overload_cast<py::array_t<uint8_t>&, int>(&FrameWriter::write), FrameWriter::DOC_WRITE_B)
+        .def("flush", &FrameWriter::flush, FrameWriter::DOC_FLUSH)
+        .def("close", &FrameWriter::close, FrameWriter::DOC_WRITER_CLOSE)
+        .def("frameCount", &FrameWriter::frameCount, FrameWriter::DOC_WRITER_FRAME_COUNT)
+        .def("bytesWritten", &FrameWriter::bytesWritten, FrameWriter::DOC_BYTES_WRITTEN);
+
+    py::class_<FrameReader>(m, "FrameReader")
+        .def(py::init<const std::string&>(), py::arg("path"))
+        .def("close", &FrameReader::close, FrameReader::DOC_READER_CLOSE)
+        .def("frameCount", &FrameReader::frameCount, FrameReader::DOC_READER_FRAME_COUNT)
+        .def("resolution", &FrameReader::resolution, FrameReader::DOC_READER_RESOLUTION)
+        .def("framerateShutter", &FrameReader::framerateShutter, FrameReader::DOC_READER_FRAMERATE_SHUTTER)
+        .def("quantization", &FrameReader::quantization, FrameReader::DOC_READER_QUANTIZATION)
+        .def("decoder", &FrameReader::decoder, FrameReader::DOC_READER_DECODER)
+        .def("sequenceNo", &FrameReader::sequenceNo, FrameReader::DOC_READER_SEQUENCENO)
+        .def("read", &FrameReader::read, FrameReader::DOC_READ)
+        .def("readRange", &FrameReader::readRange, FrameReader::DOC_READ_RANGE);
+
+    py::class_<ExportStats>(m, "ExportStats", ExportStats::DOC_CLASS_EXPORT_STATS)
+        .def_readonly("frames", &ExportStats::frames)
+        .def_readonly("bytes", &ExportStats::bytes)
+        .def_readonly("seconds", &ExportStats::seconds)
+        .def_readonly("fps", &ExportStats::fps);
+
+    py::class_<ImageExporter>(m, "ImageExporter", ImageExporter::DOC_CLASS_IMAGE_EXPORTER)
+        .def(py::init<const std::string&, const std::string&, const std::string&, int, int>(),
+             py::arg("directory"), py::arg("format") = "png", py::arg("prefix") = "", py::arg("numThread") = 0, py::arg("maxPending") = 0)
+        .def("write", py::overload_cast<FrameReader&, int, int>(&ImageExporter::write), ImageExporter::DOC_EXPORT_A,
+             py::arg("reader"), py::arg("start") = 0, py::arg("count") = -1)
+        .def("write", py::overload_cast<py::array_t<uint8_t>&, py::array_t<int64_t>&, py::array_t<uint16_t>&, const Resolution&, const vector<int>&>(&ImageExporter::write),
+             ImageExporter::DOC_EXPORT_B, py::arg("data"), py::arg("offsets"), py::arg("sequenceNo"), py::arg("resolution"), py::arg("q"))
+        .def("fileName", &ImageExporter::fileName, ImageExporter::DOC_EXPORT_FILE_NAME);
+
+    py::class_<ThumbnailIndexer>(m, "ThumbnailIndexer", ThumbnailIndexer::DOC_CLASS_THUMBNAIL_INDEXER)
+        .def(py::init<const std::string&, const std::string&, int>(),
+             py::arg("recordPath"), py::arg("path") = "", py::arg("numThread") = 0)
+        .def("wait", &ThumbnailIndexer::wait, ThumbnailIndexer::DOC_INDEXER_WAIT, py::arg("timeout") = -1)
+        .def("cancel", &ThumbnailIndexer::cancel, ThumbnailIndexer::DOC_INDEXER_CANCEL)
+        .def("progress", &ThumbnailIndexer::progress, ThumbnailIndexer::DOC_INDEXER_PROGRESS)
+        .def("frameCount", &ThumbnailIndexer::frameCount, ThumbnailIndexer::DOC_INDEXER_FRAME_COUNT)
+        .def("path", &ThumbnailIndexer::path, ThumbnailIndexer::DOC_INDEXER_PATH);
+
+    py::class_<ThumbnailIndex>(m, "ThumbnailIndex", ThumbnailIndex::DOC_CLASS_THUMBNAIL_INDEX)
+        .def(py::init<const std::string&>(), py::arg("path"))
+        .def("close", &ThumbnailIndex::close, ThumbnailIndex::DOC_INDEX_CLOSE)
+        .def("frameCount", &ThumbnailIndex::frameCount, ThumbnailIndex::DOC_INDEX_FRAME_COUNT)
+        .def("resolution", &ThumbnailIndex::resolution, ThumbnailIndex::DOC_INDEX_RESOLUTION)
+        .def("levelSize", &ThumbnailIndex::levelSize, ThumbnailIndex::DOC_INDEX_LEVEL_SIZE, py::arg("level"))
+        .def("sequenceNo", &ThumbnailIndex::sequenceNo, ThumbnailIndex::DOC_INDEX_SEQUENCENO, py::arg("start"), py::arg("count"))
+        .def("read", &ThumbnailIndex::read, ThumbnailIndex::DOC_INDEX_READ,
+             py::arg("start"), py::arg("count"), py::arg("level") = 0)
+        .def("search", &ThumbnailIndex::search, ThumbnailIndex::DOC_INDEX_SEARCH,
+             py::arg("query"), py::arg("level") = 2, py::arg("top") = 10);
+
+    py::class_<FramePublisher, std::shared_ptr<FramePublisher>>(m, "FramePublisher")
+        .def(py::init<const std::string&, Camera*, int, bool>(),
+             py::arg("name"), py::arg("cam"), py::arg("slotCount") = 16, py::arg("decoded") = false)
+        .def(py::init<const std::string&, const Resolution&, const vector<int>&, int, bool, int>(),
+             py::arg("name"), py::arg("resolution"), py::arg("quantization"), py::arg("slotCount") = 16,
+             py::arg("decoded") = false, py::arg("dataCapacity") = 0)
+        .def("publish", py::overload_cast<XferData*>(&FramePublisher::publish), FramePublisher::DOC_PUBLISH_A)
+        .def("publish", py::overload_cast<py::array_t<uint8_t>&, int>(&FramePublisher::publish), FramePublisher::DOC_PUBLISH_B)
+        .def("setLosslessTimeout", &FramePublisher::setLosslessTimeout, FramePublisher::DOC_SET_LOSSLESS_TIMEOUT, py::arg("timeout") = 100)
+        .def("close", &FramePublisher::close, FramePublisher::DOC_PUBLISHER_CLOSE)
+        .def("name", &FramePublisher::name, FramePublisher::DOC_PUBLISHER_NAME)
+        .def("frameCount", &FramePublisher::frameCount, FramePublisher::DOC_PUBLISHER_FRAME_COUNT)
+        .def("stalls", &FramePublisher::stalls, FramePublisher::DOC_PUBLISHER_STALLS)
+        .def("readers", &FramePublisher::readers, FramePublisher::DOC_PUBLISHER_READERS);
+
+    py::class_<FrameSubscriber>(m, "FrameSubscriber")
+        .def(py::init<const std::string&, bool, bool>(),
+             py::arg("name"), py::arg("lossless") = false, py::arg("decoded") = false)
+        .def("read", &FrameSubscriber::read, FrameSubscriber::DOC_SUBSCRIBER_READ, py::arg("timeout") = 1000, py::keep_alive<0, 1>())
+        .def("image", &FrameSubscriber::image, FrameSubscriber::DOC_SUBSCRIBER_IMAGE)
+        .def("close", &FrameSubscriber::close, FrameSubscriber::DOC_SUBSCRIBER_CLOSE)
+        .def("lag", &FrameSubscriber::lag, FrameSubscriber::DOC_SUBSCRIBER_LAG)
+        .def("dropped", &FrameSubscriber::dropped, FrameSubscriber::DOC_SUBSCRIBER_DROPPED)
+        .def("resolution", &FrameSubscriber::resolution, FrameSubscriber::DOC_SUBSCRIBER_RESOLUTION)
+        .def("quantization", &FrameSubscriber::quantization, FrameSubscriber::DOC_SUBSCRIBER_QUANTIZATION)
+        .def("decoder", &FrameSubscriber::decoder, FrameSubscriber::DOC_SUBSCRIBER_DECODER);
+
+    py::class_<FrameServer, std::shared_ptr<FrameServer>>(m, "FrameServer")
+        .def(py::init<const std::string&, Camera*, int>(),
+             py::arg("address"), py::arg("cam"), py::arg("sendTimeout") = 1000)
+        .def(py::init<const std::string&, const Resolution&, const vector<int>&, int, int, int>(),
+             py::arg("address"), py::arg("resolution"), py::arg("quantization"), py::arg("framerate") = 0,
+             py::arg("shutter") = 0, py::arg("sendTimeout") = 1000)
+        .def("send", py::overload_cast<XferData*>(&FrameServer::send), FrameServer::DOC_SERVER_SEND_A)
+        .def("send", py::overload_cast<py::array_t<uint8_t>&, int>(&FrameServer::send), FrameServer::DOC_SERVER_SEND_B)
+        .def("close", &FrameServer::close, FrameServer::DOC_SERVER_CLOSE)
+        .def("address", &FrameServer::address, FrameServer::DOC_SERVER_ADDRESS)
+        .def("clientCount", &FrameServer::clientCount, FrameServer::DOC_SERVER_CLIENT_COUNT)
+        .def("stats", &FrameServer::stats, FrameServer::DOC_SERVER_STATS);
+
+    py::class_<FrameMailbox, std::shared_ptr<FrameMailbox>>(m, "FrameMailbox", FrameMailbox::DOC_CLASS_FRAME_MAILBOX)
+        .def(py::init<Camera*, bool, const std::string&>(), py::arg("cam"), py::arg("decoded") = false, py::arg("decode") = "read")
+        .def(py::init<const Resolution&, const vector<int>&, bool, int, const std::string&>(),
+             py::arg("resolution"), py::arg("quantization"), py::arg("decoded") = false, py::arg("dataCapacity") = 0,
+             py::arg("decode") = "read")
+        .def("post", py::overload_cast<XferData*>(&FrameMailbox::post), FrameMailbox::DOC_MAILBOX_POST_A)
+        .def("post", py::overload_cast<py::array_t<uint8_t>&, int>(&FrameMailbox::post), FrameMailbox::DOC_MAILBOX_POST_B)
+        .def("read", &FrameMailbox::read, FrameMailbox::DOC_MAILBOX_READ)
+        .def("readImage", &FrameMailbox::readImage, FrameMailbox::DOC_MAILBOX_READ_IMAGE)
+        .def("frameCount", &FrameMailbox::frameCount, FrameMailbox::DOC_MAILBOX_FRAME_COUNT)
+        .def("droppedCount", &FrameMailbox::droppedCount, FrameMailbox::DOC_MAILBOX_DROPPED_COUNT)
+        .def("resolution", &FrameMailbox::resolution, FrameMailbox::DOC_MAILBOX_RESOLUTION);
+
+    py::enum_<ExposureMode>(m, "AE_MODE")
+        .value("MEAN", ExposureMode::MEAN)
+        .value("SATURATION", ExposureMode::SATURATION);
+
+    py::class_<AutoExposureState>(m, "AutoExposureState", AutoExposureState::DOC_CLASS_AUTO_EXPOSURE_STATE)
+        .def_readonly("mode", &AutoExposureState::mode)
+        .def_readonly("target", &AutoExposureState::target)
+        .def_readonly("measured", &AutoExposureState::measured)
+        .def_readonly("error", &AutoExposureState::error)
+        .def_readonly("exposure", &AutoExposureState::exposure)
+        .def_readonly("frameCount", &AutoExposureState::frameCount)
+        .def_readonly("updateCount", &AutoExposureState::updateCount)
+        .def_readonly("errorCount", &AutoExposureState::errorCount)
+        .def_readonly("pending", &AutoExposureState::pending)
+        .def_readonly("converged", &AutoExposureState::converged)
+        .def_readonly("settlingFrames", &AutoExposureState::settlingFrames);
+
+    py::class_<AutoExposure, std::shared_ptr<AutoExposure>>(m, "AutoExposure")
+        .def(py::init<double, ExposureMode>(), py::arg("target"), py::arg("mode") = ExposureMode::MEAN)
+        .def("setTarget", &AutoExposure::setTarget, AutoExposure::DOC_AE_SET_TARGET, py::arg("target"), py::arg("tolerance") = 0.05)
+        .def("setGain", &AutoExposure::setGain, AutoExposure::DOC_AE_SET_GAIN, py::arg("kp"), py::arg("ki"))
+        .def("setLimits", &AutoExposure::setLimits, AutoExposure::DOC_AE_SET_LIMITS, py::arg("minExposure"), py::arg("maxExposure"))
+        .def("setRate", &AutoExposure::setRate, AutoExposure::DOC_AE_SET_RATE, py::arg("interval"), py::arg("settleFrames"))
+        .def("setExposure", &AutoExposure::setExposure, AutoExposure::DOC_AE_SET_EXPOSURE)
+        .def("setActuator", &AutoExposure::setActuator, AutoExposure::DOC_AE_SET_ACTUATOR, py::arg("actuator"))
+        .def("feed", py::overload_cast<XferData*>(&AutoExposure::feed), AutoExposure::DOC_AE_FEED_A)
+        .def("feed", py::overload_cast<py::array_t<uint8_t>&, const Resolution&>(&AutoExposure::feed), AutoExposure::DOC_AE_FEED_B)
+        .def("update", &AutoExposure::update, AutoExposure::DOC_AE_UPDATE)
+        .def("state", &AutoExposure::state, AutoExposure::DOC_AE_STATE)
+        .def("reset", &AutoExposure::reset, AutoExposure::DOC_AE_RESET)
+        .def("close", &AutoExposure::close, AutoExposure::DOC_AE_CLOSE);
+
+    py::class_<FrameClient>(m, "FrameClient")
+        .def(py::init<const std::string&, int>(), py::arg("address"), py::arg("timeout") = 5000)
+        .def("read", &FrameClient::read, FrameClient::DOC_CLIENT_READ, py::arg("timeout") = 1000)
+        .def("close", &FrameClient::close, FrameClient::DOC_CLIENT_CLOSE)
+        .def("isConnected", &FrameClient::isConnected, FrameClient::DOC_CLIENT_IS_CONNECTED)
+        .def("timestamp", &FrameClient::timestamp, FrameClient::DOC_CLIENT_TIMESTAMP)
+        .def("frameCount", &FrameClient::frameCount, FrameClient::DOC_CLIENT_FRAME_COUNT)
+        .def("resolution", &FrameClient::resolution, FrameClient::DOC_CLIENT_RESOLUTION)
+        .def("framerateShutter", &FrameClient::framerateShutter, FrameClient::DOC_CLIENT_FRAMERATE_SHUTTER)
+        .def("quantization", &FrameClient::quantization, FrameClient::DOC_CLIENT_QUANTIZATION)
+        .def("decoder", &FrameClient::decoder, FrameClient::DOC_CLIENT_DECODER)
+        .def("__iter__", [](FrameClient& c) -> FrameClient& { return c; })
+        .def("__next__", [](FrameClient& c) {
+            // wake up periodically so that Ctrl+C can stop the iteration
+            while (c.isConnected())
+            {
+                auto p = c.read(100);
+                if (p) {
+                    return p;
+                }
+                if (PyErr_CheckSignals() != 0) {
+                    throw py::error_already_set();
+                }
+            }
+            throw py::stop_iteration();
+        });
+
     py::enum_<PUC_COLOR_TYPE>(m, "PUC_COLOR_TYPE")
         .value("PUC_COLOR_MONO", PUC_COLOR_MONO)
         .value("PUC_COLOR_COLOR", PUC_COLOR_COLOR)
         .export_values();
 
+    py::enum_<SheddingPolicy>(m, "SHEDDING_POLICY")
+        .value("NONE", SheddingPolicy::NONE)
+        .value("DECIMATE", SheddingPolicy::DECIMATE)
+        .value("DC_PREVIEW", SheddingPolicy::DC_PREVIEW)
+        .value("DC_CHANGE", SheddingPolicy::DC_CHANGE);
+
 
     static py::exception<PUCException> puc_exc(m, "PUCException", PyExc_RuntimeError);
     static py::exception<WrapperException> wrapper_exc(m, "WrapperException", PyExc_RuntimeError);
@@ -0,0 +1,161 @@
+#include "XferData.h"
+#include "Decoder.h"
+
+XferData::XferData(const py::array_t<uint8_t>& array, int sequenceNo, const Resolution& res)
+	:
+	XferData((int)array.size(), res)
+{
+	if (res.width <= 0 || res.height <= 0) {
+		throw(WrapperException("resolution may be illegal."));
+	}
+
+	memcpy(m_info.pData, array.data(), array.size());
+	m_info.nDataSize = (unsigned int)array.size();
+	m_info.nSequenceNo = (unsigned short)sequenceNo;
+}
+
+void XferData::bindDecoder(const py::object& decoder)
+{
+	// decoder is kept alive by reference instead of keep_alive, which adds
+	// a patient on every call to the reused XferData of callback.
+	Decoder* p = decoder.is_none() ? nullptr : decoder.cast<Decoder*>();
+
+	auto lock = lockCache();
+	m_decoder = p;
+	m_decoderOwner = decoder;
+	m_image = Image();
+	m_dc = Image();
+	m_rois.clear();
+}
+
+void XferData::rebind(const PUC_XFER_DATA_INFO* reference, const Resolution& res)
+{
+	m_info.pData = reference->pData;
+	m_info.nDataSize = reference->nDataSize;
+	m_info.nSequenceNo = reference->nSequenceNo;
+	m_resolution = res;
+	m_policy = SheddingPolicy::NONE;
+	m_backlog = 0;
+	m_preview.clear();
+	m_previewWidth = 0;
+	m_previewHeight = 0;
+	m_image = Image();
+	m_dc = Image();
+	m_rois.clear();
+}
+
+py::array_t<uint8_t> XferData::image()
+{
+	Image img;
+	{
+		auto lock = lockCache();
+		if (!m_image.buffer)
+		{
+			img.w = m_resolution.width;
+			img.h = m_resolution.height;
+			img.buffer = decoder()->decodePooled(this, 0, 0, img.w, img.h, img.lineBytes);
+			m_image = img;
+
+			// roi are views of image from now on
+			m_rois.clear();
+		}
+		img = m_image;
+	}
+	return readOnly(ImagePool::view(img.buffer, img.w, img.h, img.lineBytes));
+}
+
+py::array_t<uint8_t> XferData::imageRoi(int x, int y, int w, int h)
+{
+	checkRoi(x, y, w, h);
+
+	Image roi;
+	{
+		auto lock = lockCache();
+		if (m_image.buffer)
+		{
+			roi = m_image;
+			roi.buffer = std::shared_ptr<uint8_t>(m_image.buffer, m_image.buffer.get() + (size_t)m_image.lineBytes * y + x);
+		}
+		else
+		{
+			auto it = std::find_if(m_rois.begin(), m_rois.end(), [&](const Image& r)
+			{
+				return r.x == x && r.y == y && r.w == w && r.h == h;
+			});
+			if (it == m_rois.end())
+			{
+				Image img;
+				img.x = x;
+				img.y = y;
+				img.w = w;
+				img.h = h;
+				img.buffer = decoder()->decodePooled(this, x, y, w, h, img.lineBytes);
+				if (m_rois.size() >= MAX_CACHED_ROI) {
+					m_rois.erase(m_rois.begin());
+				}
+				m_rois.push_back(img);
+				it = m_rois.end() - 1;
+			}
+			roi = *it;
+		}
+	}
+	return readOnly(ImagePool::view(roi.buffer, w, h, roi.lineBytes));
+}
+
+py::array_t<uint8_t> XferData::dc()
+{
+	Image img;
+	{
+		auto lock = lockCache();
+		if (!m_dc.buffer)
+		{
+			img.w = (ALIGN(m_resolution.width, 4) + 7) / 8;
+			img.h = (m_resolution.height + 7) / 8;
+			img.lineBytes = img.w;
+			img.buffer = decoder()->decodeDCPooled(this, img.w, img.h);
+			m_dc = img;
+		}
+		img = m_dc;
+	}
+	return readOnly(ImagePool::view(img.buffer, img.w, img.h, img.lineBytes));
+}
+
+bool XferData::isDecoded()
+{
+	auto lock = lockCache();
+	return (bool)m_image.buffer;
+}
+
+void XferData::checkRoi(int x, int y, int w, int h) const
+{
+	if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+		x + w > m_resolution.width || y + h > m_resolution.height) {
+		throw(WrapperException("roi may be illegal."));
+	}
+}
+
+Decoder* XferData::decoder() const
+{
+	if (m_decoder == nullptr) {
+		throw(WrapperException("decoder is not bound."));
+	}
+	return m_decoder;
+}
+
+// Waits without GIL, since the thread decoding may need it to finish.
+std::unique_lock<std::mutex> XferData::lockCache()
+{
+	std::unique_lock<std::mutex> lock(m_cacheMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		OptionalGilRelease release;
+		lock.lock();
+	}
+	return lock;
+}
+
+py::array_t<uint8_t> XferData::readOnly(py::array_t<uint8_t> array)
+{
+	array.attr("flags").attr("writeable") = false;
+	return array;
+}
@@ -1,8 +1,15 @@
 #pragma once
 
 #include <pybind11/numpy.h>
+#include <mutex>
 #include "Common.h"
 #include "Utility.h"
+#include "FrameArena.h"
+#include "LoadShedding.h"
+#include "DLPack.h"
+#include "ImagePool.h"
+
+class Decoder;
 
 class XferData
 {
@@ -10,15 +17,41 @@ public:
 	XferData(int bufferSize, const Resolution& res)
 		:
 		m_resolution(res),
-		m_isReferred(false)
+		m_isReferred(false),
+		m_policy(SheddingPolicy::NONE),
+		m_backlog(0)
 	{
 		memset(&m_info, 0, sizeof(PUC_XFER_DATA_INFO));
 		m_info.pData = new uint8_t[bufferSize];
 	}
-	XferData(PUC_XFER_DATA_INFO* reference, const Resolution& res)
+	XferData(const std::shared_ptr<FrameArena>& arena, int bufferSize, const Resolution& res)
+		:
+		m_resolution(res),
+		m_isReferred(false),
+		m_policy(SheddingPolicy::NONE),
+		m_backlog(0)
+	{
+		memset(&m_info, 0, sizeof(PUC_XFER_DATA_INFO));
+		if (arena && (size_t)bufferSize <= arena->slotSize()) {
+			m_info.pData = arena->acquire();
+		}
+		if (m_info.pData != nullptr) {
+			m_arena = arena;
+		}
+		else {
+			m_info.pData = new uint8_t[bufferSize];
+		}
+	}
+	// Copy of compressed data not transferred from a camera.
+	XferData(const pybind11::array_t<uint8_t>& array, int sequenceNo, const Resolution& res);
+	// owner keeps the referred memory alive as long as this XferData.
+	XferData(PUC_XFER_DATA_INFO* reference, const Resolution& res, const std::shared_ptr<void>& owner = nullptr)
 		:
 		m_resolution(res),
-		m_isReferred(true)
+		m_isReferred(true),
+		m_owner(owner),
+		m_policy(SheddingPolicy::NONE),
+		m_backlog(0)
 	{
 		m_info.pData = reference->pData;
 		m_info.nDataSize = reference->nDataSize;
@@ -27,7 +60,12 @@ public:
 	~XferData()
 	{
 		if (!m_isReferred && m_info.pData != nullptr) {
-			delete[] m_info.pData;
+			if (m_arena) {
+				m_arena->recycle(m_info.pData);
+			}
+			else {
+				delete[] m_info.pData;
+			}
 			m_info.pData = nullptr;
 		}
 	}
@@ -78,9 +116,225 @@ public:
 		return pybind11::array_t<uint8_t>({ m_info.nDataSize }, m_info.pData);
 	}
 
+	PY_DOC(DOC_DLPACK,
+	"\"\"Export compressed data by DLPack protocol.    \n"
+	"                                                  \n"
+	"Data is shared without copy and the XferData is   \n"
+	"kept alive until the consumer releases it. Data of\n"
+	"XferData passed to the callback is valid only in  \n"
+	"the callback.                                     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"stream : None                                     \n"
+	"    Must be None for host memory.                 \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"PyCapsule                                         \n"
+	"    1d uint8 DLPack tensor named \"dltensor\".      \n"
+	"\"\"                                              \n");
+	inline py::capsule dlpack(const py::object& owner) const
+	{
+		return dlpack::toCapsule(m_info.pData, { dlpack::kDLUInt, 8, 1 },
+			{ (int64_t)m_info.nDataSize }, { 1 }, owner);
+	}
+
+	PY_DOC(DOC_DLPACK_DEVICE,
+	"\"\"Get DLPack device of compressed data.         \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"(int, int)                                        \n"
+	"    (device type, device id). Always (1, 0) of    \n"
+	"    host memory.                                  \n"
+	"\"\"                                              \n");
+	inline std::tuple<int, int> dlpackDevice() const
+	{
+		return std::tuple<int, int>(dlpack::kDLCPU, 0);
+	}
+
+	// numpy array interface v3, so numpy.asarray shares the data without copy
+	inline py::dict arrayInterface() const
+	{
+		py::dict d;
+		d["version"] = 3;
+		d["typestr"] = "|u1";
+		d["shape"] = py::make_tuple(m_info.nDataSize);
+		d["data"] = py::make_tuple((uintptr_t)m_info.pData, false);
+		return d;
+	}
+
+	PY_DOC(DOC_SHEDDING_POLICY,
+	"\"\"Get load shedding policy active for the data. \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"SHEDDING_POLICY(enum)                             \n"
+	"    Policy active when the data was delivered.    \n"
+	"    NONE if all frames were delivered.            \n"
+	"\"\"                                              \n");
+	inline SheddingPolicy sheddingPolicy() const { return m_policy; }
+
+	PY_DOC(DOC_BACKLOG,
+	"\"\"Get backlog when the data was delivered.      \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of frames waiting behind this data.    \n"
+	"\"\"                                              \n");
+	inline int backlog() const { return m_backlog; }
+
+	PY_DOC(DOC_PREVIEW,
+	"\"\"Get DC preview of the data.                   \n"
+	"                                                  \n"
+	"Preview is decoded on transfer thread while       \n"
+	"DC_PREVIEW policy is active, for frames delivered \n"
+	"without data. dataSize() of them is 0.            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    1/8 size image of DC data. Array size is      \n"
+	"    (0, 0) if no preview.                         \n"
+	"\"\"                                              \n");
+	inline pybind11::array_t<uint8_t> preview() const
+	{
+		pybind11::array_t<uint8_t> buf({ m_previewHeight, m_previewWidth });
+		if (!m_preview.empty()) {
+			memcpy(buf.mutable_data(), m_preview.data(), m_preview.size());
+		}
+		return buf;
+	}
+
+	inline void setShedding(LoadShedder::Decision& d)
+	{
+		m_policy = d.policy;
+		m_backlog = d.backlog;
+		if (!d.preview.empty())
+		{
+			m_preview.swap(d.preview);
+			m_previewWidth = d.previewWidth;
+			m_previewHeight = d.previewHeight;
+		}
+	}
+
+	PY_DOC(DOC_BIND_DECODER,
+	"\"\"Bind decoder for image attributes.            \n"
+	"                                                  \n"
+	"Images are decoded on first access by this decoder\n"
+	"and cached, so later accesses cost nothing and the\n"
+	"data never accessed is never decoded. Binding     \n"
+	"clears the cache.                                 \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"decoder : Decoder obj                             \n"
+	"    Decoder to bind. None to unbind.              \n"
+	"\"\"                                              \n");
+	void bindDecoder(const py::object& decoder);
+
+	PY_DOC(DOC_IMAGE,
+	"\"\"Image decoded by the bound decoder.           \n"
+	"                                                  \n"
+	"Decoded on first access into a pooled buffer.     \n"
+	"Returned arrays share the cached image, so they   \n"
+	"are read only.                                    \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Numpy array of the decompressed image.        \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> image();
+
+	PY_DOC(DOC_IMAGE_ROI,
+	"\"\"Get roi of image decoded by the bound decoder.\n"
+	"                                                  \n"
+	"Roi is a view of image if it is already decoded.  \n"
+	"Otherwise only the roi is decoded and cached.     \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"x : int                                           \n"
+	"    Start position of x coordinate.               \n"
+	"y : int                                           \n"
+	"    Start position of y coordinate.               \n"
+	"w : int                                           \n"
+	"    Width start from x.                           \n"
+	"h : int                                           \n"
+	"    Height start from y.                          \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Read only numpy array of (h, w).              \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> imageRoi(int x, int y, int w, int h);
+
+	PY_DOC(DOC_DC,
+	"\"\"DC image decoded by the bound decoder.        \n"
+	"                                                  \n"
+	"Decoded on first access and cached.               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"numpy array(uint8)                                \n"
+	"    Read only 1/8 size image of DC data.          \n"
+	"\"\"                                              \n");
+	py::array_t<uint8_t> dc();
+
+	PY_DOC(DOC_IS_DECODED,
+	"\"\"Check whether image is already decoded.       \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"bool                                              \n"
+	"    True if image is cached.                      \n"
+	"\"\"                                              \n");
+	bool isDecoded();
+
 	inline PUC_XFER_DATA_INFO* dataInfo() { return &m_info; }
+
+	// Points referring XferData to another frame, so the holder and its
+	// python object are reused for every frame. Cached images and preview
+	// are released with their buffers kept, and the decoder stays bound.
+	void rebind(const PUC_XFER_DATA_INFO* reference, const Resolution& res);
 private:
+	// memoized image of roi (x, y, w, h) decoded by m_decoder
+	struct Image
+	{
+		Image() : x(0), y(0), w(0), h(0), lineBytes(0) {}
+
+		int x, y, w, h;
+		int lineBytes;
+		std::shared_ptr<uint8_t> buffer;
+	};
+
+	void checkRoi(int x, int y, int w, int h) const;
+	Decoder* decoder() const;
+	std::unique_lock<std::mutex> lockCache();
+	static py::array_t<uint8_t> readOnly(py::array_t<uint8_t> array);
+
+	static constexpr size_t MAX_CACHED_ROI = 4;
+
 	PUC_XFER_DATA_INFO m_info;
 	Resolution m_resolution;
 	bool m_isReferred;
+	std::shared_ptr<void> m_owner;
+	std::shared_ptr<FrameArena> m_arena;
+	SheddingPolicy m_policy;
+	int m_backlog;
+	std::vector<uint8_t> m_preview;
+	int m_previewWidth = 0;
+	int m_previewHeight = 0;
+	// image caches are guarded, the same XferData may be used by several
+	// threads
+	std::mutex m_cacheMutex;
+	Decoder* m_decoder = nullptr;
+	py::object m_decoderOwner;
+	Image m_image;
+	Image m_dc;
+	std::vector<Image> m_rois;
 };
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <mutex>
+#include <atomic>
+#include "Common.h"
+#include "Exception.h"
+#include "XferData.h"
+#include "LoadShedding.h"
+
+namespace py = pybind11;
+
+// Delivers frames of continuous transfer to the python callback. One
+// referring XferData and its python object are reused for every frame, so
+// steady state makes no heap allocation. The holder is replaced only when
+// the callback keeps a reference to it, so a kept XferData never changes.
+// Frames are delivered one at a time, also without GIL.
+class XferDispatcher
+{
+public:
+	PY_DOC(DOC_CLASS_XFER_DISPATCHER,
+	"\"\"                                              \n"
+	"                                                  \n"
+	"Dispatcher of continuous transfer callback.       \n"
+	"                                                  \n"
+	"Camera obj delivers each frame through this. The  \n"
+	"same XferData obj is passed to every call unless  \n"
+	"the callback keeps a reference to it. This is for \n"
+	"a simulated device to drive the same path.        \n"
+	"\"\"                                              \n");
+	XferDispatcher()
+		:
+		m_xfer(nullptr),
+		m_allocations(0),
+		m_count(0)
+	{
+	}
+	~XferDispatcher()
+	{
+		// Camera obj may be deleted after python is finalized
+		if (Py_IsInitialized())
+		{
+			py::gil_scoped_acquire acquire;
+			m_holder = py::object();
+			m_callback = py::object();
+		}
+		else
+		{
+			m_holder.release();
+			m_callback.release();
+		}
+	}
+	XferDispatcher(const XferDispatcher& obj) = delete;
+	XferDispatcher& operator=(const XferDispatcher& obj) = delete;
+
+	PY_DOC(DOC_XD_SET_CALLBACK,
+	"\"\"Set callback function.                        \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"function : function<void(XferData*)>              \n"
+	"    Callback function. None to remove.            \n"
+	"\"\"                                              \n");
+	void setCallback(const py::object& f)
+	{
+		py::object old;
+		{
+			auto lock = lockDispatch();
+			old = m_callback;
+			m_callback = f;
+		}
+		// old function is released after unlock, it may run python code
+	}
+
+	// Called on transfer thread. Preview of decision is swapped with the
+	// holder's, so both buffers are reused.
+	void dispatch(const PUC_XFER_DATA_INFO* info, const Resolution& res, LoadShedder::Decision& decision)
+	{
+		py::gil_scoped_acquire acquire;
+		keepThreadState(acquire);
+
+		auto lock = lockDispatch();
+		if (!m_callback || m_callback.is_none()) {
+			return;
+		}
+
+		// callback may replace itself
+		py::object callback = m_callback;
+		XferData* p = holder(info, res);
+		p->setShedding(decision);
+		++m_count;
+		try
+		{
+			callback(m_holder);
+		}
+		catch (py::error_already_set& e)
+		{
+			// no python caller on this thread, report to sys.unraisablehook
+			e.discard_as_unraisable(__func__);
+		}
+	}
+
+	PY_DOC(DOC_XD_DISPATCH,
+	"\"\"Deliver compressed data to the callback.      \n"
+	"                                                  \n"
+	"Parameters                                        \n"
+	"----------                                        \n"
+	"data : numpy array(uint8)                         \n"
+	"    Compressed data of a frame.                   \n"
+	"sequenceNo : int                                  \n"
+	"    Sequence number of the frame.                 \n"
+	"resolution : Resolution obj                       \n"
+	"    Resolution of the frame.                      \n"
+	"\"\"                                              \n");
+	void dispatch(py::array_t<uint8_t>& data, unsigned short sequenceNo, const Resolution& res)
+	{
+		PUC_XFER_DATA_INFO info;
+		memset(&info, 0, sizeof(PUC_XFER_DATA_INFO));
+		info.pData = (PUINT8)data.data();
+		info.nDataSize = (UINT32)data.size();
+		info.nSequenceNo = sequenceNo;
+
+		LoadShedder::Decision decision = { true, true, SheddingPolicy::NONE, 0, {}, 0, 0 };
+		dispatch(&info, res, decision);
+	}
+
+	PY_DOC(DOC_XD_ALLOCATIONS,
+	"\"\"Get number of XferData obj allocated.         \n"
+	"                                                  \n"
+	"This stays the same in steady state, and grows    \n"
+	"only when the callback keeps XferData.            \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of allocations.                        \n"
+	"\"\"                                              \n");
+	int64_t allocations() const { return m_allocations; }
+
+	PY_DOC(DOC_XD_COUNT,
+	"\"\"Get number of frames delivered.               \n"
+	"                                                  \n"
+	"Returns                                           \n"
+	"-------                                           \n"
+	"int                                               \n"
+	"    Number of callbacks.                          \n"
+	"\"\"                                              \n");
+	int64_t count() const { return m_count; }
+
+	// Called on the transfer thread after its last frame, so the thread
+	// state kept by dispatch() is deleted on the thread it belongs to.
+	void releaseThreadState()
+	{
+		bool& kept = keptThreadState();
+		if (!kept || !Py_IsInitialized()) {
+			return;
+		}
+
+		// the last reference is released with the GIL by the destructor
+		py::gil_scoped_acquire acquire;
+		acquire.dec_ref();
+		kept = false;
+	}
+
+private:
+	XferData* holder(const PUC_XFER_DATA_INFO* info, const Resolution& res)
+	{
+		// only m_holder refers the holder unless the callback kept it
+		if (!m_holder || m_holder.ref_count() > 1)
+		{
+			PUC_XFER_DATA_INFO reference = *info;
+			m_holder = py::cast(new XferData(&reference, res), py::return_value_policy::take_ownership);
+			m_xfer = m_holder.cast<XferData*>();
+			++m_allocations;
+			return m_xfer;
+		}
+		m_xfer->rebind(info, res);
+		return m_xfer;
+	}
+
+	// Recursive, so the callback can call setCallback. Waits without GIL,
+	// since the thread in the callback may need it to finish.
+	std::unique_lock<std::recursive_mutex> lockDispatch()
+	{
+		std::unique_lock<std::recursive_mutex> lock(m_mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+		{
+			py::gil_scoped_release release;
+			lock.lock();
+		}
+		return lock;
+	}
+
+	// pybind11 creates and deletes thread state of a thread python doesn't
+	// know on each acquire. It is kept for the transfer thread instead,
+	// until releaseThreadState().
+	static void keepThreadState(py::gil_scoped_acquire& acquire)
+	{
+		bool& kept = keptThreadState();
+		if (!kept)
+		{
+			acquire.inc_ref();
+			kept = true;
+		}
+	}
+
+	static bool& keptThreadState()
+	{
+		static thread_local bool kept = false;
+		return kept;
+	}
+
+	std::recursive_mutex m_mutex;
+	py::object m_callback;
+	py::object m_holder;
+	XferData* m_xfer;
+	std::atomic<int64_t> m_allocations;
+	std::atomic<int64_t> m_count;
+};
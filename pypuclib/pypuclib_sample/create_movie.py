@@ -80,8 +80,10 @@ cam.beginXfer(callback)
 while True:
 
     if b_show == True:
-        # Grab the single image data
-        xferData = cam.grab()
+        # Wait for a new image data received by the transfer thread
+        xferData = cam.grabNext(1000)
+        if xferData is None:
+            continue
 
         # Decode the data can be used as image
         img = decoder.decode(xferData)
@@ -67,9 +67,8 @@ if __name__ == '__main__':
     warmup = 30
     while True:
         xferData = cam.grab()
-        frameMono = decoder.decode(xferData)
-        height, width = frameMono.shape
-        frame = cv2.merge((frameMono, frameMono, frameMono))
+        frame = decoder.decodeTensor(xferData, "HWC", 3)
+        height, width = frame.shape[:2]
         CurrTime = time.time()
         prevTime = time.time()
         blob, outputs = detect_objects(frame, model, output_layers)
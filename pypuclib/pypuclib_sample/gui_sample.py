@@ -5,11 +5,12 @@ from tkinter import filedialog
 from PIL import Image, ImageTk # need to import extra module "pip install pillow"
 
 import numpy as np
-import os, csv, json, threading
+import os, csv, threading
 from enum import IntEnum
 
 import pypuclib
 from pypuclib import CameraFactory, Camera, XferData, Resolution, Decoder
+from pypuclib import FrameWriter, FrameReader
 
 class FILE_TYPE(IntEnum):
     CSV = 0
@@ -17,49 +18,35 @@ class FILE_TYPE(IntEnum):
 
 class BinaryReader():
     def __init__(self, name):
-        # read json file
-        self.dict = dict()
-        with open(name, mode='rt', encoding='utf-8') as file:
-            self.dict = json.load(file)
-
-        self.file = open(name.replace(".json", ".npy"), "rb")
-
-        # read file info
-        d = np.load(self.file)
-        self.framesize = self.file.tell()
-        self.file.seek(0, os.SEEK_END)
-        self.filesize = self.file.tell()
-        self.framecount = int(self.filesize / self.framesize)
-        self.file.seek(0)
+        # camera settings are stored in the file header
+        self.file = FrameReader(name)
+        self.framecount = self.file.frameCount()
 
         # prepare for decode
-        self.decoder = Decoder(self.dict["quantization"])
-        self.width = self.dict["width"]
-        self.height = self.dict["height"]
+        self.decoder = self.file.decoder()
+        self.width = self.file.resolution().width
+        self.height = self.file.resolution().height
 
         self.opened = True
 
     def read(self, frameNo, raw = False):
-        self.file.seek(self.framesize * frameNo)
-        array = np.load(self.file)
+        array = self.file.read(frameNo)
         if raw:
             return array
         else:
             return self.decoder.decode(array, Resolution(self.width, self.height))
 
     def readseqNo(self,frameNo):
-        self.file.seek(self.framesize * frameNo)
-        array = np.load(self.file)
-        return self.decoder.extractSequenceNo(array, self.width, self.height)
+        return self.file.sequenceNo(frameNo)
 
 class FileCreator():
-    def __init__(self, name, filetype):
+    def __init__(self, name, filetype, cam):
         if filetype == FILE_TYPE.CSV:
             self.file = open(name + ".csv", 'w')
             self.writer = csv.writer(self.file, lineterminator='\n')
             self.writer.writerow(["SequenceNo", "diff"])
         elif filetype == FILE_TYPE.BINARY:
-            self.file = open(name + ".npy", 'wb')
+            self.file = FrameWriter(name + ".pucf", cam)
         else:
             return
 
@@ -72,8 +59,7 @@ class FileCreator():
             if self.filetype == FILE_TYPE.CSV:
                 self.write_csv(xferData.sequenceNo())
             elif self.filetype == FILE_TYPE.BINARY:
-                self.write_binary(xferData.sequenceNo(),
-                                  xferData.data())
+                self.write_binary(xferData)
 
     def write_csv(self, seq):
         if self.oldSeq != seq:
@@ -83,21 +69,12 @@ class FileCreator():
                         "*" if (seq - self.oldSeq) > 1 else ""])
             self.oldSeq = seq
 
-    def write_binary(self, seq, nparray):
+    def write_binary(self, xferData):
+        seq = xferData.sequenceNo()
         if self.oldSeq != seq:
-            np.save(self.file, nparray)
+            self.file.write(xferData)
             self.oldSeq = seq
 
-    def create_json(name, cam):
-        data = dict()
-        data["framerate"] = cam.framerate()
-        data["shutter"] = cam.shutter()
-        data["width"] = cam.resolution().width
-        data["height"] = cam.resolution().height
-        data["quantization"] = cam.decoder().quantization()
-        with open(name+".json", mode='wt', encoding='utf-8') as file:
-            json.dump(data, file, ensure_ascii=False, indent=2)
-
     def close(self):
         if self.opened:
             self.file.close()
@@ -152,6 +129,7 @@ class Application(tk.Frame):
         self.cam = CameraFactory().create()
         self.fcreator = None
         self.decoder = self.cam.decoder()
+        self.caps = self.cam.capabilities()
 
         self.framerateValues = [1, 10, 50, 100, 125, 250, 500, 950, 1000, 
                                 1500, 2000, 2500, 3000, 3200, 4000, 5000, 
@@ -350,8 +328,13 @@ class Application(tk.Frame):
         self.updateAcquisition()
 
     def update(self):
-        data = self.cam.grab()
-        self.updatecanvas(data)
+        # during transfer, redraw only when a new frame is received
+        if self.cam.isXferring():
+            data = self.cam.grabNext(0)
+        else:
+            data = self.cam.grab()
+        if data is not None:
+            self.updatecanvas(data)
         self.updateID = self.after(self.delay, self.update)
 
     def updatecanvas(self, data):
@@ -363,7 +346,14 @@ class Application(tk.Frame):
         if cw > 1 and ch > 1:
             scale = cw/w if cw/w < ch/h else ch/h
 
-        array = self.decoder.decode(data)
+        # reduce while decoding when the canvas is half size or less
+        reduction = 1
+        while reduction < 8 and scale * reduction * 2 <= 1:
+            reduction *= 2
+        if reduction > 1:
+            array = self.decoder.decode(data, reduction)
+        else:
+            array = self.decoder.decode(data)
         i = Image.fromarray(array).resize((int(w*scale), int(h*scale)))
         self.img = ImageTk.PhotoImage(image=i)
         self.canvas.delete("all")
@@ -388,21 +378,10 @@ class Application(tk.Frame):
         self.cam.setResolution(int(resStr[0]), int(resStr[1]))
 
     def updateResolutionList(self):
-        resMax = self.cam.resolutionMax()
-        resLimit = self.cam.resolutionLimit()
-        hStep = resLimit.limitH.step
-        hMin = resLimit.limitH.min
-        hMax = resMax.height
-        wStep = resLimit.limitW.step
-        wMin = resLimit.limitW.min
-        wMax = resMax.width
-
-        resW = range(wMin, wMax+1, wStep if wStep != 0 else 1)
-        resH = range(hMin, hMax+1, hStep if hStep != 0 else 1)
+        fps = self.cam.config().framerate
         resValues = []
-        for h in resH:
-            for w in resW:
-                resValues.append(str(w)+"x"+str(h))
+        for res in self.caps.resolutions(fps):
+            resValues.append(str(res.width)+"x"+str(res.height))
         self.resolutionList.config(values=resValues)
         res = self.cam.resolution()
         self.resolutionList.set(str(res.width)+"x"+str(res.height))
@@ -435,11 +414,10 @@ class Application(tk.Frame):
         self.isRec = not self.isRec
         if self.isRec:
             self.recButton.state(["pressed"])
-            self.fcreator = FileCreator("test", self.savefileVal.get())
+            self.fcreator = FileCreator("test", self.savefileVal.get(), self.cam)
         else:
             self.recButton.state(["!pressed"])
             self.fcreator.close()
-            FileCreator.create_json("test", self.cam)
         self.locker.release()
 
     def uistop(self):
@@ -551,7 +529,7 @@ class FileApplication(tk.Frame):
         
     def openfile(self):
         dir = os.path.abspath(os.path.dirname(__file__))
-        type = [("データファイル","*.json")]
+        type = [("データファイル","*.pucf")]
         fname = filedialog.askopenfilename(filetypes=type, initialdir=dir)
 
         self.reader = BinaryReader(fname)
@@ -1,13 +1,31 @@
 import unittest
 import os
 import json
+import io
+import tempfile
+import threading
+import time
+import sys
+import uuid
+import socket
+import struct
 from PIL import Image
 import numpy as np
 
 import pypuclib
-from pypuclib import Resolution, Decoder
+from pypuclib import CameraFactory, Resolution, Decoder
 from pypuclib import PUCException, WrapperException
 from pypuclib import GPUSetup
+from pypuclib import FrameWriter, FrameReader
+from pypuclib import ImageExporter
+from pypuclib import ThumbnailIndexer, ThumbnailIndex
+from pypuclib import FramePublisher, FrameSubscriber
+from pypuclib import FrameMailbox
+from pypuclib import XferData, XferDispatcher
+from pypuclib import FrameServer, FrameClient
+from pypuclib import AutoExposure, AE_MODE
+from pypuclib import TemporalProcessor
+from pypuclib import Transcoder
 
 class pypuclib_offlinetest(unittest.TestCase):
     def readJson(self, name):
@@ -136,6 +154,973 @@ class pypuclib_offlinetest(unittest.TestCase):
         img = self.decoder.decode(self.compressedData, Resolution(self.width-8, self.height-8))
         self.assertFalse(np.array_equal(img, self.answerImg))
         
+    def test_lineAlignment(self):
+        print("test_lineAlignment")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        # default alignment keeps decoded arrays packed
+        self.assertEqual(self.decoder.lineAlignment(), 1)
+        img = self.decoder.decode(self.compressedData, res)
+        self.assertTrue(img.flags["C_CONTIGUOUS"])
+        self.assertEqual(img.tobytes(), self.answerImg.tobytes())
+        roi = self.decoder.decode(self.compressedData, 8, 8, 94, 20)
+        self.assertTrue(roi.flags["C_CONTIGUOUS"])
+        self.assertTrue(np.array_equal(roi, self.answerImg[8:28, 8:102]))
+
+        for align in [4, 64, 256]:
+            self.decoder.setLineAlignment(align)
+            self.assertEqual(self.decoder.lineAlignment(), align)
+
+            img = self.decoder.decode(self.compressedData, res)
+            self.assertEqual(img.shape, (self.height, self.width))
+            self.assertEqual(img.strides[0] % align, 0)
+            self.assertEqual(img.ctypes.data % align, 0)
+            self.assertTrue(np.array_equal(img, self.answerImg))
+
+            x, y, w, h = 128, 64, 240, 132
+            roi = self.decoder.decode(self.compressedData, x, y, w, h)
+            self.assertEqual(roi.strides[0] % align, 0)
+            self.assertTrue(np.array_equal(roi, self.answerImg[y:y+h, x:x+w]))
+
+        self.decoder.setLineAlignment(1)
+        self.assertTrue(self.decoder.decode(self.compressedData, res).flags["C_CONTIGUOUS"])
+
+        # alignment violation
+        with self.assertRaises(WrapperException):
+            self.decoder.setLineAlignment(2)
+        with self.assertRaises(WrapperException):
+            self.decoder.setLineAlignment(96)
+        with self.assertRaises(WrapperException):
+            self.decoder.setLineAlignment(8192)
+
+    def test_tileDecode(self):
+        print("test_tileDecode")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        self.assertFalse(self.decoder.isTileDecode())
+        self.assertGreaterEqual(self.decoder.tileDecodeThread(), 1)
+
+        # tile size violation
+        with self.assertRaises(WrapperException):
+            self.decoder.setTileDecode(True, 100, 64)
+        with self.assertRaises(WrapperException):
+            self.decoder.setTileDecode(True, 256, 0)
+
+        for tw, th in [(256, 64), (8, 8), (2048, 2048)]:
+            self.decoder.setTileDecode(True, tw, th)
+            self.assertTrue(self.decoder.isTileDecode())
+
+            img = self.decoder.decode(self.compressedData, res)
+            self.assertTrue(np.array_equal(img, self.answerImg))
+
+            x, y, w, h = 128, 64, 240, 132
+            roi = self.decoder.decode(self.compressedData, x, y, w, h)
+            self.assertTrue(np.array_equal(roi, self.answerImg[y:y+h, x:x+w]))
+
+        # decode range violation
+        with self.assertRaises(PUCException):
+            self.decoder.decode(self.compressedData, 129, 64, 240, 132)
+        with self.assertRaises(PUCException):
+            self.decoder.decode(self.compressedData, 128, 64, 1300, 132)
+
+        # frames from several threads share the pool
+        self.decoder.setTileDecode(True)
+        results = []
+        def work():
+            for i in range(10):
+                img = self.decoder.decode(self.compressedData, res)
+                results.append(np.array_equal(img, self.answerImg))
+        threads = [threading.Thread(target=work) for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(len(results), 40)
+        self.assertTrue(all(results))
+
+        self.decoder.setTileDecode(False)
+        self.assertFalse(self.decoder.isTileDecode())
+
+    def test_decodeScale(self):
+        print("test_decodeScale")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        for scale in [2, 4, 8]:
+            oh, ow = self.height // scale, self.width // scale
+            crop = self.answerImg[:oh*scale, :ow*scale].astype(np.uint32)
+
+            # box average with rounding
+            blocks = crop.reshape(oh, scale, ow, scale).sum(axis=(1, 3))
+            answer = ((blocks + scale*scale//2) // (scale*scale)).astype(np.uint8)
+            for i in [1, 8]:
+                self.decoder.setNumDecodeThread(i)
+                img = self.decoder.decode(self.compressedData, res, scale)
+                self.assertEqual(img.shape, (oh, ow))
+                self.assertTrue(np.array_equal(img, answer))
+
+            # subsample
+            img = self.decoder.decode(self.compressedData, res, scale, "subsample")
+            self.assertTrue(np.array_equal(img, self.answerImg[0:oh*scale:scale, 0:ow*scale:scale]))
+
+        # scale and mode violation
+        with self.assertRaises(WrapperException):
+            self.decoder.decode(self.compressedData, res, 3)
+        with self.assertRaises(WrapperException):
+            self.decoder.decode(self.compressedData, res, 2, "bilinear")
+
+    def test_decodeStats(self):
+        print("test_decodeStats")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        answer = np.bincount(self.answerImg.ravel(), minlength=256)
+
+        for i in [1, 8]:
+            self.decoder.setNumDecodeThread(i)
+            img, stats = self.decoder.decode(self.compressedData, res, stats=True)
+            self.assertTrue(np.array_equal(img, self.answerImg))
+            self.assertEqual(stats.histogram, list(answer))
+            self.assertEqual(stats.pixelCount, self.answerImg.size)
+            self.assertAlmostEqual(stats.mean, self.answerImg.mean())
+            self.assertEqual(stats.min, self.answerImg.min())
+            self.assertEqual(stats.max, self.answerImg.max())
+            self.assertEqual(stats.saturated, answer[255])
+            self.assertEqual(stats.dark, answer[0])
+
+            stats = self.decoder.decodeStats(self.compressedData, res)
+            self.assertEqual(stats.histogram, list(answer))
+
+        # roi
+        x, y, w, h = 8, 16, 64, 40
+        roi, stats = self.decoder.decode(self.compressedData, x, y, w, h, True)
+        self.assertTrue(np.array_equal(roi, self.answerImg[y:y+h, x:x+w]))
+        self.assertEqual(stats.histogram, list(np.bincount(roi.ravel(), minlength=256)))
+
+    def demosaic_reference(self, mosaic, pattern, method):
+        h, w = mosaic.shape
+        p = np.pad(mosaic.astype(np.int32), 2, mode="reflect")
+        def at(dy, dx):
+            return p[2 + dy:2 + dy + h, 2 + dx:2 + dx + w]
+
+        c = at(0, 0)
+        if method == "bilinear":
+            hor = (at(0, -1) + at(0, 1) + 1) >> 1
+            ver = (at(-1, 0) + at(1, 0) + 1) >> 1
+            cross = (at(0, -1) + at(0, 1) + at(-1, 0) + at(1, 0) + 2) >> 2
+            diag = (at(-1, -1) + at(-1, 1) + at(1, -1) + at(1, 1) + 2) >> 2
+        else:
+            d4 = at(-1, -1) + at(-1, 1) + at(1, -1) + at(1, 1)
+            h2 = at(0, -2) + at(0, 2)
+            v2 = at(-2, 0) + at(2, 0)
+            hor = np.clip((10 * c + 8 * (at(0, -1) + at(0, 1)) - 2 * h2 - 2 * d4 + v2 + 8) >> 4, 0, 255)
+            ver = np.clip((10 * c + 8 * (at(-1, 0) + at(1, 0)) - 2 * v2 - 2 * d4 + h2 + 8) >> 4, 0, 255)
+            diag = np.clip((12 * c + 4 * d4 - 3 * (h2 + v2) + 8) >> 4, 0, 255)
+            dh = np.abs(at(0, -1) - at(0, 1)) + np.abs(2 * c - h2)
+            dv = np.abs(at(-1, 0) - at(1, 0)) + np.abs(2 * c - v2)
+            gh = 2 * (at(0, -1) + at(0, 1)) + 2 * c - h2
+            gv = 2 * (at(-1, 0) + at(1, 0)) + 2 * c - v2
+            g = np.where(dh < dv, gh, np.where(dv < dh, gv, (gh + gv) >> 1))
+            cross = np.clip((g + 2) >> 2, 0, 255)
+
+        cfa = np.array(list(pattern)).reshape(2, 2)
+        site = np.tile(cfa, (h // 2 + 1, w // 2 + 1))[:h, :w]
+        rowR = np.array(["R" in cfa[y % 2] for y in range(h)])[:, None]
+        r = np.where(site == "R", c, np.where(site == "G", np.where(rowR, hor, ver), diag))
+        g = np.where(site == "G", c, cross)
+        b = np.where(site == "B", c, np.where(site == "G", np.where(rowR, ver, hor), diag))
+        return np.dstack([r, g, b]).astype(np.uint8)
+
+    def test_decodeColor(self):
+        print("test_decodeColor")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        # recorded frame is used as bayer mosaic
+        for pattern in ["RGGB", "BGGR", "GRBG", "GBRG"]:
+            for method in ["bilinear", "edge"]:
+                answer = self.demosaic_reference(self.answerImg, pattern, method)
+                for i in [1, 8]:
+                    self.decoder.setNumDecodeThread(i)
+                    rgb = self.decoder.decodeColor(self.compressedData, res, pattern, method)
+                    self.assertEqual(rgb.shape, (self.height, self.width, 3))
+                    self.assertTrue(np.array_equal(rgb, answer))
+
+        # white balance and output
+        answer = self.demosaic_reference(self.answerImg, "RGGB", "bilinear")
+        balanced = np.minimum(np.floor(answer * np.array([2.0, 1.0, 0.5]) + 0.5), 255).astype(np.uint8)
+        bgr = self.decoder.decodeColor(self.compressedData, res, output="BGR", wb=[2.0, 1.0, 0.5])
+        self.assertTrue(np.array_equal(bgr, balanced[:, :, ::-1]))
+
+        yuv = self.decoder.decodeColor(self.compressedData, res, output="YUV")
+        self.assertEqual(yuv.shape, (3, self.height, self.width))
+        r, g, b = [answer[:, :, i].astype(np.float64) for i in range(3)]
+        self.assertTrue(np.allclose(yuv[0], 0.299 * r + 0.587 * g + 0.114 * b, atol=1))
+        self.assertTrue(np.allclose(yuv[1], np.clip(-0.168736 * r - 0.331264 * g + 0.5 * b + 128, 0, 255), atol=1))
+        self.assertTrue(np.allclose(yuv[2], np.clip(0.5 * r - 0.418688 * g - 0.081312 * b + 128, 0, 255), atol=1))
+
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeColor(self.compressedData, res, "RGBG")
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeColor(self.compressedData, res, method="nearest")
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeColor(self.compressedData, res, output="HSV")
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeColor(self.compressedData, res, wb=[1.0, 1.0])
+
+    def test_temporalProcessor(self):
+        print("test_temporalProcessor")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        rng = np.random.default_rng(0)
+        frames = [np.clip(self.answerImg.astype(np.int16) + rng.integers(-20, 21, self.answerImg.shape), 0, 255).astype(np.uint8)
+                  for i in range(5)]
+
+        # difference
+        proc = TemporalProcessor(self.width, self.height)
+        self.assertFalse(proc.difference(frames[0]).any())
+        diff = np.abs(frames[1].astype(np.int16) - frames[0]).astype(np.uint8)
+        self.assertTrue(np.array_equal(proc.difference(frames[1]), diff))
+        diff = np.abs(frames[2].astype(np.int16) - frames[1])
+        self.assertTrue(np.array_equal(proc.difference(frames[2], 10), np.where(diff > 10, 255, 0)))
+
+        # accumulate
+        proc.setWindow(3)
+        for i, f in enumerate(frames):
+            window = np.array(frames[max(0, i - 2):i + 1], dtype=np.uint32)
+            avg = proc.accumulate(f)
+            self.assertTrue(np.array_equal(proc.sum(), window.sum(axis=0)))
+            self.assertTrue(np.array_equal(avg, (window.sum(axis=0) + len(window) // 2) // len(window)))
+        self.assertEqual(proc.count(), 3)
+
+        # background
+        proc.setBackground(0.1, 3.0, 4.0)
+        self.assertFalse(proc.background(frames[0]).any())
+        mean = frames[0].astype(np.float32)
+        var = np.zeros_like(mean)
+        for f in frames[1:]:
+            d = f - mean
+            mask = proc.background(f)
+            self.assertTrue(np.array_equal(mask > 0, d * d > 9.0 * np.maximum(var, 16.0)))
+            mean += np.float32(0.1) * d
+            var = np.float32(0.9) * (var + np.float32(0.1) * (d * d))
+        self.assertTrue(np.allclose(proc.mean(), mean, atol=1e-3))
+        self.assertTrue(np.allclose(proc.variance(), var, rtol=1e-4, atol=1e-3))
+
+        # processed while decoding gives the same result
+        a = TemporalProcessor(self.width, self.height)
+        b = TemporalProcessor(self.width, self.height)
+        for i in [1, 8]:
+            self.decoder.setNumDecodeThread(i)
+            for op in ["background", "difference", "accumulate"]:
+                expect = getattr(a, op)(self.answerImg)
+                self.assertTrue(np.array_equal(self.decoder.decodeTemporal(self.compressedData, res, b, op), expect))
+
+        with self.assertRaises(WrapperException):
+            proc.difference(frames[0][:, :-8])
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeTemporal(self.compressedData, res, b, "median")
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeTemporal(self.compressedData, res, TemporalProcessor(8, 8), "difference")
+        with self.assertRaises(WrapperException):
+            proc.setWindow(258)
+
+    def test_decodeTensor(self):
+        print("test_decodeTensor")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        for i in [1, 8]:
+            self.decoder.setNumDecodeThread(i)
+            hwc = self.decoder.decodeTensor(self.compressedData, res)
+            self.assertEqual(hwc.shape, (self.height, self.width, 3))
+            self.assertTrue(hwc.flags["C_CONTIGUOUS"])
+            self.assertTrue(np.array_equal(hwc, np.dstack([self.answerImg] * 3)))
+
+        gray = self.decoder.decodeTensor(self.compressedData, res, "HWC", 1)
+        self.assertEqual(gray.shape, (self.height, self.width, 1))
+        self.assertTrue(np.array_equal(gray[:, :, 0], self.answerImg))
+
+        nchw = self.decoder.decodeTensor(self.compressedData, res, "NCHW", 3, 0.5, 0.25)
+        self.assertEqual(nchw.dtype, np.float32)
+        self.assertEqual(nchw.shape, (1, 3, self.height, self.width))
+        answer = (self.answerImg.astype(np.float32) / 255 - 0.5) / 0.25
+        for c in range(3):
+            self.assertTrue(np.allclose(nchw[0, c], answer))
+        self.assertTrue(np.array_equal(np.from_dlpack(nchw), nchw))
+
+        # compressed data is exported without copy and kept alive by consumer
+        xfer = XferData(self.compressedData, self.answerSeq, res)
+        self.assertEqual(xfer.__dlpack_device__(), (1, 0))
+        data = np.from_dlpack(xfer)
+        view = np.asarray(xfer)
+        self.assertTrue(np.shares_memory(data, view))
+        del xfer
+        self.assertTrue(np.array_equal(data, self.compressedData))
+        self.assertTrue(np.array_equal(view, self.compressedData))
+
+        # layout and channels violation
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeTensor(self.compressedData, res, "CHW")
+        with self.assertRaises(WrapperException):
+            self.decoder.decodeTensor(self.compressedData, res, "HWC", 2)
+
+    def test_xferDataImage(self):
+        print("test_xferDataImage")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        xfer = XferData(self.compressedData, self.answerSeq, res)
+        self.assertEqual(xfer.dataSize(), self.compressedData.size)
+        self.assertEqual(xfer.sequenceNo(), self.answerSeq)
+        self.assertEqual(xfer.resolution(), res)
+        self.assertTrue(np.array_equal(xfer.data(), self.compressedData))
+        with self.assertRaises(WrapperException):
+            XferData(self.compressedData, self.answerSeq, Resolution(0, self.height))
+
+        with self.assertRaises(WrapperException):
+            xfer.image
+        xfer.bindDecoder(self.decoder)
+        self.assertFalse(xfer.isDecoded())
+
+        # roi is decoded alone and memoized
+        roi = xfer.imageRoi(16, 8, 64, 32)
+        self.assertTrue(np.array_equal(roi, self.answerImg[8:40, 16:80]))
+        self.assertTrue(np.shares_memory(roi, xfer.imageRoi(16, 8, 64, 32)))
+        self.assertFalse(xfer.isDecoded())
+
+        img = xfer.image
+        self.assertTrue(xfer.isDecoded())
+        self.assertTrue(np.array_equal(img, self.answerImg))
+        self.assertFalse(img.flags["WRITEABLE"])
+        self.assertTrue(np.shares_memory(img, xfer.image))
+
+        # roi is view of the whole image once it is decoded
+        roi = xfer.imageRoi(16, 8, 64, 32)
+        self.assertTrue(np.shares_memory(roi, img))
+        self.assertTrue(np.array_equal(roi, self.answerImg[8:40, 16:80]))
+
+        countX = ((self.width + 3) // 4 * 4 + 7) // 8
+        countY = (self.height + 7) // 8
+        dc = xfer.dc
+        self.assertEqual(dc.shape, (countY, countX))
+        self.assertTrue(np.array_equal(dc, self.decoder.decodeDC(self.compressedData, 0, 0, countX, countY)))
+
+        # image outlives xfer
+        del xfer
+        self.assertTrue(np.array_equal(img, self.answerImg))
+
+        # roi violation
+        xfer = XferData(self.compressedData, self.answerSeq, res)
+        xfer.bindDecoder(self.decoder)
+        with self.assertRaises(WrapperException):
+            xfer.imageRoi(self.width - 8, 0, 16, 16)
+        with self.assertRaises(WrapperException):
+            xfer.imageRoi(0, 0, 0, 16)
+
+    def test_xferDispatcher(self):
+        print("test_xferDispatcher")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        decoder = self.decoder
+
+        # simulated device drives the callback path of continuous transfer
+        dispatcher = XferDispatcher()
+        ids = set()
+        last = [0]
+        def callback(xfer):
+            ids.add(id(xfer))
+            xfer.bindDecoder(decoder)
+            last[0] = xfer.sequenceNo()
+        dispatcher.setCallback(callback)
+
+        for i in range(100):
+            dispatcher.dispatch(self.compressedData, i, res)
+        self.assertEqual(dispatcher.count(), 100)
+        self.assertEqual(dispatcher.allocations(), 1)
+        refs = sys.getrefcount(decoder)
+
+        for i in range(1000):
+            dispatcher.dispatch(self.compressedData, i, res)
+
+        # holder and python object are reused
+        self.assertEqual(dispatcher.allocations(), 1)
+        self.assertEqual(len(ids), 1)
+        self.assertEqual(last[0], 999)
+        self.assertEqual(sys.getrefcount(decoder), refs)
+
+        # decoded image of each frame, cache is cleared on every frame
+        images = []
+        def decode(xfer):
+            xfer.bindDecoder(decoder)
+            self.assertFalse(xfer.isDecoded())
+            images.append((xfer.sequenceNo(), xfer.image))
+        dispatcher.setCallback(decode)
+        for i in range(3):
+            dispatcher.dispatch(self.compressedData, 10 + i, res)
+        self.assertEqual(dispatcher.allocations(), 1)
+        for i, (seq, img) in enumerate(images):
+            self.assertEqual(seq, 10 + i)
+            self.assertTrue(np.array_equal(img, self.answerImg))
+
+        # kept XferData is never reused
+        kept = []
+        dispatcher.setCallback(lambda xfer: kept.append(xfer))
+        for i in range(3):
+            dispatcher.dispatch(self.compressedData, 20 + i, res)
+        self.assertEqual(dispatcher.allocations(), 3)
+        self.assertEqual([x.sequenceNo() for x in kept], [20, 21, 22])
+        self.assertEqual(len(set(id(x) for x in kept)), 3)
+
+        dispatcher.setCallback(None)
+        dispatcher.dispatch(self.compressedData, 30, res)
+        self.assertEqual(dispatcher.count(), 1106)
+
+        # simulated transfer runs the callback path of Camera obj on its own
+        # thread. Each call into the module from python allocates in
+        # pybind11, so the callback stays in python while counting, and
+        # allocations per simulateXfer() must not grow with frames. They
+        # are counted only by module built with PYPUCLIB_COUNT_ALLOCATIONS.
+        cam = CameraFactory().createSimulated()
+        ids.clear()
+        count = lambda xfer: ids.add(id(xfer))
+        cam.simulateXfer(count, self.compressedData, res, 10)
+        if hasattr(pypuclib, "nativeAllocations"):
+            before = pypuclib.nativeAllocations()
+            cam.simulateXfer(count, self.compressedData, res, 10)
+            fixed = pypuclib.nativeAllocations() - before
+            before = pypuclib.nativeAllocations()
+            cam.simulateXfer(count, self.compressedData, res, 1010)
+            self.assertEqual(pypuclib.nativeAllocations() - before, fixed)
+        else:
+            cam.simulateXfer(count, self.compressedData, res, 1010)
+        self.assertEqual(len(ids), 1)
+
+        # decoder bound on every frame is held once by the holder
+        cam.simulateXfer(callback, self.compressedData, res, 10)
+        refs = sys.getrefcount(decoder)
+        cam.simulateXfer(callback, self.compressedData, res, 100)
+        self.assertEqual(last[0], 99)
+        self.assertEqual(len(ids), 1)
+        self.assertEqual(sys.getrefcount(decoder), refs)
+
+        # frames reach the hooks of the camera too
+        mailbox = FrameMailbox(res, self.dict["quantization"])
+        cam.setFrameMailbox(mailbox)
+        cam.simulateXfer(lambda xfer: None, self.compressedData, res, 5)
+        self.assertEqual(mailbox.frameCount(), 5)
+        self.assertEqual(mailbox.read().sequenceNo(), 4)
+        self.assertEqual(mailbox.droppedCount(), 0)
+
+        # frames of another resolution are dropped and counted
+        other = Resolution(self.width // 2, self.height)
+        cam.simulateXfer(lambda xfer: None, self.compressedData, other, 3)
+        self.assertEqual(mailbox.frameCount(), 5)
+        self.assertEqual(mailbox.droppedCount(), 3)
+        cam.setFrameMailbox(None)
+
+        with self.assertRaises(WrapperException):
+            cam.simulateXfer(callback, self.compressedData, res, -1)
+
+    def test_freeThreading(self):
+        print("test_freeThreading")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        gil = sys._is_gil_enabled() if hasattr(sys, "_is_gil_enabled") else True
+
+        # settings change while other threads decode with the same decoder
+        decoder = Decoder(self.dict["quantization"])
+        wrong = Decoder(list(range(64))).decode(self.compressedData, res)
+        stop = threading.Event()
+        errors = []
+        def control():
+            while not stop.is_set():
+                decoder.setQuantization(list(range(64)))
+                decoder.setQuantization(self.dict["quantization"])
+                decoder.setLineAlignment(64)
+                decoder.setLineAlignment(1)
+                decoder.setNumDecodeThread(2)
+                decoder.setNumDecodeThread(1)
+        def decode():
+            for i in range(20):
+                img = decoder.decode(self.compressedData, res)
+                if not (np.array_equal(img, self.answerImg) or np.array_equal(img, wrong)):
+                    errors.append(i)
+        controller = threading.Thread(target=control)
+        controller.start()
+        workers = [threading.Thread(target=decode) for i in range(4)]
+        for t in workers:
+            t.start()
+        for t in workers:
+            t.join()
+        stop.set()
+        controller.join()
+        self.assertEqual(errors, [])
+
+        # the same XferData decoded by several threads is decoded once
+        xfer = XferData(self.compressedData, self.answerSeq, res)
+        xfer.bindDecoder(Decoder(self.dict["quantization"]))
+        images = []
+        workers = [threading.Thread(target=lambda: images.append(xfer.image)) for i in range(8)]
+        for t in workers:
+            t.start()
+        for t in workers:
+            t.join()
+        self.assertEqual(len(images), 8)
+        for img in images:
+            self.assertTrue(np.shares_memory(img, images[0]))
+        self.assertTrue(np.array_equal(images[0], self.answerImg))
+        del xfer
+
+        # scaling of decode by python threads, a decoder and a thread each.
+        # wall clock depends on free cores of the machine, only reported.
+        frames = 40
+        def throughput(count):
+            decoders = [Decoder(self.dict["quantization"]) for i in range(count)]
+            barrier = threading.Barrier(count + 1)
+            def run(d):
+                barrier.wait()
+                for i in range(frames):
+                    d.decode(self.compressedData, res)
+            threads = [threading.Thread(target=run, args=(d,)) for d in decoders]
+            for t in threads:
+                t.start()
+            barrier.wait()
+            begin = time.perf_counter()
+            for t in threads:
+                t.join()
+            return count * frames / (time.perf_counter() - begin)
+
+        base = throughput(1)
+        scaling = {}
+        for count in [2, 4, 8]:
+            fps = throughput(count)
+            scaling[count] = fps / base
+            print("  decode %d threads: %.1f fps (x%.2f, gil=%s)" % (count, fps, scaling[count], gil))
+
+    def test_frameFile(self):
+        print("test_frameFile")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        name = os.path.join(tempfile.mkdtemp(), "frames.pucf")
+        count = 100
+
+        writer = FrameWriter(name, res, self.dict["quantization"],
+                             self.dict["framerate"], self.dict["shutter"])
+        for i in range(count):
+            writer.write(self.compressedData, self.answerSeq + i)
+        writer.flush()
+        self.assertEqual(writer.frameCount(), count)
+        writer.close()
+        with self.assertRaises(WrapperException):
+            writer.write(self.compressedData, 0)
+
+        reader = FrameReader(name)
+        self.assertEqual(reader.frameCount(), count)
+        self.assertEqual(reader.resolution(), res)
+        self.assertEqual(reader.framerateShutter(),
+                         (self.dict["framerate"], self.dict["shutter"]))
+        self.assertEqual(reader.quantization(), self.dict["quantization"])
+
+        # random access
+        for i in [0, 1, count - 1]:
+            self.assertEqual(reader.sequenceNo(i), self.answerSeq + i)
+            self.assertTrue(np.array_equal(reader.read(i), self.compressedData))
+        img = reader.decoder().decode(reader.read(count // 2), reader.resolution())
+        self.assertTrue(np.array_equal(img, self.answerImg))
+
+        # bulk read into contiguous array
+        data, offsets, seqs = reader.readRange(10, 20)
+        self.assertEqual(len(offsets), 21)
+        self.assertTrue(np.array_equal(seqs, np.arange(20) + self.answerSeq + 10))
+        for i in range(20):
+            self.assertTrue(np.array_equal(data[offsets[i]:offsets[i+1]], self.compressedData))
+
+        # range violation
+        with self.assertRaises(WrapperException):
+            reader.read(count)
+        with self.assertRaises(WrapperException):
+            reader.readRange(count - 1, 2)
+        reader.close()
+
+        # not a frame file
+        with self.assertRaises(WrapperException):
+            FrameReader(self.dataname + ".json")
+
+        # close from another thread while a thread writes and polls, the
+        # index only has frames written before close
+        name = os.path.join(tempfile.mkdtemp(), "closed.pucf")
+        writer = FrameWriter(name, res, self.dict["quantization"])
+        written = []
+        def write():
+            i = 0
+            try:
+                while True:
+                    writer.write(self.compressedData, i & 0xffff)
+                    writer.frameCount()
+                    i += 1
+            except WrapperException:
+                written.append(i)
+        th = threading.Thread(target=write)
+        th.start()
+        while writer.frameCount() < 500:
+            writer.bytesWritten()
+        writer.close()
+        th.join()
+
+        reader = FrameReader(name)
+        self.assertEqual(reader.frameCount(), written[0])
+        last = reader.frameCount() - 1
+        self.assertEqual(reader.sequenceNo(last), last & 0xffff)
+        self.assertTrue(np.array_equal(reader.read(last), self.compressedData))
+        reader.close()
+
+    def test_imageExporter(self):
+        print("test_imageExporter")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        name = os.path.join(tempfile.mkdtemp(), "frames.pucf")
+        count = 50
+
+        writer = FrameWriter(name, res, self.dict["quantization"],
+                             self.dict["framerate"], self.dict["shutter"])
+        for i in range(count):
+            writer.write(self.compressedData, self.answerSeq + i)
+        writer.close()
+        reader = FrameReader(name)
+
+        for fmt in ["png", "tiff"]:
+            outdir = tempfile.mkdtemp()
+            exporter = ImageExporter(outdir, fmt, "f")
+            stats = exporter.write(reader)
+            self.assertEqual(stats.frames, count)
+
+            total = 0
+            for i in range(count):
+                path = exporter.fileName(self.answerSeq + i)
+                self.assertTrue(os.path.exists(path))
+                total += os.path.getsize(path)
+            self.assertEqual(stats.bytes, total)
+            for i in [0, count - 1]:
+                img = np.array(Image.open(exporter.fileName(self.answerSeq + i)))
+                self.assertTrue(np.array_equal(img, self.answerImg))
+            print(fmt, "{:.1f}fps {}bytes".format(stats.fps, stats.bytes))
+
+        # frames in memory
+        outdir = tempfile.mkdtemp()
+        exporter = ImageExporter(outdir, "png", "m", 2)
+        data, offsets, seqs = reader.readRange(10, 5)
+        stats = exporter.write(data, offsets, seqs, res, self.dict["quantization"])
+        self.assertEqual(stats.frames, 5)
+        img = np.array(Image.open(exporter.fileName(self.answerSeq + 12)))
+        self.assertTrue(np.array_equal(img, self.answerImg))
+
+        # reference of python decode and save
+        decoder = reader.decoder()
+        outdir = tempfile.mkdtemp()
+        start = time.perf_counter()
+        for i in range(count):
+            img = decoder.decode(reader.read(i), res)
+            Image.fromarray(img).save(os.path.join(outdir, "{:06d}.png".format(i)))
+        print("python {:.1f}fps".format(count / (time.perf_counter() - start)))
+
+        # argument violation
+        with self.assertRaises(WrapperException):
+            ImageExporter(outdir, "jpg")
+        with self.assertRaises(WrapperException):
+            exporter.write(reader, count - 1, 2)
+        reader.close()
+
+    def test_thumbnailIndex(self):
+        print("test_thumbnailIndex")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        name = os.path.join(tempfile.mkdtemp(), "frames.pucf")
+        count = 300
+
+        # two frames of other images with the same quantization, the rest
+        # is the same image
+        here = os.path.dirname(os.path.abspath(__file__))
+        distinct = {123: np.load(here + "\\testImage_GPUDecode.npy"),
+                    200: np.load(here + "\\DCImage.npy")}
+        writer = FrameWriter(name, res, self.dict["quantization"])
+        for i in range(count):
+            writer.write(distinct.get(i, self.compressedData), self.answerSeq + i)
+        writer.close()
+
+        start = time.perf_counter()
+        indexer = ThumbnailIndexer(name)
+        self.assertEqual(indexer.frameCount(), count)
+        self.assertTrue(indexer.wait())
+        print("{:.1f}fps".format(count / (time.perf_counter() - start)))
+        self.assertEqual(indexer.progress(), count)
+        self.assertEqual(indexer.path(), name + ".thumb")
+
+        index = ThumbnailIndex(indexer.path())
+        self.assertEqual(index.frameCount(), count)
+        self.assertEqual(index.resolution(), res)
+        self.assertTrue(np.array_equal(index.sequenceNo(0, count),
+                                       (np.arange(count) + self.answerSeq) & 0xffff))
+
+        # level 0 is DC image, next levels are 2x2 average
+        size = index.levelSize(0)
+        dc = self.decoder.decodeDC(self.compressedData, 0, 0, size.width, size.height)
+        for level in range(3):
+            size = index.levelSize(level)
+            thumbs = index.read(10, 5, level)
+            self.assertEqual(thumbs.shape, (5, size.height, size.width))
+            self.assertTrue(np.array_equal(thumbs[4], dc))
+            if dc.shape[0] % 2:
+                dc = np.vstack([dc, dc[-1:]])
+            if dc.shape[1] % 2:
+                dc = np.hstack([dc, dc[:, -1:]])
+            dc = dc.astype(np.int32)
+            dc = ((dc[0::2, 0::2] + dc[0::2, 1::2] + dc[1::2, 0::2] + dc[1::2, 1::2] + 2) >> 2).astype(np.uint8)
+
+        size = index.levelSize(0)
+        for frameNo, data in distinct.items():
+            dc = self.decoder.decodeDC(data, 0, 0, size.width, size.height)
+            self.assertTrue(np.array_equal(index.read(frameNo, 1, 0)[0], dc))
+
+        frames, diffs = index.search(index.read(0, 1, 2)[0], 2, 5)
+        self.assertTrue(np.array_equal(frames, np.arange(5)))
+        self.assertTrue(np.all(diffs == 0))
+
+        # query with DC shifted still ranks its own frame first
+        thumbs = index.read(0, count, 2).astype(np.int32)
+        for frameNo in distinct:
+            query = np.clip(thumbs[frameNo] + 3, 0, 255).astype(np.uint8)
+            expected = np.abs(thumbs - query).mean(axis=(1, 2))
+            frames, diffs = index.search(query, 2, 5)
+            self.assertEqual(frames[0], frameNo)
+            self.assertGreater(diffs[0], 0)
+            self.assertTrue(np.allclose(diffs, np.sort(expected)[:5]))
+
+        # argument violation
+        with self.assertRaises(WrapperException):
+            index.read(count - 1, 2)
+        with self.assertRaises(WrapperException):
+            index.levelSize(3)
+        with self.assertRaises(WrapperException):
+            index.search(index.read(0, 1, 1)[0], 2)
+        index.close()
+
+    def test_frameMailbox(self):
+        print("test_frameMailbox")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        with self.assertRaises(WrapperException):
+            FrameMailbox(res, list(range(10)))
+        with self.assertRaises(WrapperException):
+            FrameMailbox(res, self.dict["quantization"]).readImage()
+
+        box = FrameMailbox(res, self.dict["quantization"], True)
+        self.assertEqual(box.resolution(), res)
+        self.assertIsNone(box.read())
+        self.assertIsNone(box.readImage())
+
+        box.post(self.compressedData, self.answerSeq)
+        xfer = box.read()
+        self.assertEqual(xfer.sequenceNo(), self.answerSeq)
+        self.assertTrue(np.array_equal(xfer.data(), self.compressedData))
+        img, seq = box.readImage()
+        self.assertEqual(seq, self.answerSeq)
+        self.assertTrue(np.array_equal(img, self.answerImg))
+
+        # decoded image is kept and copied out again
+        again, seq = box.readImage()
+        self.assertEqual(seq, self.answerSeq)
+        self.assertFalse(np.shares_memory(img, again))
+        self.assertTrue(np.array_equal(again, self.answerImg))
+
+        # the same frame is read until a new one is posted, and only the
+        # latest frame is kept
+        self.assertEqual(box.read().sequenceNo(), self.answerSeq)
+        for i in range(1, 4):
+            box.post(self.compressedData, self.answerSeq + i)
+        self.assertEqual(box.read().sequenceNo(), self.answerSeq + 3)
+        self.assertEqual(box.frameCount(), 4)
+
+        # readers never go back to older frames while a writer posts
+        count = 200
+        done = threading.Event()
+        results = []
+        def reader():
+            seqs = []
+            while not done.is_set():
+                img, seq = box.readImage()
+                seqs.append(seq)
+                if not np.array_equal(img, self.answerImg):
+                    seqs.append(-1)
+                    break
+            results.append(seqs)
+        threads = [threading.Thread(target=reader) for i in range(4)]
+        for th in threads:
+            th.start()
+        for i in range(count):
+            box.post(self.compressedData, self.answerSeq + 4 + i)
+        done.set()
+        for th in threads:
+            th.join()
+        for seqs in results:
+            self.assertTrue(all(a <= b for a, b in zip(seqs, seqs[1:])))
+        self.assertEqual(box.readImage()[1], self.answerSeq + 3 + count)
+        self.assertEqual(box.frameCount(), count + 4)
+
+        # decode on publish gives the same images, and is checked on creation
+        with self.assertRaises(WrapperException):
+            FrameMailbox(res, self.dict["quantization"], True, decode="write")
+        box = FrameMailbox(res, self.dict["quantization"], True, decode="publish")
+        self.assertIsNone(box.readImage())
+        box.post(self.compressedData, self.answerSeq)
+        img, seq = box.readImage()
+        self.assertEqual(seq, self.answerSeq)
+        self.assertTrue(np.array_equal(img, self.answerImg))
+        box.post(XferData(self.compressedData, self.answerSeq + 1, res))
+        img, seq = box.readImage()
+        self.assertEqual(seq, self.answerSeq + 1)
+        self.assertTrue(np.array_equal(img, self.answerImg))
+
+    def test_frameBus(self):
+        print("test_frameBus")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+        name = "test_" + uuid.uuid4().hex
+        slots = 8
+
+        pub = FramePublisher(name, res, self.dict["quantization"], slots, True)
+        with self.assertRaises(WrapperException):
+            FramePublisher(name, res, self.dict["quantization"])
+        with self.assertRaises(WrapperException):
+            FrameSubscriber("not_" + name)
+
+        lossless = FrameSubscriber(name, True, True)
+        lossy = FrameSubscriber(name, False, True)
+        self.assertEqual(lossless.resolution(), res)
+        self.assertEqual(lossless.quantization(), self.dict["quantization"])
+        self.assertEqual(len(pub.readers()), 2)
+        self.assertIsNone(lossy.read(10))
+
+        # lossless reader receives every frame in order from another thread
+        count = 100
+        received = []
+        first = []
+        def reader():
+            for i in range(count):
+                xfer = lossless.read(5000)
+                if xfer is None:
+                    break
+                received.append(xfer.sequenceNo())
+                if i == 0:
+                    first.extend([xfer.data(), lossless.image().copy()])
+        th = threading.Thread(target=reader)
+        th.start()
+        pub.setLosslessTimeout(5000)
+        for i in range(count):
+            pub.publish(self.compressedData, self.answerSeq + i)
+        th.join()
+        self.assertEqual(received, [self.answerSeq + i for i in range(count)])
+        self.assertTrue(np.array_equal(first[0], self.compressedData))
+        self.assertTrue(np.array_equal(first[1], self.answerImg))
+        self.assertEqual(lossless.dropped(), 0)
+        self.assertEqual(pub.frameCount(), count)
+        self.assertEqual(pub.stalls(), 0)
+
+        # lossy reader skips to the latest frame
+        xfer = lossy.read(0)
+        self.assertEqual(xfer.sequenceNo(), self.answerSeq + count - 1)
+        self.assertEqual(lossy.dropped(), count - 1)
+        self.assertEqual(lossy.lag(), 0)
+        self.assertTrue(np.array_equal(lossy.decoder().decode(xfer), self.answerImg))
+        self.assertTrue(np.array_equal(lossy.image(), self.answerImg))
+
+        # lossless reader holding a slot stalls the publisher until timeout
+        pub.setLosslessTimeout(1)
+        for i in range(slots + 2):
+            pub.publish(self.compressedData, i)
+        self.assertEqual(pub.stalls(), 3)
+        self.assertEqual(lossless.read(0).sequenceNo(), 2)
+        self.assertEqual(lossless.dropped(), 2)
+
+        # closed bus wakes up readers
+        lossy.close()
+        pub.close()
+        with self.assertRaises(WrapperException):
+            pub.publish(self.compressedData, 0)
+        with self.assertRaises(WrapperException):
+            lossy.read(0)
+        last = lossless.read(0)
+        while last is not None:
+            xfer = last
+            last = lossless.read(0)
+        lossless.close()
+
+        # frame read without copy stays mapped after close
+        self.assertTrue(np.array_equal(xfer.data(), self.compressedData))
+        decoder = Decoder(self.dict["quantization"])
+        self.assertTrue(np.array_equal(decoder.decode(xfer), self.answerImg))
+
+    def test_frameStream(self):
+        print("test_frameStream")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        with self.assertRaises(WrapperException):
+            FrameServer("http://127.0.0.1:0", res, self.dict["quantization"])
+
+        server = FrameServer("tcp://127.0.0.1:0", res, self.dict["quantization"], 1000, 2000)
+        clients = [FrameClient(server.address()) for i in range(2)]
+        while server.clientCount() < 2:
+            time.sleep(0.01)
+        self.assertEqual(clients[0].resolution(), res)
+        self.assertEqual(clients[0].framerateShutter(), (1000, 2000))
+        self.assertEqual(clients[0].quantization(), self.dict["quantization"])
+        self.assertIsNone(clients[0].read(10))
+
+        count = 20
+        for i in range(count):
+            server.send(self.compressedData, self.answerSeq + i)
+        for client in clients:
+            for i in range(count):
+                xfer = client.read()
+                self.assertEqual(xfer.sequenceNo(), self.answerSeq + i)
+            self.assertTrue(np.array_equal(xfer.data(), self.compressedData))
+            self.assertTrue(np.array_equal(client.decoder().decode(xfer), self.answerImg))
+            self.assertEqual(client.frameCount(), count)
+        self.assertEqual(server.stats(), (count, count * (16 + self.compressedData.size), 0))
+
+        # closed server disconnects clients
+        server.close()
+        with self.assertRaises(WrapperException):
+            server.send(self.compressedData, 0)
+        for client in clients:
+            self.assertIsNone(client.read())
+            self.assertFalse(client.isConnected())
+
+        # server stalled in a record closes the client within the timeout
+        listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        listener.bind(("127.0.0.1", 0))
+        listener.listen(1)
+        stalled = threading.Event()
+        def stall():
+            conn, addr = listener.accept()
+            header = struct.pack("<8s8I64H88x", b"PUCSTRM", 1, 256, self.width, self.height,
+                                 0, 0, 0, 0, *self.dict["quantization"])
+            conn.sendall(header + struct.pack("<IHHq", 1000, 0, 0, 0) + bytes(10))
+            stalled.wait()
+            conn.close()
+        th = threading.Thread(target=stall)
+        th.start()
+        client = FrameClient("tcp://127.0.0.1:%d" % listener.getsockname()[1])
+        begin = time.monotonic()
+        self.assertIsNone(client.read(100))
+        self.assertLess(time.monotonic() - begin, 5)
+        self.assertFalse(client.isConnected())
+        stalled.set()
+        th.join()
+        listener.close()
+
     def test_decodeDC(self):
         print("test_decodeDC")
         self.prepare_DCdata()
@@ -185,6 +1170,107 @@ class pypuclib_offlinetest(unittest.TestCase):
         self.assertFalse(np.array_equal(decode_img, DCdecode_img))
         self.assertTrue(np.array_equal(self.DCanswerImg, DCdecode_img))
 
+    def test_transcode(self):
+        print("test_transcode")
+        self.prepare_data()
+        res = Resolution(self.width, self.height)
+
+        with self.assertRaises(WrapperException):
+            Transcoder(list(range(10)))
+        transcoder = Transcoder(self.dict["quantization"])
+        self.assertEqual(transcoder.quantization(), self.dict["quantization"])
+        self.assertEqual(Transcoder(list(range(200, 264))).quantization()[-1], 255)
+        with self.assertRaises(WrapperException):
+            transcoder.setNumThread(0)
+
+        # same coefficients as the decoder, so only IDCT rounding differs
+        jpeg = transcoder.transcode(self.compressedData, res)
+        self.assertEqual(jpeg[:2], b"\xff\xd8")
+        self.assertEqual(jpeg[-2:], b"\xff\xd9")
+        img = np.asarray(Image.open(io.BytesIO(jpeg)))
+        self.assertEqual(img.shape, (self.height, self.width))
+        diff = np.abs(img.astype(np.int32) - self.answerImg)
+        self.assertLess(diff.mean(), 1.0)
+        self.assertLessEqual(diff.max(), 8)
+
+        # restart intervals are coded on each thread
+        for i in [2, 3, 8]:
+            transcoder.setNumThread(i)
+            self.assertEqual(transcoder.transcode(self.compressedData, res), jpeg)
+
+        # roi
+        roi = transcoder.transcode(self.compressedData, 64, 32, 250, 101)
+        img = np.asarray(Image.open(io.BytesIO(roi)))
+        self.assertEqual(img.shape, (101, 250))
+        self.assertLess(np.abs(img.astype(np.int32) - self.answerImg[32:133, 64:314]).mean(), 1.0)
+        with self.assertRaises(WrapperException):
+            transcoder.transcode(self.compressedData, 4, 0, 64, 64)
+        with self.assertRaises(WrapperException):
+            transcoder.transcode(self.compressedData, 0, 0, 0, 64)
+
+        # compared with decode and encode
+        count = 20
+        start = time.perf_counter()
+        for i in range(count):
+            transcoder.transcode(self.compressedData, res)
+        transcode_time = (time.perf_counter() - start) / count
+        start = time.perf_counter()
+        for i in range(count):
+            Image.fromarray(self.decoder.decode(self.compressedData, res)).save(io.BytesIO(), "JPEG", qtables=[self.dict["quantization"]])
+        encode_time = (time.perf_counter() - start) / count
+        print("  transcode %.2f ms, decode and encode %.2f ms, %d bytes" % (transcode_time * 1000, encode_time * 1000, len(jpeg)))
+
+
+    def test_autoExposure(self):
+        print("test_autoExposure")
+        self.prepare_DCdata()
+        res = Resolution(self.DCwidth, self.DCheight)
+
+        # recorded frame is measured by DC image
+        ae = AutoExposure(118.0)
+        self.assertAlmostEqual(ae.feed(self.DCcompressedData, res), self.DCanswerImg.mean())
+        sat = AutoExposure(0.01, AE_MODE.SATURATION)
+        self.assertAlmostEqual(sat.feed(self.DCcompressedData, res), (self.DCanswerImg >= 250).mean())
+        sat.close()
+
+        # simulated device whose brightness is proportional to exposure
+        device = {"exposure": 1000000}
+        def actuator(exposure):
+            device["exposure"] = exposure
+        def run(frames, scene=118.0 / 4000000):
+            for i in range(frames):
+                ae.update(min(255.0, scene * device["exposure"]))
+                while ae.state().pending:
+                    time.sleep(0.001)
+
+        ae.setActuator(actuator)
+        ae.setRate(0, 0)
+        ae.setExposure(device["exposure"])
+        ae.reset()
+        run(30)
+        state = ae.state()
+        self.assertTrue(state.converged)
+        self.assertGreater(state.settlingFrames, 0)
+        self.assertEqual(state.exposure, device["exposure"])
+        self.assertAlmostEqual(device["exposure"], 4000000, delta=4000000 * 0.06)
+
+        # exposure is bounded by limits
+        ae.setLimits(1000, 2000000)
+        run(20)
+        self.assertEqual(device["exposure"], 2000000)
+        self.assertFalse(ae.state().converged)
+
+        # failed update is counted
+        def broken(exposure):
+            raise RuntimeError("device is lost")
+        ae.setActuator(broken)
+        errors = ae.state().errorCount
+        run(1, 1.0 / 4000000)
+        self.assertEqual(ae.state().errorCount, errors + 1)
+
+        with self.assertRaises(WrapperException):
+            ae.setTarget(300)
+        ae.close()
 
     # tests for GPUDecode success only for can use GPU device
     def test_setupGPUDecode(self):
@@ -3,8 +3,11 @@ import numpy as np
 
 import pypuclib
 from pypuclib import CameraFactory, Camera, XferData, Resolution, Decoder, FramerateLimit
+from pypuclib import CameraConfig, SHEDDING_POLICY
 from pypuclib import PUCException, WrapperException
 from pypuclib import PUC_COLOR_TYPE
+from pypuclib import FrameMailbox
+from pypuclib import AutoExposure
 
 import time
 
@@ -156,6 +159,58 @@ class pypuclib_onlinetest(unittest.TestCase):
                                         xferdata.resolution().height)
         self.assertEqual(seq, xferdata.sequenceNo())
 
+    def test_grabNext(self):
+        # no frame without continuous transfer
+        self.assertIsNone(self.cam.grabNext(100))
+        self.assertIsNone(self.cam.grabLatest())
+
+        # frames are kept from the first call in the transfer
+        self.cam.beginXfer(None)
+        time.sleep(0.1)
+        self.assertIsNone(self.cam.grabLatest())
+        self.assertIsNotNone(self.cam.grabNext())
+
+        seqs = []
+        for i in range(20):
+            xferdata = self.cam.grabNext()
+            self.assertIsNotNone(xferdata)
+            seqs.append(xferdata.sequenceNo())
+        self.assertEqual(len(set(seqs)), len(seqs))
+
+        # latest is the same until next frame arrives
+        latest = self.cam.grabLatest()
+        self.assertIsNotNone(latest)
+        self.assertTrue(np.array_equal(latest.data(), self.cam.grabLatest().data()))
+        self.assertNotEqual(self.cam.grabNext().sequenceNo(), latest.sequenceNo())
+
+        img = self.cam.decoder().decode(latest)
+        res = self.cam.resolution()
+        self.assertEqual(latest.resolution(), res)
+        self.assertEqual(img.shape, (res.height, res.width))
+
+        # grabNext never blocks after endXfer
+        self.cam.endXfer()
+        self.assertIsNone(self.cam.grabNext(-1))
+
+    def test_frameMailbox(self):
+        box = FrameMailbox(self.cam, True)
+        self.cam.setFrameMailbox(box)
+        self.assertIsNotNone(self.cam.frameMailbox())
+
+        self.cam.beginXfer(None)
+        time.sleep(0.5)
+        self.cam.endXfer()
+        self.assertGreater(box.frameCount(), 0)
+        self.assertEqual(box.droppedCount(), 0)
+
+        img, seq = box.readImage()
+        res = self.cam.resolution()
+        self.assertEqual(img.shape, (res.height, res.width))
+        self.assertEqual(box.read().sequenceNo(), seq)
+
+        self.cam.setFrameMailbox(None)
+        self.assertIsNone(self.cam.frameMailbox())
+
     def test_framerateLimit(self):
         limit = self.cam.framerateLimit()
 
@@ -167,6 +222,16 @@ class pypuclib_onlinetest(unittest.TestCase):
         with self.assertRaises(PUCException):
             self.cam.setFramerate(limit.limitMin - 1)
 
+    def test_openClose(self):
+        # open of opened camera keeps the handle, close is repeatable
+        res = self.cam.resolution()
+        self.cam.open()
+        self.assertEqual(self.cam.resolution(), res)
+        self.cam.close()
+        self.cam.close()
+        self.cam.open()
+        self.assertEqual(self.cam.resolution(), res)
+
     def test_resetDevice(self):
         self.cam.beginXfer(self.callback)
         self.cam.endXfer()
@@ -218,8 +283,353 @@ class pypuclib_onlinetest(unittest.TestCase):
         temperature = self.cam.sensorTemperature()
         print("sensor temperature=%d" %(temperature))
         self.assertTrue(0 <= temperature <= 100)
-        
 
+    def test_frameArena(self):
+        # negative count violation
+        with self.assertRaises(WrapperException):
+            self.cam.setFrameArenaCount(-1)
+
+        target = 4
+        self.cam.setFrameArenaCount(target)
+        self.assertEqual(self.cam.frameArenaCount(), target)
+
+        # grab more frames than arena slots, rest fall back to heap
+        decoder = self.cam.decoder()
+        datas = [self.cam.grab() for i in range(target * 2)]
+        for data in datas:
+            img = decoder.decode(data)
+            self.assertEqual(img.shape, (data.resolution().height,
+                                         data.resolution().width))
+
+        # arena disabled
+        self.cam.setFrameArenaCount(0)
+        self.assertFalse(self.cam.isFrameArenaLargePage())
+        xferdata = self.cam.grab()
+        self.assertEqual(xferdata.resolution(), self.cam.resolution())
+
+    def test_apply(self):
+        limit_reso = self.cam.resolutionLimit()
+        limit_fps = self.cam.framerateLimit()
+        min_on, min_off = self.cam.minExposeTime()
+        current = self.cam.config()
+        self.assertEqual(current.resolution, self.cam.resolution())
+        self.assertEqual(current.framerate, self.cam.framerate())
+
+        # offline validation violations
+        with self.assertRaises(WrapperException):
+            self.cam.validate(CameraConfig(Resolution(limit_reso.limitW.max + limit_reso.limitW.step,
+                                                      current.resolution.height), 1000, 1000))
+        with self.assertRaises(WrapperException):
+            self.cam.validate(CameraConfig(current.resolution, limit_fps.limitMax + 1, limit_fps.limitMax + 1))
+        with self.assertRaises(WrapperException):
+            self.cam.validate(CameraConfig(current.resolution, 1000, 500))
+        with self.assertRaises(WrapperException):
+            self.cam.validate(CameraConfig(current.resolution, 1000, 1000, min_on - 1))
+        with self.assertRaises(WrapperException):
+            self.cam.validate(CameraConfig(current.resolution, 1000, 1000, 1000000000 // 1000))
+
+        # small resolution with high framerate, then back to maximum resolution
+        small = Resolution(limit_reso.limitW.min, limit_reso.limitH.min)
+        self.cam.setResolution(small)
+        fast = CameraConfig(small, self.cam.framerateMax(), self.cam.framerateMax())
+        self.cam.setResolution(current.resolution)
+        latency = self.cam.apply(fast)
+        print("switch latency", latency)
+        self.assertGreaterEqual(latency, 0)
+        self.assertEqual(self.cam.resolution(), small)
+        self.assertEqual(self.cam.framerateShutter(), (fast.framerate, fast.shutter))
+
+        slow = CameraConfig(Resolution(limit_reso.limitW.max, limit_reso.limitH.max), 1000, 2000)
+        self.cam.apply(slow)
+        self.assertEqual(self.cam.applyCommandCount(), 2)
+        self.assertEqual(self.cam.resolution(), slow.resolution)
+        self.assertEqual(self.cam.framerateShutter(), (1000, 2000))
+
+        # exposure period in nsec
+        expose = CameraConfig(slow.resolution, 1000, 0, 200000)
+        self.cam.apply(expose)
+        self.assertEqual(self.cam.applyCommandCount(), 1)
+        self.assertEqual(self.cam.exposeTime(), (200000, 1000000 - 200000))
+
+        # unchanged settings send nothing
+        self.cam.apply(expose)
+        self.assertEqual(self.cam.applyCommandCount(), 0)
+        self.assertEqual(self.cam.config().exposeTime, expose.exposeTime)
+
+        # rejected by the device, previous settings are restored
+        with self.assertRaises(PUCException):
+            self.cam.apply(CameraConfig(slow.resolution, limit_fps.limitMax, limit_fps.limitMax))
+        self.assertEqual(self.cam.resolution(), slow.resolution)
+        self.assertEqual(self.cam.exposeTime(), (200000, 1000000 - 200000))
+
+    def test_capabilities(self):
+        limit_reso = self.cam.resolutionLimit()
+        before = self.cam.config()
+
+        start = time.time()
+        caps = self.cam.capabilities()
+        print("capabilities build time", time.time() - start)
+        self.assertEqual(caps.serialNo(), self.cam.serialNo())
+
+        # settings are restored after build
+        self.assertEqual(self.cam.resolution(), before.resolution)
+        self.assertEqual(self.cam.framerateShutter(), (before.framerate, before.shutter))
+
+        # cached across opens
+        self.cam.close()
+        self.cam.open()
+        start = time.time()
+        self.assertIs(self.cam.capabilities(), caps)
+        self.assertLess(time.time() - start, 0.1)
+
+        # illegal resolution
+        self.assertFalse(caps.isLegal(limit_reso.limitW.min - 1, limit_reso.limitH.min))
+        with self.assertRaises(WrapperException):
+            caps.framerateMax(limit_reso.limitW.min - 1, limit_reso.limitH.min)
+
+        # table matches the device, at the limits and at interior points
+        # between the probed widths
+        def interior(limit, k):
+            return limit.min + (limit.max - limit.min) * k // 8 // limit.step * limit.step
+
+        targets = [Resolution(limit_reso.limitW.min, limit_reso.limitH.min),
+                   Resolution(limit_reso.limitW.max, limit_reso.limitH.max)]
+        for kw, kh in [(1, 2), (3, 4), (5, 6), (7, 2)]:
+            targets.append(Resolution(interior(limit_reso.limitW, kw) + limit_reso.limitW.step,
+                                      interior(limit_reso.limitH, kh)))
+        for res in targets:
+            self.cam.setFramerate(self.cam.framerateLimit().limitMin)
+            self.cam.setResolution(res)
+            fps = self.cam.framerateMax()
+            self.assertEqual(caps.framerateMax(res.width, res.height), fps)
+            self.assertTrue(caps.isFeasible(res.width, res.height, fps))
+            self.assertFalse(caps.isFeasible(res.width, res.height, fps + 1))
+            xferdata = self.cam.grab()
+            self.assertEqual(caps.xferDataSize(res.width, res.height), xferdata.dataSize())
+            self.assertEqual(caps.throughput(res.width, res.height, fps), xferdata.dataSize() * fps)
+
+        fps = self.cam.framerate()
+        for res in caps.resolutions(fps):
+            self.assertTrue(caps.isFeasible(res.width, res.height, fps))
+
+    def test_telemetry(self):
+        # interval violation
+        with self.assertRaises(WrapperException):
+            self.cam.startTelemetry(0)
+
+        self.assertEqual(self.cam.telemetry().sampleCount, 0)
+
+        events = []
+        temp = self.cam.sensorTemperature()
+        self.cam.setThermalCallback(temp, temp - 1, lambda t, hot: events.append(hot))
+        with self.assertRaises(WrapperException):
+            self.cam.setThermalCallback(temp - 1, temp, None)
+
+        self.cam.startTelemetry(10)
+        self.assertTrue(self.cam.isTelemetryRunning())
+        self.cam.beginXfer(lambda data: None)
+        time.sleep(0.5)
+
+        # reading snapshot never touches the device
+        start = time.perf_counter()
+        for i in range(1000):
+            t = self.cam.telemetry()
+        self.assertLess(time.perf_counter() - start, 0.1)
+
+        self.assertGreater(t.sampleCount, 10)
+        self.assertLess(t.age, 0.5)
+        self.assertTrue(t.xferring)
+        self.assertEqual(t.fanState, self.cam.fanState())
+        self.assertEqual((t.framerate, t.shutter), self.cam.framerateShutter())
+        self.assertAlmostEqual(t.temperature, self.cam.sensorTemperature(), delta=2)
+        self.assertEqual(events[0], True)
+
+        self.cam.endXfer()
+        self.cam.stopTelemetry()
+        self.assertFalse(self.cam.isTelemetryRunning())
+        count = self.cam.telemetry().sampleCount
+        time.sleep(0.1)
+        self.assertEqual(self.cam.telemetry().sampleCount, count)
+
+    def test_autoExposure(self):
+        self.cam.setFramerateShutter(1000, 1000)
+        ae = AutoExposure(1.0)
+        self.cam.setAutoExposure(ae)
+
+        # framerate changed after attach is kept by every update
+        self.cam.setFramerate(2000)
+        self.cam.beginXfer(lambda data: None)
+        time.sleep(1.0)
+        self.cam.endXfer()
+        self.assertGreater(ae.state().updateCount, 0)
+        self.assertEqual(self.cam.config().framerate, 2000)
+        on, off = self.cam.exposeTime()
+        self.assertEqual(on + off, 1000000000 // 2000)
+        self.assertEqual(self.cam.config().exposeTime, on)
+
+        self.cam.setAutoExposure(None)
+        self.assertIsNone(self.cam.autoExposure())
+
+    def test_adaptiveRingBuffer(self):
+        # budget violation
+        with self.assertRaises(WrapperException):
+            self.cam.setAdaptiveRingBuffer(True, 0)
+
+        self.cam.setFramerateShutter(1000, 1000)
+        self.cam.setAdaptiveRingBuffer(True, 64)
+        self.assertTrue(self.cam.isAdaptiveRingBuffer())
+
+        # too few samples, count is only reduced within the budget
+        before = self.cam.ringBufferCount()
+        self.cam.resetCallbackStats()
+        self.cam.beginXfer(lambda data: None)
+        self.cam.endXfer()
+        self.assertLessEqual(self.cam.ringBufferCount(), before)
+
+        # consumer with occasional 50ms pause
+        count = [0]
+        def callback(data):
+            count[0] += 1
+            if count[0] % 200 == 0:
+                time.sleep(0.05)
+        self.cam.resetCallbackStats()
+        self.cam.beginXfer(callback)
+        time.sleep(3)
+        self.cam.endXfer()
+
+        stats = self.cam.callbackStats()
+        self.assertEqual(stats.count, count[0])
+        self.assertGreaterEqual(stats.max, 0.05)
+        self.assertGreaterEqual(stats.p999, 0.05 * 15 / 16)
+        self.assertLessEqual(stats.p50, stats.p99)
+        self.assertLessEqual(stats.p99, stats.p999)
+        self.assertGreaterEqual(stats.ringBufferCount, 50)
+        self.assertGreater(stats.xferTimeout, 50)
+
+        # applied on next transfer
+        self.cam.beginXfer(lambda data: None)
+        self.cam.endXfer()
+        self.assertEqual(self.cam.ringBufferCount(), stats.ringBufferCount)
+        self.assertEqual(self.cam.xferTimeout()[1], stats.xferTimeout)
+
+        # limited by small budget
+        self.cam.setAdaptiveRingBuffer(True, 1)
+        self.assertTrue(self.cam.callbackStats().budgetLimited)
+
+    def test_loadShedding(self):
+        # threshold violation
+        with self.assertRaises(WrapperException):
+            self.cam.setLoadShedding(SHEDDING_POLICY.DECIMATE, 16, 16)
+        with self.assertRaises(WrapperException):
+            self.cam.setLoadShedding(SHEDDING_POLICY.DECIMATE, 64, 16, 0)
+
+        self.cam.setFramerateShutter(1000, 1000)
+        res = self.cam.resolution()
+
+        # slow consumer, every 4th frame while behind
+        self.cam.setLoadShedding(SHEDDING_POLICY.DECIMATE, 32, 8, 4)
+        self.assertEqual(self.cam.loadShedding(), SHEDDING_POLICY.DECIMATE)
+        frames = []
+        def callback(data):
+            frames.append((data.sequenceNo(), data.sheddingPolicy(), data.backlog()))
+            time.sleep(0.002)
+        self.cam.beginXfer(callback)
+        time.sleep(2)
+        self.cam.endXfer()
+
+        delivered, shed, activations = self.cam.loadSheddingStats()
+        self.assertEqual(delivered, len(frames))
+        self.assertGreater(shed, 0)
+        self.assertGreater(activations, 0)
+        self.assertLess(max(f[2] for f in frames), 64)
+        policies = set(f[1] for f in frames)
+        self.assertIn(SHEDDING_POLICY.DECIMATE, policies)
+
+        # previews without data while behind, data of every 4th frame
+        self.cam.setLoadShedding(SHEDDING_POLICY.DC_PREVIEW, 32, 8, 4)
+        shapes = []
+        full = []
+        def preview(data):
+            if data.dataSize() == 0:
+                self.assertEqual(data.sheddingPolicy(), SHEDDING_POLICY.DC_PREVIEW)
+                shapes.append(data.preview().shape)
+            else:
+                self.assertEqual(data.preview().shape, (0, 0))
+                full.append(data.sequenceNo())
+                time.sleep(0.002)
+        self.cam.beginXfer(preview)
+        time.sleep(2)
+        self.cam.endXfer()
+        delivered, shed, activations = self.cam.loadSheddingStats()
+        self.assertGreater(len(shapes), 0)
+        self.assertEqual(delivered, len(full))
+        self.assertEqual(shed, len(shapes))
+        self.assertEqual(shapes[0], ((res.height + 7) // 8, ((res.width + 3) // 4 * 4 + 7) // 8))
+
+        # static scene, only changed frames while behind
+        self.cam.setLoadShedding(SHEDDING_POLICY.DC_CHANGE, 32, 8, 0, 255)
+        self.cam.beginXfer(lambda data: time.sleep(0.002))
+        time.sleep(2)
+        self.cam.endXfer()
+        delivered, shed, activations = self.cam.loadSheddingStats()
+        self.assertGreater(shed, delivered)
+
+        self.cam.setLoadShedding(SHEDDING_POLICY.NONE)
+
+    def test_freeThreading(self):
+        import threading
+        gil = sys._is_gil_enabled() if hasattr(sys, "_is_gil_enabled") else True
+        self.cam.setFramerateShutter(1000, 1000)
+        res = self.cam.resolution()
+        decoder = self.cam.decoder()
+
+        # grab and decode on several threads while another thread controls
+        def throughput(count, frames=50):
+            stop = threading.Event()
+            errors = []
+            def grab():
+                for i in range(frames):
+                    try:
+                        img = decoder.decode(self.cam.grab(), res)
+                        if img.shape != (res.height, res.width):
+                            errors.append(img.shape)
+                    except Exception as e:
+                        errors.append(e)
+            def control():
+                while not stop.is_set():
+                    self.cam.config()
+                    self.cam.setShutter(self.cam.shutter())
+                    self.cam.sensorTemperature()
+            controller = threading.Thread(target=control)
+            controller.start()
+            threads = [threading.Thread(target=grab) for i in range(count)]
+            begin = time.perf_counter()
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            elapsed = time.perf_counter() - begin
+            stop.set()
+            controller.join()
+            self.assertEqual(errors, [])
+            return count * frames / elapsed
+
+        base = throughput(1)
+        for count in [2, 4]:
+            fps = throughput(count)
+            print("  grab and decode %d threads: %.1f fps (x%.2f, gil=%s)" % (count, fps, fps / base, gil))
+
+        # callback is enabled and disabled while other threads control
+        frames = []
+        self.cam.beginXfer(lambda xfer: frames.append(xfer.sequenceNo()))
+        for i in range(10):
+            self.cam.config()
+            time.sleep(0.01)
+        self.cam.endXfer()
+        count = len(frames)
+        time.sleep(0.1)
+        self.assertEqual(len(frames), count)
+        self.assertGreater(count, 0)
 
 
 